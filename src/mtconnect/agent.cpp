@@ -46,6 +46,7 @@
 #include "mtconnect/asset/file_asset.hpp"
 #include "mtconnect/asset/qif_document.hpp"
 #include "mtconnect/asset/raw_material.hpp"
+#include "mtconnect/buffer/buffer_snapshot.hpp"
 #include "mtconnect/configuration/config_options.hpp"
 #include "mtconnect/device_model/agent_device.hpp"
 #include "mtconnect/entity/xml_parser.hpp"
@@ -78,11 +79,14 @@ namespace mtconnect {
     : m_options(options),
       m_context(context),
       m_strand(m_context),
+      m_bufferMetricsTimer(m_context),
       m_xmlParser(make_unique<parser::XmlParser>()),
       m_schemaVersion(GetOption<string>(options, config::SchemaVersion)),
       m_deviceXmlPath(deviceXmlPath),
       m_circularBuffer(GetOption<int>(options, config::BufferSize).value_or(17),
-                       GetOption<int>(options, config::CheckpointFrequency).value_or(1000)),
+                       GetOption<int>(options, config::CheckpointFrequency).value_or(1000),
+                       GetOption<bool>(options, config::DataItemSequenceIndex).value_or(true),
+                       IsOptionSet(options, config::CompactBuffer)),
       m_pretty(IsOptionSet(options, mtconnect::configuration::Pretty))
   {
     using namespace asset;
@@ -100,12 +104,52 @@ namespace mtconnect {
     m_versionDeviceXml = IsOptionSet(options, mtconnect::configuration::VersionDeviceXml);
     m_createUniqueIds = IsOptionSet(options, config::CreateUniqueIds);
 
+    auto durablePath = GetOption<string>(options, config::DurableBufferPath);
+    if (durablePath && !durablePath->empty())
+    {
+      auto segmentSize =
+          ConvertFileSize(options, config::DurableBufferSegmentSize, 64 * 1024 * 1024);
+      m_durableBuffer = make_unique<buffer::DurableBuffer>(*durablePath, size_t(segmentSize),
+                                                           m_circularBuffer.getBufferSize());
+    }
+
+    m_circularBuffer.setMemoryLimit(size_t(ConvertFileSize(options, config::BufferMemoryLimit, 0)));
+
+    auto spillPath = GetOption<string>(options, config::SpillBufferPath);
+    if (spillPath && !spillPath->empty())
+    {
+      auto maxSize = ConvertFileSize(options, config::SpillBufferMaxSize, 1024 * 1024 * 1024);
+      auto maxAge = GetOption<Seconds>(options, config::SpillBufferMaxAge).value_or(0s);
+      m_circularBuffer.setSpillBuffer(
+          make_unique<buffer::SpillBuffer>(*spillPath, size_t(maxSize), maxAge));
+    }
+
     auto jsonVersion =
         uint32_t(GetOption<int>(options, mtconnect::configuration::JsonVersion).value_or(2));
 
     // Create the Printers
-    m_printers["xml"] = make_unique<printer::XmlPrinter>(m_pretty);
+    auto xmlPrinter = make_unique<printer::XmlPrinter>(m_pretty);
+    xmlPrinter->setDirectWriter(IsOptionSet(options, config::DirectXmlWriter));
+    m_printers["xml"] = std::move(xmlPrinter);
     m_printers["json"] = make_unique<printer::JsonPrinter>(jsonVersion, m_pretty);
+    if (IsOptionSet(options, config::CacheObservationFragments))
+    {
+      // Compact observations are recreated each time they are read, so a fragment would never
+      // be reused. The fragments are not in the memory estimate, so they would exceed a limit.
+      if (m_circularBuffer.isCompact())
+      {
+        LOG(warning) << "CacheObservationFragments is ignored when CompactBuffer is set";
+      }
+      else if (m_circularBuffer.getMemoryLimit() > 0)
+      {
+        LOG(warning) << "CacheObservationFragments is ignored when BufferMemoryLimit is set";
+      }
+      else
+      {
+        for (auto &[k, pr] : m_printers)
+          pr->setCacheFragments(true);
+      }
+    }
 
     if (m_schemaVersion)
     {
@@ -150,11 +194,111 @@ namespace mtconnect {
 
     loadCachedProbe();
 
+    auto snapshot = GetOption<string>(m_options, config::BufferSnapshotFile);
+    if (m_durableBuffer)
+    {
+      recoverDurableBuffer();
+      if (snapshot && !snapshot->empty())
+        LOG(warning) << "Ignoring the buffer snapshot " << *snapshot
+                     << " since the durable buffer is enabled";
+    }
+    else if (snapshot && !snapshot->empty())
+    {
+      loadBufferSnapshot(*snapshot);
+    }
+
     m_initialized = true;
 
     m_afterInitializeHooks.exec(*this);
   }
 
+  observation::ObservationPtr Agent::recoverObservation(const buffer::ObservationRecord &record,
+                                                       const char *source)
+  {
+    DataItemPtr di;
+    for (auto device : m_deviceIndex)
+    {
+      const auto &items = device->getDeviceDataItems();
+      auto it = items.find(record.m_dataItemId);
+      if (it != items.end() && (di = it->lock()))
+        break;
+    }
+
+    if (!di)
+    {
+      LOG(warning) << source << ": cannot find data item " << record.m_dataItemId
+                   << " for observation " << record.m_sequence;
+      return nullptr;
+    }
+
+    try
+    {
+      entity::ErrorList errors;
+      return observation::Observation::make(di, record.m_properties, record.m_timestamp, errors);
+    }
+    catch (entity::EntityError &e)
+    {
+      LOG(warning) << source << ": cannot recover observation " << record.m_sequence << ": "
+                   << e.what();
+      return nullptr;
+    }
+  }
+
+  void Agent::recoverDurableBuffer()
+  {
+    NAMED_SCOPE("Agent::recoverDurableBuffer");
+
+    std::lock_guard<buffer::CircularBuffer> lock(m_circularBuffer);
+    m_instanceId = m_durableBuffer->recover([this](buffer::ObservationRecord &record) {
+      if (auto obs = recoverObservation(record, "Durable buffer"))
+      {
+        // Skip the sequence numbers of the observations that could not be recovered, the
+        // observations already recovered are kept.
+        if (record.m_sequence > m_circularBuffer.getSequence())
+          m_circularBuffer.skipTo(record.m_sequence);
+        m_circularBuffer.addToBuffer(obs);
+      }
+    });
+  }
+
+  void Agent::loadBufferSnapshot(const std::string &file)
+  {
+    NAMED_SCOPE("Agent::loadBufferSnapshot");
+
+    auto contents = buffer::BufferSnapshot::read(file);
+    if (!contents)
+      return;
+
+    observation::ObservationList first;
+    for (const auto &record : contents->m_first)
+    {
+      if (auto obs = recoverObservation(record, "Buffer snapshot"))
+      {
+        obs->setSequence(record.m_sequence);
+        first.push_back(obs);
+      }
+    }
+
+    std::lock_guard<buffer::CircularBuffer> lock(m_circularBuffer);
+    m_circularBuffer.restore(contents->m_firstSequence, first);
+    for (const auto &record : contents->m_observations)
+    {
+      // Skip the sequence numbers of the observations that could not be recovered
+      if (auto obs = recoverObservation(record, "Buffer snapshot"))
+      {
+        if (record.m_sequence > m_circularBuffer.getSequence())
+          m_circularBuffer.skipTo(record.m_sequence);
+        m_circularBuffer.addToBuffer(obs);
+      }
+    }
+    m_circularBuffer.skipTo(contents->m_sequence);
+    m_instanceId = contents->m_instanceId;
+
+    LOG(info) << "Loaded buffer snapshot " << file << " with " << contents->m_observations.size()
+              << " observations from " << contents->m_firstSequence << " to "
+              << contents->m_sequence;
+  }
+
   void Agent::initialDataItemObservations()
   {
     NAMED_SCOPE("Agent::initialDataItemObservations");
@@ -218,6 +362,9 @@ namespace mtconnect {
       {
         auto d = m_agentDevice->getDeviceDataItem("agent_avail");
         m_loopback->receive(d, "AVAILABLE"s);
+
+        if (m_circularBuffer.getMemoryLimit() > 0)
+          publishBufferMetrics();
       }
 
       // Start all the sources
@@ -245,6 +392,8 @@ namespace mtconnect {
 
     m_beforeStopHooks.exec(*this);
 
+    m_bufferMetricsTimer.cancel();
+
     // Stop all adapter threads...
     LOG(info) << "Shutting down sources";
     for (auto source : m_sources)
@@ -276,11 +425,30 @@ namespace mtconnect {
     std::lock_guard<buffer::CircularBuffer> lock(m_circularBuffer);
     if (m_circularBuffer.addToBuffer(observation) != 0)
     {
+      if (m_durableBuffer)
+        m_durableBuffer->append(observation);
+
       for (auto &sink : m_sinks)
         sink->publish(observation);
     }
   }
 
+  void Agent::receiveObservations(observation::ObservationList &observations)
+  {
+    std::lock_guard<buffer::CircularBuffer> lock(m_circularBuffer);
+    if (m_circularBuffer.addToBuffer(observations) != 0)
+    {
+      if (m_durableBuffer)
+      {
+        for (auto &observation : observations)
+          m_durableBuffer->append(observation);
+      }
+
+      for (auto &sink : m_sinks)
+        sink->publish(observations);
+    }
+  }
+
   void Agent::receiveAsset(asset::AssetPtr asset)
   {
     DevicePtr device;
@@ -526,6 +694,7 @@ namespace mtconnect {
 
       verifyDevice(device);
       createUniqueIds(device);
+      indexDataItems(device);
 
       LOG(info) << "Checking if device " << *uuid << " has changed";
       if (*device != *oldDev)
@@ -743,9 +912,78 @@ namespace mtconnect {
         LOG(fatal) << "Error creating the agent device: " << e->what();
       throw EntityError("Cannot create AgentDevice");
     }
+    if (m_circularBuffer.getMemoryLimit() > 0)
+    {
+      m_agentDevice->addBufferDataItems();
+      addExtensionNamespace();
+    }
+    if (GetOption<int>(m_options, mtconnect::configuration::StreamBacklogLimit).value_or(0) > 0)
+    {
+      m_agentDevice->addStreamDataItems();
+      addExtensionNamespace();
+    }
     addDevice(m_agentDevice);
   }
 
+  void Agent::addExtensionNamespace()
+  {
+    auto xmlPrinter = dynamic_cast<printer::XmlPrinter *>(m_printers["xml"].get());
+    if (!xmlPrinter)
+      return;
+
+    // A namespace configured for the prefix takes precedence
+    const string prefix = AgentDevice::ExtensionPrefix;
+    if (xmlPrinter->getDevicesUrn(prefix).empty())
+      xmlPrinter->addDevicesNamespace(AgentDevice::ExtensionUrn, "", prefix);
+    if (xmlPrinter->getStreamsUrn(prefix).empty())
+      xmlPrinter->addStreamsNamespace(AgentDevice::ExtensionUrn, "", prefix);
+  }
+
+  void Agent::publishBufferMetrics()
+  {
+    NAMED_SCOPE("Agent::publishBufferMetrics");
+
+    auto memory = m_agentDevice->getDeviceDataItem("observation_buffer_memory");
+    auto count = m_agentDevice->getDeviceDataItem("observation_buffer_count");
+    if (memory)
+      m_loopback->receive(memory, to_string(m_circularBuffer.getMemoryUsed()));
+    if (count)
+      m_loopback->receive(count, to_string(m_circularBuffer.getCount()));
+
+    m_bufferMetricsTimer.expires_after(10s);
+    m_bufferMetricsTimer.async_wait(
+        boost::asio::bind_executor(m_strand, [this](boost::system::error_code ec) {
+          if (!ec)
+            publishBufferMetrics();
+        }));
+  }
+
+  void Agent::resizeBuffer(unsigned int bufferSize, int checkpointFreq)
+  {
+    NAMED_SCOPE("Agent::resizeBuffer");
+
+    {
+      std::lock_guard<buffer::CircularBuffer> lock(m_circularBuffer);
+      m_circularBuffer.resize(bufferSize, checkpointFreq);
+      if (m_durableBuffer)
+        m_durableBuffer->setBufferSize(m_circularBuffer.getBufferSize());
+    }
+
+    LOG(info) << "Resized the buffer to " << m_circularBuffer.getBufferSize()
+              << " observations with checkpoints every " << checkpointFreq;
+
+    rebuildCheckpoints();
+  }
+
+  void Agent::rebuildCheckpoints()
+  {
+    // Rebuild in batches so the writers only wait for one batch at a time
+    boost::asio::post(m_strand, [this]() {
+      if (!m_circularBuffer.rebuildCheckpoints(1024))
+        rebuildCheckpoints();
+    });
+  }
+
   // ----------------------------------------------
   // Device management and Initialization
   // ----------------------------------------------
@@ -852,6 +1090,21 @@ namespace mtconnect {
     }
   }
 
+  void Agent::indexDataItems(DevicePtr device)
+  {
+    // The registry is kept across device reloads so a data item id keeps its index
+    for (auto &item : device->getDeviceDataItems())
+    {
+      auto di = item.lock();
+      if (!di)
+        continue;
+
+      // Only write the index when it changes, the data items may be read by the printers
+      if (auto index = m_dataItemIndexes.assign(di->getId()); index != di->getIndex())
+        di->setIndex(index);
+    }
+  }
+
   void Agent::initializeDataItems(DevicePtr device, std::optional<std::set<std::string>> skip)
   {
     NAMED_SCOPE("Agent::initializeDataItems");
@@ -915,6 +1168,7 @@ namespace mtconnect {
       // device->resolveReferences();
       verifyDevice(device);
       createUniqueIds(device);
+      indexDataItems(device);
 
       if (m_observationsInitialized)
       {
@@ -940,6 +1194,10 @@ namespace mtconnect {
     if (m_intSchemaVersion >= SCHEMA_VERSION(2, 2))
       device->addHash();
 
+    // The devices are ordered once they are all added when initializing
+    if (m_initialized)
+      orderDataItems();
+
     for (auto &printer : m_printers)
       printer.second->setModelChangeTime(getCurrentTime(GMT_UV_SEC));
   }
@@ -970,6 +1228,7 @@ namespace mtconnect {
     if (changed)
     {
       createUniqueIds(device);
+      indexDataItems(device);
       if (m_intSchemaVersion >= SCHEMA_VERSION(2, 2))
         device->addHash();
 
@@ -1003,6 +1262,12 @@ namespace mtconnect {
         }
       }
     }
+    else
+    {
+      // The device properties changed, so documents printed from the model are out of date
+      for (auto &printer : m_printers)
+        printer.second->modelChanged();
+    }
   }
 
   void Agent::createUniqueIds(DevicePtr device)
@@ -1034,11 +1299,77 @@ namespace mtconnect {
     // Reload the document for path resolution
     auto xmlPrinter = dynamic_cast<printer::XmlPrinter *>(m_printers["xml"].get());
     m_xmlParser->loadDocument(xmlPrinter->printProbe(0, 0, 0, 0, 0, getDevices()));
+    orderDataItems();
 
     for (auto &printer : m_printers)
       printer.second->setModelChangeTime(getCurrentTime(GMT_UV_SEC));
   }
 
+  void Agent::orderDataItems()
+  {
+    NAMED_SCOPE("Agent::orderDataItems");
+
+    // The streams documents are ordered by device id, component id, and category. The XML
+    // documents then order the data items by id and the JSON documents by observation name.
+    struct Position
+    {
+      string_view m_device;
+      string_view m_component;
+      DataItem::Category m_category;
+      DataItemPtr m_dataItem;
+
+      auto category() const { return std::tie(m_device, m_component, m_category); }
+    };
+
+    vector<Position> positions;
+    for (auto &device : m_deviceIndex)
+    {
+      for (auto &wdi : device->getDeviceDataItems())
+      {
+        auto di = wdi.lock();
+        if (!di || di->isOrphan())
+          continue;
+        positions.push_back({device->getId(), di->getComponent()->getId(), di->getCategory(), di});
+      }
+    }
+
+    sort(positions.begin(), positions.end(), [](const Position &a, const Position &b) {
+      return std::tie(a.m_device, a.m_component, a.m_category, a.m_dataItem->getId()) <
+             std::tie(b.m_device, b.m_component, b.m_category, b.m_dataItem->getId());
+    });
+
+    // Build the table off to the side and publish it as a whole, documents being printed keep
+    // the table they loaded
+    auto orders = make_shared<printer::StreamOrders>(m_dataItemIndexes.size());
+    uint32_t category = 0;
+    for (auto begin = positions.begin(); begin != positions.end();)
+    {
+      category++;
+      auto end = find_if(begin, positions.end(),
+                         [begin](const Position &p) { return p.category() != begin->category(); });
+
+      // Number the observation names of the category in order
+      std::set<string_view> names;
+      for (auto it = begin; it != end; it++)
+        names.insert(it->m_dataItem->getObservationName().str());
+
+      for (auto it = begin; it != end; it++)
+      {
+        auto type = std::distance(names.begin(),
+                                  names.find(it->m_dataItem->getObservationName().str()));
+        auto index = it->m_dataItem->getIndex();
+        if (index >= orders->size())
+          orders->resize(index + 1);
+        (*orders)[index] = {uint32_t(it - positions.begin() + 1), category, uint32_t(type)};
+      }
+
+      begin = end;
+    }
+
+    for (auto &[k, pr] : m_printers)
+      pr->setStreamOrders(orders);
+  }
+
   // ----------------------------------------------------
   // Helper Methods
   // ----------------------------------------------------
@@ -1099,6 +1430,7 @@ namespace mtconnect {
     if (m_agentDevice && adapter)
     {
       m_agentDevice->addAdapter(adapter);
+      indexDataItems(m_agentDevice);
 
       if (m_observationsInitialized)
         initializeDataItems(m_agentDevice);
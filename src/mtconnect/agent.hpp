@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <boost/asio/steady_timer.hpp>
 #include <boost/multi_index/composite_key.hpp>
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/identity.hpp>
@@ -39,6 +40,7 @@
 #include "mtconnect/asset/asset_buffer.hpp"
 #include "mtconnect/buffer/checkpoint.hpp"
 #include "mtconnect/buffer/circular_buffer.hpp"
+#include "mtconnect/buffer/durable_buffer.hpp"
 #include "mtconnect/config.hpp"
 #include "mtconnect/configuration/async_context.hpp"
 #include "mtconnect/configuration/hook_manager.hpp"
@@ -87,6 +89,13 @@ namespace mtconnect {
     /// @param[in] options Configuration Options
     ///     - SchemaVersion
     ///     - CheckpointFrequency
+    ///     - DataItemSequenceIndex
+    ///     - CompactBuffer
+    ///     - DurableBufferPath
+    ///     - DurableBufferSegmentSize
+    ///     - SpillBufferPath
+    ///     - SpillBufferMaxSize
+    ///     - SpillBufferMaxAge
     ///     - Pretty
     ///     - VersionDeviceXml
     ///     - JsonVersion
@@ -164,6 +173,13 @@ namespace mtconnect {
     ///        get latest and historical data.
     /// @return A const reference to the circular buffer
     const auto &getCircularBuffer() const { return m_circularBuffer; }
+    /// @brief Get the dense data item indexes for the device model
+    /// @return A const reference to the index registry
+    const auto &getDataItemIndexes() const { return m_dataItemIndexes; }
+    /// @brief Get the instance id recovered from or stored in the durable buffer or loaded from
+    ///        a buffer snapshot
+    /// @return the instance id if the durable buffer is enabled or a snapshot was loaded
+    std::optional<uint64_t> getInstanceId() const { return m_instanceId; }
 
     /// @brief Adds an adapter to the agent
     /// @param[in] source: shared pointer to the source being added
@@ -270,6 +286,13 @@ namespace mtconnect {
     /// @param[in] deviceFile The device file to load
     /// @return true if successful
     bool reloadDevices(const std::string &deviceFile);
+    /// @brief Resize the circular buffer without restarting the agent
+    ///
+    /// The checkpoints are rebuilt in batches on the agent strand.
+    ///
+    /// @param[in] bufferSize the buffer size as a power of 2
+    /// @param[in] checkpointFreq the checkpoint frequency
+    void resizeBuffer(unsigned int bufferSize, int checkpointFreq);
 
     /// @brief receive a single device from a source
     /// @param[in] deviceXml the device xml as a string
@@ -342,6 +365,13 @@ namespace mtconnect {
     /// @brief Receive an observation
     /// @param[in] observation A shared pointer to the observation
     void receiveObservation(observation::ObservationPtr observation);
+    /// @brief Receive a batch of observations
+    ///
+    /// The buffer lock is taken once and the observations are given a contiguous range of
+    /// sequence numbers before the batch is published to the sinks.
+    ///
+    /// @param[in] observations the observations, orphaned observations are removed
+    void receiveObservations(observation::ObservationList &observations);
     /// @brief Receive an asset
     /// @param[in] asset A shared pointer to the asset
     void receiveAsset(asset::AssetPtr asset);
@@ -444,25 +474,40 @@ namespace mtconnect {
     void createAgentDevice();
     std::list<device_model::DevicePtr> loadXMLDeviceFile(const std::string &config);
     void verifyDevice(DevicePtr device);
+    void indexDataItems(DevicePtr device);
     void initializeDataItems(DevicePtr device,
                              std::optional<std::set<std::string>> skip = std::nullopt);
     void loadCachedProbe();
+    void orderDataItems();
     void versionDeviceXml();
+    observation::ObservationPtr recoverObservation(const buffer::ObservationRecord &record,
+                                                   const char *source);
+    void recoverDurableBuffer();
+    void loadBufferSnapshot(const std::string &file);
+    void addExtensionNamespace();
+    void publishBufferMetrics();
+    void rebuildCheckpoints();
 
     // Asset count management
     void updateAssetCounts(const DevicePtr &device, const std::optional<std::string> type);
 
     observation::ObservationPtr getLatest(const std::string &id)
     {
-      return m_circularBuffer.getLatest().getObservation(id);
+      if (auto index = m_dataItemIndexes.find(id))
+        return m_circularBuffer.getLatest().getObservation(*index);
+      return nullptr;
     }
 
-    observation::ObservationPtr getLatest(const DataItemPtr &di) { return getLatest(di->getId()); }
+    observation::ObservationPtr getLatest(const DataItemPtr &di)
+    {
+      return m_circularBuffer.getLatest().getObservation(di->getIndex());
+    }
 
   protected:
     ConfigOptions m_options;
     configuration::AsyncContext &m_context;
     boost::asio::io_context::strand m_strand;
+    boost::asio::steady_timer m_bufferMetricsTimer;
 
     std::shared_ptr<source::LoopbackSource> m_loopback;
 
@@ -523,6 +568,7 @@ namespace mtconnect {
 
     DeviceIndex m_deviceIndex;
     std::unordered_map<std::string, WeakDataItemPtr> m_dataItemMap;
+    DataItemIndexes m_dataItemIndexes;
 
     // Xml Config
     std::optional<std::string> m_schemaVersion;
@@ -533,6 +579,8 @@ namespace mtconnect {
 
     // Circular Buffer
     buffer::CircularBuffer m_circularBuffer;
+    std::unique_ptr<buffer::DurableBuffer> m_durableBuffer;
+    std::optional<uint64_t> m_instanceId;
 
     // For debugging
     bool m_pretty;
@@ -579,6 +627,10 @@ namespace mtconnect {
     {
       m_agent->receiveObservation(obs);
     }
+    void deliverObservations(observation::ObservationList &observations) override
+    {
+      m_agent->receiveObservations(observations);
+    }
     void deliverAsset(asset::AssetPtr asset) override { m_agent->receiveAsset(asset); }
     void deliverAssetCommand(entity::EntityPtr command) override;
     void deliverConnectStatus(entity::EntityPtr, const StringList &devices,
@@ -640,10 +692,19 @@ namespace mtconnect {
     {
       std::string dataPath = m_agent->devicesAndPath(path, device);
       const auto &parser = m_agent->getXmlParser();
-      parser->getDataItems(filter, dataPath);
+      FilterSet ids;
+      parser->getDataItems(ids, dataPath);
+
+      const auto &indexes = m_agent->getDataItemIndexes();
+      for (const auto &id : ids)
+      {
+        if (auto index = indexes.find(id))
+          filter.insert(id, *index);
+      }
     }
 
     buffer::CircularBuffer &getCircularBuffer() override { return m_agent->getCircularBuffer(); }
+    std::optional<uint64_t> getInstanceId() const override { return m_agent->getInstanceId(); }
 
   protected:
     Agent *m_agent;
@@ -0,0 +1,166 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "buffer_snapshot.hpp"
+
+#include <boost/crc.hpp>
+
+#include <cstring>
+#include <fstream>
+
+#include "mtconnect/logging.hpp"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace mtconnect {
+  using namespace observation;
+
+  namespace buffer {
+    namespace {
+      const char SnapshotMagic[8] = {'M', 'T', 'C', 'S', 'N', 'P', '0', '1'};
+
+      struct SnapshotHeader
+      {
+        char m_magic[8];
+        uint64_t m_instanceId;
+        uint64_t m_firstSequence;
+        uint64_t m_sequence;
+        uint64_t m_firstCount;
+        uint64_t m_count;
+      };
+
+      size_t writeRecords(ofstream &out, const ObservationList &observations, string &scratch)
+      {
+        size_t count = 0;
+        for (const auto &obs : observations)
+        {
+          if (obs->isOrphan())
+            continue;
+
+          DurableBuffer::encode(scratch, obs);
+          boost::crc_32_type check;
+          check.process_bytes(scratch.data(), scratch.size());
+          uint32_t length = uint32_t(scratch.size()), crc = check.checksum();
+          out.write(reinterpret_cast<const char *>(&length), sizeof(length));
+          out.write(reinterpret_cast<const char *>(&crc), sizeof(crc));
+          out.write(scratch.data(), scratch.size());
+          count++;
+        }
+        return count;
+      }
+
+      bool readRecords(ifstream &in, uint64_t count, vector<ObservationRecord> &records,
+                       string &scratch)
+      {
+        records.reserve(count);
+        for (uint64_t i = 0; i < count; i++)
+        {
+          uint32_t length, crc;
+          in.read(reinterpret_cast<char *>(&length), sizeof(length));
+          in.read(reinterpret_cast<char *>(&crc), sizeof(crc));
+          if (!in)
+            return false;
+
+          scratch.resize(length);
+          in.read(scratch.data(), length);
+          if (!in)
+            return false;
+
+          boost::crc_32_type check;
+          check.process_bytes(scratch.data(), scratch.size());
+          ObservationRecord record;
+          if (check.checksum() != crc || !DurableBuffer::decode(scratch.data(), length, record))
+            return false;
+          records.emplace_back(std::move(record));
+        }
+        return true;
+      }
+    }  // namespace
+
+    size_t BufferSnapshot::write(const fs::path &file, const CircularBuffer &buffer,
+                                 uint64_t instanceId)
+    {
+      auto snapshot = buffer.getSnapshot();
+
+      auto temp = file;
+      temp += ".tmp";
+      ofstream out(temp, ios::binary | ios::trunc);
+      if (!out)
+        throw runtime_error("Cannot create snapshot file: " + temp.string());
+
+      // The counts are written after the records
+      SnapshotHeader header {};
+      memcpy(header.m_magic, SnapshotMagic, sizeof(SnapshotMagic));
+      header.m_instanceId = instanceId;
+      header.m_firstSequence = snapshot.m_firstSequence;
+      header.m_sequence = snapshot.m_sequence;
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+      string scratch;
+      header.m_firstCount = writeRecords(out, snapshot.m_first, scratch);
+      header.m_count = writeRecords(out, snapshot.m_observations, scratch);
+
+      out.seekp(0);
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      out.close();
+      if (!out)
+        throw runtime_error("Cannot write snapshot file: " + temp.string());
+
+      fs::rename(temp, file);
+
+      LOG(info) << "Wrote buffer snapshot " << file << " with " << header.m_count
+                << " observations from " << header.m_firstSequence << " to "
+                << header.m_sequence;
+
+      return size_t(header.m_count);
+    }
+
+    optional<BufferSnapshot::Contents> BufferSnapshot::read(const fs::path &file)
+    {
+      ifstream in(file, ios::binary);
+      if (!in)
+      {
+        LOG(warning) << "Cannot open snapshot file: " << file;
+        return nullopt;
+      }
+
+      SnapshotHeader header;
+      in.read(reinterpret_cast<char *>(&header), sizeof(header));
+      if (!in || memcmp(header.m_magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0)
+      {
+        LOG(warning) << "Invalid snapshot file: " << file;
+        return nullopt;
+      }
+
+      Contents contents;
+      contents.m_instanceId = header.m_instanceId;
+      contents.m_firstSequence = header.m_firstSequence;
+      contents.m_sequence = header.m_sequence;
+
+      string scratch;
+      if (!readRecords(in, header.m_firstCount, contents.m_first, scratch) ||
+          !readRecords(in, header.m_count, contents.m_observations, scratch))
+      {
+        LOG(warning) << "Snapshot file " << file << " has an invalid record";
+        return nullopt;
+      }
+
+      return contents;
+    }
+  }  // namespace buffer
+}  // namespace mtconnect
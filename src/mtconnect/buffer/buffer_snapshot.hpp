@@ -0,0 +1,71 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include "circular_buffer.hpp"
+#include "durable_buffer.hpp"
+#include "mtconnect/config.hpp"
+#include "mtconnect/utilities.hpp"
+
+namespace mtconnect::buffer {
+  /// @brief Binary snapshot of the circular buffer
+  ///
+  /// A snapshot holds the observations of the first checkpoint followed by the observations in
+  /// the buffer. The observations use the durable buffer record encoding, a 32 bit length, a 32
+  /// bit CRC and the encoded observation. The latest checkpoint and the intermediate
+  /// checkpoints are recreated by adding the observations to a buffer when the snapshot is
+  /// loaded. Values are stored in the host byte order.
+  class AGENT_LIB_API BufferSnapshot
+  {
+  public:
+    /// @brief the contents of a snapshot file
+    struct Contents
+    {
+      uint64_t m_instanceId {0};
+      SequenceNumber_t m_firstSequence {0};
+      SequenceNumber_t m_sequence {0};
+      /// @brief the observations in the first checkpoint
+      std::vector<ObservationRecord> m_first;
+      /// @brief the observations in the buffer in sequence order
+      std::vector<ObservationRecord> m_observations;
+    };
+
+    /// @brief Write a snapshot of a circular buffer
+    ///
+    /// The buffer is copied with `CircularBuffer::getSnapshot()` and the file is written after
+    /// the buffer locks are released. The snapshot is written to a temporary file that is
+    /// renamed when complete.
+    ///
+    /// @param[in] file the snapshot file
+    /// @param[in] buffer the circular buffer
+    /// @param[in] instanceId the agent instance id
+    /// @return the number of observations written from the buffer
+    static size_t write(const std::filesystem::path &file, const CircularBuffer &buffer,
+                        uint64_t instanceId);
+
+    /// @brief Read a snapshot file
+    /// @param[in] file the snapshot file
+    /// @return the contents or `std::nullopt` if the file is not a valid snapshot
+    static std::optional<Contents> read(const std::filesystem::path &file);
+  };
+}  // namespace mtconnect::buffer
@@ -36,84 +36,87 @@ namespace mtconnect {
       copy(checkpoint, filter);
     }
 
-    void Checkpoint::clear() { m_observations.clear(); }
+    void Checkpoint::clear()
+    {
+      m_chunks.clear();
+      m_conditions.clear();
+    }
 
     Checkpoint::~Checkpoint() { clear(); }
 
-    void Checkpoint::addObservation(ConditionPtr event, ObservationPtr &&old)
+    void Checkpoint::addObservation(ConditionPtr event, size_t index, ObservationPtr &old)
     {
-      bool assign = true;
-      Condition *cond = dynamic_cast<Condition *>(old.get());
-      if (cond->getLevel() != Condition::NORMAL && event->getLevel() != Condition::NORMAL &&
-          cond->getLevel() != Condition::UNAVAILABLE && event->getLevel() != Condition::UNAVAILABLE)
-      {
-        // Check to see if the native code matches an existing
-        // active condition
-        if (auto e = cond->find(event->getCode()))
-        {
-          // Replace in chain.
-          old = cond->deepCopyAndRemove(e);
-          // Check if this is the only event...
-          // ??
-        }
+      auto active = [](const Condition::Level level) {
+        return level != Condition::NORMAL && level != Condition::UNAVAILABLE;
+      };
 
-        // Chain the event
-        if (old)
-          event->appendTo(dynamic_pointer_cast<Condition>(old));
+      auto cond = dynamic_cast<Condition *>(old.get());
+      if (active(event->getLevel()))
+      {
+        // Add to the active conditions, replacing an active condition with the same code.
+        // If the previous condition was normal or unavailable, this is the only condition.
+        if (!cond || !active(cond->getLevel()))
+          m_conditions[index] = make_shared<ConditionSet>();
+        conditionSet(index).activate(event);
+        old = event;
+        return;
       }
-      else if (event->getLevel() == Condition::NORMAL)
+
+      // Check for a normal that clears an active condition by code
+      if (event->getLevel() == Condition::NORMAL && !event->getCode().empty() && cond &&
+          findCondition(index, *cond, event->getCode()))
       {
-        // Check for a normal that clears an active condition by code
-        if (!event->getCode().empty())
+        if (m_conditions.count(index) > 0)
         {
-          if (auto e = cond->find(event->getCode()))
+          auto &set = conditionSet(index);
+          set.remove(event->getCode());
+          if (!set.empty())
           {
-            // Clear the one condition by removing it from the chain
-            old = cond->deepCopyAndRemove(e);
-
-            if (!old)
-            {
-              // Need to put a normal event in with no code since this
-              // is the last one.
-              auto n = make_shared<Condition>(*event);
-              n->normal();
-              old = n;
-            }
-            assign = false;
-          }
-          else
-          {
-            // Not sure if we should register code specific normals if
-            // previous normal was not found
-            // (*ptr) = event;
+            old = set.newest();
+            return;
           }
+          m_conditions.erase(index);
         }
+
+        // Need to put a normal event in with no code since this is the last one.
+        auto n = make_shared<Condition>(*event);
+        n->normal();
+        old = n;
+        return;
       }
-      if (assign)
-        old = event;
+
+      // A normal without a code or unavailable clears all the conditions. Code specific normals
+      // for a condition that is not active are not registered separately.
+      m_conditions.erase(index);
+      old = event;
     }
 
     void Checkpoint::addObservation(const DataSetEventPtr event, ObservationPtr &&old)
     {
       if (!event->isUnavailable() && !old->isUnavailable() && !event->hasProperty("resetTriggered"))
       {
-        // Get the existing data set from the existing event
-        DataSet set = old->getValue<DataSet>();
+        // The merged event is owned by this checkpoint once the chunk has been copied on write.
+        // If no one else holds it, take its data set instead of copying every entry.
+        DataSet set;
+        if (old.use_count() == 1)
+          set = static_pointer_cast<DataSetEvent>(old)->takeDataSet();
+        else
+          set = old->getValue<DataSet>();
 
-        // For data sets merge the maps together
+        // For data sets merge the changed entries into the set
         for (auto &e : event->getValue<DataSet>())
         {
-          const auto &oe = set.find(e);
+          auto oe = set.find(e);
           if (oe != set.end())
-            set.erase(oe);
+            oe = set.erase(oe);
           if (!e.m_removed)
-            set.insert(e);
+            set.insert(oe, e);
         }
 
         // Replace the old event with a copy of the new event with sets merged
         // Do not modify the new event.
-        auto n = make_shared<DataSetEvent>(*event);
-        n->setDataSet(set);
+        auto n = static_pointer_cast<DataSetEvent>(event->copy());
+        n->setDataSet(std::move(set));
         old = n;
       }
       else
@@ -124,37 +127,35 @@ namespace mtconnect {
 
     void Checkpoint::addObservation(ObservationPtr obs)
     {
-      if (obs->isOrphan() || (m_filter && m_filter->count(obs->getDataItem()->getId()) == 0))
-      {
+      if (obs->isOrphan())
         return;
-      }
 
       auto item = obs->getDataItem();
-      const auto &id = item->getId();
-      auto old = m_observations.find(id);
+      auto index = item->getIndex();
+      if (m_filter && !m_filter->contains(index))
+        return;
 
-      if (old != m_observations.end())
+      auto &old = slot(index);
+
+      if (item->isCondition())
       {
-        if (item->isCondition())
-        {
-          auto cond = dynamic_pointer_cast<Condition>(obs);
-          // Chain event only if it is normal or unavailable and the
-          // previous condition was not normal or unavailable
-          addObservation(cond, std::forward<ObservationPtr>(old->second));
-        }
-        else if (item->isDataSet())
+        addObservation(dynamic_pointer_cast<Condition>(obs), index, old);
+      }
+      else if (old)
+      {
+        if (item->isDataSet())
         {
           auto set = dynamic_pointer_cast<DataSetEvent>(obs);
-          addObservation(set, std::forward<ObservationPtr>(old->second));
+          addObservation(set, std::forward<ObservationPtr>(old));
         }
         else
         {
-          old->second = obs;
+          old = obs;
         }
       }
       else
       {
-        m_observations[id] = dynamic_pointer_cast<Observation>(obs->getptr());
+        old = obs;
       }
     }
 
@@ -167,28 +168,48 @@ namespace mtconnect {
         m_filter = filterSet;
       }
 
-      for (const auto &event : checkpoint.m_observations)
+      if (!m_filter)
       {
-        if (!m_filter || m_filter->count(event.first) > 0)
-          m_observations[event.first] = dynamic_pointer_cast<Observation>(event.second->getptr());
+        // Share the chunks and condition sets, they are copied when they are written
+        m_chunks = checkpoint.m_chunks;
+        m_conditions = checkpoint.m_conditions;
+      }
+      else
+      {
+        // Only materialize the filtered observations
+        for (size_t i = 0; i < m_filter->indexLimit(); i++)
+        {
+          if (m_filter->contains(i))
+          {
+            auto found = checkpoint.find(i);
+            if (found && *found)
+              slot(i) = *found;
+            auto set = checkpoint.m_conditions.find(i);
+            if (set != checkpoint.m_conditions.end())
+              m_conditions.emplace(i, set->second);
+          }
+        }
       }
     }
 
     void Checkpoint::getObservations(ObservationList &list, const FilterSetOpt &filterSet) const
     {
-      for (const auto &obs : m_observations)
+      for (size_t c = 0; c < m_chunks.size(); c++)
       {
-        auto e = obs.second;
-        if (!e->isOrphan())
+        if (!m_chunks[c])
+          continue;
+
+        for (size_t j = 0; j < ChunkSize; j++)
         {
-          if (!filterSet || (e && filterSet->count(e->getDataItem()->getId()) > 0))
+          const auto &e = (*m_chunks[c])[j];
+          if (e && !e->isOrphan() && (!filterSet || filterSet->contains(c * ChunkSize + j)))
           {
-            if (e->getDataItem()->isCondition())
+            auto set = m_conditions.find(c * ChunkSize + j);
+            if (set != m_conditions.end())
             {
-              for (auto ev = dynamic_pointer_cast<Condition>(e); ev; ev = ev->getPrev())
-              {
-                list.push_back(ev);
-              }
+              // Most recently activated condition first
+              for (const auto &cond : set->second->getConditions())
+                list.push_back(cond);
             }
             else
             {
@@ -199,6 +220,27 @@ namespace mtconnect {
       }
     }
 
+    void Checkpoint::getObservations(ObservationList &list, const vector<size_t> &indexes) const
+    {
+      for (auto index : indexes)
+      {
+        auto found = find(index);
+        if (!found || !*found || (*found)->isOrphan())
+          continue;
+
+        auto set = m_conditions.find(index);
+        if (set != m_conditions.end())
+        {
+          for (const auto &cond : set->second->getConditions())
+            list.push_back(cond);
+        }
+        else
+        {
+          list.push_back(*found);
+        }
+      }
+    }
+
     void Checkpoint::filter(const FilterSet &filterSet)
     {
       m_filter = filterSet;
@@ -206,22 +248,46 @@ namespace mtconnect {
       if (m_filter->empty())
         return;
 
-      auto it = m_observations.begin();
-      while (it != m_observations.end())
+      for (size_t i = 0; i < m_chunks.size() * ChunkSize; i++)
       {
-        if (!m_filter->count(it->first))
+        auto found = find(i);
+        if (found && *found && !m_filter->contains(i))
         {
-#ifdef _WINDOWS
-          it = m_observations.erase(it);
-#else
-          auto pos = it++;
-          m_observations.erase(pos);
-#endif
+          slot(i).reset();
+          m_conditions.erase(i);
         }
-        else
+      }
+    }
+
+    void Checkpoint::updateDataItems(DataItemUpdate &update)
+    {
+      for (auto &chunk : m_chunks)
+      {
+        if (!chunk)
+          continue;
+
+        auto &copy = update.m_chunks[chunk];
+        if (!copy)
+        {
+          copy = make_shared<Chunk>();
+          for (size_t i = 0; i < ChunkSize; i++)
+            (*copy)[i] = update.m_observations((*chunk)[i]);
+        }
+        chunk = copy;
+      }
+
+      for (auto &[index, set] : m_conditions)
+      {
+        auto &copy = update.m_conditions[set];
+        if (!copy)
         {
-          ++it;
+          // Activate from the oldest so the copy keeps the activation order
+          copy = make_shared<ConditionSet>();
+          const auto &conditions = set->getConditions();
+          for (auto it = conditions.rbegin(); it != conditions.rend(); it++)
+            copy->activate(update.m_observations(*it));
         }
+        set = copy;
       }
     }
 
@@ -237,36 +303,32 @@ namespace mtconnect {
       {
         auto oldEvent = dynamic_pointer_cast<const DataSetEvent>(old);
         auto &oldSet = oldEvent->getDataSet();
-        DataSet eventSet = setEvent->getDataSet();
-        bool changed = false;
+        auto &eventSet = setEvent->getDataSet();
 
-        for (auto it = eventSet.begin(); it != eventSet.end();)
+        // Only copy the event set if some of the entries are the same as the current entries
+        size_t same = 0;
+        for (const auto &e : eventSet)
         {
-          const auto v = oldSet.find(*it);
-          if (v == oldSet.end() || !v->same(*it))
-          {
-            it++;
-          }
-          else
-          {
-            changed = true;
-            eventSet.erase(it++);
-          }
+          const auto v = oldSet.find(e);
+          if (v != oldSet.end() && v->same(e))
+            same++;
         }
 
-        // If the data set has changed and been edited by delting it against the current latest.
-        if (changed)
+        if (same == eventSet.size())
+          return nullptr;
+        else if (same > 0)
         {
-          if (!eventSet.empty())
-          {
-            auto copy = dynamic_pointer_cast<DataSetEvent>(setEvent->copy());
-            copy->setDataSet(eventSet);
-            return copy;
-          }
-          else
+          DataSet changed;
+          for (const auto &e : eventSet)
           {
-            return nullptr;
+            const auto v = oldSet.find(e);
+            if (v == oldSet.end() || !v->same(e))
+              changed.insert(changed.end(), e);
           }
+
+          auto copy = static_pointer_cast<DataSetEvent>(setEvent->copy());
+          copy->setDataSet(std::move(changed));
+          return copy;
         }
       }
 
@@ -17,12 +17,14 @@
 
 #pragma once
 
+#include <array>
 #include <map>
 #include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "condition_set.hpp"
 #include "mtconnect/config.hpp"
 #include "mtconnect/observation/observation.hpp"
 #include "mtconnect/utilities.hpp"
@@ -30,6 +32,16 @@
 /// @brief Internal storage of observations
 namespace mtconnect::buffer {
   /// @brief A point in time snapshot of all data items with a optional filter
+  ///
+  /// The observations are kept in fixed size chunks indexed by the dense data item index, see
+  /// `DataItem::getIndex()`. Data items without an observation have a `nullptr` entry. The
+  /// chunks are shared between copies and only copied when a shared chunk is written, so copying
+  /// a checkpoint is proportional to the number of chunks and adding observations only copies
+  /// the chunks that changed since.
+  ///
+  /// The active conditions of a condition data item are kept in a `ConditionSet` keyed by native
+  /// code and the slot holds the most recent condition. The sets are shared the same way as the
+  /// chunks and a set is only copied the first time it is written after the checkpoint is copied.
   class AGENT_LIB_API Checkpoint
   {
   public:
@@ -49,7 +61,8 @@ namespace mtconnect::buffer {
     /// @brief If this is a data set event, diff the value
     /// @param[in] observation the data set observation
     /// @param[in] old the previous value of the data set
-    /// @return The observation or a copy  if the data set changed
+    /// @return The observation, a copy with only the changed entries, or `nullptr` if no entries
+    ///         changed
     observation::ObservationPtr dataSetDifference(
         const observation::ObservationPtr &observation,
         const observation::ConstObservationPtr &old) const;
@@ -64,12 +77,11 @@ namespace mtconnect::buffer {
       using namespace std;
 
       auto di = obs->getDataItem();
-      const auto &id = di->getId();
-      auto old = m_observations.find(id);
+      auto index = di->getIndex();
 
-      if (old != m_observations.end())
+      if (auto found = find(index); found && *found)
       {
-        auto &oldObs = old->second;
+        auto &oldObs = *found;
         // Filter out unavailable duplicates, only allow through changed
         // state. If both are unavailable, disregard.
         if (obs->isUnavailable() != oldObs->isUnavailable())
@@ -94,7 +106,7 @@ namespace mtconnect::buffer {
 
           // If there is already an active condition with this code,
           // then check if nothing has changed between activations.
-          if (const auto &e = oldCond->find(cond->getCode()))
+          if (const auto &e = findCondition(index, *oldCond, cond->getCode()))
           {
             if (cond->getLevel() != e->getLevel())
               return obs;
@@ -159,25 +171,23 @@ namespace mtconnect::buffer {
     /// @return `true` if a checkpoint exists
     bool hasFilter() const { return bool(m_filter); }
 
-    /// @brief get a map of data item id to observation shared pointers
-    /// @return a map of ids to observations
-    const std::unordered_map<std::string, observation::ObservationPtr> &getObservations() const
+    /// @brief get the observations in the checkpoint
+    /// @return a vector of the latest observation for each data item in data item index order
+    std::vector<observation::ObservationPtr> getObservations() const
     {
-      return m_observations;
-    }
-
-    /// @brief updates the data item reference of an observation in a checkpoint
-    ///
-    /// Used when the device model is modified and data items may have been removed or
-    /// changed. The new data item shared pointer will replace the old.
-    ///
-    /// @param[in] diMap the map of data ids to data item pointers
-    void updateDataItems(std::unordered_map<std::string, WeakDataItemPtr> &diMap)
-    {
-      for (auto &o : m_observations)
+      std::vector<observation::ObservationPtr> list;
+      for (const auto &chunk : m_chunks)
       {
-        o.second->updateDataItem(diMap);
+        if (chunk)
+        {
+          for (const auto &o : *chunk)
+          {
+            if (o)
+              list.push_back(o);
+          }
+        }
       }
+      return list;
     }
 
     /// @brief Get a list of observations from the checkpoint
@@ -186,24 +196,144 @@ namespace mtconnect::buffer {
     void getObservations(observation::ObservationList &list,
                          const FilterSetOpt &filter = std::nullopt) const;
 
+    /// @brief Get the observations for a list of data items
+    /// @param[in,out] list the list to add the observations to
+    /// @param[in] indexes the data item indexes in ascending order
+    void getObservations(observation::ObservationList &list,
+                         const std::vector<size_t> &indexes) const;
+
     /// @brief Get an observation for a data item id
+    ///
+    /// The id is looked up in the default index registry. Use the index for data items loaded
+    /// by an agent.
+    ///
     /// @param[in] id the data item id
     /// @return shared pointer to the observation if it exists
     observation::ObservationPtr getObservation(const std::string &id) const
     {
-      auto pos = m_observations.find(id);
-      if (pos != m_observations.end())
-        return pos->second;
+      auto index = DataItemIndexes::Default().find(id);
+      if (index)
+      {
+        if (auto found = find(*index))
+          return *found;
+      }
+      return nullptr;
+    }
+
+    /// @brief Get an observation for a data item index
+    /// @param[in] index the dense data item index
+    /// @return shared pointer to the observation if it exists
+    observation::ObservationPtr getObservation(size_t index) const
+    {
+      if (auto found = find(index))
+        return *found;
       return nullptr;
     }
 
   protected:
-    void addObservation(observation::ConditionPtr event, observation::ObservationPtr &&old);
+    /// @brief the number of observations in a chunk
+    static constexpr size_t ChunkSize = 64;
+    using Chunk = std::array<observation::ObservationPtr, ChunkSize>;
+    using ChunkPtr = std::shared_ptr<Chunk>;
+
+    void addObservation(observation::ConditionPtr event, size_t index,
+                        observation::ObservationPtr &old);
     void addObservation(const observation::DataSetEventPtr event,
                         observation::ObservationPtr &&old);
 
+    /// @brief find an active condition by code
+    /// @param[in] index the data item index
+    /// @param[in] current the condition in the slot
+    /// @param[in] code the native code
+    /// @return the condition or `nullptr` if it is not active
+    observation::ConditionPtr findCondition(size_t index, const observation::Condition &current,
+                                            const std::string &code) const
+    {
+      auto set = m_conditions.find(index);
+      if (set != m_conditions.end())
+        return set->second->find(code);
+      else if (current.getCode() == code)
+        return std::dynamic_pointer_cast<observation::Condition>(current.Entity::getptr());
+      else
+        return nullptr;
+    }
+
+    /// @brief get a writable condition set for a data item index
+    ///
+    /// Creates the set if it does not exist and copies the set if it is shared with another
+    /// checkpoint.
+    ///
+    /// @param[in] index the data item index
+    /// @return a reference to the set
+    ConditionSet &conditionSet(size_t index)
+    {
+      auto &set = m_conditions[index];
+      if (!set)
+        set = std::make_shared<ConditionSet>();
+      else if (set.use_count() > 1)
+        set = std::make_shared<ConditionSet>(*set);
+      return *set;
+    }
+
+    /// @brief find the observation slot for a data item index
+    /// @param[in] index the data item index
+    /// @return a pointer to the slot or `nullptr` if the chunk does not exist
+    const observation::ObservationPtr *find(size_t index) const
+    {
+      auto c = index / ChunkSize;
+      if (c < m_chunks.size() && m_chunks[c])
+        return &(*m_chunks[c])[index % ChunkSize];
+      else
+        return nullptr;
+    }
+
+    /// @brief get a writable observation slot for a data item index
+    ///
+    /// Creates the chunk if it does not exist and copies the chunk if it is shared with
+    /// another checkpoint.
+    ///
+    /// @param[in] index the data item index
+    /// @return a reference to the slot
+    observation::ObservationPtr &slot(size_t index)
+    {
+      auto c = index / ChunkSize;
+      if (c >= m_chunks.size())
+        m_chunks.resize(c + 1);
+      auto &chunk = m_chunks[c];
+      if (!chunk)
+        chunk = std::make_shared<Chunk>();
+      else if (chunk.use_count() > 1)
+        chunk = std::make_shared<Chunk>(*chunk);
+      return (*chunk)[index % ChunkSize];
+    }
+
   protected:
-    std::unordered_map<std::string, observation::ObservationPtr> m_observations;
+    std::vector<ChunkPtr> m_chunks;
+    std::unordered_map<size_t, ConditionSetPtr> m_conditions;
     FilterSetOpt m_filter;
+
+  public:
+    /// @brief The copies made while updating the data items of the checkpoints in a buffer
+    ///
+    /// The chunks and condition sets shared between checkpoints are copied once and the copies
+    /// are shared the same way.
+    struct DataItemUpdate
+    {
+      DataItemUpdate(observation::ObservationUpdater &observations) : m_observations(observations)
+      {}
+
+      observation::ObservationUpdater &m_observations;
+      std::unordered_map<ChunkPtr, ChunkPtr> m_chunks;
+      std::unordered_map<ConditionSetPtr, ConditionSetPtr> m_conditions;
+    };
+
+    /// @brief replace the observations with copies that reference the new data items
+    ///
+    /// Used when the device model is modified and data items may have been removed or
+    /// changed. The chunks and condition sets are replaced, not modified, since they may be
+    /// shared with checkpoints held by readers.
+    ///
+    /// @param[in,out] update the copies made for the other checkpoints in the buffer
+    void updateDataItems(DataItemUpdate &update);
   };
 }  // namespace mtconnect::buffer
@@ -19,12 +19,22 @@
 
 #include <boost/circular_buffer.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <deque>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <vector>
 
 #include "checkpoint.hpp"
+#include "compact_observation.hpp"
+#include "memory_size.hpp"
 #include "mtconnect/config.hpp"
+#include "spill_buffer.hpp"
 #include "mtconnect/observation/observation.hpp"
 #include "mtconnect/utilities.hpp"
 
@@ -32,20 +42,58 @@ namespace mtconnect::buffer {
   using SequenceNumber_t = uint64_t;
 
   /// @brief Limited epherimal in-memory storage of observations and checkpoint management
+  ///
+  /// The buffer has a single writer and many readers. Writers are serialized with the
+  /// buffer lock (`lock()`, `unlock()`). The observations are kept in a ring of slots indexed by
+  /// the sequence number and the first and next sequence numbers are published atomically, so
+  /// `getObservations()` never takes a lock and never blocks `addToBuffer()`. A reader that
+  /// falls behind the writer will detect an overwritten slot by its sequence number and skip it.
+  ///
+  /// The checkpoints are guarded by a separate checkpoint lock held only while a checkpoint is
+  /// being updated or copied.
+  ///
+  /// When the data item index is enabled, the buffer also keeps the sequence numbers of each
+  /// data item's observations so a filtered request only visits the matching slots.
+  ///
+  /// When compact storage is enabled, the slots hold a `CompactObservation` instead of the
+  /// observation entity and the entity is recreated when the observation is read.
+  ///
+  /// When a spill buffer is attached, observations evicted from the ring are written to
+  /// compressed disk segments and requests for older sequence numbers are read from them.
+  ///
+  /// The buffer keeps an estimate of the memory held by the observations in the slots. When a
+  /// memory limit is set, the oldest observations are evicted until the estimate is within the
+  /// limit, so the buffer may hold fewer observations than its size.
+  ///
+  /// A coarse time index maps the observation timestamps, in `TimeIndexResolution` buckets, to
+  /// the first sequence number in each bucket so a time range can be resolved to sequence
+  /// numbers with a binary search.
+  ///
+  /// The buffer can be resized while it is in use. The slots are moved to a new ring that is
+  /// published atomically, readers holding the previous ring still see consistent slots. When
+  /// the checkpoint frequency changes, the checkpoints before the resize are rebuilt in batches
+  /// by `rebuildCheckpoints()`.
   class AGENT_LIB_API CircularBuffer
   {
   public:
+    /// @brief the width of the time index buckets
+    static constexpr std::chrono::milliseconds TimeIndexResolution {100};
+
     /// @brief Create a circular buffer
     /// @param bufferSize the size of the circular buffer
     /// @param checkpointFreq how often to create checkpoints
-    CircularBuffer(unsigned int bufferSize, int checkpointFreq)
+    /// @param indexed maintain a per data item sequence index for filtered requests
+    /// @param compact store compact observations in the slots
+    CircularBuffer(unsigned int bufferSize, int checkpointFreq, bool indexed = true,
+                   bool compact = false)
       : m_sequence(1ull),
-        m_firstSequence(m_sequence),
-        m_slidingBufferSize(1 << bufferSize),
-        m_slidingBuffer(m_slidingBufferSize),
+        m_firstSequence(1ull),
+        m_ring(std::make_shared<Ring>(1 << bufferSize, compact)),
+        m_compact(compact),
         m_checkpointFreq(checkpointFreq),
-        m_checkpointCount(m_slidingBufferSize / checkpointFreq),
-        m_checkpoints(m_checkpointCount)
+        m_checkpointCount(m_ring->m_size / checkpointFreq),
+        m_checkpoints(m_checkpointCount),
+        m_indexed(indexed)
     {}
 
     ~CircularBuffer() { m_checkpoints.clear(); }
@@ -55,57 +103,217 @@ namespace mtconnect::buffer {
     /// @return shared pointer to an obseration at sequence
     observation::ObservationPtr getFromBuffer(uint64_t seq) const
     {
-      auto off = seq - m_firstSequence;
-      if (off < m_slidingBufferSize)
-        return m_slidingBuffer[off];
-      else
+      if (seq < getFirstSequence() || seq >= getSequence())
         return observation::ObservationPtr();
+      else
+        return loadSlot(*ring(), seq);
     }
 
     /// @brief get index into underlying circular buffer at a sequence number
     /// @param at the sequence number
     /// @return the index into the circular buffer
-    auto getIndexAt(uint64_t at) const { return at - m_firstSequence; }
+    auto getIndexAt(uint64_t at) const { return at - getFirstSequence(); }
 
     /// @brief Get the current sequence number
     /// @return sequence number one greater than last observation in circular buffer
-    SequenceNumber_t getSequence() const { return m_sequence; }
+    SequenceNumber_t getSequence() const { return m_sequence.load(std::memory_order_acquire); }
     /// @brief get the buffer size
     /// @return the buffer size
-    unsigned int getBufferSize() const { return m_slidingBufferSize; }
+    unsigned int getBufferSize() const { return ring()->m_size; }
+    /// @brief is the data item sequence index enabled
+    /// @return `true` if filtered requests use the index
+    bool isIndexed() const { return m_indexed; }
+    /// @brief are compact observations stored in the slots
+    /// @return `true` if the observations are stored compactly
+    bool isCompact() const { return m_compact; }
 
     /// @brief get the first sequence number in the circular buffer
     /// @return first sequence
-    SequenceNumber_t getFirstSequence() const { return m_firstSequence; }
+    SequenceNumber_t getFirstSequence() const
+    {
+      return m_firstSequence.load(std::memory_order_acquire);
+    }
+
+    /// @brief get the number of observations in the buffer
+    /// @return the number of observations
+    SequenceNumber_t getCount() const { return getSequence() - getFirstSequence(); }
+
+    /// @brief Get the sequence number of the first observation at or after a time
+    ///
+    /// The time is resolved to the start of its time index bucket, so the sequence number
+    /// may include observations up to `TimeIndexResolution` before `time`. An observation with a
+    /// timestamp before an earlier observation is indexed by the latest timestamp before it.
+    ///
+    /// @param time the time
+    /// @return the sequence number, the earliest sequence if the time is before the oldest
+    ///         observation, or `std::nullopt` if the time is after the newest observation
+    std::optional<SequenceNumber_t> getSequenceAt(const Timestamp &time) const
+    {
+      auto earliest = getEarliestSequence();
+      std::lock_guard<std::mutex> lock(m_timeIndexLock);
+      if (m_timeIndex.empty())
+        return std::nullopt;
+      if (time < m_timeIndex.front().first)
+        return earliest;
+
+      auto it = std::lower_bound(
+          m_timeIndex.begin(), m_timeIndex.end(), timeBucket(time),
+          [](const TimeIndexEntry &entry, const Timestamp &t) { return entry.first < t; });
+      if (it == m_timeIndex.end())
+        return std::nullopt;
+      return std::max(it->second, earliest);
+    }
+
+    /// @brief Set the memory limit for the observations in the buffer
+    /// @note must be called before observations are added
+    /// @param limit the limit in bytes, 0 is unlimited
+    void setMemoryLimit(size_t limit) { m_memoryLimit = limit; }
+    /// @brief get the memory limit
+    /// @return the limit in bytes, 0 if unlimited
+    size_t getMemoryLimit() const { return m_memoryLimit; }
+    /// @brief get the estimated memory held by the observations in the buffer
+    /// @return the size in bytes
+    size_t getMemoryUsed() const { return m_memoryUsed.load(std::memory_order_relaxed); }
+
+    /// @brief get the first sequence number available in the buffer or the spill buffer
+    /// @return earliest sequence
+    SequenceNumber_t getEarliestSequence() const
+    {
+      auto first = getFirstSequence();
+      if (m_spill)
+      {
+        auto spilled = m_spill->getFirstSequence();
+        if (spilled > 0 && spilled < first)
+          return spilled;
+      }
+      return first;
+    }
+
+    /// @brief Attach a spill buffer for the observations evicted from the ring
+    /// @note must be called before observations are added
+    /// @param spill the spill buffer
+    void setSpillBuffer(std::unique_ptr<SpillBuffer> &&spill) { m_spill = std::move(spill); }
+    /// @brief get the spill buffer
+    /// @return the spill buffer or `nullptr` if it is not enabled
+    const SpillBuffer *getSpillBuffer() const { return m_spill.get(); }
 
     /// @brief update the data item references when device model changes
+    ///
+    /// The observations are read without a lock, so they are replaced with copies that
+    /// reference the new data items instead of being changed in place. The slots are published
+    /// atomically and the checkpoints share the copies the same way they shared the originals.
+    ///
     /// @param diMap the map of data item ids to new data item entities
     void updateDataItems(std::unordered_map<std::string, WeakDataItemPtr> &diMap)
     {
-      for (auto &o : m_slidingBuffer)
+      std::lock_guard<std::recursive_mutex> lock(m_sequenceLock);
+      std::lock_guard<std::mutex> cpLock(m_checkpointLock);
+
+      observation::ObservationUpdater observations(diMap);
+      auto &ring = *m_ring;
+      for (auto &slot : ring.m_observations)
+      {
+        if (slot)
+          std::atomic_store_explicit(&slot, observations(slot), std::memory_order_release);
+      }
+
+      for (auto &slot : ring.m_compact)
       {
-        o->updateDataItem(diMap);
+        if (slot)
+        {
+          auto compact = std::make_shared<CompactObservation>(*slot);
+          compact->updateDataItem(diMap);
+          std::atomic_store_explicit(&slot, compact, std::memory_order_release);
+        }
       }
 
-      m_first.updateDataItems(diMap);
-      m_latest.updateDataItems(diMap);
+      Checkpoint::DataItemUpdate update(observations);
+      m_first.updateDataItems(update);
+      m_latest.updateDataItems(update);
 
       for (auto &cp : m_checkpoints)
       {
-        cp->updateDataItems(diMap);
+        cp->updateDataItems(update);
       }
+
+      if (m_spill)
+        m_spill->updateDataItems(observations);
     }
 
-    /// @brief Set the sequence number
+    /// @brief Restart the buffer at a sequence number
     ///
-    /// recomputes the first sequence if the sequence is larger than the circular buffer size.
+    /// The observations held in the buffer are no longer addressable and the first checkpoint
+    /// becomes the latest.
     ///
     /// @param seq the new sequence number
-    void setSequence(SequenceNumber_t seq)
+    void restart(SequenceNumber_t seq)
+    {
+      std::lock_guard<std::recursive_mutex> lock(m_sequenceLock);
+      std::lock_guard<std::mutex> cpLock(m_checkpointLock);
+
+      m_first.copy(m_latest);
+      m_checkpoints.clear();
+      if (m_indexed)
+      {
+        std::lock_guard<std::mutex> indexLock(m_indexLock);
+        m_index.clear();
+      }
+      if (m_spill)
+        m_spill->clear();
+      for (SequenceNumber_t slot = 0; slot < m_ring->m_size; slot++)
+        releaseSlot(slot);
+      {
+        std::lock_guard<std::mutex> timeLock(m_timeIndexLock);
+        m_timeIndex.clear();
+      }
+      m_firstSequence.store(seq, std::memory_order_release);
+      m_sequence.store(seq, std::memory_order_release);
+    }
+
+    /// @brief Advance the sequence number over a gap keeping the contents of the buffer
+    ///
+    /// No observations have the skipped sequence numbers. The oldest observations are evicted
+    /// when the buffer can no longer hold them with the gap, and the latest checkpoint is
+    /// taken for every skipped checkpoint sequence number so the checkpoints stay evenly spaced.
+    ///
+    /// @param seq the next sequence number, ignored if it is not after the current sequence
+    void skipTo(SequenceNumber_t seq)
     {
-      m_sequence = seq;
-      if (seq > m_slidingBufferSize)
-        m_firstSequence = seq - m_slidingBuffer.size();
+      std::lock_guard<std::recursive_mutex> lock(m_sequenceLock);
+      std::lock_guard<std::mutex> cpLock(m_checkpointLock);
+
+      auto first = m_firstSequence.load(std::memory_order_relaxed);
+      const auto next = m_sequence.load(std::memory_order_relaxed);
+      if (seq <= next)
+        return;
+
+      while (first < next && seq - first > m_ring->m_size)
+      {
+        auto oldest = first & m_ring->m_mask;
+        evict(first);
+        releaseSlot(oldest);
+      }
+
+      // If every observation has been evicted, the buffer starts after the gap
+      if (first == next)
+      {
+        first = seq;
+        m_firstSequence.store(first, std::memory_order_release);
+      }
+
+      if (m_checkpointCount > 0)
+      {
+        const SequenceNumber_t span = m_checkpointCount * m_checkpointFreq;
+        auto cp = std::max(next, seq > span ? seq - span : 0);
+        cp = ((cp + m_checkpointFreq - 1) / m_checkpointFreq) * m_checkpointFreq;
+        for (; cp < seq; cp += m_checkpointFreq)
+        {
+          if (cp > first)
+            m_checkpoints.push_back(std::make_unique<Checkpoint>(m_latest));
+        }
+      }
+
+      m_sequence.store(seq, std::memory_order_release);
     }
 
     /// @brief Add an observation to the circular buffer
@@ -120,49 +328,332 @@ namespace mtconnect::buffer {
         return 0;
 
       std::lock_guard<std::recursive_mutex> lock(m_sequenceLock);
-      auto dataItem = observation->getDataItem();
-      auto seq = m_sequence;
+      std::lock_guard<std::mutex> cpLock(m_checkpointLock);
 
-      observation->setSequence(seq);
-      m_slidingBuffer.push_back(observation);
-      m_latest.addObservation(observation);
+      auto seq = m_sequence.load(std::memory_order_relaxed);
+      insert(observation, seq);
+      m_sequence.store(seq + 1, std::memory_order_release);
 
-      // Special case for the first event in the series to prime the first checkpoint.
-      if (seq == 1)
-        m_first.addObservation(observation);
-      else if (m_slidingBuffer.full())
+      return seq;
+    }
+
+    /// @brief Add a batch of observations to the circular buffer
+    ///
+    /// The locks are taken once for the batch and the observations are assigned a contiguous
+    /// range of sequence numbers that is published when the whole batch has been added.
+    /// Orphaned observations are removed from the batch.
+    ///
+    /// @param observations the observations
+    /// @return the sequence number of the first observation or 0 if none were added
+    SequenceNumber_t addToBuffer(observation::ObservationList &observations)
+    {
+      std::lock_guard<std::recursive_mutex> lock(m_sequenceLock);
+      std::lock_guard<std::mutex> cpLock(m_checkpointLock);
+
+      const auto start = m_sequence.load(std::memory_order_relaxed);
+      auto seq = start;
+      for (auto it = observations.begin(); it != observations.end();)
       {
-        observation::ObservationPtr old = m_slidingBuffer.front();
-        m_first.addObservation(old);
-        if (old->getSequence() > 1)
-          m_firstSequence++;
-        // assert(old->getSequence() == m_firstSequence);
+        if ((*it)->isOrphan())
+        {
+          it = observations.erase(it);
+        }
+        else
+        {
+          insert(*it, seq++);
+          it++;
+        }
       }
+      m_sequence.store(seq, std::memory_order_release);
 
-      // Checkpoint management
-      if (m_checkpointCount > 0 && (seq % m_checkpointFreq) == 0)
+      return seq == start ? 0 : start;
+    }
+
+    /// @brief Resize the buffer and change the checkpoint frequency
+    ///
+    /// The observations that fit in the new size are moved to a new ring, the oldest are
+    /// evicted when the buffer shrinks. If the checkpoint frequency changes, the checkpoints
+    /// are cleared and new checkpoints are taken as observations are added;
+    /// `rebuildCheckpoints()` must be called until it returns `true` to recreate the
+    /// checkpoints for the observations already in the buffer.
+    ///
+    /// @param bufferSize the size of the circular buffer as a power of 2
+    /// @param checkpointFreq how often to create checkpoints
+    void resize(unsigned int bufferSize, int checkpointFreq)
+    {
+      std::lock_guard<std::recursive_mutex> lock(m_sequenceLock);
+      std::lock_guard<std::mutex> cpLock(m_checkpointLock);
+
+      const unsigned int size = 1 << bufferSize;
+      auto first = m_firstSequence.load(std::memory_order_relaxed);
+      const auto seq = m_sequence.load(std::memory_order_relaxed);
+
+      if (size != m_ring->m_size)
       {
-        // Copy the checkpoint from the current into the slot
-        m_checkpoints.push_back(std::make_unique<Checkpoint>(m_latest));
+        while (seq - first > size)
+          evict(first);
+
+        // Move the slots to the new ring and publish it, the slots in the old ring are left for
+        // the readers that are still using it
+        auto ring = std::make_shared<Ring>(size, m_compact);
+        size_t used = 0;
+        for (auto s = first; s < seq; s++)
+        {
+          auto from = s & m_ring->m_mask, to = s & ring->m_mask;
+          if (m_compact)
+            ring->m_compact[to] = m_ring->m_compact[from];
+          else
+            ring->m_observations[to] = m_ring->m_observations[from];
+          ring->m_sizes[to] = m_ring->m_sizes[from];
+          used += ring->m_sizes[to];
+        }
+        m_memoryUsed.store(used, std::memory_order_relaxed);
+        std::atomic_store_explicit(&m_ring, ring, std::memory_order_release);
+
+        if (m_indexed)
+        {
+          std::lock_guard<std::mutex> indexLock(m_indexLock);
+          for (auto it = m_index.begin(); it != m_index.end();)
+          {
+            auto &index = it->second;
+            index.erase(index.begin(), std::lower_bound(index.begin(), index.end(), first));
+            if (index.empty())
+              it = m_index.erase(it);
+            else
+              it++;
+          }
+        }
       }
 
-      m_sequence++;
+      if (SequenceNumber_t(checkpointFreq) != m_checkpointFreq)
+      {
+        m_checkpoints.clear();
+        m_checkpointFreq = checkpointFreq;
+      }
+      m_checkpointCount = size / m_checkpointFreq;
+      m_checkpoints.rset_capacity(m_checkpointCount);
 
-      return seq;
+      // Recreate the checkpoints older than the ones that have been kept
+      if (m_checkpointCount > 0 && !m_checkpoints.full())
+        m_rebuild = std::make_unique<CheckpointRebuild>();
+      else
+        m_rebuild.reset();
+    }
+
+    /// @brief Rebuild the checkpoints after the checkpoint frequency or buffer size changes
+    ///
+    /// Rolls a checkpoint forward from the first checkpoint over at most `limit` observations
+    /// while holding the checkpoint lock. When it reaches the oldest checkpoint taken since the
+    /// resize, the rebuilt checkpoints are added before it.
+    ///
+    /// @param limit the maximum number of observations to visit
+    /// @return `true` when there is nothing left to rebuild
+    bool rebuildCheckpoints(size_t limit)
+    {
+      std::lock_guard<std::mutex> lock(m_checkpointLock);
+      if (!m_rebuild)
+        return true;
+
+      auto &rebuild = *m_rebuild;
+      const auto first = getFirstSequence();
+      const auto seq = getSequence();
+
+      // Restart from the first checkpoint if the observations have been evicted
+      if (rebuild.m_next <= first)
+      {
+        rebuild.m_checkpoint.copy(m_first);
+        rebuild.m_next = first + 1;
+        rebuild.m_built.clear();
+      }
+
+      SequenceNumber_t stop = seq;
+      if (!m_checkpoints.empty())
+      {
+        auto newest = ((seq - 1) / m_checkpointFreq) * m_checkpointFreq;
+        stop = newest - (m_checkpoints.size() - 1) * m_checkpointFreq;
+      }
+
+      const auto &ring = *m_ring;
+      for (size_t visited = 0; visited < limit && rebuild.m_next < stop; visited++)
+      {
+        auto next = rebuild.m_next++;
+        if (auto obs = loadSlot(ring, next))
+          rebuild.m_checkpoint.addObservation(obs);
+        if (next % m_checkpointFreq == 0)
+          rebuild.m_built.push_back(std::make_unique<Checkpoint>(rebuild.m_checkpoint));
+      }
+
+      if (rebuild.m_next < stop)
+        return false;
+
+      for (auto it = rebuild.m_built.rbegin(); it != rebuild.m_built.rend() && !m_checkpoints.full();
+           it++)
+        m_checkpoints.push_front(std::move(*it));
+      m_rebuild.reset();
+
+      return true;
+    }
+
+    /// @brief A copy of the buffer contents
+    struct Snapshot
+    {
+      SequenceNumber_t m_firstSequence {0};
+      SequenceNumber_t m_sequence {0};
+      /// @brief the observations in the first checkpoint
+      observation::ObservationList m_first;
+      /// @brief the observations in the buffer in sequence order
+      observation::ObservationList m_observations;
+    };
+
+    /// @brief Copy the first checkpoint and the observations in the buffer
+    ///
+    /// The checkpoint lock is only held while the first checkpoint and the slots are copied,
+    /// compact observations are materialized after it is released.
+    ///
+    /// @return the snapshot
+    Snapshot getSnapshot() const
+    {
+      Snapshot snapshot;
+      std::vector<std::shared_ptr<CompactObservation>> compact;
+      {
+        std::lock_guard<std::mutex> lock(m_checkpointLock);
+        snapshot.m_firstSequence = getFirstSequence();
+        snapshot.m_sequence = getSequence();
+        m_first.getObservations(snapshot.m_first);
+
+        const auto &ring = *m_ring;
+        for (auto seq = snapshot.m_firstSequence; seq < snapshot.m_sequence; seq++)
+        {
+          auto slot = seq & ring.m_mask;
+          if (m_compact && ring.m_compact[slot])
+            compact.push_back(ring.m_compact[slot]);
+          else if (!m_compact && ring.m_observations[slot])
+            snapshot.m_observations.push_back(ring.m_observations[slot]);
+        }
+      }
+
+      for (const auto &c : compact)
+      {
+        if (auto obs = c->materialize())
+          snapshot.m_observations.push_back(obs);
+      }
+
+      return snapshot;
+    }
+
+    /// @brief Restart the buffer at a sequence number with the observations of the first
+    ///        checkpoint
+    ///
+    /// Used to load a snapshot, the observations in the buffer are added with `addToBuffer()`.
+    ///
+    /// @param seq the sequence number
+    /// @param checkpoint the observations in the first checkpoint
+    void restore(SequenceNumber_t seq, const observation::ObservationList &checkpoint)
+    {
+      std::lock_guard<std::recursive_mutex> lock(m_sequenceLock);
+      restart(seq);
+
+      std::lock_guard<std::mutex> cpLock(m_checkpointLock);
+      m_first.clear();
+      m_latest.clear();
+
+      // The active conditions are listed from the most recent
+      for (auto it = checkpoint.rbegin(); it != checkpoint.rend(); it++)
+      {
+        m_first.addObservation(*it);
+        m_latest.addObservation(*it);
+      }
     }
 
     /// @name Checkpoint methods
     ///@{
 
     /// @brief Get the checkpoint at the end of the circular buffer
+    /// @note the caller must hold the buffer lock since the writer modifies the checkpoint
     /// @return reference to the checkpoint
     const Checkpoint &getLatest() const { return m_latest; }
     /// @brief Get the checkpoint at the beginning of the circular buffer
+    /// @note the caller must hold the buffer lock since the writer modifies the checkpoint
     /// @return reference to the checkpoint
     const Checkpoint &getFirst() const { return m_first; }
     auto getCheckpointFreq() const { return m_checkpointFreq; }
     auto getCheckpointCount() const { return m_checkpointCount; }
 
+    /// @brief Get the observations from the latest checkpoint without taking the buffer lock
+    /// @param[out] list the list to add the observations to
+    /// @param[in] filterSet an optional filter for the observations
+    /// @param[out] firstSeq the first sequence number in the buffer
+    /// @return the next sequence number consistent with the observations
+    SequenceNumber_t getLatestObservations(observation::ObservationList &list,
+                                           const FilterSetOpt &filterSet,
+                                           SequenceNumber_t &firstSeq) const
+    {
+      std::lock_guard<std::mutex> lock(m_checkpointLock);
+      m_latest.getObservations(list, filterSet);
+      firstSeq = getFirstSequence();
+      return getSequence();
+    }
+
+    /// @brief Get the latest observations of the data items that changed since a sequence number
+    ///
+    /// The buffer is scanned from `since` without a lock to find the changed data items, then
+    /// their observations are taken from the latest checkpoint. If `since` is no longer in the
+    /// buffer, the observations of all data items are returned.
+    ///
+    /// @param[out] list the list to add the observations to
+    /// @param[in] filterSet an optional filter for the observations
+    /// @param[in] since the first sequence number to check for changes
+    /// @param[out] firstSeq the first sequence number in the buffer
+    /// @return the next sequence number to check for changes
+    SequenceNumber_t getChangedObservations(observation::ObservationList &list,
+                                            const FilterSetOpt &filterSet, SequenceNumber_t since,
+                                            SequenceNumber_t &firstSeq) const
+    {
+      const auto seq = getSequence();
+      const auto r = ring();
+      const auto &ring = *r;
+      const FilterSet *filter = filterSet ? &*filterSet : nullptr;
+
+      std::vector<size_t> indexes;
+      bool evicted = since < getFirstSequence();
+      for (auto s = since; !evicted && s < seq; s++)
+      {
+        std::optional<size_t> index;
+        if (m_compact)
+        {
+          auto compact = std::atomic_load_explicit(&ring.m_compact[s & ring.m_mask],
+                                                   std::memory_order_acquire);
+          if (!compact || compact->getSequence() != s)
+            evicted = true;
+          else
+            index = compact->getDataItemIndex();
+        }
+        else
+        {
+          auto obs = std::atomic_load_explicit(&ring.m_observations[s & ring.m_mask],
+                                               std::memory_order_acquire);
+          if (!obs || obs->getSequence() != s)
+            evicted = true;
+          else if (auto di = obs->getDataItem())
+            index = di->getIndex();
+        }
+
+        if (index && (!filter || filter->contains(*index)))
+          indexes.push_back(*index);
+      }
+
+      if (evicted)
+        return getLatestObservations(list, filterSet, firstSeq);
+
+      std::sort(indexes.begin(), indexes.end());
+      indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+      std::lock_guard<std::mutex> lock(m_checkpointLock);
+      m_latest.getObservations(list, indexes);
+      firstSeq = getFirstSequence();
+      return seq;
+    }
+
     /// @brief Check if observation is a duplicate by validating against the latest checkpoint
     /// @param[in] obs the observation to check
     /// @return `true` if the observation is a duplicate
@@ -175,49 +666,51 @@ namespace mtconnect::buffer {
     /// @brief Get a checkpoint at a sequence number
     /// @param at the sequence number to get the checkpoint at
     /// @param filterSet the filter to apply to the new checkpoint
-    /// @return a unique point to a new checkpoint
+    /// @return a unique point to a new checkpoint or `nullptr` if `at` is no longer in the buffer
     std::unique_ptr<Checkpoint> getCheckpointAt(SequenceNumber_t at,
                                                 const FilterSetOpt &filterSet) const
     {
-      std::lock_guard<std::recursive_mutex> lock(m_sequenceLock);
+      std::lock_guard<std::mutex> lock(m_checkpointLock);
+      auto firstSequence = getFirstSequence();
+      if (at < firstSequence || at >= getSequence())
+        return nullptr;
+      const auto &ring = *m_ring;
 
-      // Compute the closest checkpoint. If the checkpoint is after the
-      // first checkpoint and before the next incremental checkpoint,
+      // Compute the closest checkpoint at or before `at`. Checkpoints are taken every
+      // checkpoint frequency observations with the newest at or before the last observation.
+      // If the checkpoint is before the first sequence or has already been dropped,
       // use first.
-      auto fi = (m_firstSequence / m_checkpointFreq);
-      auto in = (at / m_checkpointFreq);
-      int dt = int(in - fi) - 1;
+      auto cps = (at / m_checkpointFreq) * m_checkpointFreq;
+      auto newest = ((getSequence() - 1) / m_checkpointFreq) * m_checkpointFreq;
+      auto back = (newest - cps) / m_checkpointFreq;
 
       std::unique_ptr<Checkpoint> check;
-      decltype(m_slidingBuffer.cbegin()) iter;
-      decltype(m_slidingBuffer.cend()) end;
+      SequenceNumber_t from;
 
-      if (dt < 0)
+      if (cps <= firstSequence || back >= m_checkpoints.size())
       {
         check = std::make_unique<Checkpoint>(m_first, filterSet);
-        if (at == m_firstSequence)
+        if (at == firstSequence)
           return check;
 
-        iter = m_slidingBuffer.cbegin();
-        end = iter + (at - m_firstSequence) + 1;
+        from = firstSequence + 1;
       }
       else
       {
-        check = std::make_unique<Checkpoint>(*m_checkpoints[dt], filterSet);
-
-        auto cps = in * m_checkpointFreq;
+        check = std::make_unique<Checkpoint>(*m_checkpoints[m_checkpoints.size() - 1 - back],
+                                             filterSet);
         if (at == cps)
           return check;
 
-        auto ind = cps - m_firstSequence;
-        iter = m_slidingBuffer.cbegin() + ind;
-        end = iter + (at - cps) + 1;
+        from = cps + 1;
       }
 
-      // Roll forward from the checkpoint.
-      while (iter != end)
+      // Roll forward from the checkpoint. The writer cannot advance while the checkpoint
+      // lock is held, so all slots up to `at` are present.
+      for (auto seq = from; seq <= at; seq++)
       {
-        check->addObservation(*iter++);
+        if (auto obs = loadSlot(ring, seq))
+          check->addObservation(obs);
       }
 
       return check;
@@ -225,6 +718,13 @@ namespace mtconnect::buffer {
     ///@}
 
     /// @brief Get a list of observations from the circular buffer
+    ///
+    /// This method does not lock the buffer. The first and next sequence numbers are
+    /// read once and any slot overwritten by the writer during the scan is skipped.
+    ///
+    /// If a spill buffer is attached, the part of the range before the first sequence
+    /// number is read from the spill buffer.
+    ///
     /// @param[in] count maximum number of observations to get
     /// @param[in] filterSet optional filter set of data item ids
     /// @param[in] start optional starting sequence
@@ -240,19 +740,38 @@ namespace mtconnect::buffer {
     {
       auto results = std::make_unique<observation::ObservationList>();
 
-      std::lock_guard<std::recursive_mutex> lock(m_sequenceLock);
-      firstSeq = m_firstSequence;
+      auto firstSequence = getFirstSequence();
+      const auto sequence = getSequence();
+      // Load the ring after the sequence so it holds all the observations before `sequence`
+      const auto ring = this->ring();
+      firstSeq = firstSequence;
       int limit, inc;
 
+      // Read forward from the spill buffer up to the first sequence in the ring
+      const auto spilled = m_spill ? m_spill->getFirstSequence() : 0;
+      if (spilled > 0 && count > 0 && !to && start && *start < firstSequence)
+      {
+        auto next = m_spill->getObservations(*results, std::max(*start, spilled), firstSequence,
+                                             filterSet, count, 1);
+        if (results->size() == size_t(count))
+        {
+          end = next;
+          firstSeq = spilled;
+          endOfBuffer = false;
+          return results;
+        }
+        count -= int(results->size());
+      }
+
       SequenceNumber_t first;
-      size_t max = m_slidingBuffer.size();
+      size_t max = sequence - firstSequence;
 
       // Determine where to start and direction of iteration.
       if (count >= 0)
       {
         if (to)
         {
-          if (start && *start > m_firstSequence)
+          if (start && *start > firstSequence)
             firstSeq = *start;
           first = *to;
           inc = -1;
@@ -266,21 +785,27 @@ namespace mtconnect::buffer {
       }
       else
       {
-        first = (start && *start < m_sequence) ? *start : m_sequence - 1;
+        first = (start && *start < sequence) ? *start : sequence - 1;
         limit = -count;
         inc = -1;
       }
 
-      size_t min = firstSeq - m_firstSequence;
-      size_t i = first - m_firstSequence;
-      for (int added = 0; added < limit && i < max && i >= min; i += inc)
+      size_t min = firstSeq - firstSequence;
+      size_t i = first - firstSequence;
+      if (filterSet && m_indexed)
+      {
+        if (limit > 0 && i < max && i >= min)
+          i = getIndexedObservations(*ring, *results, *filterSet, limit, inc, first, firstSeq,
+                                     sequence) -
+              firstSequence;
+      }
+      else
       {
-        // Filter out according to if it exists in the list
-        auto &event = m_slidingBuffer[i];
-        if (!event->isOrphan())
+        for (int added = 0; added < limit && i < max && i >= min; i += inc)
         {
-          const std::string &dataId = event->getDataItem()->getId();
-          if (!filterSet || filterSet->count(dataId) > 0)
+          // Filter out according to if it exists in the list
+          auto event = loadSlot(*ring, firstSequence + i, filterSet ? &*filterSet : nullptr);
+          if (event && !event->isOrphan())
           {
             results->push_back(event);
             added++;
@@ -289,19 +814,34 @@ namespace mtconnect::buffer {
       }
 
       if (to)
-        end = first < m_sequence ? first + 1 : m_sequence;
+        end = first < sequence ? first + 1 : sequence;
       else
-        end = m_firstSequence + i;
+        end = firstSequence + i;
 
       if (count >= 0)
-        endOfBuffer = i + m_firstSequence >= m_sequence;
+        endOfBuffer = i + firstSequence >= sequence;
       else
-        endOfBuffer = i + m_firstSequence <= m_firstSequence;
+        endOfBuffer = i + firstSequence <= firstSequence;
+
+      // Continue backward into the spill buffer when the ring did not fill the request
+      if (spilled > 0 && inc < 0 && results->size() < size_t(limit) && spilled < firstSequence)
+      {
+        auto lower = (to && start) ? std::max(*start, spilled) : spilled;
+        auto upper = std::min(first + 1, firstSequence);
+        if (lower < upper)
+          m_spill->getObservations(*results, lower, upper, filterSet,
+                                   limit - int(results->size()), -1);
+      }
+
+      if (spilled > 0 && firstSeq == firstSequence)
+        firstSeq = std::min(spilled, firstSequence);
 
       return results;
     }
 
     /// @name Mutex lock  management
+    ///
+    /// The buffer lock serializes writers. Readers do not need to hold it.
     ///@{
 
     /// @brief lock the mutex
@@ -312,17 +852,421 @@ namespace mtconnect::buffer {
     auto try_lock() { return m_sequenceLock.try_lock(); }
     ///@}
 
+    /// @brief Get the number of sequence numbers held in the index for a data item
+    /// @param id the data item id, looked up in the default index registry
+    /// @return the number of indexed sequence numbers
+    size_t getIndexedCount(const std::string &id) const
+    {
+      auto index = DataItemIndexes::Default().find(id);
+      if (!index)
+        return 0;
+
+      std::lock_guard<std::mutex> lock(m_indexLock);
+      auto it = m_index.find(*index);
+      return it == m_index.end() ? 0 : it->second.size();
+    }
+
   protected:
-    // Access control to the buffer
+    using SequenceIndex = std::deque<SequenceNumber_t>;
+    using TimeIndexEntry = std::pair<Timestamp, SequenceNumber_t>;
+
+    /// @brief The slots of the buffer indexed by the sequence number masked by the size
+    struct Ring
+    {
+      Ring(unsigned int size, bool compact)
+        : m_size(size),
+          m_mask(size - 1),
+          m_observations(compact ? 0 : size),
+          m_compact(compact ? size : 0),
+          m_sizes(size, 0)
+      {}
+
+      unsigned int m_size;
+      SequenceNumber_t m_mask;
+      std::vector<observation::ObservationPtr> m_observations;
+      std::vector<std::shared_ptr<CompactObservation>> m_compact;
+      // Estimated memory of the observation in each slot
+      std::vector<uint32_t> m_sizes;
+    };
+
+    /// @brief The state of a checkpoint rebuild
+    struct CheckpointRebuild
+    {
+      Checkpoint m_checkpoint;
+      SequenceNumber_t m_next {0};
+      std::vector<std::unique_ptr<Checkpoint>> m_built;
+    };
+
+    /// @brief atomically load the current ring for a reader
+    /// @return the ring
+    std::shared_ptr<const Ring> ring() const
+    {
+      return std::atomic_load_explicit(&m_ring, std::memory_order_acquire);
+    }
+
+    /// @brief get the start of the time index bucket for a time
+    /// @param time the time
+    /// @return the bucket start
+    static Timestamp timeBucket(const Timestamp &time)
+    {
+      return time - (time.time_since_epoch() % TimeIndexResolution);
+    }
+
+    /// @brief add an observation at a sequence number
+    ///
+    /// The caller must hold the buffer and checkpoint locks and publish the new
+    /// sequence number when done.
+    ///
+    /// @param observation the observation
+    /// @param seq the sequence number for the observation
+    void insert(observation::ObservationPtr &observation, SequenceNumber_t seq)
+    {
+      auto first = m_firstSequence.load(std::memory_order_relaxed);
+
+      observation->setSequence(seq);
+      m_latest.addObservation(observation);
+
+      // Special case for the first event in the series to prime the first checkpoint.
+      if (seq == first)
+        m_first.addObservation(observation);
+      else if (seq - first >= m_ring->m_size)
+      {
+        // The slot for this sequence holds the oldest observation. Evict it before it is
+        // overwritten so readers never see a stale range.
+        evict(first);
+      }
+
+      // Checkpoint management
+      if (m_checkpointCount > 0 && (seq % m_checkpointFreq) == 0 && seq > first)
+      {
+        // Copy the checkpoint from the current into the slot
+        m_checkpoints.push_back(std::make_unique<Checkpoint>(m_latest));
+      }
+
+      if (m_indexed)
+        indexObservation(observation, seq, first);
+
+      // Publish the observation, the caller publishes the new sequence number
+      auto &ring = *m_ring;
+      auto slot = seq & ring.m_mask;
+      size_t size;
+      if (m_compact)
+      {
+        auto compact = std::make_shared<CompactObservation>(observation);
+        size = compact->getMemorySize();
+        std::atomic_store_explicit(&ring.m_compact[slot], compact, std::memory_order_release);
+      }
+      else
+      {
+        size = memory::ObservationSize(*observation);
+        std::atomic_store_explicit(&ring.m_observations[slot], observation,
+                                   std::memory_order_release);
+      }
+      m_memoryUsed.store(m_memoryUsed.load(std::memory_order_relaxed) - ring.m_sizes[slot] + size,
+                         std::memory_order_relaxed);
+      ring.m_sizes[slot] = uint32_t(size);
+
+      // Evict the oldest observations until the buffer is within the memory limit. The
+      // observation just added is always kept.
+      while (m_memoryLimit > 0 && m_memoryUsed.load(std::memory_order_relaxed) > m_memoryLimit &&
+             first < seq)
+      {
+        auto oldest = first & ring.m_mask;
+        evict(first);
+        releaseSlot(oldest);
+      }
+
+      indexTime(observation->getTimestamp(), seq);
+    }
+
+    /// @brief add the observation timestamp to the time index
+    ///
+    /// The observations are indexed by the running maximum of their timestamps, so the index
+    /// stays ordered when a timestamp goes backward. A new entry is added when an observation
+    /// falls in a later bucket than the last entry. Entries for observations that are no longer
+    /// available are removed from the front.
+    ///
+    /// @param time the timestamp of the observation
+    /// @param seq the sequence number of the observation
+    void indexTime(const Timestamp &time, SequenceNumber_t seq)
+    {
+      auto bucket = timeBucket(time);
+      auto earliest = getEarliestSequence();
+
+      std::lock_guard<std::mutex> lock(m_timeIndexLock);
+      if (m_timeIndex.empty() || m_timeIndex.back().first < bucket)
+        m_timeIndex.emplace_back(bucket, seq);
+
+      while (m_timeIndex.size() > 1 && m_timeIndex[1].second <= earliest)
+        m_timeIndex.pop_front();
+    }
+
+    /// @brief evict the oldest observation from the buffer
+    ///
+    /// The observation is written to the spill buffer and the first sequence number is moved
+    /// past it. The caller must hold the buffer and checkpoint locks.
+    ///
+    /// @param[in,out] first the first sequence number, incremented
+    void evict(SequenceNumber_t &first)
+    {
+      if (m_spill)
+      {
+        if (auto evicted = loadSlot(*m_ring, first))
+          m_spill->spill(evicted);
+      }
+      first++;
+      m_firstSequence.store(first, std::memory_order_release);
+      if (auto old = loadSlot(*m_ring, first))
+        m_first.addObservation(old);
+    }
+
+    /// @brief free the observation in a slot that is no longer in the buffer
+    /// @param slot the slot index
+    void releaseSlot(SequenceNumber_t slot)
+    {
+      auto &ring = *m_ring;
+      if (m_compact)
+        std::atomic_store_explicit(&ring.m_compact[slot], std::shared_ptr<CompactObservation>(),
+                                   std::memory_order_release);
+      else
+        std::atomic_store_explicit(&ring.m_observations[slot], observation::ObservationPtr(),
+                                   std::memory_order_release);
+      m_memoryUsed.store(m_memoryUsed.load(std::memory_order_relaxed) - ring.m_sizes[slot],
+                         std::memory_order_relaxed);
+      ring.m_sizes[slot] = 0;
+    }
+
+    /// @brief add the sequence number of an observation to the index
+    ///
+    /// Called by the writer. Once every time the buffer wraps, sequence numbers that have
+    /// fallen out of the buffer are removed from all data items.
+    ///
+    /// @param observation the observation
+    /// @param seq the sequence number of the observation
+    /// @param first the first sequence number in the buffer
+    void indexObservation(const observation::ObservationPtr &observation, SequenceNumber_t seq,
+                          SequenceNumber_t first)
+    {
+      auto di = observation->getDataItem();
+      std::lock_guard<std::mutex> lock(m_indexLock);
+      if (di)
+        m_index[di->getIndex()].push_back(seq);
+
+      if ((seq & m_ring->m_mask) == 0)
+      {
+        for (auto it = m_index.begin(); it != m_index.end();)
+        {
+          auto &index = it->second;
+          index.erase(index.begin(), std::lower_bound(index.begin(), index.end(), first));
+          if (index.empty())
+            it = m_index.erase(it);
+          else
+            it++;
+        }
+      }
+    }
+
+    /// @brief merge the index of the filtered data items in sequence order
+    /// @tparam Iter the index iterator type
+    /// @tparam Compare heap ordering, `std::greater` for ascending sequences
+    /// @param ranges the ranges of sequence numbers for each data item
+    /// @param count the maximum number of sequence numbers to merge
+    /// @param[out] sequences the merged sequence numbers
+    /// @return `true` if there are sequence numbers left in the ranges
+    template <typename Iter, typename Compare>
+    static bool mergeIndex(std::vector<std::pair<Iter, Iter>> &ranges, size_t count,
+                           std::vector<SequenceNumber_t> &sequences)
+    {
+      auto order = [](const std::pair<Iter, Iter> &a, const std::pair<Iter, Iter> &b) {
+        return Compare()(*a.first, *b.first);
+      };
+      std::make_heap(ranges.begin(), ranges.end(), order);
+
+      while (sequences.size() < count && !ranges.empty())
+      {
+        std::pop_heap(ranges.begin(), ranges.end(), order);
+        auto &range = ranges.back();
+        sequences.push_back(*range.first);
+        if (++range.first == range.second)
+          ranges.pop_back();
+        else
+          std::push_heap(ranges.begin(), ranges.end(), order);
+      }
+
+      return !ranges.empty();
+    }
+
+    /// @brief get the next sequence numbers of the filtered data items from the index
+    ///
+    /// Only the sequence numbers are merged while the index lock is held, the observations are
+    /// loaded by the caller after it is released.
+    ///
+    /// @param filterSet the data item filter
+    /// @param count the maximum number of sequence numbers
+    /// @param inc `1` to go forward from `first`, `-1` to go backward
+    /// @param first the sequence number to start at
+    /// @param lower the lowest sequence number to consider
+    /// @param sequence the next sequence number of the buffer
+    /// @param[out] sequences the sequence numbers in the direction of travel
+    /// @return `true` if there are more sequence numbers after the last one
+    bool getIndexedSequences(const FilterSet &filterSet, size_t count, int inc,
+                             SequenceNumber_t first, SequenceNumber_t lower,
+                             SequenceNumber_t sequence,
+                             std::vector<SequenceNumber_t> &sequences) const
+    {
+      std::lock_guard<std::mutex> lock(m_indexLock);
+      if (inc > 0)
+      {
+        std::vector<std::pair<SequenceIndex::const_iterator, SequenceIndex::const_iterator>> ranges;
+        for (size_t di = 0; di < filterSet.indexLimit(); di++)
+        {
+          if (!filterSet.contains(di))
+            continue;
+          auto it = m_index.find(di);
+          if (it != m_index.end())
+          {
+            auto &index = it->second;
+            auto from = std::lower_bound(index.begin(), index.end(), first);
+            auto to = std::lower_bound(from, index.end(), sequence);
+            if (from != to)
+              ranges.emplace_back(from, to);
+          }
+        }
+
+        return mergeIndex<SequenceIndex::const_iterator, std::greater<SequenceNumber_t>>(
+            ranges, count, sequences);
+      }
+      else
+      {
+        std::vector<std::pair<SequenceIndex::const_reverse_iterator,
+                              SequenceIndex::const_reverse_iterator>>
+            ranges;
+        for (size_t di = 0; di < filterSet.indexLimit(); di++)
+        {
+          if (!filterSet.contains(di))
+            continue;
+          auto it = m_index.find(di);
+          if (it != m_index.end())
+          {
+            auto &index = it->second;
+            auto from = std::upper_bound(index.begin(), index.end(), first);
+            auto to = std::lower_bound(index.begin(), from, lower);
+            if (from != to)
+              ranges.emplace_back(SequenceIndex::const_reverse_iterator(from),
+                                  SequenceIndex::const_reverse_iterator(to));
+          }
+        }
+
+        return mergeIndex<SequenceIndex::const_reverse_iterator, std::less<SequenceNumber_t>>(
+            ranges, count, sequences);
+      }
+    }
+
+    /// @brief get the observations for a filter set using the data item index
+    ///
+    /// The sequence numbers are taken from the index in batches of at most the remaining limit
+    /// and the observations are loaded without holding the index lock. Another batch is taken
+    /// if observations were evicted or orphaned.
+    ///
+    /// @param ring the ring to read the observations from
+    /// @param results the list to add the observations to
+    /// @param filterSet the data item filter
+    /// @param limit the maximum number of observations
+    /// @param inc `1` to go forward from `first`, `-1` to go backward
+    /// @param first the sequence number to start at
+    /// @param lower the lowest sequence number to consider
+    /// @param sequence the next sequence number of the buffer
+    /// @return the sequence number following the last one visited in the direction of travel
+    SequenceNumber_t getIndexedObservations(const Ring &ring, observation::ObservationList &results,
+                                            const FilterSet &filterSet, int limit, int inc,
+                                            SequenceNumber_t first, SequenceNumber_t lower,
+                                            SequenceNumber_t sequence) const
+    {
+      SequenceNumber_t last = 0;
+      int added = 0;
+      bool more = true;
+      std::vector<SequenceNumber_t> sequences;
+      while (added < limit && more)
+      {
+        sequences.clear();
+        more = getIndexedSequences(filterSet, size_t(limit - added), inc, first, lower, sequence,
+                                   sequences);
+        if (sequences.empty())
+          break;
+
+        for (auto seq : sequences)
+        {
+          auto event = loadSlot(ring, seq);
+          if (event && !event->isOrphan())
+          {
+            results.push_back(event);
+            last = seq;
+            added++;
+          }
+        }
+        first = inc > 0 ? sequences.back() + 1 : sequences.back() - 1;
+      }
+
+      if (added == limit)
+        return inc > 0 ? last + 1 : last - 1;
+      else
+        return inc > 0 ? sequence : lower - 1;
+    }
+
+    /// @brief atomically load the observation in the slot for a sequence number
+    ///
+    /// A compact observation is only materialized if it passes the filter.
+    ///
+    /// @param ring the ring holding the slot
+    /// @param seq the sequence number
+    /// @param filterSet optional filter of data items
+    /// @return the observation or `nullptr` if the slot has been reused for another sequence
+    ///         or the observation does not pass the filter
+    observation::ObservationPtr loadSlot(const Ring &ring, SequenceNumber_t seq,
+                                         const FilterSet *filterSet = nullptr) const
+    {
+      if (m_compact)
+      {
+        auto compact = std::atomic_load_explicit(&ring.m_compact[seq & ring.m_mask],
+                                                 std::memory_order_acquire);
+        if (compact && compact->getSequence() == seq &&
+            (!filterSet || filterSet->contains(compact->getDataItemIndex())))
+          return compact->materialize();
+        else
+          return nullptr;
+      }
+
+      auto obs = std::atomic_load_explicit(&ring.m_observations[seq & ring.m_mask],
+                                           std::memory_order_acquire);
+      if (!obs || obs->getSequence() != seq)
+        return nullptr;
+      if (filterSet)
+      {
+        auto di = obs->getDataItem();
+        if (!di || !filterSet->contains(di->getIndex()))
+          return nullptr;
+      }
+      return obs;
+    }
+
+  protected:
+    // Serializes the writers
     mutable std::recursive_mutex m_sequenceLock;
+    // Access control to the checkpoints
+    mutable std::mutex m_checkpointLock;
 
     // Sequence number
-    SequenceNumber_t m_sequence;
-    SequenceNumber_t m_firstSequence;
+    std::atomic<SequenceNumber_t> m_sequence;
+    std::atomic<SequenceNumber_t> m_firstSequence;
 
-    // The sliding/circular buffer to hold all of the events/sample data
-    unsigned int m_slidingBufferSize;
-    boost::circular_buffer<observation::ObservationPtr> m_slidingBuffer;
+    // The sliding/circular buffer to hold all of the events/sample data. Only replaced while
+    // both locks are held, readers load it atomically.
+    std::shared_ptr<Ring> m_ring;
+    bool m_compact;
+
+    // Estimated memory of the observations in the buffer
+    std::atomic<size_t> m_memoryUsed {0};
+    size_t m_memoryLimit {0};
 
     // Checkpoints
     SequenceNumber_t m_checkpointFreq;
@@ -331,5 +1275,18 @@ namespace mtconnect::buffer {
     Checkpoint m_latest;
     Checkpoint m_first;
     boost::circular_buffer<std::unique_ptr<Checkpoint>> m_checkpoints;
+    std::unique_ptr<CheckpointRebuild> m_rebuild;
+
+    // Evicted observations
+    std::unique_ptr<SpillBuffer> m_spill;
+
+    // Sequence numbers of the observations in the buffer for each data item
+    bool m_indexed;
+    mutable std::mutex m_indexLock;
+    std::unordered_map<size_t, SequenceIndex> m_index;
+
+    // First sequence number in each time bucket
+    mutable std::mutex m_timeIndexLock;
+    std::deque<TimeIndexEntry> m_timeIndex;
   };
 }  // namespace mtconnect::buffer
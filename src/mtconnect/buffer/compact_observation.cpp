@@ -0,0 +1,147 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "compact_observation.hpp"
+
+#include "memory_size.hpp"
+#include "mtconnect/device_model/data_item/data_item.hpp"
+#include "mtconnect/logging.hpp"
+
+using namespace std;
+
+namespace mtconnect {
+  using namespace observation;
+  using namespace entity;
+
+  namespace buffer {
+    CompactObservation::CompactObservation(const ObservationPtr &observation)
+      : m_dataItem(observation->getDataItem()),
+        m_sequence(observation->getSequence()),
+        m_timestamp(observation->getTimestamp()),
+        m_unavailable(observation->isUnavailable())
+    {
+      auto di = observation->getDataItem();
+      m_index = uint32_t(di->getIndex());
+      if (di->isCondition())
+      {
+        if (auto cond = dynamic_pointer_cast<Condition>(observation))
+          m_level = int8_t(cond->getLevel());
+      }
+
+      const auto &diProps = di->getObservationProperties();
+      for (const auto &[key, value] : observation->getProperties())
+      {
+        if (key == "VALUE")
+        {
+          if (!m_unavailable)
+            m_value = value;
+        }
+        else if (key != "timestamp" && key != "sequence" && diProps.count(key) == 0)
+        {
+          if (!m_attributes)
+            m_attributes = make_unique<Properties>();
+          m_attributes->emplace(key, value);
+        }
+      }
+    }
+
+    CompactObservation::CompactObservation(const CompactObservation &other)
+      : m_dataItem(other.m_dataItem),
+        m_sequence(other.m_sequence),
+        m_timestamp(other.m_timestamp),
+        m_value(other.m_value),
+        m_index(other.m_index),
+        m_level(other.m_level),
+        m_unavailable(other.m_unavailable)
+    {
+      if (other.m_attributes)
+        m_attributes = make_unique<Properties>(*other.m_attributes);
+    }
+
+    ObservationPtr CompactObservation::materialize() const
+    {
+      auto di = m_dataItem.lock();
+      if (!di)
+        return nullptr;
+
+      Properties props;
+      if (m_attributes)
+        props = *m_attributes;
+
+      if (di->isCondition())
+      {
+        switch (m_level)
+        {
+          case Condition::NORMAL:
+            props.insert_or_assign("level", "NORMAL"s);
+            break;
+
+          case Condition::WARNING:
+            props.insert_or_assign("level", "WARNING"s);
+            break;
+
+          case Condition::FAULT:
+            props.insert_or_assign("level", "FAULT"s);
+            break;
+
+          default:
+            break;
+        }
+        if (!m_unavailable && m_value.index() != EMPTY)
+          props.insert_or_assign("VALUE", m_value);
+      }
+      else if (m_unavailable)
+        props.insert_or_assign("VALUE", "UNAVAILABLE"s);
+      else if (m_value.index() != EMPTY)
+        props.insert_or_assign("VALUE", m_value);
+
+      try
+      {
+        ErrorList errors;
+        auto obs = Observation::make(di, props, m_timestamp, errors);
+        obs->setSequence(m_sequence);
+        return obs;
+      }
+      catch (EntityError &e)
+      {
+        LOG(warning) << "Cannot materialize observation " << m_sequence << " for "
+                     << di->getId() << ": " << e.what();
+        return nullptr;
+      }
+    }
+
+    size_t CompactObservation::getMemorySize() const
+    {
+      size_t size =
+          sizeof(CompactObservation) + memory::SharedOverhead + memory::DynamicSize(m_value);
+      if (m_attributes)
+        size += sizeof(Properties) + memory::DynamicSize(*m_attributes);
+      return size;
+    }
+
+    void CompactObservation::updateDataItem(unordered_map<string, WeakDataItemPtr> &diMap)
+    {
+      auto old = m_dataItem.lock();
+      if (!old)
+        return;
+
+      auto ndi = diMap.find(old->getId());
+      if (ndi != diMap.end())
+        m_dataItem = ndi->second;
+    }
+  }  // namespace buffer
+}  // namespace mtconnect
@@ -0,0 +1,74 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "mtconnect/config.hpp"
+#include "mtconnect/entity/entity.hpp"
+#include "mtconnect/observation/observation.hpp"
+#include "mtconnect/utilities.hpp"
+
+namespace mtconnect::buffer {
+  /// @brief Compact representation of an observation held in the circular buffer
+  ///
+  /// Only the data item, sequence number, timestamp and value are kept. The properties copied
+  /// from the data item are not stored and the remaining attributes, such as a condition's
+  /// `nativeCode`, are kept in a separate block that is only allocated when present. The
+  /// observation entity is recreated by `materialize()` when the observation is read.
+  class AGENT_LIB_API CompactObservation
+  {
+  public:
+    /// @brief Create a compact observation from an observation entity
+    /// @param[in] observation the observation with its sequence number assigned
+    CompactObservation(const observation::ObservationPtr &observation);
+    /// @brief Copy a compact observation and its attributes
+    /// @param[in] other the compact observation to copy
+    CompactObservation(const CompactObservation &other);
+
+    /// @brief Create an observation entity with the same properties
+    /// @return the observation or `nullptr` if the data item no longer exists
+    observation::ObservationPtr materialize() const;
+
+    /// @brief get the sequence number
+    /// @return the sequence number
+    auto getSequence() const { return m_sequence; }
+    /// @brief get the dense index of the data item
+    /// @return the index
+    auto getDataItemIndex() const { return m_index; }
+    /// @brief get the estimated memory held by the compact observation
+    /// @return the size in bytes
+    size_t getMemorySize() const;
+
+    /// @brief update related data item when the device is updated
+    /// @param[in] diMap a map of data item ids to data items
+    void updateDataItem(std::unordered_map<std::string, WeakDataItemPtr> &diMap);
+
+  protected:
+    WeakDataItemPtr m_dataItem;
+    uint64_t m_sequence;
+    Timestamp m_timestamp;
+    entity::Value m_value;
+    std::unique_ptr<entity::Properties> m_attributes;
+    uint32_t m_index;
+    int8_t m_level {-1};
+    bool m_unavailable {false};
+  };
+}  // namespace mtconnect::buffer
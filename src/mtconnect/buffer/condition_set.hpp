@@ -0,0 +1,103 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "mtconnect/config.hpp"
+#include "mtconnect/observation/observation.hpp"
+
+namespace mtconnect::buffer {
+  /// @brief The active conditions of a condition data item keyed by native code
+  ///
+  /// The conditions are kept in activation order with an index by native code, so activating,
+  /// replacing, and clearing a condition are constant time. A condition that is activated again
+  /// with the same code moves to the most recent position.
+  class AGENT_LIB_API ConditionSet
+  {
+  public:
+    ConditionSet() = default;
+    /// @brief copy the conditions and rebuild the code index
+    /// @param[in] other the condition set to copy
+    ConditionSet(const ConditionSet &other) : m_conditions(other.m_conditions)
+    {
+      for (auto it = m_conditions.begin(); it != m_conditions.end(); it++)
+        m_codes.emplace((*it)->getCode(), it);
+    }
+    ConditionSet &operator=(const ConditionSet &) = delete;
+
+    /// @brief find an active condition by native code
+    /// @param[in] code the native code
+    /// @return the condition or `nullptr` if there is no active condition with the code
+    observation::ConditionPtr find(const std::string &code) const
+    {
+      auto it = m_codes.find(code);
+      return it == m_codes.end() ? nullptr : *it->second;
+    }
+
+    /// @brief activate a condition replacing an active condition with the same code
+    /// @param[in] condition the condition
+    void activate(const observation::ConditionPtr &condition)
+    {
+      remove(condition->getCode());
+      m_conditions.push_front(condition);
+      m_codes.emplace(condition->getCode(), m_conditions.begin());
+    }
+
+    /// @brief remove an active condition by code
+    /// @param[in] code the native code
+    /// @return `true` if the condition was active
+    bool remove(const std::string &code)
+    {
+      auto it = m_codes.find(code);
+      if (it == m_codes.end())
+        return false;
+
+      m_conditions.erase(it->second);
+      m_codes.erase(it);
+      return true;
+    }
+
+    /// @brief get the most recently activated condition
+    /// @return the condition or `nullptr` if the set is empty
+    observation::ConditionPtr newest() const
+    {
+      return m_conditions.empty() ? nullptr : m_conditions.front();
+    }
+
+    /// @brief get the conditions from the most recently activated to the oldest
+    /// @return the list of conditions
+    const std::list<observation::ConditionPtr> &getConditions() const { return m_conditions; }
+
+    /// @brief get the number of active conditions
+    /// @return the number of conditions
+    size_t size() const { return m_conditions.size(); }
+    /// @brief is the set empty
+    /// @return `true` if there are no active conditions
+    bool empty() const { return m_conditions.empty(); }
+
+  protected:
+    std::list<observation::ConditionPtr> m_conditions;
+    std::unordered_map<std::string, std::list<observation::ConditionPtr>::iterator> m_codes;
+  };
+
+  using ConditionSetPtr = std::shared_ptr<ConditionSet>;
+}  // namespace mtconnect::buffer
@@ -0,0 +1,592 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "durable_buffer.hpp"
+
+#include <boost/crc.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "mtconnect/device_model/data_item/data_item.hpp"
+#include "mtconnect/logging.hpp"
+
+using namespace std;
+namespace ip = boost::interprocess;
+namespace fs = std::filesystem;
+
+namespace mtconnect {
+  using namespace observation;
+  using namespace entity;
+
+  namespace buffer {
+    namespace {
+      const char SegmentMagic[8] = {'M', 'T', 'C', 'S', 'E', 'G', '0', '1'};
+      const char *SegmentPrefix = "observations-";
+      const char *SegmentExtension = ".seg";
+
+      struct SegmentHeader
+      {
+        char m_magic[8];
+        uint64_t m_instanceId;
+        uint64_t m_first;
+        uint64_t m_reserved;
+      };
+
+      // Record length and CRC
+      const size_t RecordHeaderSize = 2 * sizeof(uint32_t);
+
+      template <typename T>
+      inline void put(string &buffer, T value)
+      {
+        buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+      }
+
+      inline void putString(string &buffer, const string &s)
+      {
+        put<uint32_t>(buffer, uint32_t(s.size()));
+        buffer.append(s);
+      }
+
+      inline int64_t toMicros(const Timestamp &ts)
+      {
+        return chrono::duration_cast<chrono::microseconds>(ts.time_since_epoch()).count();
+      }
+
+      void putDataSet(string &buffer, const DataSet &set)
+      {
+        put<uint32_t>(buffer, uint32_t(set.size()));
+        for (const auto &entry : set)
+        {
+          putString(buffer, entry.m_key);
+          put<uint8_t>(buffer, entry.m_removed);
+          visit(overloaded {[&](const monostate &) { put<uint8_t>(buffer, EMPTY); },
+                            [&](const DataSet &v) {
+                              put<uint8_t>(buffer, DATA_SET);
+                              putDataSet(buffer, v);
+                            },
+                            [&](const string &v) {
+                              put<uint8_t>(buffer, STRING);
+                              putString(buffer, v);
+                            },
+                            [&](const int64_t &v) {
+                              put<uint8_t>(buffer, INTEGER);
+                              put<int64_t>(buffer, v);
+                            },
+                            [&](const double &v) {
+                              put<uint8_t>(buffer, DOUBLE);
+                              put<double>(buffer, v);
+                            }},
+                entry.m_value);
+        }
+      }
+
+      // Returns false if the value cannot be stored in an observation record
+      bool putValue(string &buffer, const Value &value)
+      {
+        return visit(overloaded {[&](const string &v) {
+                                   put<uint8_t>(buffer, STRING);
+                                   putString(buffer, v);
+                                   return true;
+                                 },
+                                 [&](const int64_t &v) {
+                                   put<uint8_t>(buffer, INTEGER);
+                                   put<int64_t>(buffer, v);
+                                   return true;
+                                 },
+                                 [&](const double &v) {
+                                   put<uint8_t>(buffer, DOUBLE);
+                                   put<double>(buffer, v);
+                                   return true;
+                                 },
+                                 [&](const bool &v) {
+                                   put<uint8_t>(buffer, BOOL);
+                                   put<uint8_t>(buffer, v);
+                                   return true;
+                                 },
+                                 [&](const Vector &v) {
+                                   put<uint8_t>(buffer, VECTOR);
+                                   put<uint32_t>(buffer, uint32_t(v.size()));
+                                   for (auto d : v)
+                                     put<double>(buffer, d);
+                                   return true;
+                                 },
+                                 [&](const DataSet &v) {
+                                   put<uint8_t>(buffer, DATA_SET);
+                                   putDataSet(buffer, v);
+                                   return true;
+                                 },
+                                 [&](const Timestamp &v) {
+                                   put<uint8_t>(buffer, TIMESTAMP);
+                                   put<int64_t>(buffer, toMicros(v));
+                                   return true;
+                                 },
+                                 [](const auto &) { return false; }},
+                     value);
+      }
+
+      /// Bounds checked reader for encoded observations
+      struct Reader
+      {
+        Reader(const char *data, size_t length) : m_data(data), m_length(length) {}
+
+        template <typename T>
+        T get()
+        {
+          T value {};
+          if (m_pos + sizeof(T) > m_length)
+          {
+            m_ok = false;
+            return value;
+          }
+          memcpy(&value, m_data + m_pos, sizeof(T));
+          m_pos += sizeof(T);
+          return value;
+        }
+
+        string getString()
+        {
+          auto len = get<uint32_t>();
+          if (!m_ok || m_pos + len > m_length)
+          {
+            m_ok = false;
+            return "";
+          }
+          string s(m_data + m_pos, len);
+          m_pos += len;
+          return s;
+        }
+
+        bool getDataSet(DataSet &set, int depth = 0)
+        {
+          auto count = get<uint32_t>();
+          for (uint32_t i = 0; m_ok && i < count; i++)
+          {
+            auto key = getString();
+            bool removed = get<uint8_t>() != 0;
+            DataSetValue value;
+            switch (get<uint8_t>())
+            {
+              case EMPTY:
+                break;
+
+              case DATA_SET:
+              {
+                // Tables only nest one level
+                DataSet row;
+                if (depth > 0 || !getDataSet(row, depth + 1))
+                  return m_ok = false;
+                value = row;
+                break;
+              }
+
+              case STRING:
+                value = getString();
+                break;
+
+              case INTEGER:
+                value = get<int64_t>();
+                break;
+
+              case DOUBLE:
+                value = get<double>();
+                break;
+
+              default:
+                return m_ok = false;
+            }
+            if (m_ok)
+              set.emplace(key, value, removed);
+          }
+          return m_ok;
+        }
+
+        bool getValue(Value &value)
+        {
+          switch (get<uint8_t>())
+          {
+            case STRING:
+              value = getString();
+              break;
+
+            case INTEGER:
+              value = get<int64_t>();
+              break;
+
+            case DOUBLE:
+              value = get<double>();
+              break;
+
+            case BOOL:
+              value = get<uint8_t>() != 0;
+              break;
+
+            case VECTOR:
+            {
+              Vector v;
+              auto count = get<uint32_t>();
+              for (uint32_t i = 0; m_ok && i < count; i++)
+                v.push_back(get<double>());
+              value = v;
+              break;
+            }
+
+            case DATA_SET:
+            {
+              DataSet set;
+              getDataSet(set);
+              value = set;
+              break;
+            }
+
+            case TIMESTAMP:
+              value = Timestamp(chrono::microseconds(get<int64_t>()));
+              break;
+
+            default:
+              m_ok = false;
+          }
+          return m_ok;
+        }
+
+        const char *m_data;
+        size_t m_length;
+        size_t m_pos {0};
+        bool m_ok {true};
+      };
+
+      string segmentName(SequenceNumber_t first)
+      {
+        stringstream name;
+        name << SegmentPrefix << setw(20) << setfill('0') << first << SegmentExtension;
+        return name.str();
+      }
+    }  // namespace
+
+    DurableBuffer::DurableBuffer(const fs::path &directory, size_t segmentSize,
+                                 unsigned int bufferSize)
+      : m_directory(directory),
+        m_segmentSize(std::max(segmentSize, sizeof(SegmentHeader) + 1024)),
+        m_bufferSize(bufferSize)
+    {}
+
+    DurableBuffer::~DurableBuffer() { flush(); }
+
+    void DurableBuffer::encode(string &buffer, const ObservationPtr &observation)
+    {
+      auto di = observation->getDataItem();
+      const auto &diProps = di->getObservationProperties();
+
+      buffer.clear();
+      put<uint64_t>(buffer, observation->getSequence());
+      put<int64_t>(buffer, toMicros(observation->getTimestamp()));
+      putString(buffer, di->getId());
+
+      // Conditions keep their level in the entity name
+      string level;
+      if (auto cond = dynamic_pointer_cast<Condition>(observation))
+      {
+        switch (cond->getLevel())
+        {
+          case Condition::NORMAL:
+            level = "NORMAL";
+            break;
+
+          case Condition::WARNING:
+            level = "WARNING";
+            break;
+
+          case Condition::FAULT:
+            level = "FAULT";
+            break;
+
+          case Condition::UNAVAILABLE:
+            break;
+        }
+      }
+
+      // Reserve the property count and patch it when the properties have been written
+      auto countPos = buffer.size();
+      put<uint16_t>(buffer, 0);
+      uint16_t count = 0;
+
+      if (!level.empty())
+      {
+        putString(buffer, "level");
+        putValue(buffer, level);
+        count++;
+      }
+
+      for (const auto &[key, value] : observation->getProperties())
+      {
+        if (key == "timestamp" || key == "sequence" || diProps.count(key) > 0)
+          continue;
+
+        auto pos = buffer.size();
+        putString(buffer, key);
+        if (putValue(buffer, value))
+          count++;
+        else
+          buffer.resize(pos);
+      }
+
+      memcpy(buffer.data() + countPos, &count, sizeof(count));
+    }
+
+    bool DurableBuffer::decode(const char *data, size_t length, ObservationRecord &record)
+    {
+      Reader reader(data, length);
+      record.m_sequence = reader.get<uint64_t>();
+      record.m_timestamp = Timestamp(chrono::microseconds(reader.get<int64_t>()));
+      record.m_dataItemId = reader.getString();
+      record.m_properties.clear();
+
+      auto count = reader.get<uint16_t>();
+      for (uint16_t i = 0; reader.m_ok && i < count; i++)
+      {
+        auto key = reader.getString();
+        Value value;
+        if (reader.getValue(value))
+          record.m_properties.insert_or_assign(key, value);
+      }
+
+      return reader.m_ok && reader.m_pos == length;
+    }
+
+    uint64_t DurableBuffer::recover(RecoverFunction recover)
+    {
+      NAMED_SCOPE("DurableBuffer::recover");
+
+      m_segments.clear();
+      m_region.reset();
+
+      fs::create_directories(m_directory);
+      for (const auto &entry : fs::directory_iterator(m_directory))
+      {
+        auto name = entry.path().filename().string();
+        if (entry.is_regular_file() && name.rfind(SegmentPrefix, 0) == 0 &&
+            entry.path().extension() == SegmentExtension)
+        {
+          try
+          {
+            auto first = stoull(name.substr(strlen(SegmentPrefix)));
+            m_segments.push_back({entry.path(), first, 0});
+          }
+          catch (logic_error &)
+          {
+            LOG(warning) << "Ignoring durable buffer file: " << entry.path();
+          }
+        }
+      }
+      sort(m_segments.begin(), m_segments.end(),
+           [](const Segment &a, const Segment &b) { return a.m_first < b.m_first; });
+
+      // A segment without a valid header, such as one torn by a crash while it was created, is
+      // removed. The instance id comes from the last valid header and appending continues in the
+      // last valid segment.
+      size_t offset = 0;
+      for (auto it = m_segments.begin(); it != m_segments.end();)
+      {
+        if (auto end = scanSegment(*it, recover))
+        {
+          offset = *end;
+          it++;
+        }
+        else
+        {
+          LOG(warning) << "Removing invalid durable buffer segment: " << it->m_path;
+          error_code ec;
+          fs::remove(it->m_path, ec);
+          it = m_segments.erase(it);
+        }
+      }
+
+      if (!m_segments.empty())
+      {
+        openSegment(m_segments.back(), offset);
+        removeOldSegments();
+        LOG(info) << "Recovered durable buffer with instance id " << m_instanceId << " from "
+                  << m_segments.size() << " segments";
+      }
+      else
+      {
+        m_instanceId = getCurrentTimeInSec();
+        LOG(info) << "Starting durable buffer in " << m_directory << " with instance id "
+                  << m_instanceId;
+      }
+
+      return m_instanceId;
+    }
+
+    optional<size_t> DurableBuffer::scanSegment(Segment &segment, RecoverFunction &recover)
+    {
+      try
+      {
+        ip::file_mapping file(segment.m_path.string().c_str(), ip::read_only);
+        ip::mapped_region region(file, ip::read_only);
+        auto base = static_cast<const char *>(region.get_address());
+        auto size = region.get_size();
+
+        SegmentHeader header;
+        if (size < sizeof(header))
+          return nullopt;
+        memcpy(&header, base, sizeof(header));
+        if (memcmp(header.m_magic, SegmentMagic, sizeof(SegmentMagic)) != 0)
+        {
+          return nullopt;
+        }
+        m_instanceId = header.m_instanceId;
+
+        size_t offset = sizeof(header);
+        ObservationRecord record;
+        while (offset + RecordHeaderSize <= size)
+        {
+          uint32_t length, crc;
+          memcpy(&length, base + offset, sizeof(length));
+          memcpy(&crc, base + offset + sizeof(length), sizeof(crc));
+          if (length == 0 || offset + RecordHeaderSize + length > size)
+            break;
+
+          auto data = base + offset + RecordHeaderSize;
+          boost::crc_32_type check;
+          check.process_bytes(data, length);
+          if (check.checksum() != crc || !decode(data, length, record))
+          {
+            LOG(warning) << "Durable buffer segment " << segment.m_path
+                         << " has an invalid record at " << offset;
+            break;
+          }
+
+          recover(record);
+          segment.m_count++;
+          offset += RecordHeaderSize + length;
+        }
+
+        return offset;
+      }
+      catch (ip::interprocess_exception &e)
+      {
+        LOG(error) << "Cannot read durable buffer segment " << segment.m_path << ": " << e.what();
+        return nullopt;
+      }
+    }
+
+    void DurableBuffer::openSegment(Segment &segment, size_t offset)
+    {
+      ip::file_mapping file(segment.m_path.string().c_str(), ip::read_write);
+      m_region = make_unique<ip::mapped_region>(file, ip::read_write);
+      m_offset = offset;
+
+      // Clear anything left after the last valid record
+      auto base = static_cast<char *>(m_region->get_address());
+      memset(base + m_offset, 0, m_region->get_size() - m_offset);
+    }
+
+    void DurableBuffer::createSegment(SequenceNumber_t first)
+    {
+      flush();
+      m_region.reset();
+
+      Segment segment {m_directory / segmentName(first), first, 0};
+      {
+        ofstream out(segment.m_path, ios::binary | ios::trunc);
+      }
+      fs::resize_file(segment.m_path, m_segmentSize);
+
+      ip::file_mapping file(segment.m_path.string().c_str(), ip::read_write);
+      m_region = make_unique<ip::mapped_region>(file, ip::read_write);
+
+      SegmentHeader header {};
+      memcpy(header.m_magic, SegmentMagic, sizeof(SegmentMagic));
+      header.m_instanceId = m_instanceId;
+      header.m_first = first;
+      memcpy(m_region->get_address(), &header, sizeof(header));
+      m_offset = sizeof(header);
+
+      m_segments.push_back(segment);
+      removeOldSegments();
+    }
+
+    void DurableBuffer::removeOldSegments()
+    {
+      // Keep the oldest segment until the newer segments hold a full buffer
+      size_t newer = 0;
+      for (auto it = m_segments.begin() + 1; it < m_segments.end(); it++)
+        newer += it->m_count;
+
+      while (m_segments.size() > 1 && newer >= m_bufferSize)
+      {
+        error_code ec;
+        fs::remove(m_segments.front().m_path, ec);
+        m_segments.pop_front();
+        newer -= m_segments.front().m_count;
+      }
+    }
+
+    void DurableBuffer::append(const ObservationPtr &observation)
+    {
+      if (observation->isOrphan())
+        return;
+
+      encode(m_scratch, observation);
+      auto needed = RecordHeaderSize + m_scratch.size();
+      if (sizeof(SegmentHeader) + needed > m_segmentSize)
+      {
+        LOG(error) << "Observation " << observation->getSequence()
+                   << " is too large for the durable buffer segment size";
+        return;
+      }
+
+      try
+      {
+        if (!m_region || m_offset + needed > m_region->get_size())
+          createSegment(observation->getSequence());
+      }
+      catch (std::exception &e)
+      {
+        LOG(error) << "Cannot create durable buffer segment: " << e.what();
+        m_region.reset();
+        return;
+      }
+
+      boost::crc_32_type check;
+      check.process_bytes(m_scratch.data(), m_scratch.size());
+      uint32_t length = uint32_t(m_scratch.size()), crc = check.checksum();
+
+      // Write the length last so a partial record is never recovered
+      auto base = static_cast<char *>(m_region->get_address()) + m_offset;
+      memcpy(base + RecordHeaderSize, m_scratch.data(), m_scratch.size());
+      memcpy(base + sizeof(length), &crc, sizeof(crc));
+      atomic_thread_fence(memory_order_release);
+      memcpy(base, &length, sizeof(length));
+
+      m_offset += needed;
+      m_segments.back().m_count++;
+    }
+
+    void DurableBuffer::flush()
+    {
+      if (m_region)
+        m_region->flush(0, m_offset);
+    }
+  }  // namespace buffer
+}  // namespace mtconnect
@@ -0,0 +1,132 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "mtconnect/config.hpp"
+#include "mtconnect/entity/entity.hpp"
+#include "mtconnect/observation/observation.hpp"
+#include "mtconnect/utilities.hpp"
+
+namespace mtconnect::buffer {
+  /// @brief An observation read back from the durable buffer
+  struct ObservationRecord
+  {
+    SequenceNumber_t m_sequence {0};
+    Timestamp m_timestamp;
+    std::string m_dataItemId;
+    /// @brief the observation properties excluding the properties copied from the data item
+    entity::Properties m_properties;
+  };
+
+  /// @brief Memory mapped, append-only backing store for the circular buffer
+  ///
+  /// Every observation added to the circular buffer is appended to the current segment file
+  /// in a compact binary encoding. Segments are fixed size files named by the first sequence
+  /// number they contain and are rotated when full. Old segments are removed once the newer
+  /// segments hold at least a full buffer of observations.
+  ///
+  /// Each segment starts with a header containing the agent instance id. A record is a 32 bit
+  /// length, a 32 bit CRC and the encoded observation. The length is written last so a record
+  /// torn by a crash is ignored when the segments are recovered. Values are stored in the host
+  /// byte order; the files are not portable between architectures.
+  class AGENT_LIB_API DurableBuffer
+  {
+  public:
+    using RecoverFunction = std::function<void(ObservationRecord &)>;
+
+    /// @brief Create a durable buffer
+    /// @param[in] directory the directory for the segment files
+    /// @param[in] segmentSize the size of each segment file in bytes
+    /// @param[in] bufferSize the number of observations the circular buffer holds
+    DurableBuffer(const std::filesystem::path &directory, size_t segmentSize,
+                  unsigned int bufferSize);
+    ~DurableBuffer();
+
+    /// @brief Read back all the observations in the segment files
+    ///
+    /// Must be called once before observations are appended. The current segment is reopened
+    /// so new observations are appended after the last valid record. Segments without a valid
+    /// header are removed.
+    ///
+    /// @param[in] recover called for every observation in sequence order
+    /// @return the instance id from the segments or a new instance id if there are none
+    uint64_t recover(RecoverFunction recover);
+
+    /// @brief Append an observation to the current segment
+    /// @param[in] observation the observation with its sequence number assigned
+    void append(const observation::ObservationPtr &observation);
+
+    /// @brief Flush the current segment to disk
+    void flush();
+
+    /// @brief get the instance id stored in the segments
+    /// @return the instance id
+    uint64_t getInstanceId() const { return m_instanceId; }
+    /// @brief get the number of segment files
+    /// @return the number of segments
+    size_t getSegmentCount() const { return m_segments.size(); }
+    /// @brief set the number of observations the circular buffer holds
+    /// @param[in] bufferSize the buffer size
+    void setBufferSize(unsigned int bufferSize) { m_bufferSize = bufferSize; }
+
+    /// @brief Encode an observation
+    /// @param[out] buffer the buffer to write the encoded observation to
+    /// @param[in] observation the observation
+    static void encode(std::string &buffer, const observation::ObservationPtr &observation);
+    /// @brief Decode an observation
+    /// @param[in] data the encoded observation
+    /// @param[in] length the length of the encoded observation
+    /// @param[out] record the observation record
+    /// @return `true` if the observation was decoded
+    static bool decode(const char *data, size_t length, ObservationRecord &record);
+
+  protected:
+    struct Segment
+    {
+      std::filesystem::path m_path;
+      SequenceNumber_t m_first;
+      size_t m_count;
+    };
+
+    std::optional<size_t> scanSegment(Segment &segment, RecoverFunction &recover);
+    void openSegment(Segment &segment, size_t offset);
+    void createSegment(SequenceNumber_t first);
+    void removeOldSegments();
+
+  protected:
+    std::filesystem::path m_directory;
+    size_t m_segmentSize;
+    unsigned int m_bufferSize;
+    uint64_t m_instanceId {0};
+
+    std::deque<Segment> m_segments;
+    std::unique_ptr<boost::interprocess::mapped_region> m_region;
+    size_t m_offset {0};
+    std::string m_scratch;
+  };
+}  // namespace mtconnect::buffer
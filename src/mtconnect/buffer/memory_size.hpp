@@ -0,0 +1,124 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <string>
+
+#include "mtconnect/config.hpp"
+#include "mtconnect/entity/data_set.hpp"
+#include "mtconnect/entity/entity.hpp"
+#include "mtconnect/observation/observation.hpp"
+
+/// @brief Estimates of the heap memory held by observations in the buffer
+///
+/// The estimates count the allocated objects, the node overhead of the standard containers
+/// and the string capacity beyond the small string buffer. They are used to account for the
+/// memory of the circular buffer and are not exact.
+namespace mtconnect::buffer::memory {
+  /// @brief overhead of a node in a tree or list container
+  constexpr size_t NodeOverhead = 4 * sizeof(void *);
+  /// @brief overhead of the control block of a shared pointer created by `make_shared`
+  constexpr size_t SharedOverhead = 2 * sizeof(void *);
+
+  /// @brief heap memory of a string
+  /// @param[in] s the string
+  /// @return the allocated capacity or 0 if the string fits in the small string buffer
+  inline size_t DynamicSize(const std::string &s)
+  {
+    static const size_t small = std::string().capacity();
+    return s.capacity() > small ? s.capacity() + 1 : 0;
+  }
+
+  inline size_t DynamicSize(const entity::Value &value);
+
+  /// @brief heap memory of a data set value
+  /// @param[in] value the data set value
+  /// @return the estimated size in bytes
+  inline size_t DynamicSize(const entity::DataSetValue &value);
+
+  /// @brief heap memory of a data set or table
+  /// @param[in] set the data set
+  /// @return the estimated size in bytes
+  inline size_t DynamicSize(const entity::DataSet &set)
+  {
+    size_t size = 0;
+    for (const auto &entry : set)
+      size += NodeOverhead + sizeof(entity::DataSetEntry) + DynamicSize(entry.m_key) +
+              DynamicSize(entry.m_value);
+    return size;
+  }
+
+  inline size_t DynamicSize(const entity::DataSetValue &value)
+  {
+    if (auto s = std::get_if<std::string>(&value))
+      return DynamicSize(*s);
+    else if (auto set = std::get_if<entity::DataSet>(&value))
+      return DynamicSize(*set);
+    return 0;
+  }
+
+  /// @brief heap memory of a property map
+  /// @param[in] properties the properties
+  /// @return the estimated size in bytes
+  inline size_t DynamicSize(const entity::Properties &properties)
+  {
+    size_t size = 0;
+    for (const auto &[key, value] : properties)
+      size += NodeOverhead + sizeof(entity::Properties::value_type) + DynamicSize(key) +
+              DynamicSize(value);
+    return size;
+  }
+
+  /// @brief heap memory of an entity value
+  ///
+  /// Entities referenced by the value are shared with the device model and are not counted.
+  ///
+  /// @param[in] value the value
+  /// @return the estimated size in bytes
+  inline size_t DynamicSize(const entity::Value &value)
+  {
+    using namespace entity;
+    switch (value.index())
+    {
+      case STRING:
+        return DynamicSize(std::get<std::string>(value));
+
+      case VECTOR:
+        return std::get<Vector>(value).capacity() * sizeof(double);
+
+      case DATA_SET:
+        return DynamicSize(std::get<DataSet>(value));
+
+      case ENTITY_LIST:
+        return std::get<EntityList>(value).size() * (NodeOverhead + sizeof(EntityPtr));
+
+      default:
+        return 0;
+    }
+  }
+
+  /// @brief memory of an observation and its properties
+  /// @param[in] observation the observation
+  /// @return the estimated size in bytes
+  inline size_t ObservationSize(const observation::Observation &observation)
+  {
+    // The observation classes only differ by a few scalar members
+    return sizeof(observation::Condition) + SharedOverhead +
+           DynamicSize(observation.getProperties());
+  }
+}  // namespace mtconnect::buffer::memory
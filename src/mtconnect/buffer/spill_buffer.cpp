@@ -0,0 +1,443 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "spill_buffer.hpp"
+
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include "durable_buffer.hpp"
+#include "mtconnect/device_model/data_item/data_item.hpp"
+#include "mtconnect/logging.hpp"
+
+using namespace std;
+namespace fs = std::filesystem;
+namespace io = boost::iostreams;
+
+namespace mtconnect {
+  using namespace observation;
+
+  namespace buffer {
+    namespace {
+      const char *SpillPrefix = "spill-";
+      const char *SpillExtension = ".z";
+
+      string spillName(SequenceNumber_t first)
+      {
+        stringstream name;
+        name << SpillPrefix << setw(20) << setfill('0') << first << SpillExtension;
+        return name.str();
+      }
+    }  // namespace
+
+    SpillBuffer::SpillBuffer(const fs::path &directory, size_t maxSize, chrono::seconds maxAge,
+                             size_t segmentObservations)
+      : m_directory(directory),
+        m_maxSize(maxSize),
+        m_maxAge(maxAge),
+        m_segmentObservations(std::max(segmentObservations, size_t(1)))
+    {
+      fs::create_directories(m_directory);
+
+      // The spilled observations belong to the previous run of the agent
+      for (const auto &entry : fs::directory_iterator(m_directory))
+      {
+        auto name = entry.path().filename().string();
+        if (entry.is_regular_file() && name.rfind(SpillPrefix, 0) == 0 &&
+            entry.path().extension() == SpillExtension)
+        {
+          error_code ec;
+          fs::remove(entry.path(), ec);
+        }
+      }
+
+      m_pending.reserve(m_segmentObservations);
+      m_writer = std::thread([this]() { run(); });
+    }
+
+    SpillBuffer::~SpillBuffer()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+      }
+      m_queueChanged.notify_all();
+      m_writer.join();
+      clear();
+    }
+
+    void SpillBuffer::spill(const ObservationPtr &observation)
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      auto di = observation->getDataItem();
+      if (m_dataItems.count(di->getId()) == 0)
+        m_dataItems.emplace(di->getId(), di);
+
+      m_pending.push_back(observation);
+      if (m_pending.size() == 1 && m_segments.empty() && m_queued.empty())
+        updateFirstSequence();
+
+      if (m_pending.size() >= m_segmentObservations)
+      {
+        m_queued.push_back(make_shared<const ObservationVector>(std::move(m_pending)));
+        m_pending = ObservationVector();
+        m_pending.reserve(m_segmentObservations);
+        m_queueChanged.notify_all();
+      }
+    }
+
+    void SpillBuffer::flush() const
+    {
+      std::unique_lock<std::mutex> lock(m_lock);
+      m_queueChanged.wait(lock, [this]() { return m_queued.empty(); });
+    }
+
+    void SpillBuffer::run()
+    {
+      std::unique_lock<std::mutex> lock(m_lock);
+      while (true)
+      {
+        m_queueChanged.wait(lock, [this]() { return m_stop || !m_queued.empty(); });
+        if (m_stop)
+          break;
+
+        // The queued segment stays readable until it has been written
+        auto observations = m_queued.front();
+        auto generation = m_generation;
+        lock.unlock();
+        auto segment = writeSegment(*observations);
+        lock.lock();
+
+        if (generation != m_generation)
+        {
+          if (segment)
+          {
+            error_code ec;
+            fs::remove(segment->m_path, ec);
+          }
+          continue;
+        }
+
+        m_queued.pop_front();
+        if (segment)
+        {
+          m_segments.push_back(*segment);
+          m_size += segment->m_size;
+          removeSegments();
+        }
+        updateFirstSequence();
+        m_queueChanged.notify_all();
+      }
+    }
+
+    optional<SpillBuffer::Segment> SpillBuffer::writeSegment(const ObservationVector &observations)
+    {
+      NAMED_SCOPE("SpillBuffer::writeSegment");
+
+      Segment segment {m_directory / spillName(observations.front()->getSequence()),
+                       observations.front()->getSequence(), observations.back()->getSequence(), 0,
+                       chrono::system_clock::now()};
+
+      try
+      {
+        io::filtering_ostream output;
+        output.push(io::zlib_compressor(io::zlib_params(io::zlib::best_speed)));
+        output.push(io::file_sink(segment.m_path.string(), ios_base::out | ios_base::binary));
+
+        string record;
+        for (const auto &obs : observations)
+        {
+          DurableBuffer::encode(record, obs);
+          uint32_t length = uint32_t(record.size());
+          output.write(reinterpret_cast<const char *>(&length), sizeof(length));
+          output.write(record.data(), record.size());
+        }
+        output.reset();
+
+        segment.m_size = fs::file_size(segment.m_path);
+      }
+      catch (std::exception &e)
+      {
+        LOG(error) << "Cannot write spill segment " << segment.m_path << ": " << e.what();
+        error_code ec;
+        fs::remove(segment.m_path, ec);
+        return nullopt;
+      }
+
+      return segment;
+    }
+
+    void SpillBuffer::removeSegments()
+    {
+      auto now = chrono::system_clock::now();
+      while (!m_segments.empty() &&
+             ((m_maxSize > 0 && m_size > m_maxSize) ||
+              (m_maxAge.count() > 0 && now - m_segments.front().m_created > m_maxAge)))
+      {
+        auto &segment = m_segments.front();
+        error_code ec;
+        fs::remove(segment.m_path, ec);
+        if (m_cached && m_cachedFirst == segment.m_first)
+          m_cached.reset();
+        m_size -= segment.m_size;
+        m_segments.pop_front();
+      }
+    }
+
+    void SpillBuffer::updateFirstSequence()
+    {
+      SequenceNumber_t first = 0;
+      if (!m_segments.empty())
+        first = m_segments.front().m_first;
+      else if (!m_queued.empty())
+        first = m_queued.front()->front()->getSequence();
+      else if (!m_pending.empty())
+        first = m_pending.front()->getSequence();
+      m_firstSequence.store(first, std::memory_order_release);
+    }
+
+    shared_ptr<const SpillBuffer::ObservationVector> SpillBuffer::readSegment(
+        const Segment &segment)
+    {
+      NAMED_SCOPE("SpillBuffer::readSegment");
+
+      {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_cached && m_cachedFirst == segment.m_first)
+          return m_cached;
+      }
+
+      vector<ObservationRecord> records;
+      try
+      {
+        string data;
+        io::filtering_istream input;
+        input.push(io::zlib_decompressor());
+        input.push(io::file_source(segment.m_path.string(), ios_base::in | ios_base::binary));
+        io::copy(input, io::back_inserter(data));
+
+        records.reserve(segment.m_last - segment.m_first + 1);
+        size_t offset = 0;
+        while (offset + sizeof(uint32_t) <= data.size())
+        {
+          uint32_t length;
+          memcpy(&length, data.data() + offset, sizeof(length));
+          offset += sizeof(length);
+          if (offset + length > data.size())
+            break;
+
+          auto &record = records.emplace_back();
+          if (!DurableBuffer::decode(data.data() + offset, length, record))
+            records.pop_back();
+          offset += length;
+        }
+      }
+      catch (std::exception &e)
+      {
+        // The segment may have been removed by the retention policy
+        LOG(debug) << "Cannot read spill segment " << segment.m_path << ": " << e.what();
+        return nullptr;
+      }
+
+      vector<DataItemPtr> dataItems(records.size());
+      {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (size_t i = 0; i < records.size(); i++)
+        {
+          auto it = m_dataItems.find(records[i].m_dataItemId);
+          if (it != m_dataItems.end())
+            dataItems[i] = it->second.lock();
+        }
+      }
+
+      auto observations = make_shared<ObservationVector>();
+      observations->reserve(records.size());
+      for (size_t i = 0; i < records.size(); i++)
+      {
+        if (!dataItems[i])
+          continue;
+
+        try
+        {
+          entity::ErrorList errors;
+          auto obs = Observation::make(dataItems[i], records[i].m_properties,
+                                       records[i].m_timestamp, errors);
+          obs->setSequence(records[i].m_sequence);
+          observations->push_back(obs);
+        }
+        catch (entity::EntityError &e)
+        {
+          LOG(warning) << "Cannot restore spilled observation " << records[i].m_sequence << ": "
+                       << e.what();
+        }
+      }
+
+      std::lock_guard<std::mutex> lock(m_lock);
+      m_cached = observations;
+      m_cachedFirst = segment.m_first;
+      return observations;
+    }
+
+    SequenceNumber_t SpillBuffer::getObservations(ObservationList &results, SequenceNumber_t from,
+                                                  SequenceNumber_t to,
+                                                  const FilterSetOpt &filterSet, int limit,
+                                                  int inc)
+    {
+      if (from >= to || limit <= 0)
+        return inc > 0 ? to : from - 1;
+
+      // Take a consistent view of the segments and the pending observations and read
+      // them without holding the lock.
+      vector<Segment> segments;
+      vector<shared_ptr<const ObservationVector>> queued;
+      ObservationVector pending;
+      {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (const auto &segment : m_segments)
+        {
+          if (segment.m_last >= from && segment.m_first < to)
+            segments.push_back(segment);
+        }
+        for (const auto &observations : m_queued)
+        {
+          if (observations->back()->getSequence() >= from &&
+              observations->front()->getSequence() < to)
+            queued.push_back(observations);
+        }
+        if (!m_pending.empty() && m_pending.front()->getSequence() < to)
+          pending = m_pending;
+      }
+
+      int added = 0;
+      SequenceNumber_t last = 0;
+      auto visit = [&](const ObservationPtr &obs) {
+        auto seq = obs->getSequence();
+        if (seq < from || seq >= to)
+          return false;
+        if (!filterSet || filterSet->contains(obs->getDataItem()->getIndex()))
+        {
+          results.push_back(obs);
+          last = seq;
+          added++;
+        }
+        return added == limit;
+      };
+
+      if (inc > 0)
+      {
+        for (const auto &segment : segments)
+        {
+          if (auto observations = readSegment(segment))
+          {
+            for (const auto &obs : *observations)
+              if (visit(obs))
+                return last + 1;
+          }
+        }
+        for (const auto &observations : queued)
+        {
+          for (const auto &obs : *observations)
+            if (visit(obs))
+              return last + 1;
+        }
+        for (const auto &obs : pending)
+          if (visit(obs))
+            return last + 1;
+
+        return to;
+      }
+      else
+      {
+        for (auto it = pending.rbegin(); it != pending.rend(); it++)
+          if (visit(*it))
+            return last - 1;
+
+        for (auto observations = queued.rbegin(); observations != queued.rend(); observations++)
+        {
+          for (auto it = (*observations)->rbegin(); it != (*observations)->rend(); it++)
+            if (visit(*it))
+              return last - 1;
+        }
+
+        for (auto segment = segments.rbegin(); segment != segments.rend(); segment++)
+        {
+          if (auto observations = readSegment(*segment))
+          {
+            for (auto it = observations->rbegin(); it != observations->rend(); it++)
+              if (visit(*it))
+                return last - 1;
+          }
+        }
+
+        return from - 1;
+      }
+    }
+
+    void SpillBuffer::clear()
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      for (const auto &segment : m_segments)
+      {
+        error_code ec;
+        fs::remove(segment.m_path, ec);
+      }
+      m_segments.clear();
+      m_pending.clear();
+      m_queued.clear();
+      m_generation++;
+      m_cached.reset();
+      m_size = 0;
+      m_firstSequence.store(0, std::memory_order_release);
+      m_queueChanged.notify_all();
+    }
+
+    void SpillBuffer::updateDataItems(ObservationUpdater &observations)
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      for (auto &obs : m_pending)
+        obs = observations(obs);
+
+      // The background thread may be writing a queued segment, so the segments are replaced
+      for (auto &queued : m_queued)
+      {
+        auto copy = make_shared<ObservationVector>();
+        copy->reserve(queued->size());
+        for (const auto &obs : *queued)
+          copy->push_back(observations(obs));
+        queued = copy;
+      }
+
+      auto &diMap = observations.getDataItems();
+      for (auto &[id, di] : m_dataItems)
+      {
+        auto it = diMap.find(id);
+        if (it != diMap.end())
+          di = it->second;
+      }
+
+      // The cached observations reference the old data items
+      m_cached.reset();
+    }
+  }  // namespace buffer
+}  // namespace mtconnect
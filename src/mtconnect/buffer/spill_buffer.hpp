@@ -0,0 +1,163 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "checkpoint.hpp"
+#include "mtconnect/config.hpp"
+#include "mtconnect/observation/observation.hpp"
+#include "mtconnect/utilities.hpp"
+
+namespace mtconnect::buffer {
+  using SequenceNumber_t = uint64_t;
+
+  /// @brief Second tier of the circular buffer holding evicted observations on disk
+  ///
+  /// Observations that fall out of the circular buffer are collected in memory and written
+  /// to a zlib compressed segment file once a segment is full. The full segments are queued
+  /// and written by a background thread, so the buffer writer never waits for compression or
+  /// the disk. Queued segments are read from memory until they are written. Segments are indexed
+  /// by their first and last sequence numbers so a request for an older range only decompresses
+  /// the segments that overlap it. The most recently decoded segment is kept for the next
+  /// request.
+  ///
+  /// Segments are removed, oldest first, when the total size or the age of a segment exceeds
+  /// the retention limits. The segments do not survive a restart of the agent.
+  class AGENT_LIB_API SpillBuffer
+  {
+  public:
+    /// @brief Create a spill buffer
+    /// @param[in] directory the directory for the segment files. Existing segments are removed.
+    /// @param[in] maxSize the maximum total size of the segment files in bytes, 0 is unlimited
+    /// @param[in] maxAge the maximum age of a segment, 0 is unlimited
+    /// @param[in] segmentObservations the number of observations in each segment
+    SpillBuffer(const std::filesystem::path &directory, size_t maxSize, std::chrono::seconds maxAge,
+                size_t segmentObservations = 4096);
+    ~SpillBuffer();
+
+    /// @brief Add an observation evicted from the circular buffer
+    ///
+    /// When the segment is full it is queued for the background thread.
+    ///
+    /// @note called by the buffer writer in sequence order
+    /// @param[in] observation the observation
+    void spill(const observation::ObservationPtr &observation);
+
+    /// @brief Wait until the queued segments have been written
+    void flush() const;
+
+    /// @brief Get the observations in a range of sequence numbers
+    /// @param[out] results the list to add the observations to
+    /// @param[in] from the first sequence number in the range
+    /// @param[in] to the sequence number after the range
+    /// @param[in] filterSet optional filter set of data items
+    /// @param[in] limit the maximum number of observations
+    /// @param[in] inc `1` to read forward from `from`, `-1` to read backward from `to`
+    /// @return the sequence number following the last one visited in the direction of travel
+    SequenceNumber_t getObservations(observation::ObservationList &results, SequenceNumber_t from,
+                                     SequenceNumber_t to, const FilterSetOpt &filterSet,
+                                     int limit, int inc);
+
+    /// @brief get the first sequence number held in the spill buffer
+    /// @return the first sequence number or 0 if the spill buffer is empty
+    SequenceNumber_t getFirstSequence() const
+    {
+      return m_firstSequence.load(std::memory_order_acquire);
+    }
+    /// @brief get the number of segment files
+    /// @return the number of segments
+    size_t getSegmentCount() const
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      return m_segments.size();
+    }
+    /// @brief get the total size of the segment files
+    /// @return the size in bytes
+    size_t getSize() const
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      return m_size;
+    }
+
+    /// @brief Remove all the observations and segments
+    void clear();
+
+    /// @brief update the data item references when device model changes
+    ///
+    /// The pending observations are replaced with the copies referencing the new data items.
+    ///
+    /// @param observations the copies of the observations with the new data items
+    void updateDataItems(observation::ObservationUpdater &observations);
+
+  protected:
+    using ObservationVector = std::vector<observation::ObservationPtr>;
+
+    struct Segment
+    {
+      std::filesystem::path m_path;
+      SequenceNumber_t m_first;
+      SequenceNumber_t m_last;
+      size_t m_size;
+      std::chrono::system_clock::time_point m_created;
+    };
+
+    void run();
+    std::optional<Segment> writeSegment(const ObservationVector &observations);
+    void removeSegments();
+    std::shared_ptr<const ObservationVector> readSegment(const Segment &segment);
+    void updateFirstSequence();
+
+  protected:
+    std::filesystem::path m_directory;
+    size_t m_maxSize;
+    std::chrono::seconds m_maxAge;
+    size_t m_segmentObservations;
+
+    // Guards the pending observations, the queue, the segments and the cache
+    mutable std::mutex m_lock;
+    // Signaled when a segment is queued or written
+    mutable std::condition_variable m_queueChanged;
+    std::atomic<SequenceNumber_t> m_firstSequence {0};
+
+    ObservationVector m_pending;
+    std::deque<std::shared_ptr<const ObservationVector>> m_queued;
+    // Incremented by clear() so a segment written after the clear is discarded
+    uint64_t m_generation {0};
+    bool m_stop {false};
+    std::deque<Segment> m_segments;
+    size_t m_size {0};
+    std::unordered_map<std::string, WeakDataItemPtr> m_dataItems;
+
+    SequenceNumber_t m_cachedFirst {0};
+    std::shared_ptr<const ObservationVector> m_cached;
+
+    std::thread m_writer;
+  };
+}  // namespace mtconnect::buffer
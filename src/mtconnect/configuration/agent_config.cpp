@@ -308,7 +308,13 @@ namespace mtconnect::configuration {
     }
     else
     {
-      if (cfgTime != *m_configTime)
+      if (cfgTime != *m_configTime && applyBufferChanges())
+      {
+        LOG(warning) << "Monitor thread has applied the buffer changes in: " << m_configFile;
+        m_configTime.emplace(cfgTime);
+        scheduleMonitorTimer();
+      }
+      else if (cfgTime != *m_configTime)
       {
         LOG(warning) << "Monitor thread has detected change in configuration files.";
         LOG(warning) << ".... Restarting agent: " << m_configFile;
@@ -368,6 +374,55 @@ namespace mtconnect::configuration {
     return;
   }
 
+  bool AgentConfiguration::applyBufferChanges()
+  {
+    NAMED_SCOPE("AgentConfiguration::applyBufferChanges");
+
+    if (!m_agent)
+      return false;
+
+    ptree config;
+    try
+    {
+      ifstream file(m_configFile.c_str());
+      std::stringstream buffer;
+      buffer << file.rdbuf();
+      config = Parser::parse(buffer.str());
+    }
+    catch (std::exception &e)
+    {
+      LOG(warning) << "Cannot parse the changed configuration: " << e.what();
+      return false;
+    }
+
+    // Any change other than the buffer options requires a restart
+    auto others = [](ptree tree) {
+      tree.erase(configuration::BufferSize);
+      tree.erase(configuration::CheckpointFrequency);
+      return tree;
+    };
+    if (others(config) != others(m_config))
+      return false;
+
+    ConfigOptions options;
+    GetOptions(config, options,
+               {{configuration::BufferSize, int(DEFAULT_SLIDING_BUFFER_EXP)},
+                {configuration::CheckpointFrequency, 1000}});
+    auto bufferSize = *GetOption<int>(options, configuration::BufferSize);
+    auto checkpointFreq = *GetOption<int>(options, configuration::CheckpointFrequency);
+    if (bufferSize <= 0 || bufferSize >= 32 || checkpointFreq <= 0)
+    {
+      LOG(warning) << "Invalid BufferSize " << bufferSize << " or CheckpointFrequency "
+                   << checkpointFreq << ", restarting the agent";
+      return false;
+    }
+
+    m_agent->resizeBuffer(bufferSize, checkpointFreq);
+    m_config = config;
+
+    return true;
+  }
+
   void AgentConfiguration::scheduleMonitorTimer()
   {
     using namespace chrono;
@@ -688,6 +743,7 @@ namespace mtconnect::configuration {
 
     // Now get our configuration
     auto config = Parser::parse(text);
+    m_config = config;
 
     // if (!m_loggerFile)
     if (!m_sink)
@@ -706,8 +762,21 @@ namespace mtconnect::configuration {
                 {configuration::ServerIp, "0.0.0.0"s},
                 {configuration::Devices, "Devices.xml"s},
                 {configuration::BufferSize, int(DEFAULT_SLIDING_BUFFER_EXP)},
+                {configuration::BufferMemoryLimit, "0"s},
+                {configuration::BufferSnapshotFile, ""s},
+                {configuration::BufferSnapshotPath, ""s},
                 {configuration::MaxAssets, int(DEFAULT_MAX_ASSETS)},
+                {configuration::CacheObservationFragments, false},
                 {configuration::CheckpointFrequency, 1000},
+                {configuration::DataItemSequenceIndex, true},
+                {configuration::CompactBuffer, false},
+                {configuration::CompressResponses, true},
+                {configuration::DirectXmlWriter, false},
+                {configuration::DurableBufferPath, ""s},
+                {configuration::DurableBufferSegmentSize, "64M"s},
+                {configuration::SpillBufferPath, ""s},
+                {configuration::SpillBufferMaxSize, "1G"s},
+                {configuration::SpillBufferMaxAge, 0s},
                 {configuration::LegacyTimeout, 600s},
                 {configuration::CreateUniqueIds, false},
                 {configuration::ReconnectInterval, 10000ms},
@@ -729,6 +798,8 @@ namespace mtconnect::configuration {
                 {configuration::ServiceName, "MTConnect Agent"s},
                 {configuration::SchemaVersion, ""s},
                 {configuration::LogStreams, false},
+                {configuration::StreamBacklogLimit, 0},
+                {configuration::StreamBacklogPolicy, "Disconnect"s},
                 {configuration::ShdrVersion, 1},
                 {configuration::WorkerThreads, 1},
                 {configuration::TlsCertificateChain, ""s},
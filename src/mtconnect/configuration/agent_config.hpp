@@ -297,6 +297,11 @@ namespace mtconnect {
 
       void expandConfigVariables(boost::property_tree::ptree &);
 
+      /// @brief apply the changes to the configuration file in place if only the buffer options
+      ///        changed
+      /// @return `true` if the changes were applied and the agent does not need to restart
+      bool applyBufferChanges();
+
     protected:
       using text_sink = boost::log::sinks::synchronous_sink<boost::log::sinks::text_file_backend>;
 
@@ -325,6 +330,8 @@ namespace mtconnect {
       bool m_restart = false;
       std::optional<std::filesystem::file_time_type> m_configTime;
       std::optional<std::filesystem::file_time_type> m_deviceTime;
+      // The configuration last loaded, used to detect changes that can be applied in place
+      ptree m_config;
 
       // Logging info for testing
       std::filesystem::path m_logDirectory;
@@ -46,9 +46,19 @@ namespace mtconnect {
     DECLARE_CONFIGURATION(DisableAgentDevice);
     DECLARE_CONFIGURATION(AllowPut);
     DECLARE_CONFIGURATION(AllowPutFrom);
+    DECLARE_CONFIGURATION(BufferMemoryLimit);
     DECLARE_CONFIGURATION(BufferSize);
+    DECLARE_CONFIGURATION(BufferSnapshotFile);
+    DECLARE_CONFIGURATION(BufferSnapshotPath);
+    DECLARE_CONFIGURATION(CacheObservationFragments);
     DECLARE_CONFIGURATION(CheckpointFrequency);
+    DECLARE_CONFIGURATION(CompactBuffer);
+    DECLARE_CONFIGURATION(CompressResponses);
+    DECLARE_CONFIGURATION(DataItemSequenceIndex);
     DECLARE_CONFIGURATION(Devices);
+    DECLARE_CONFIGURATION(DirectXmlWriter);
+    DECLARE_CONFIGURATION(DurableBufferPath);
+    DECLARE_CONFIGURATION(DurableBufferSegmentSize);
     DECLARE_CONFIGURATION(HttpHeaders);
     DECLARE_CONFIGURATION(JsonVersion);
     DECLARE_CONFIGURATION(LogStreams);
@@ -64,6 +74,11 @@ namespace mtconnect {
     DECLARE_CONFIGURATION(SchemaVersion);
     DECLARE_CONFIGURATION(ServerIp);
     DECLARE_CONFIGURATION(ServiceName);
+    DECLARE_CONFIGURATION(SpillBufferMaxAge);
+    DECLARE_CONFIGURATION(SpillBufferMaxSize);
+    DECLARE_CONFIGURATION(SpillBufferPath);
+    DECLARE_CONFIGURATION(StreamBacklogLimit);
+    DECLARE_CONFIGURATION(StreamBacklogPolicy);
     DECLARE_CONFIGURATION(TlsCertificateChain);
     DECLARE_CONFIGURATION(TlsCertificatePassword);
     DECLARE_CONFIGURATION(TlsClientCAs);
@@ -175,5 +175,40 @@ namespace mtconnect {
           {{"type", "DEVICE_CHANGED"s}, {"id", "device_changed"s}, {"category", "EVENT"s}}, errors);
       addDataItem(changed, errors);
     }
+
+    void AgentDevice::addBufferDataItems()
+    {
+      using namespace entity;
+      using namespace device_model::data_item;
+      ErrorList errors;
+
+      auto memory = DataItem::make({{"type", "x:OBSERVATION_BUFFER_MEMORY"s},
+                                    {"id", "observation_buffer_memory"s},
+                                    {"category", "EVENT"s}},
+                                   errors);
+      addDataItem(memory, errors);
+
+      auto count = DataItem::make({{"type", "x:OBSERVATION_BUFFER_COUNT"s},
+                                   {"id", "observation_buffer_count"s},
+                                   {"category", "EVENT"s}},
+                                  errors);
+      addDataItem(count, errors);
+    }
+
+    void AgentDevice::addStreamDataItems()
+    {
+      using namespace entity;
+      using namespace device_model::data_item;
+      ErrorList errors;
+
+      for (auto &[type, id] : {pair {"x:STREAM_COUNT"s, "stream_count"s},
+                               pair {"x:STREAM_BACKLOG"s, "stream_backlog"s},
+                               pair {"x:STREAM_MAX_BACKLOG"s, "stream_max_backlog"s},
+                               pair {"x:STREAM_OVERFLOW_COUNT"s, "stream_overflow_count"s}})
+      {
+        auto di = DataItem::make({{"type", type}, {"id", id}, {"category", "EVENT"s}}, errors);
+        addDataItem(di, errors);
+      }
+    }
   }  // namespace device_model
 }  // namespace mtconnect
@@ -56,6 +56,23 @@ namespace mtconnect {
       /// @param adapter the adapter
       void addAdapter(const source::adapter::AdapterPtr adapter);
 
+      /// @brief Add the data items for the observation buffer memory and count
+      ///
+      /// The types are not defined by MTConnect and use the `x` prefix of the
+      /// `ExtensionUrn` namespace.
+      void addBufferDataItems();
+
+      /// @brief Add the data items for the sample stream metrics
+      ///
+      /// The number of streams, their total and largest backlog, and the number of times a
+      /// stream fell behind. The types use the `x` prefix.
+      void addStreamDataItems();
+
+      /// @brief The namespace of the agent specific data item types
+      static constexpr const char *ExtensionUrn = "urn:mtconnect.org:MTConnectAgent:1.0";
+      /// @brief The prefix of the agent specific data item types
+      static constexpr const char *ExtensionPrefix = "x";
+
       /// @brief get the connection status data item for an addapter
       /// @param adapter the adapter name
       /// @return shared pointer to the data item
@@ -107,6 +107,7 @@ namespace mtconnect {
       static const char *condition = "Condition";
 
       m_id = get<string>("id");
+      m_index = DataItemIndexes::Default().assign(m_id);
       m_name = maybeGet<string>("name");
       auto type = get<string>("type");
       optional<string> pre;
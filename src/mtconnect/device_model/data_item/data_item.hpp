@@ -106,6 +106,12 @@ namespace mtconnect {
 
         /// @brief get the data item id
         const auto &getId() const { return m_id; }
+        /// @brief get the dense index of the data item id
+        /// @return the index assigned by the agent or the default registry
+        auto getIndex() const { return m_index; }
+        /// @brief set the dense index of the data item id
+        /// @param[in] index the index assigned by the agent
+        void setIndex(size_t index) { m_index = index; }
         /// @brief get the data item name
         const auto &getName() const { return m_name; }
         /// @brief get the data item source
@@ -240,6 +246,7 @@ namespace mtconnect {
           m_originalId.emplace(m_id);
           auto pref = m_id == m_preferredName;
           m_id = *Entity::createUniqueId(idMap, sha1);
+          m_index = DataItemIndexes::Default().assign(m_id);
           if (pref)
             m_preferredName = m_id;
           m_observatonProperties.insert_or_assign("dataItemId", m_id);
@@ -272,6 +279,7 @@ namespace mtconnect {
       protected:
         // Unique ID for each component
         std::string m_id;
+        size_t m_index;
         std::optional<std::string> m_originalId;
 
         // Name for itself
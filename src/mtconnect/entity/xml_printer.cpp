@@ -22,6 +22,7 @@
 #include <libxml/xmlwriter.h>
 
 #include "mtconnect/logging.hpp"
+#include "mtconnect/printer/xml_buffer_writer.hpp"
 #include "mtconnect/printer/xml_printer_helper.hpp"
 
 using namespace std;
@@ -260,5 +261,95 @@ namespace mtconnect {
               e.second);
       }
     }
+
+    bool XmlPrinter::print(XmlBufferWriter &writer, const EntityPtr entity,
+                           const std::unordered_set<std::string> &namespaces)
+    {
+      NAMED_SCOPE("entity.xml_printer");
+
+      // Namespaced entities may declare their namespace, leave them to libxml2
+      if (entity->getName().hasNs())
+        return false;
+
+      const auto &properties = entity->getProperties();
+      const auto order = entity->getOrder();
+
+      list<const Properties::value_type *> attributes;
+      list<const Properties::value_type *> elements;
+
+      // Partition the properties and make sure they can all be written before writing anything
+      const auto &attrs = entity->getAttributes();
+      for (const auto &prop : properties)
+      {
+        auto &key = prop.first;
+        if (m_includeHidden || !entity->isHidden(key))
+        {
+          if (islower(key.getName()[0]) || attrs.count(key) > 0)
+          {
+            string t;
+            if (!writer.canWriteAttribute(toCharPtr(prop.second, t)))
+              return false;
+            attributes.emplace_back(&prop);
+          }
+          else if (holds_alternative<EntityPtr>(prop.second) ||
+                   holds_alternative<EntityList>(prop.second) ||
+                   holds_alternative<DataSet>(prop.second))
+          {
+            return false;
+          }
+          else
+          {
+            elements.emplace_back(&prop);
+          }
+        }
+      }
+
+      if (order)
+      {
+        elements.sort([&order](auto &e1, auto &e2) -> bool {
+          auto it1 = order->find(e1->first);
+          if (it1 == order->end())
+            return false;
+          auto it2 = order->find(e2->first);
+          if (it2 == order->end())
+            return true;
+          return it1->second < it2->second;
+        });
+      }
+
+      writer.startElement(entity->getName().getName());
+
+      for (auto a : attributes)
+      {
+        string t;
+        QName name(a->first);
+        bool isNsDecl = name.hasNs() && name.getNs() == "xmlns";
+        if (!isNsDecl || namespaces.count(string(name.getName())) == 0)
+          writer.addAttribute(a->first, toCharPtr(a->second, t));
+      }
+
+      for (auto e : elements)
+      {
+        string t;
+        const char *s = toCharPtr(e->second, t);
+        if (e->first == "VALUE")
+        {
+          writer.writeText(s);
+        }
+        else if (e->first == "RAW")
+        {
+          writer.writeRaw(s);
+        }
+        else
+        {
+          writer.startElement(stripUndeclaredNamespace(QName(e->first), namespaces));
+          writer.writeText(s);
+          writer.endElement();
+        }
+      }
+
+      writer.endElement();
+      return true;
+    }
   }  // namespace entity
 }  // namespace mtconnect
@@ -29,6 +29,10 @@ extern "C"
 }
 
 namespace mtconnect {
+  namespace printer {
+    class XmlBufferWriter;
+  }
+
   namespace entity {
     /// @brief Convert an entity to an XML document
     class AGENT_LIB_API XmlPrinter
@@ -43,6 +47,19 @@ namespace mtconnect {
       void print(xmlTextWriterPtr writer, const EntityPtr entity,
                  const std::unordered_set<std::string> &namespaces);
 
+      /// @brief write an entity with only simple properties directly into a buffer
+      ///
+      /// Writes the same XML as the `libxml2` writer. Entities with nested entities, data sets,
+      /// a namespace, or attribute values the buffer writer cannot escape the same are not
+      /// written.
+      ///
+      /// @param writer the buffer writer
+      /// @param entity the entity
+      /// @param namespaces a set of namespaces to use in the document
+      /// @return `true` if the entity was written, nothing is written if `false`
+      bool print(printer::XmlBufferWriter &writer, const EntityPtr entity,
+                 const std::unordered_set<std::string> &namespaces);
+
     protected:
       bool m_includeHidden {false};
     };
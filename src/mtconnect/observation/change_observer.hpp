@@ -58,8 +58,7 @@ namespace mtconnect::observation {
       }
       else
       {
-        m_timer.expires_from_now(duration);
-        m_timer.async_wait(handler);
+        startTimer(duration, handler);
       }
       return true;
     }
@@ -75,7 +74,7 @@ namespace mtconnect::observation {
       if (m_sequence > sequence && sequence)
         m_sequence = sequence;
 
-      m_timer.cancel();
+      cancelTimer();
     }
     /// @brief get the last sequence number signaled
     /// @return the sequence number
@@ -99,6 +98,18 @@ namespace mtconnect::observation {
     volatile uint64_t m_sequence = UINT64_MAX;
 
   protected:
+    /// @brief start the timer for a wait
+    /// @param duration the duration to wait
+    /// @param handler the handler to call when the timer expires or is canceled
+    virtual void startTimer(std::chrono::milliseconds duration,
+                            std::function<void(boost::system::error_code)> handler)
+    {
+      m_timer.expires_from_now(duration);
+      m_timer.async_wait(handler);
+    }
+    /// @brief cancel the timer of the wait, the handler is called with `operation_aborted`
+    virtual void cancelTimer() { m_timer.cancel(); }
+
     friend class ChangeSignaler;
     void addSignaler(ChangeSignaler *sig);
     bool removeSignaler(ChangeSignaler *sig);
@@ -428,37 +428,5 @@ namespace mtconnect {
 
       return m_prev->replace(old, _new);
     }
-
-    ConditionPtr Condition::deepCopy()
-    {
-      auto n = make_shared<Condition>(*this);
-
-      if (m_prev)
-      {
-        n->m_prev = m_prev->deepCopy();
-      }
-
-      return n;
-    }
-
-    ConditionPtr Condition::deepCopyAndRemove(ConditionPtr &old)
-    {
-      if (this->getptr() == old)
-      {
-        if (m_prev)
-          return m_prev->deepCopy();
-        else
-          return nullptr;
-      }
-
-      auto n = make_shared<Condition>(*this);
-
-      if (m_prev)
-      {
-        n->m_prev = m_prev->deepCopyAndRemove(old);
-      }
-
-      return n;
-    }
   }  // namespace observation
 }  // namespace mtconnect
@@ -17,8 +17,11 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <cmath>
 #include <date/date.h>
+#include <memory>
 #include <set>
 #include <string>
 #include <utility>
@@ -39,6 +42,78 @@ namespace mtconnect::observation {
   using ConstObservationPtr = std::shared_ptr<const Observation>;
   using ObservationList = std::list<ObservationPtr>;
 
+  /// @brief Serialized fragments of an observation cached by the printers
+  ///
+  /// Each format has one slot holding the text and the key of the printer that rendered it, so a
+  /// printer only reuses fragments it rendered itself. The slots are read and replaced atomically
+  /// and are not copied with the observation.
+  ///
+  /// The fragments are not included in the memory estimate of the circular buffer, so the agent
+  /// does not cache them when the buffer has a memory limit.
+  class AGENT_LIB_API FragmentCache
+  {
+  public:
+    /// @brief The serialization formats that can be cached
+    enum Format
+    {
+      XML,
+      JSON_V1,
+      JSON_V2,
+      FORMAT_COUNT
+    };
+
+    /// @brief A rendered fragment
+    struct Fragment
+    {
+      uint64_t m_key;
+      std::string m_text;
+    };
+    using FragmentPtr = std::shared_ptr<const Fragment>;
+
+    FragmentCache() = default;
+    FragmentCache(const FragmentCache &) {}
+    FragmentCache &operator=(const FragmentCache &)
+    {
+      clear();
+      return *this;
+    }
+
+    /// @brief get the fragment rendered by a printer
+    /// @param[in] format the format
+    /// @param[in] key the printer's fragment key
+    /// @return the fragment or `nullptr` if the slot is empty or holds another printer's fragment
+    FragmentPtr get(Format format, uint64_t key) const
+    {
+      auto fragment = std::atomic_load_explicit(&m_fragments[format], std::memory_order_acquire);
+      if (fragment && fragment->m_key == key)
+        return fragment;
+      else
+        return nullptr;
+    }
+
+    /// @brief store a rendered fragment replacing the current fragment for the format
+    /// @param[in] format the format
+    /// @param[in] key the printer's fragment key
+    /// @param[in] text the serialized observation
+    /// @return the fragment
+    FragmentPtr set(Format format, uint64_t key, std::string &&text) const
+    {
+      FragmentPtr fragment = std::make_shared<Fragment>(Fragment {key, std::move(text)});
+      std::atomic_store_explicit(&m_fragments[format], fragment, std::memory_order_release);
+      return fragment;
+    }
+
+    /// @brief remove all the fragments
+    void clear() const
+    {
+      for (auto &fragment : m_fragments)
+        std::atomic_store_explicit(&fragment, FragmentPtr(), std::memory_order_release);
+    }
+
+  protected:
+    mutable std::array<FragmentPtr, FORMAT_COUNT> m_fragments;
+  };
+
   /// @brief Abstract observation
   class AGENT_LIB_API Observation : public entity::Entity
   {
@@ -115,6 +190,7 @@ namespace mtconnect::observation {
     {
       m_sequence = sequence;
       setProperty("sequence", sequence);
+      m_fragments.clear();
     }
     /// @brief make the observation unavailable
     virtual void makeUnavailable()
@@ -175,13 +251,26 @@ namespace mtconnect::observation {
     }
 
     /// @brief Clear the reset triggered state
-    void clearResetTriggered() { m_properties.erase("resetTriggered"); }
+    void clearResetTriggered()
+    {
+      m_properties.erase("resetTriggered");
+      m_fragments.clear();
+    }
+
+    /// @brief get the serialized fragments cached by the printers
+    ///
+    /// The fragments are only valid while the observation is not modified, which holds once it
+    /// has a sequence number and is in the buffer.
+    ///
+    /// @return the fragment cache
+    const FragmentCache &getFragments() const { return m_fragments; }
 
   protected:
     Timestamp m_timestamp;
     bool m_unavailable {false};
     std::weak_ptr<device_model::data_item::DataItem> m_dataItem;
     uint64_t m_sequence {0};
+    FragmentCache m_fragments;
   };
 
   /// @brief A MTConnect Sample with a double value
@@ -206,6 +295,7 @@ namespace mtconnect::observation {
     using Sample::Sample;
     static entity::FactoryPtr getFactory();
     ~ThreeSpaceSample() override = default;
+    ObservationPtr copy() const override { return std::make_shared<ThreeSpaceSample>(*this); }
   };
 
   /// @brief A vector of timeseries values with a count and duration
@@ -338,46 +428,11 @@ namespace mtconnect::observation {
       list.emplace_back(getptr());
     }
 
-    /// @brief find a condition by code in the condition list
-    /// @param[in] code te code
-    /// @return shared pointer to the condition if found
-    ConditionPtr find(const std::string &code)
-    {
-      if (m_code == code)
-        return getptr();
-
-      if (m_prev)
-        return m_prev->find(code);
-
-      return nullptr;
-    }
-
-    /// @brief const find a condition by code in the condition list
-    /// @param[in] code te code
-    /// @return shared pointer to the condition if found
-    const ConditionPtr find(const std::string &code) const
-    {
-      if (m_code == code)
-        return std::dynamic_pointer_cast<Condition>(Entity::getptr());
-
-      if (m_prev)
-        return m_prev->find(code);
-
-      return nullptr;
-    }
-
     /// @brief replace a condition with another in the condition list
     /// @param[in] old the condition to be placed
     /// @param[in] _new the replacement condition
     /// @return `true` if the old condition was found
     bool replace(ConditionPtr &old, ConditionPtr &_new);
-    /// @brief copy the condition and all conditions in the list
-    /// @return a new shared condition pointer
-    ConditionPtr deepCopy();
-    /// @brief copy the condition and all conditions in the list removing one condition
-    /// @param[in] old the condition to skip
-    /// @return the new condition pointer
-    ConditionPtr deepCopyAndRemove(ConditionPtr &old);
 
     /// @brief Get the code for the condition
     /// @return the code
@@ -465,6 +520,29 @@ namespace mtconnect::observation {
       setValue(set);
       setProperty("count", int64_t(set.size()));
     }
+    /// @brief move a data set into the value and set the count
+    /// @param[in] set the data set
+    void setDataSet(entity::DataSet &&set)
+    {
+      auto count = int64_t(set.size());
+      m_properties.insert_or_assign("VALUE", std::move(set));
+      setProperty("count", count);
+    }
+    /// @brief move the data set out of the value
+    ///
+    /// Only call when the event is not shared, the value is left empty.
+    ///
+    /// @return the data set
+    entity::DataSet takeDataSet()
+    {
+      auto it = m_properties.find("VALUE");
+      if (it != m_properties.end())
+      {
+        if (auto set = std::get_if<entity::DataSet>(&it->second))
+          return std::move(*set);
+      }
+      return entity::DataSet();
+    }
   };
 
   using DataSetEventPtr = std::shared_ptr<DataSetEvent>;
@@ -530,4 +608,55 @@ namespace mtconnect::observation {
 
   using ObservationComparer = bool (*)(ObservationPtr &, ObservationPtr &);
   inline bool ObservationCompare(ObservationPtr &aE1, ObservationPtr &aE2) { return *aE1 < *aE2; }
+
+  /// @brief Copies observations referencing the new data items when the device model changes
+  ///
+  /// Observations held by the buffer are read without a lock, so their data item is never
+  /// changed in place. Each observation is copied once with the new data item and the same copy
+  /// is returned for every reference to it, including the previous conditions of a condition.
+  class AGENT_LIB_API ObservationUpdater
+  {
+  public:
+    /// @brief create an updater for a map of data items
+    /// @param[in] diMap the map of data item ids to the new data items
+    ObservationUpdater(std::unordered_map<std::string, WeakDataItemPtr> &diMap) : m_dataItems(diMap)
+    {}
+
+    /// @brief get the copy of an observation with the new data item
+    /// @param[in] observation the observation
+    /// @return the copy or `nullptr` if the observation is `nullptr`
+    ObservationPtr operator()(const ObservationPtr &observation)
+    {
+      if (!observation)
+        return observation;
+
+      auto it = m_copies.find(observation.get());
+      if (it != m_copies.end())
+        return it->second;
+
+      auto copy = observation->copy();
+      copy->updateDataItem(m_dataItems);
+      if (auto cond = dynamic_cast<Condition *>(copy.get()); cond && cond->getPrev())
+        cond->appendTo((*this)(cond->getPrev()));
+      m_copies.emplace(observation.get(), copy);
+
+      return copy;
+    }
+
+    /// @brief get the copy of a condition with the new data item
+    /// @param[in] condition the condition
+    /// @return the copy or `nullptr` if the condition is `nullptr`
+    ConditionPtr operator()(const ConditionPtr &condition)
+    {
+      return std::dynamic_pointer_cast<Condition>((*this)(ObservationPtr(condition)));
+    }
+
+    /// @brief get the map of data item ids to the new data items
+    /// @return the map
+    auto &getDataItems() { return m_dataItems; }
+
+  protected:
+    std::unordered_map<std::string, WeakDataItemPtr> &m_dataItems;
+    std::unordered_map<const Observation *, ObservationPtr> m_copies;
+  };
 }  // namespace mtconnect::observation
@@ -45,12 +45,84 @@ namespace mtconnect {
             "Unexpected entity type, cannot convert to observation in DeliverObservation");
       }
 
-      m_contract->deliverObservation(o);
+      if (!ObservationBatch::add(m_contract, o))
+        m_contract->deliverObservation(o);
       (*m_count)++;
 
       return entity;
     }
 
+    namespace {
+      thread_local ObservationBatch *t_currentBatch {nullptr};
+    }
+
+    ObservationBatch::ObservationBatch()
+    {
+      if (t_currentBatch == nullptr)
+      {
+        t_currentBatch = this;
+        m_open = true;
+      }
+    }
+
+    ObservationBatch::~ObservationBatch()
+    {
+      if (m_open)
+      {
+        try
+        {
+          flush();
+        }
+        catch (std::exception &e)
+        {
+          LOG(error) << "Could not deliver observation batch: " << e.what();
+        }
+        t_currentBatch = nullptr;
+      }
+    }
+
+    void ObservationBatch::flush()
+    {
+      if (m_open && m_contract && !m_observations.empty())
+      {
+        ObservationList observations;
+        observations.swap(m_observations);
+        m_contract->deliverObservations(observations);
+      }
+    }
+
+    bool ObservationBatch::add(PipelineContract *contract, ObservationPtr &observation)
+    {
+      auto batch = t_currentBatch;
+      if (batch == nullptr)
+        return false;
+
+      if (batch->m_contract != contract)
+      {
+        batch->flush();
+        batch->m_contract = contract;
+      }
+      batch->m_observations.push_back(observation);
+      return true;
+    }
+
+    void ObservationBatch::flushIfPending(const ObservationPtr &observation)
+    {
+      auto batch = t_currentBatch;
+      if (batch == nullptr)
+        return;
+
+      auto di = observation->getDataItem();
+      for (const auto &pending : batch->m_observations)
+      {
+        if (pending->getDataItem() == di)
+        {
+          batch->flush();
+          break;
+        }
+      }
+    }
+
     void ComputeMetrics::start()
     {
       m_timer.cancel();
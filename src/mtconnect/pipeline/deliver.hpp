@@ -126,6 +126,41 @@ namespace mtconnect::pipeline {
     std::optional<std::string> m_dataItem;
   };
 
+  /// @brief Collects the observations delivered on the current thread into one batch
+  ///
+  /// While a batch is open, `DeliverObservation` adds observations to the batch instead of
+  /// delivering them individually. The batch is delivered with
+  /// `PipelineContract::deliverObservations()` when it is flushed or goes out of scope. A batch
+  /// opened while another is open on the same thread is merged into the outer batch.
+  class AGENT_LIB_API ObservationBatch
+  {
+  public:
+    ObservationBatch();
+    ~ObservationBatch();
+
+    /// @brief deliver the observations collected so far
+    void flush();
+
+    /// @brief add an observation to the batch open on this thread
+    /// @param[in] contract the contract to deliver the batch to
+    /// @param[in] observation the observation
+    /// @return `true` if the observation was added, `false` if there is no open batch
+    static bool add(PipelineContract *contract, observation::ObservationPtr &observation);
+
+    /// @brief flush the batch open on this thread if it has an observation for the data item
+    ///
+    /// Used by transforms that compare an observation with the latest observation in the
+    /// buffer, so they see the earlier observation from the same batch.
+    ///
+    /// @param[in] observation the observation about to be checked
+    static void flushIfPending(const observation::ObservationPtr &observation);
+
+  protected:
+    bool m_open {false};
+    PipelineContract *m_contract {nullptr};
+    observation::ObservationList m_observations;
+  };
+
   /// @brief A transform to deliver and meter observation delivery
   class AGENT_LIB_API DeliverObservation : public MeteredTransform
   {
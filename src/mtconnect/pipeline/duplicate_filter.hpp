@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include "deliver.hpp"
 #include "mtconnect/config.hpp"
 #include "transform.hpp"
 
@@ -51,6 +52,8 @@ namespace mtconnect::pipeline {
       if (o->isOrphan())
         return entity::EntityPtr();
 
+      // An earlier observation for the data item may be waiting in the batch
+      ObservationBatch::flushIfPending(o);
       auto o2 = m_context->m_contract->checkDuplicate(o);
       if (!o2)
         return entity::EntityPtr();
@@ -45,6 +45,7 @@ namespace mtconnect {
   namespace observation {
     class Observation;
     using ObservationPtr = std::shared_ptr<Observation>;
+    using ObservationList = std::list<ObservationPtr>;
   }  // namespace observation
   namespace entity {
     class Entity;
@@ -79,6 +80,16 @@ namespace mtconnect {
       /// @brief deliver an observation to the circular buffer and the sinks
       /// @param[in] obs a shared pointer to the observation
       virtual void deliverObservation(observation::ObservationPtr obs) = 0;
+      /// @brief deliver a batch of observations to the circular buffer and the sinks
+      ///
+      /// The default delivers each observation in order.
+      ///
+      /// @param[in] observations the observations
+      virtual void deliverObservations(observation::ObservationList &observations)
+      {
+        for (auto &obs : observations)
+          deliverObservation(obs);
+      }
       /// @brief deliver an asset to the asset storage
       /// @param[in] asset the asset to deliver
       virtual void deliverAsset(asset::AssetPtr asset) = 0;
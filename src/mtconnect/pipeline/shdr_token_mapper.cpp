@@ -23,6 +23,7 @@
 #include "mtconnect/entity/xml_parser.hpp"
 #include "mtconnect/logging.hpp"
 #include "mtconnect/observation/observation.hpp"
+#include "deliver.hpp"
 #include "upcase_value.hpp"
 
 using namespace std;
@@ -352,6 +353,9 @@ namespace mtconnect {
         auto token = tokens.cbegin();
         auto end = tokens.end();
 
+        // Deliver all the observations from the line as one batch
+        ObservationBatch batch;
+
         while (token != end)
         {
           auto start = token;
@@ -400,6 +404,8 @@ namespace mtconnect {
           }
         }
 
+        batch.flush();
+
         res->setValue(entities);
         return next(res);
       }
@@ -18,13 +18,6 @@
 #include "json_printer.hpp"
 
 #include <boost/asio/ip/host_name.hpp>
-#include <boost/multi_index/composite_key.hpp>
-#include <boost/multi_index/identity.hpp>
-#include <boost/multi_index/key.hpp>
-#include <boost/multi_index/mem_fun.hpp>
-#include <boost/multi_index/member.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index_container.hpp>
 #include <boost/range/algorithm/sort.hpp>
 
 #include <cstdlib>
@@ -38,6 +31,7 @@
 #include "mtconnect/entity/json_printer.hpp"
 #include "mtconnect/logging.hpp"
 #include "mtconnect/printer/json_printer_helper.hpp"
+#include "mtconnect/printer/stream_order.hpp"
 #include "mtconnect/version.h"
 
 using namespace std;
@@ -139,7 +133,7 @@ namespace mtconnect::printer {
         {
           AutoJsonObject obj(writer, "Header");
           header(obj, m_version, hostname(), instanceId, bufferSize, *m_schemaVersion,
-                 m_modelChangeTime);
+                 getModelChangeTime());
         }
         {
           if (m_jsonVersion > 1)
@@ -196,7 +190,7 @@ namespace mtconnect::printer {
       {
         AutoJsonObject obj(writer, "Header");
         probeAssetHeader(obj, m_version, hostname(), instanceId, bufferSize, assetBufferSize,
-                         assetCount, *m_schemaVersion, m_modelChangeTime);
+                         assetCount, *m_schemaVersion, getModelChangeTime());
       }
       {
         obj.Key("Devices");
@@ -223,7 +217,7 @@ namespace mtconnect::printer {
       {
         AutoJsonObject obj(writer, "Header");
         probeAssetHeader(obj, m_version, hostname(), instanceId, 0, bufferSize, assetCount,
-                         *m_schemaVersion, m_modelChangeTime);
+                         *m_schemaVersion, getModelChangeTime());
       }
       {
         obj.Key("Assets");
@@ -234,47 +228,50 @@ namespace mtconnect::printer {
   }
 
   using namespace boost;
-  using namespace multi_index;
   using namespace device_model::data_item;
 
-  /// @brief A structure used by the multimap to create a composite key for a list of observations.
-  ///
-  /// Caches the data item, component, category, and device associated with the observation
-  struct ObservationRef
+  /// @brief print an observation, using the fragment cached in the observation when the printer
+  /// caches fragments
+  /// @param[in] writer the document writer
+  /// @param[in] printer the entity printer for the document writer
+  /// @param[in] jsonVersion the json version
+  /// @param[in] fragmentKey the printer's fragment key or `0` if fragments are not cached
+  /// @param[in] observation the observation
+  template <typename T, typename P>
+  void printObservation(T &writer, P &printer, uint32_t jsonVersion, uint64_t fragmentKey,
+                        const ObservationPtr &observation)
   {
-    ObservationRef(const ObservationPtr &obs) : m_observation(obs)
+    if (fragmentKey == 0)
     {
-      m_dataItem = obs->getDataItem();
-      m_category = m_dataItem->getCategory();
-      m_component = m_dataItem->getComponent();
-      m_device = m_component->getDevice();
+      if (jsonVersion == 1)
+        printer.print(observation);
+      else
+        printer.printEntity(observation);
+      return;
     }
 
-    std::string_view getDeviceId() const { return m_device->getId(); }
-    std::string_view getComponentId() const { return m_component->getId(); }
-    auto getCategory() const { return m_category; }
-    auto getSequence() const { return m_observation->getSequence(); }
-    std::string_view getType() const { return m_observation->getName().str(); }
-
-    ObservationPtr m_observation;
-    ComponentPtr m_component;
-    DataItemPtr m_dataItem;
-    DevicePtr m_device;
-    DataItem::Category m_category;
-  };
-
-  using ObservationMap = multi_index_container<
-      ObservationRef,
-      indexed_by<ordered_non_unique<composite_key<
-          ObservationRef,
-          const_mem_fun<ObservationRef, std::string_view, &ObservationRef::getDeviceId>,
-          const_mem_fun<ObservationRef, std::string_view, &ObservationRef::getComponentId>,
-          const_mem_fun<ObservationRef, DataItem::Category, &ObservationRef::getCategory>,
-          const_mem_fun<ObservationRef, std::string_view, &ObservationRef::getType>,
-          const_mem_fun<ObservationRef, SequenceNumber_t, &ObservationRef::getSequence>>>>>;
+    auto format = jsonVersion == 1 ? FragmentCache::JSON_V1 : FragmentCache::JSON_V2;
+    const auto &fragments = observation->getFragments();
+    auto fragment = fragments.get(format, fragmentKey);
+    if (!fragment)
+    {
+      StringBuffer output;
+      Writer<StringBuffer> fragmentWriter(output);
+      entity::JsonPrinter fragmentPrinter(fragmentWriter, jsonVersion);
+      if (jsonVersion == 1)
+        fragmentPrinter.print(observation);
+      else
+        fragmentPrinter.printEntity(observation);
+      fragment =
+          fragments.set(format, fragmentKey, string(output.GetString(), output.GetLength()));
+    }
+
+    writer.RawValue(fragment->m_text.data(), fragment->m_text.size(), kObjectType);
+  }
 
   template <typename T>
-  void printSampleVersion1(T &writer, uint32_t jsonVersion, ObservationMap &observations)
+  void printSampleVersion1(T &writer, uint32_t jsonVersion, uint64_t fragmentKey,
+                           const OrderedObservations &observations)
   {
     using WriterType = decltype(writer);
     using StackType = JsonStack<WriterType>;
@@ -284,28 +281,32 @@ namespace mtconnect::printer {
 
     AutoJsonArray streams(writer, "Streams");
 
-    std::string_view deviceId;
-    std::string_view componentId;
+    const Device *deviceStream {nullptr};
+    const Component *componentStream {nullptr};
     int32_t category = -1;
 
-    for (auto &ref : observations)
+    for (auto &position : observations)
     {
-      if (ref.getDeviceId() != deviceId)
+      const auto &observation = *position;
+      const auto &dataItem = observation->getDataItem();
+      const auto &component = dataItem->getComponent();
+      const auto &device = component->getDevice();
+
+      if (device.get() != deviceStream)
       {
         stack.clear();
-        componentId = "";
+        componentStream = nullptr;
         category = -1;
 
         stack.addObject();
         stack.addObject("DeviceStream");
 
-        deviceId = ref.getDeviceId();
-        auto device = ref.m_device;
+        deviceStream = device.get();
         stack.AddPairs("name", *(device->getComponentName()), "uuid", *(device->getUuid()));
         stack.addArray("ComponentStreams");
       }
 
-      if (ref.getComponentId() != componentId)
+      if (component.get() != componentStream)
       {
         stack.clear(3);
         category = -1;
@@ -313,29 +314,29 @@ namespace mtconnect::printer {
         stack.addObject();
         stack.addObject("ComponentStream");
 
-        componentId = ref.getComponentId();
-        auto component = ref.m_component;
+        componentStream = component.get();
         stack.AddPairs("component", component->getName(), "componentId", component->getId());
         if (component->getComponentName())
           stack.AddPairs("name", *(component->getComponentName()));
       }
 
-      if (ref.getCategory() != category)
+      if (dataItem->getCategory() != category)
       {
         stack.clear(5);
 
-        category = ref.getCategory();
-        stack.addArray(ref.m_dataItem->getCategoryText());
+        category = dataItem->getCategory();
+        stack.addArray(dataItem->getCategoryText());
       }
 
-      printer.print(ref.m_observation);
+      printObservation(writer, printer, jsonVersion, fragmentKey, observation);
     }
 
     stack.clear();
   }
 
   template <typename T>
-  void printSampleVersion2(T &writer, uint32_t jsonVersion, ObservationMap &observations)
+  void printSampleVersion2(T &writer, uint32_t jsonVersion, uint64_t fragmentKey,
+                           const OrderedObservations &observations)
   {
     using WriterType = decltype(writer);
     using StackType = JsonStack<WriterType>;
@@ -345,31 +346,34 @@ namespace mtconnect::printer {
     StackType stack(writer);
     entity::JsonPrinter printer(writer, jsonVersion);
 
-    std::string_view deviceId;
-    std::string_view componentId;
+    const Device *deviceStream {nullptr};
+    const Component *componentStream {nullptr};
     int32_t category = -1;
     std::string_view obsType;
 
-    for (auto &ref : observations)
+    for (auto &position : observations)
     {
-      if (ref.getDeviceId() != deviceId)
+      const auto &observation = *position;
+      const auto &dataItem = observation->getDataItem();
+      const auto &component = dataItem->getComponent();
+      const auto &device = component->getDevice();
+
+      if (device.get() != deviceStream)
       {
         stack.clear();
-        componentId = "";
+        componentStream = nullptr;
         category = -1;
         obsType = "";
 
         stack.addObject();
 
-        deviceId = ref.getDeviceId();
-
-        auto device = ref.m_device;
+        deviceStream = device.get();
         stack.AddPairs("name", *(device->getComponentName()), "uuid", *(device->getUuid()));
 
         stack.addArray("ComponentStream");
       }
 
-      if (ref.getComponentId() != componentId)
+      if (component.get() != componentStream)
       {
         stack.clear(2);
         category = -1;
@@ -377,30 +381,29 @@ namespace mtconnect::printer {
 
         stack.addObject();
 
-        componentId = ref.getComponentId();
-        auto component = ref.m_component;
+        componentStream = component.get();
         stack.AddPairs("component", component->getName(), "componentId", component->getId());
         if (component->getComponentName())
           stack.AddPairs("name", *(component->getComponentName()));
       }
 
-      if (ref.getCategory() != category)
+      if (dataItem->getCategory() != category)
       {
         stack.clear(3);
         obsType = "";
 
-        category = ref.getCategory();
-        stack.addObject(ref.m_dataItem->getCategoryText());
+        category = dataItem->getCategory();
+        stack.addObject(dataItem->getCategoryText());
       }
 
-      if (ref.m_observation->getName() != obsType)
+      if (observation->getName() != obsType)
       {
         stack.clear(4);
-        obsType = ref.m_observation->getName();
+        obsType = observation->getName();
         stack.addArray(obsType);
       }
 
-      printer.printEntity(ref.m_observation);
+      printObservation(writer, printer, jsonVersion, fragmentKey, observation);
     }
 
     stack.clear();
@@ -421,24 +424,21 @@ namespace mtconnect::printer {
       {
         AutoJsonObject obj(writer, "Header");
         streamHeader(obj, m_version, hostname(), instanceId, bufferSize, nextSeq, firstSeq, lastSeq,
-                     *m_schemaVersion, m_modelChangeTime);
+                     *m_schemaVersion, getModelChangeTime());
       }
 
       {
         if (!observations.empty())
         {
           // Order the observations by Device, Component, Category, Observation Type, and Sequence
-          ObservationMap obs;
-          for (const auto &o : observations)
-          {
-            if (!o->isOrphan())
-              obs.emplace(o);
-          }
+          OrderedObservations obs;
+          OrderByType(observations, getStreamOrders(), obs);
 
+          uint64_t fragmentKey = m_cacheFragments && !(m_pretty || pretty) ? m_fragmentKey : 0;
           if (m_jsonVersion == 1)
-            printSampleVersion1(writer, m_jsonVersion, obs);
+            printSampleVersion1(writer, m_jsonVersion, fragmentKey, obs);
           else if (m_jsonVersion == 2)
-            printSampleVersion2(writer, m_jsonVersion, obs);
+            printSampleVersion2(writer, m_jsonVersion, fragmentKey, obs);
         }
         else
         {
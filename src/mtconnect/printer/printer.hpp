@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <list>
 #include <map>
 #include <string>
@@ -25,6 +26,7 @@
 #include "mtconnect/asset/asset.hpp"
 #include "mtconnect/config.hpp"
 #include "mtconnect/observation/observation.hpp"
+#include "mtconnect/printer/stream_order.hpp"
 #include "mtconnect/utilities.hpp"
 #include "mtconnect/version.h"
 
@@ -114,11 +116,41 @@ namespace mtconnect {
       /// @return the mime type
       virtual std::string mimeType() const = 0;
       /// @brief Set the last model change time
+      ///
+      /// Also increments the model version, the time only has a resolution of a second.
+      ///
       /// @param t the time
-      void setModelChangeTime(const std::string &t) { m_modelChangeTime = t; }
+      void setModelChangeTime(const std::string &t)
+      {
+        std::atomic_store(&m_modelChangeTime, std::make_shared<const std::string>(t));
+        modelChanged();
+      }
       /// @brief Get the last model change time
       /// @return the time
-      const std::string &getModelChangeTime() { return m_modelChangeTime; }
+      std::string getModelChangeTime() const
+      {
+        auto time = std::atomic_load(&m_modelChangeTime);
+        return time ? *time : std::string();
+      }
+      /// @brief Get the version of the device model, incremented every time the model changes
+      /// @return the model version
+      uint64_t getModelVersion() const { return m_modelVersion; }
+      /// @brief Increment the model version when the devices change without a new change time
+      void modelChanged() { m_modelVersion++; }
+
+      /// @brief Publish the positions of the data items in the streams documents
+      ///
+      /// The agent publishes a new table when the device model changes. A document loads the
+      /// table once, so all its observations are ordered with the same model version.
+      ///
+      /// @param orders the positions indexed by data item index
+      void setStreamOrders(StreamOrdersPtr orders)
+      {
+        std::atomic_store(&m_streamOrders, std::move(orders));
+      }
+      /// @brief Get the positions of the data items in the streams documents
+      /// @return the last published positions, can be `nullptr`
+      StreamOrdersPtr getStreamOrders() const { return std::atomic_load(&m_streamOrders); }
 
       /// @brief set the schema version we are generating
       /// @param s the version
@@ -138,9 +170,36 @@ namespace mtconnect {
         }
       }
 
+      /// @brief Cache the serialized observations in the observations
+      ///
+      /// When enabled, a sample or current document that is not pretty printed renders each
+      /// observation once and copies the cached fragment into the following documents.
+      ///
+      /// @param cache `true` to cache observation fragments
+      void setCacheFragments(bool cache) { m_cacheFragments = cache; }
+      /// @brief are observation fragments cached
+      /// @return `true` if fragments are cached
+      bool getCacheFragments() const { return m_cacheFragments; }
+      /// @brief get the key of the fragments rendered by this printer
+      /// @return the fragment key
+      uint64_t getFragmentKey() const { return m_fragmentKey; }
+
+    protected:
+      /// @brief get a new key identifying the fragments rendered by a printer configuration
+      /// @return a unique key
+      static uint64_t NextFragmentKey()
+      {
+        static std::atomic<uint64_t> key {0};
+        return ++key;
+      }
+
     protected:
       bool m_pretty;
-      std::string m_modelChangeTime;
+      bool m_cacheFragments {false};
+      uint64_t m_fragmentKey {NextFragmentKey()};
+      std::shared_ptr<const std::string> m_modelChangeTime;
+      std::atomic<uint64_t> m_modelVersion {0};
+      StreamOrdersPtr m_streamOrders;
       std::optional<std::string> m_schemaVersion;
     };
   }  // namespace printer
@@ -0,0 +1,140 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "stream_order.hpp"
+
+#include <algorithm>
+#include <tuple>
+
+#include "mtconnect/device_model/device.hpp"
+
+namespace mtconnect::printer {
+  using namespace observation;
+  using namespace device_model;
+  using namespace device_model::data_item;
+
+  namespace {
+    // Condition observations are named by their level, the names in alphabetical order
+    inline uint32_t LevelOrder(const Observation &observation)
+    {
+      auto condition = dynamic_cast<const Condition *>(&observation);
+      if (condition == nullptr)
+        return 0;
+
+      switch (condition->getLevel())
+      {
+        case Condition::FAULT:
+          return 0;
+        case Condition::NORMAL:
+          return 1;
+        case Condition::UNAVAILABLE:
+          return 2;
+        case Condition::WARNING:
+          return 3;
+      }
+      return 0;
+    }
+
+    // The position of the data item in the order table, `nullptr` if it has not been ordered
+    inline const StreamOrder *FindOrder(const StreamOrdersPtr &orders, const DataItem &dataItem)
+    {
+      auto index = dataItem.getIndex();
+      if (orders && index < orders->size() && (*orders)[index].m_stream != 0)
+        return &(*orders)[index];
+      else
+        return nullptr;
+    }
+  }  // namespace
+
+  void OrderByDataItem(const ObservationList &observations, const StreamOrdersPtr &orders,
+                       OrderedObservations &ordered)
+  {
+    ordered.clear();
+    ordered.reserve(observations.size());
+
+    bool positioned = true;
+    for (const auto &observation : observations)
+    {
+      auto dataItem = observation->getDataItem();
+      if (!dataItem || dataItem->isOrphan())
+        continue;
+
+      auto order = FindOrder(orders, *dataItem);
+      positioned = positioned && order != nullptr;
+      ordered.push_back({order ? order->m_stream : 0, observation->getSequence(), &observation});
+    }
+
+    if (positioned)
+    {
+      std::sort(ordered.begin(), ordered.end());
+    }
+    else
+    {
+      // Data items added since the order table was published are compared by their ids
+      std::sort(ordered.begin(), ordered.end(), [](const auto &a, const auto &b) {
+        return **a < **b;
+      });
+    }
+  }
+
+  void OrderByType(const ObservationList &observations, const StreamOrdersPtr &orders,
+                   OrderedObservations &ordered)
+  {
+    ordered.clear();
+    ordered.reserve(observations.size());
+
+    bool positioned = true;
+    for (const auto &observation : observations)
+    {
+      auto dataItem = observation->getDataItem();
+      if (!dataItem || dataItem->isOrphan())
+        continue;
+
+      auto order = FindOrder(orders, *dataItem);
+      positioned = positioned && order != nullptr;
+
+      uint64_t key = 0;
+      if (order != nullptr)
+      {
+        uint64_t category = order->m_category;
+        auto type = dataItem->isCondition() ? LevelOrder(*observation) : order->m_type;
+        key = category << 32 | type;
+      }
+      ordered.push_back({key, observation->getSequence(), &observation});
+    }
+
+    if (positioned)
+    {
+      std::sort(ordered.begin(), ordered.end());
+    }
+    else
+    {
+      // Data items added since the order table was published are compared by their ids and
+      // names
+      auto key = [](const OrderedObservation &o) {
+        const auto &observation = *o;
+        auto dataItem = observation->getDataItem();
+        auto component = dataItem->getComponent();
+        return std::make_tuple(component->getDevice()->getId(), component->getId(),
+                               dataItem->getCategory(), observation->getName().str(),
+                               o.m_sequence);
+      };
+      std::sort(ordered.begin(), ordered.end(),
+                [&key](const auto &a, const auto &b) { return key(a) < key(b); });
+    }
+  }
+}  // namespace mtconnect::printer
@@ -0,0 +1,83 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "mtconnect/config.hpp"
+#include "mtconnect/observation/observation.hpp"
+
+namespace mtconnect::printer {
+  /// @brief An observation and its position in a streams document
+  struct OrderedObservation
+  {
+    uint64_t m_key;                                    ///< The position of the data item or type
+    SequenceNumber_t m_sequence;                       ///< The sequence number of the observation
+    const observation::ObservationPtr *m_observation;  ///< The observation in the list
+
+    /// @brief get the observation
+    /// @return the observation
+    const observation::ObservationPtr &operator*() const { return *m_observation; }
+    /// @brief order by the key and then the sequence
+    bool operator<(const OrderedObservation &other) const
+    {
+      return m_key < other.m_key || (m_key == other.m_key && m_sequence < other.m_sequence);
+    }
+  };
+
+  using OrderedObservations = std::vector<OrderedObservation>;
+
+  /// @brief The positions of a data item in the streams documents
+  struct StreamOrder
+  {
+    uint32_t m_stream {0};    ///< The position ordered by data item id, `0` if not ordered
+    uint32_t m_category {0};  ///< The position of the device id, component id, and category
+    uint32_t m_type {0};      ///< The position of the observation name in the category
+  };
+
+  /// @brief The positions of the data items of a device model version
+  ///
+  /// Indexed by `DataItem::getIndex()`. A table is never changed once it is published, a new
+  /// table is published when the device model changes.
+  using StreamOrders = std::vector<StreamOrder>;
+  using StreamOrdersPtr = std::shared_ptr<const StreamOrders>;
+
+  /// @brief Order observations for an XML streams document
+  ///
+  /// Orders by device id, component id, category, data item id, and sequence using the positions
+  /// in the order table. If a data item is not in the table, all the observations are ordered by
+  /// comparing the ids. Orphaned observations are skipped.
+  ///
+  /// @param[in] observations the observations, they must outlive the ordered observations
+  /// @param[in] orders the positions of the data items, can be `nullptr`
+  /// @param[out] ordered the ordered observations
+  AGENT_LIB_API void OrderByDataItem(const observation::ObservationList &observations,
+                                     const StreamOrdersPtr &orders, OrderedObservations &ordered);
+  /// @brief Order observations for a JSON streams document
+  ///
+  /// Orders by device id, component id, category, observation name, and sequence using the
+  /// positions in the order table. If a data item is not in the table, all the observations are
+  /// ordered by comparing the ids and names. Orphaned observations are skipped.
+  ///
+  /// @param[in] observations the observations, they must outlive the ordered observations
+  /// @param[in] orders the positions of the data items, can be `nullptr`
+  /// @param[out] ordered the ordered observations
+  AGENT_LIB_API void OrderByType(const observation::ObservationList &observations,
+                                 const StreamOrdersPtr &orders, OrderedObservations &ordered);
+}  // namespace mtconnect::printer
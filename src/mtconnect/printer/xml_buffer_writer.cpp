@@ -0,0 +1,73 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "xml_buffer_writer.hpp"
+
+#include <array>
+
+namespace mtconnect::printer {
+  namespace {
+    // Replacement for each character that is escaped, nullptr if the character is copied
+    using EscapeTable = std::array<const char *, 256>;
+
+    constexpr EscapeTable MakeEscapeTable(bool attribute)
+    {
+      EscapeTable table {};
+      table['<'] = "&lt;";
+      table['>'] = "&gt;";
+      table['&'] = "&amp;";
+      table['"'] = "&quot;";
+      table['\r'] = "&#13;";
+      if (attribute)
+      {
+        table['\n'] = "&#10;";
+        table['\t'] = "&#9;";
+      }
+      return table;
+    }
+
+    constexpr EscapeTable AttributeEscapes = MakeEscapeTable(true);
+    constexpr EscapeTable TextEscapes = MakeEscapeTable(false);
+
+    // Copy runs of characters that do not need escaping with a single append
+    inline void Escape(std::string &out, std::string_view value, const EscapeTable &table)
+    {
+      auto start = value.data();
+      const auto end = start + value.size();
+      for (auto cp = start; cp != end; cp++)
+      {
+        auto replacement = table[static_cast<unsigned char>(*cp)];
+        if (replacement != nullptr)
+        {
+          out.append(start, cp - start).append(replacement);
+          start = cp + 1;
+        }
+      }
+      out.append(start, end - start);
+    }
+  }  // namespace
+
+  void XmlBufferWriter::EscapeAttribute(std::string &out, std::string_view value)
+  {
+    Escape(out, value, AttributeEscapes);
+  }
+
+  void XmlBufferWriter::EscapeText(std::string &out, std::string_view text)
+  {
+    Escape(out, text, TextEscapes);
+  }
+}  // namespace mtconnect::printer
@@ -0,0 +1,167 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mtconnect/config.hpp"
+
+namespace mtconnect::printer {
+  /// @brief Writes XML directly into a string buffer
+  ///
+  /// Appends the same bytes as the `libxml2` text writer without indentation, so documents
+  /// written with either writer are identical. Characters are escaped the way `libxml2` escapes
+  /// them: `<`, `>`, `&` and `"` in text and attributes, carriage returns in text, and carriage
+  /// returns, newlines and tabs in attributes.
+  ///
+  /// Outside of a document, `libxml2` writes the non-ASCII characters of attribute values as
+  /// character references and how it treats invalid UTF-8 depends on its version. Use
+  /// `canWriteAttribute()` to find the values that must be written with `libxml2` instead, or
+  /// write fragments that are copied into documents as if they were in a document.
+  class AGENT_LIB_API XmlBufferWriter
+  {
+  public:
+    /// @brief Create a writer appending to a buffer
+    /// @param buffer the buffer, the caller can reserve its capacity and reuse it
+    /// @param inDocument `true` if the content is a fragment copied into a document
+    XmlBufferWriter(std::string &buffer, bool inDocument = false)
+      : m_buffer(buffer), m_document(inDocument)
+    {
+      m_elements.reserve(8);
+    }
+    /// @brief Writers cannot be copied
+    XmlBufferWriter(const XmlBufferWriter &) = delete;
+    ~XmlBufferWriter() = default;
+
+    /// @brief Write the XML declaration
+    void startDocument()
+    {
+      m_buffer.append(R"(<?xml version="1.0" encoding="UTF-8"?>)").push_back('\n');
+      m_document = true;
+    }
+    /// @brief Close all open elements and end the document with a newline
+    void endDocument()
+    {
+      while (!m_elements.empty())
+        endElement();
+      m_buffer.push_back('\n');
+    }
+    /// @brief Write a processing instruction
+    /// @param target the target and content of the instruction
+    void writePI(std::string_view target)
+    {
+      closeStartTag();
+      m_buffer.append("<?").append(target).append("?>");
+    }
+
+    /// @brief Open an element
+    /// @param name the element name
+    void startElement(std::string_view name)
+    {
+      closeStartTag();
+      m_buffer.push_back('<');
+      m_buffer.append(name);
+      m_elements.emplace_back(name);
+      m_startTag = true;
+    }
+    /// @brief Close the last open element, writes an empty element if it has no content
+    void endElement()
+    {
+      if (m_startTag)
+      {
+        m_buffer.append("/>");
+        m_startTag = false;
+      }
+      else
+      {
+        m_buffer.append("</").append(m_elements.back()).push_back('>');
+      }
+      m_elements.pop_back();
+    }
+    /// @brief Add an attribute to the element that was just opened
+    /// @param name the attribute name
+    /// @param value the attribute value, escaped when written
+    void addAttribute(std::string_view name, std::string_view value)
+    {
+      m_buffer.push_back(' ');
+      m_buffer.append(name).append("=\"");
+      EscapeAttribute(m_buffer, value);
+      m_buffer.push_back('"');
+    }
+    /// @brief Write text content
+    /// @param text the text, escaped when written
+    void writeText(std::string_view text)
+    {
+      closeStartTag();
+      EscapeText(m_buffer, text);
+    }
+    /// @brief Write content without escaping
+    /// @param raw the content
+    void writeRaw(std::string_view raw)
+    {
+      closeStartTag();
+      m_buffer.append(raw);
+    }
+
+    /// @brief Check if an attribute value is written the same as `libxml2`
+    /// @param value the attribute value
+    /// @return `true` if this writer writes the same characters
+    bool canWriteAttribute(std::string_view value) const
+    {
+      if (m_document)
+        return true;
+      for (auto c : value)
+        if (static_cast<unsigned char>(c) >= 0x80)
+          return false;
+      return true;
+    }
+    /// @brief is the writer inside a document
+    /// @return `true` if the declaration was written or the writer writes a document fragment
+    bool isDocument() const { return m_document; }
+    /// @brief get the number of open elements
+    /// @return the number of open elements
+    size_t depth() const { return m_elements.size(); }
+
+    /// @brief Append an attribute value with the characters escaped
+    /// @param[out] out the buffer to append to
+    /// @param[in] value the value
+    static void EscapeAttribute(std::string &out, std::string_view value);
+    /// @brief Append text with the characters escaped
+    /// @param[out] out the buffer to append to
+    /// @param[in] text the text
+    static void EscapeText(std::string &out, std::string_view text);
+
+  protected:
+    void closeStartTag()
+    {
+      if (m_startTag)
+      {
+        m_buffer.push_back('>');
+        m_startTag = false;
+      }
+    }
+
+  protected:
+    std::string &m_buffer;
+    std::vector<std::string> m_elements;
+    bool m_startTag {false};
+    bool m_document {false};
+  };
+}  // namespace mtconnect::printer
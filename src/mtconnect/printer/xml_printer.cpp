@@ -19,6 +19,7 @@
 
 #include <boost/asio/ip/host_name.hpp>
 
+#include <cstring>
 #include <set>
 #include <typeindex>
 #include <typeinfo>
@@ -33,6 +34,8 @@
 #include "mtconnect/device_model/device.hpp"
 #include "mtconnect/logging.hpp"
 #include "mtconnect/version.h"
+#include "stream_order.hpp"
+#include "xml_buffer_writer.hpp"
 #include "xml_printer.hpp"
 
 #define strfy(line) #line
@@ -57,7 +60,7 @@ namespace mtconnect::printer {
   class AGENT_LIB_API XmlWriter
   {
   public:
-    XmlWriter(bool pretty) : m_writer(nullptr), m_buf(nullptr)
+    XmlWriter(bool pretty, bool fragment = false) : m_writer(nullptr), m_buf(nullptr)
     {
       THROW_IF_XML2_NULL(m_buf = xmlBufferCreate());
       THROW_IF_XML2_NULL(m_writer = xmlNewTextWriterMemory(m_buf, 0));
@@ -66,6 +69,14 @@ namespace mtconnect::printer {
         THROW_IF_XML2_ERROR(xmlTextWriterSetIndent(m_writer, 1));
         THROW_IF_XML2_ERROR(xmlTextWriterSetIndentString(m_writer, BAD_CAST "  "));
       }
+      if (fragment)
+      {
+        // libxml2 escapes non-ASCII attribute values outside of a document, write the fragment
+        // after a declaration so it is the same as in the document it is copied into.
+        THROW_IF_XML2_ERROR(xmlTextWriterStartDocument(m_writer, nullptr, "UTF-8", nullptr));
+        THROW_IF_XML2_ERROR(xmlTextWriterFlush(m_writer));
+        m_start = m_buf->use;
+      }
     }
 
     ~XmlWriter()
@@ -95,9 +106,16 @@ namespace mtconnect::printer {
       return string((char *)m_buf->content, m_buf->use);
     }
 
+    string getFragment()
+    {
+      THROW_IF_XML2_ERROR(xmlTextWriterFlush(m_writer));
+      return string((char *)m_buf->content + m_start, m_buf->use - m_start);
+    }
+
   protected:
     xmlTextWriterPtr m_writer;
     xmlBufferPtr m_buf;
+    unsigned int m_start {0};
   };
 
   XmlPrinter::XmlPrinter(bool pretty) : Printer(pretty) { NAMED_SCOPE("xml.printer"); }
@@ -177,6 +195,7 @@ namespace mtconnect::printer {
     item.first = prefix;
 
     m_streamsNsSet.insert(prefix);
+    m_fragmentKey = NextFragmentKey();
 
     m_streamsNamespaces.insert(item);
   }
@@ -250,6 +269,13 @@ namespace mtconnect::printer {
           xmlTextWriterWriteAttribute(writer, BAD_CAST key, BAD_CAST value.c_str()));
   }
 
+  static inline void addAttribute(XmlBufferWriter &writer, const char *key,
+                                  const std::string &value)
+  {
+    if (!value.empty())
+      writer.addAttribute(key, value);
+  }
+
   void addAttributes(xmlTextWriterPtr writer, const std::map<string, string> &attributes)
   {
     for (const auto &attr : attributes)
@@ -418,6 +444,9 @@ namespace mtconnect::printer {
                                  const uint64_t lastSeq, ObservationList &observations,
                                  bool pretty) const
   {
+    if (m_directWriter && !(m_pretty || pretty))
+      return printSampleDirect(instanceId, bufferSize, nextSeq, firstSeq, lastSeq, observations);
+
     string ret;
 
     try
@@ -428,10 +457,12 @@ namespace mtconnect::printer {
 
       AutoElement streams(writer, "Streams");
 
-      // Sort the vector by category.
+      // Order the observations by device, component, category, and data item
       if (observations.size() > 0)
       {
-        observations.sort(ObservationCompare);
+        OrderedObservations ordered;
+        OrderByDataItem(observations, getStreamOrders(), ordered);
+        bool cacheFragments = m_cacheFragments && !(m_pretty || pretty);
 
         AutoElement deviceElement(writer);
         {
@@ -439,39 +470,40 @@ namespace mtconnect::printer {
           {
             AutoElement categoryElement(writer);
 
-            for (auto &observation : observations)
+            for (auto &position : ordered)
             {
-              if (!observation->isOrphan())
-              {
-                const auto &dataItem = observation->getDataItem();
-                const auto &component = dataItem->getComponent();
-                const auto &device = component->getDevice();
+              const auto &observation = *position;
+              const auto &dataItem = observation->getDataItem();
+              const auto &component = dataItem->getComponent();
+              const auto &device = component->getDevice();
 
-                if (deviceElement.key() != device->getId())
-                {
-                  categoryElement.reset("");
-                  componentStreamElement.reset("");
+              if (deviceElement.key() != device->getId())
+              {
+                categoryElement.reset("");
+                componentStreamElement.reset("");
 
-                  deviceElement.reset("DeviceStream", device->getId());
-                  addAttribute(writer, "name", *device->getComponentName());
-                  addAttribute(writer, "uuid", *device->getUuid());
-                }
+                deviceElement.reset("DeviceStream", device->getId());
+                addAttribute(writer, "name", *device->getComponentName());
+                addAttribute(writer, "uuid", *device->getUuid());
+              }
 
-                if (componentStreamElement.key() != component->getId())
-                {
-                  categoryElement.reset("");
+              if (componentStreamElement.key() != component->getId())
+              {
+                categoryElement.reset("");
 
-                  componentStreamElement.reset("ComponentStream", component->getId());
-                  addAttribute(writer, "component", component->getName());
-                  if (component->getComponentName())
-                    addAttribute(writer, "name", *component->getComponentName());
-                  addAttribute(writer, "componentId", component->getId());
-                }
+                componentStreamElement.reset("ComponentStream", component->getId());
+                addAttribute(writer, "component", component->getName());
+                if (component->getComponentName())
+                  addAttribute(writer, "name", *component->getComponentName());
+                addAttribute(writer, "componentId", component->getId());
+              }
 
-                categoryElement.reset(dataItem->getCategoryText());
+              categoryElement.reset(dataItem->getCategoryText());
 
+              if (cacheFragments)
+                addCachedObservation(writer, observation);
+              else
                 addObservation(writer, observation);
-              }
             }
           }
         }
@@ -494,6 +526,113 @@ namespace mtconnect::printer {
     return ret;
   }
 
+  string XmlPrinter::printSampleDirect(const uint64_t instanceId, const unsigned int bufferSize,
+                                       const uint64_t nextSeq, const uint64_t firstSeq,
+                                       const uint64_t lastSeq, ObservationList &observations) const
+  {
+    // Each thread reuses its buffer, so it only grows until it holds the largest document
+    constexpr size_t MaxRetainedBuffer = 1024 * 1024;
+    thread_local string buffer;
+    buffer.clear();
+    buffer.reserve(1024 + observations.size() * 128);
+
+    string ret;
+
+    try
+    {
+      XmlBufferWriter writer(buffer);
+
+      initXmlDoc(writer, eSTREAMS, instanceId, bufferSize, nextSeq, firstSeq, lastSeq);
+
+      writer.startElement("Streams");
+
+      // Order the observations by device, component, category, and data item
+      if (observations.size() > 0)
+      {
+        OrderedObservations ordered;
+        OrderByDataItem(observations, getStreamOrders(), ordered);
+
+        // The open DeviceStream, ComponentStream and category elements
+        const device_model::Device *deviceElement {nullptr};
+        const device_model::Component *componentStreamElement {nullptr};
+        const char *categoryElement {nullptr};
+
+        for (auto &position : ordered)
+        {
+          const auto &observation = *position;
+          const auto &dataItem = observation->getDataItem();
+          const auto &component = dataItem->getComponent();
+          const auto &device = component->getDevice();
+
+          if (deviceElement != device.get())
+          {
+            if (categoryElement)
+              writer.endElement();
+            if (componentStreamElement)
+              writer.endElement();
+            if (deviceElement)
+              writer.endElement();
+            categoryElement = nullptr;
+            componentStreamElement = nullptr;
+
+            deviceElement = device.get();
+            writer.startElement("DeviceStream");
+            addAttribute(writer, "name", *device->getComponentName());
+            addAttribute(writer, "uuid", *device->getUuid());
+          }
+
+          if (componentStreamElement != component.get())
+          {
+            if (categoryElement)
+              writer.endElement();
+            if (componentStreamElement)
+              writer.endElement();
+            categoryElement = nullptr;
+
+            componentStreamElement = component.get();
+            writer.startElement("ComponentStream");
+            addAttribute(writer, "component", component->getName());
+            if (component->getComponentName())
+              addAttribute(writer, "name", *component->getComponentName());
+            addAttribute(writer, "componentId", component->getId());
+          }
+
+          if (categoryElement == nullptr ||
+              strcmp(categoryElement, dataItem->getCategoryText()) != 0)
+          {
+            if (categoryElement)
+              writer.endElement();
+            categoryElement = dataItem->getCategoryText();
+            writer.startElement(categoryElement);
+          }
+
+          if (m_cacheFragments)
+            addCachedObservation(writer, observation);
+          else
+            addObservation(writer, observation);
+        }
+      }
+
+      // Closes the open streams, Streams and MTConnectStreams
+      writer.endDocument();
+
+      if (buffer.capacity() > MaxRetainedBuffer)
+        ret = std::move(buffer);
+      else
+        ret = buffer;
+    }
+    catch (string error)
+    {
+      LOG(error) << "printSample: " << error;
+    }
+    catch (...)
+    {
+      LOG(error) << "printSample: unknown error";
+    }
+
+    return ret;
+  }
+
   string XmlPrinter::printAssets(const uint64_t instanceId, const unsigned int bufferSize,
                                  const unsigned int assetCount, const AssetList &asset,
                                  bool pretty) const
@@ -534,67 +673,110 @@ namespace mtconnect::printer {
     printer.print(writer, result, m_streamsNsSet);
   }
 
-  void XmlPrinter::initXmlDoc(xmlTextWriterPtr writer, EDocumentType aType,
-                              const uint64_t instanceId, const unsigned int bufferSize,
-                              const unsigned int assetBufferSize, const unsigned int assetCount,
-                              const uint64_t nextSeq, const uint64_t firstSeq,
-                              const uint64_t lastSeq, const map<string, size_t> *count) const
+  void XmlPrinter::addCachedObservation(xmlTextWriterPtr writer,
+                                        const ObservationPtr &result) const
   {
-    THROW_IF_XML2_ERROR(xmlTextWriterStartDocument(writer, nullptr, "UTF-8", nullptr));
+    auto fragment = getCachedFragment(result);
+    THROW_IF_XML2_ERROR(xmlTextWriterWriteRawLen(writer, BAD_CAST fragment->m_text.data(),
+                                                 int(fragment->m_text.size())));
+  }
+
+  void XmlPrinter::addObservation(XmlBufferWriter &writer, const ObservationPtr &result) const
+  {
+    entity::XmlPrinter printer;
+    if (!printer.print(writer, result, m_streamsNsSet))
+    {
+      // Data sets, tables and attributes the buffer writer cannot escape are written by libxml2
+      XmlWriter fragmentWriter(false, writer.isDocument());
+      addObservation(fragmentWriter, result);
+      writer.writeRaw(fragmentWriter.getFragment());
+    }
+  }
+
+  void XmlPrinter::addCachedObservation(XmlBufferWriter &writer,
+                                        const ObservationPtr &result) const
+  {
+    auto fragment = getCachedFragment(result);
+    writer.writeRaw(fragment->m_text);
+  }
 
+  FragmentCache::FragmentPtr XmlPrinter::getCachedFragment(const ObservationPtr &result) const
+  {
+    const auto &fragments = result->getFragments();
+    auto fragment = fragments.get(FragmentCache::XML, m_fragmentKey);
+    if (!fragment)
+    {
+      // Fragments are written as they are in a document, both writers write the same text
+      string text;
+      if (m_directWriter)
+      {
+        XmlBufferWriter fragmentWriter(text, true);
+        addObservation(fragmentWriter, result);
+      }
+      else
+      {
+        XmlWriter fragmentWriter(false, true);
+        addObservation(fragmentWriter, result);
+        text = fragmentWriter.getFragment();
+      }
+      fragment = fragments.set(FragmentCache::XML, m_fragmentKey, std::move(text));
+    }
+
+    return fragment;
+  }
+
+  void XmlPrinter::makeDocumentHeader(DocumentHeader &header, EDocumentType aType,
+                                      const uint64_t instanceId, const unsigned int bufferSize,
+                                      const unsigned int assetBufferSize,
+                                      const unsigned int assetCount, const uint64_t nextSeq,
+                                      const uint64_t firstSeq, const uint64_t lastSeq) const
+  {
     // TODO: Cache the locations and header attributes.
     // Write the root element
-    string xmlType, style;
+    string xmlType;
     const map<string, SchemaNamespace> *namespaces;
 
     switch (aType)
     {
       case eERROR:
         namespaces = &m_errorNamespaces;
-        style = m_errorStyle;
+        header.m_style = m_errorStyle;
         xmlType = "Error";
         break;
 
       case eSTREAMS:
         namespaces = &m_streamsNamespaces;
-        style = m_streamsStyle;
+        header.m_style = m_streamsStyle;
         xmlType = "Streams";
         break;
 
       case eDEVICES:
         namespaces = &m_devicesNamespaces;
-        style = m_devicesStyle;
+        header.m_style = m_devicesStyle;
         xmlType = "Devices";
         break;
 
       case eASSETS:
         namespaces = &m_assetNamespaces;
-        style = m_assetStyle;
+        header.m_style = m_assetStyle;
         xmlType = "Assets";
         break;
     }
 
-    if (!style.empty())
-    {
-      string pi = R"(xml-stylesheet type="text/xsl" href=")" + style + '"';
-      THROW_IF_XML2_ERROR(xmlTextWriterStartPI(writer, BAD_CAST pi.c_str()));
-      THROW_IF_XML2_ERROR(xmlTextWriterEndPI(writer));
-    }
-
     string rootName = "MTConnect" + xmlType;
     if (!m_schemaVersion)
       defaultSchemaVersion();
     string xmlns = "urn:mtconnect.org:" + rootName + ":" + *m_schemaVersion;
     string location;
 
-    openElement(writer, rootName.c_str());
+    auto &root = header.m_rootAttributes;
 
     // Always make the default namespace and the m: namespace MTConnect default.
-    addAttribute(writer, "xmlns:m", xmlns);
-    addAttribute(writer, "xmlns", xmlns);
+    root.emplace_back("xmlns:m", xmlns);
+    root.emplace_back("xmlns", xmlns);
 
     // Alwats add the xsi namespace
-    addAttribute(writer, "xmlns:xsi", "http://www.w3.org/2001/XMLSchema-instance");
+    root.emplace_back("xmlns:xsi", "http://www.w3.org/2001/XMLSchema-instance");
 
     string mtcLocation;
 
@@ -604,8 +786,7 @@ namespace mtconnect::printer {
       // Skip the mtconnect ns (always m)
       if (ns.first != "m")
       {
-        string attr = "xmlns:" + ns.first;
-        addAttribute(writer, attr.c_str(), ns.second.mUrn);
+        header.m_namespaces.emplace_back("xmlns:" + ns.first, ns.second.mUrn);
 
         if (location.empty() && !ns.second.mSchemaLocation.empty())
         {
@@ -627,12 +808,13 @@ namespace mtconnect::printer {
       location = xmlns + " http://schemas.mtconnect.org/schemas/" + rootName + "_" +
                  *m_schemaVersion + ".xsd";
 
-    addAttribute(writer, "xsi:schemaLocation", location);
+    header.m_schemaLocation = location;
+    header.m_rootName = rootName;
 
     // Create the header
-    AutoElement header(writer, "Header");
+    auto &attributes = header.m_headerAttributes;
 
-    addAttribute(writer, "creationTime", getCurrentTime(GMT));
+    attributes.emplace_back("creationTime", getCurrentTime(GMT));
 
     static std::string sHostname;
     if (sHostname.empty())
@@ -642,44 +824,79 @@ namespace mtconnect::printer {
       if (ec)
         sHostname = "localhost";
     }
-    addAttribute(writer, "sender", sHostname);
-    addAttribute(writer, "instanceId", to_string(instanceId));
+    attributes.emplace_back("sender", sHostname);
+    attributes.emplace_back("instanceId", to_string(instanceId));
 
     char version[32] = {0};
     sprintf(version, "%d.%d.%d.%d", AGENT_VERSION_MAJOR, AGENT_VERSION_MINOR, AGENT_VERSION_PATCH,
             AGENT_VERSION_BUILD);
-    addAttribute(writer, "version", version);
+    attributes.emplace_back("version", version);
 
     int major, minor;
     char c;
     stringstream v(*m_schemaVersion);
     v >> major >> c >> minor;
+    header.m_major = major;
 
     if (major > 1 || (major == 1 && minor >= 7))
     {
-      addAttribute(writer, "deviceModelChangeTime", m_modelChangeTime);
+      attributes.emplace_back("deviceModelChangeTime", getModelChangeTime());
     }
 
     if (aType == eASSETS || aType == eDEVICES)
     {
-      addAttribute(writer, "assetBufferSize", to_string(assetBufferSize));
-      addAttribute(writer, "assetCount", to_string(assetCount));
+      attributes.emplace_back("assetBufferSize", to_string(assetBufferSize));
+      attributes.emplace_back("assetCount", to_string(assetCount));
     }
 
     if (aType == eDEVICES || aType == eERROR || aType == eSTREAMS)
     {
-      addAttribute(writer, "bufferSize", to_string(bufferSize));
+      attributes.emplace_back("bufferSize", to_string(bufferSize));
     }
 
     if (aType == eSTREAMS)
     {
       // Add additional attribtues for streams
-      addAttribute(writer, "nextSequence", to_string(nextSeq));
-      addAttribute(writer, "firstSequence", to_string(firstSeq));
-      addAttribute(writer, "lastSequence", to_string(lastSeq));
+      attributes.emplace_back("nextSequence", to_string(nextSeq));
+      attributes.emplace_back("firstSequence", to_string(firstSeq));
+      attributes.emplace_back("lastSequence", to_string(lastSeq));
+    }
+  }
+
+  void XmlPrinter::initXmlDoc(xmlTextWriterPtr writer, EDocumentType aType,
+                              const uint64_t instanceId, const unsigned int bufferSize,
+                              const unsigned int assetBufferSize, const unsigned int assetCount,
+                              const uint64_t nextSeq, const uint64_t firstSeq,
+                              const uint64_t lastSeq, const map<string, size_t> *count) const
+  {
+    THROW_IF_XML2_ERROR(xmlTextWriterStartDocument(writer, nullptr, "UTF-8", nullptr));
+
+    DocumentHeader header;
+    makeDocumentHeader(header, aType, instanceId, bufferSize, assetBufferSize, assetCount,
+                       nextSeq, firstSeq, lastSeq);
+
+    if (!header.m_style.empty())
+    {
+      string pi = R"(xml-stylesheet type="text/xsl" href=")" + header.m_style + '"';
+      THROW_IF_XML2_ERROR(xmlTextWriterStartPI(writer, BAD_CAST pi.c_str()));
+      THROW_IF_XML2_ERROR(xmlTextWriterEndPI(writer));
     }
 
-    if (major < 2 && aType == eDEVICES && count && !count->empty())
+    openElement(writer, header.m_rootName.c_str());
+
+    for (const auto &attr : header.m_rootAttributes)
+      addAttribute(writer, attr.first, attr.second);
+    for (const auto &ns : header.m_namespaces)
+      addAttribute(writer, ns.first.c_str(), ns.second);
+    addAttribute(writer, "xsi:schemaLocation", header.m_schemaLocation);
+
+    // Create the header
+    AutoElement headerElement(writer, "Header");
+
+    for (const auto &attr : header.m_headerAttributes)
+      addAttribute(writer, attr.first, attr.second);
+
+    if (header.m_major < 2 && aType == eDEVICES && count && !count->empty())
     {
       AutoElement ele(writer, "AssetCounts");
 
@@ -689,4 +906,34 @@ namespace mtconnect::printer {
       }
     }
   }
+
+  void XmlPrinter::initXmlDoc(XmlBufferWriter &writer, EDocumentType aType,
+                              const uint64_t instanceId, const unsigned int bufferSize,
+                              const uint64_t nextSeq, const uint64_t firstSeq,
+                              const uint64_t lastSeq) const
+  {
+    writer.startDocument();
+
+    DocumentHeader header;
+    makeDocumentHeader(header, aType, instanceId, bufferSize, 0, 0, nextSeq, firstSeq, lastSeq);
+
+    if (!header.m_style.empty())
+    {
+      string pi = R"(xml-stylesheet type="text/xsl" href=")" + header.m_style + '"';
+      writer.writePI(pi);
+    }
+
+    writer.startElement(header.m_rootName);
+
+    for (const auto &attr : header.m_rootAttributes)
+      addAttribute(writer, attr.first, attr.second);
+    for (const auto &ns : header.m_namespaces)
+      addAttribute(writer, ns.first.c_str(), ns.second);
+    addAttribute(writer, "xsi:schemaLocation", header.m_schemaLocation);
+
+    writer.startElement("Header");
+    for (const auto &attr : header.m_headerAttributes)
+      addAttribute(writer, attr.first, attr.second);
+    writer.endElement();
+  }
 }  // namespace mtconnect::printer
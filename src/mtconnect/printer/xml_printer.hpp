@@ -18,6 +18,8 @@
 #pragma once
 
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "mtconnect/asset/asset.hpp"
 #include "mtconnect/config.hpp"
@@ -35,6 +37,7 @@ namespace mtconnect {
 
   namespace printer {
     class XmlWriter;
+    class XmlBufferWriter;
 
     /// @brief Printer to generate XML Documents
     class AGENT_LIB_API XmlPrinter : public Printer
@@ -62,6 +65,18 @@ namespace mtconnect {
                               bool pretty = false) const override;
       std::string mimeType() const override { return "text/xml"; }
 
+      /// @brief Write sample and current documents directly into a buffer
+      ///
+      /// Documents that are not pretty printed are written with the XmlBufferWriter instead of
+      /// `libxml2`. The documents are identical, observations with data sets or tables are
+      /// still written by `libxml2`.
+      ///
+      /// @param direct `true` to write the streams documents directly
+      void setDirectWriter(bool direct) { m_directWriter = direct; }
+      /// @brief are streams documents written directly into a buffer
+      /// @return `true` if the documents are written directly
+      bool getDirectWriter() const { return m_directWriter; }
+
       /// @brief Add a Devices XML device namespace
       /// @param urn the namespace URN
       /// @param location the location of the schema file
@@ -162,18 +177,52 @@ namespace mtconnect {
         std::string mSchemaLocation;
       };
 
+      // The root element and header of a document, empty attributes are not written
+      struct DocumentHeader
+      {
+        std::string m_rootName;
+        std::string m_style;
+        std::vector<std::pair<const char *, std::string>> m_rootAttributes;
+        std::vector<std::pair<std::string, std::string>> m_namespaces;
+        std::string m_schemaLocation;
+        std::vector<std::pair<const char *, std::string>> m_headerAttributes;
+        int m_major {0};
+      };
+
+      void makeDocumentHeader(DocumentHeader &header, EDocumentType docType,
+                              const uint64_t instanceId, const unsigned int bufferSize,
+                              const unsigned int assetBufferSize, const unsigned int assetCount,
+                              const uint64_t nextSeq, const uint64_t firstSeq,
+                              const uint64_t lastSeq) const;
+
       // Initiate all documents
       void initXmlDoc(xmlTextWriterPtr writer, EDocumentType docType, const uint64_t instanceId,
                       const unsigned int bufferSize, const unsigned int assetBufferSize,
                       const unsigned int assetCount, const uint64_t nextSeq,
                       const uint64_t firstSeq = 0, const uint64_t lastSeq = 0,
                       const std::map<std::string, size_t> *counts = nullptr) const;
+      // Initiate documents written directly, without asset counts
+      void initXmlDoc(XmlBufferWriter &writer, EDocumentType docType, const uint64_t instanceId,
+                      const unsigned int bufferSize, const uint64_t nextSeq,
+                      const uint64_t firstSeq, const uint64_t lastSeq) const;
+
+      std::string printSampleDirect(const uint64_t instanceId, const unsigned int bufferSize,
+                                    const uint64_t nextSeq, const uint64_t firstSeq,
+                                    const uint64_t lastSeq,
+                                    observation::ObservationList &results) const;
 
       // Helper to print individual components and details
       void printProbeHelper(xmlTextWriterPtr writer, device_model::ComponentPtr component,
                             const char *name) const;
       void printDataItem(xmlTextWriterPtr writer, DataItemPtr dataItem) const;
       void addObservation(xmlTextWriterPtr writer, observation::ObservationPtr result) const;
+      void addCachedObservation(xmlTextWriterPtr writer,
+                                const observation::ObservationPtr &result) const;
+      void addObservation(XmlBufferWriter &writer, const observation::ObservationPtr &result) const;
+      void addCachedObservation(XmlBufferWriter &writer,
+                                const observation::ObservationPtr &result) const;
+      observation::FragmentCache::FragmentPtr getCachedFragment(
+          const observation::ObservationPtr &result) const;
 
     protected:
       std::map<std::string, SchemaNamespace> m_devicesNamespaces;
@@ -190,6 +239,8 @@ namespace mtconnect {
       std::string m_devicesStyle;
       std::string m_errorStyle;
       std::string m_assetStyle;
+
+      bool m_directWriter {false};
     };
   }  // namespace printer
 }  // namespace mtconnect
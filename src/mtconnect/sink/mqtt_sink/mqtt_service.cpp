@@ -77,8 +77,11 @@ namespace mtconnect {
           auto obsList {circ.getLatest().getObservations()};
           for (auto &obs : obsList)
           {
-            observation::ObservationPtr p {obs.second};
-            publish(p);
+            if (obs)
+            {
+              observation::ObservationPtr p {obs};
+              publish(p);
+            }
           }
 
           AssetList list;
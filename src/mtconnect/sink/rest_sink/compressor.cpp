@@ -0,0 +1,103 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "compressor.hpp"
+
+#include <boost/algorithm/string.hpp>
+
+#include <zlib.h>
+
+#include "mtconnect/logging.hpp"
+
+using namespace std;
+
+namespace mtconnect::sink::rest_sink {
+  Compressor::Encoding Compressor::Negotiate(const string &acceptEncoding)
+  {
+    Encoding encoding {NONE};
+    vector<string> codings;
+    boost::split(codings, acceptEncoding, boost::is_any_of(","));
+    for (auto &coding : codings)
+    {
+      // Ignore the codings the client refuses with `q=0`
+      auto params = coding.find(';');
+      auto name = boost::trim_copy(coding.substr(0, params));
+      if (params != string::npos)
+      {
+        auto q = coding.find("q=", params);
+        if (q != string::npos && atof(coding.c_str() + q + 2) <= 0.0)
+          continue;
+      }
+
+      if (boost::iequals(name, "gzip") || boost::iequals(name, "x-gzip") || name == "*")
+        return GZIP;
+      else if (boost::iequals(name, "deflate"))
+        encoding = DEFLATE;
+    }
+
+    return encoding;
+  }
+
+  Compressor::Compressor(Encoding encoding) : m_encoding(encoding), m_stream(new z_stream)
+  {
+    m_stream->zalloc = Z_NULL;
+    m_stream->zfree = Z_NULL;
+    m_stream->opaque = Z_NULL;
+
+    // Window bits greater than 15 write the gzip header and trailer
+    int windowBits = encoding == GZIP ? MAX_WBITS + 16 : MAX_WBITS;
+    if (deflateInit2(m_stream.get(), Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+      LOG(error) << "Cannot create compression context: "
+                 << (m_stream->msg ? m_stream->msg : "unknown error");
+      throw std::bad_alloc();
+    }
+  }
+
+  Compressor::~Compressor() { deflateEnd(m_stream.get()); }
+
+  string Compressor::compress(string_view data, bool finish)
+  {
+    string out;
+    if (m_finished)
+      return out;
+
+    m_stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    m_stream->avail_in = uInt(data.size());
+
+    // A sync flush ends every part on a byte boundary so it can be decoded immediately
+    int flush = finish ? Z_FINISH : Z_SYNC_FLUSH;
+    size_t used = 0;
+    int res;
+    do
+    {
+      out.resize(used + deflateBound(m_stream.get(), uLong(m_stream->avail_in)) + 16);
+      m_stream->next_out = reinterpret_cast<Bytef *>(out.data() + used);
+      m_stream->avail_out = uInt(out.size() - used);
+      res = deflate(m_stream.get(), flush);
+      used = out.size() - m_stream->avail_out;
+    } while (res == Z_OK && m_stream->avail_out == 0);
+
+    if (res == Z_STREAM_ERROR)
+      LOG(error) << "Compression failed";
+    m_finished = finish;
+    out.resize(used);
+
+    return out;
+  }
+}  // namespace mtconnect::sink::rest_sink
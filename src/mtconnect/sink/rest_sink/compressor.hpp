@@ -0,0 +1,89 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "mtconnect/config.hpp"
+
+struct z_stream_s;
+
+namespace mtconnect::sink::rest_sink {
+  /// @brief Streaming compression of response bodies with gzip or deflate
+  ///
+  /// One compression context is kept for the whole response, so the chunks of a stream share the
+  /// compression dictionary. The output of each call is flushed so the client can decompress a
+  /// chunk as soon as it arrives.
+  class AGENT_LIB_API Compressor
+  {
+  public:
+    /// @brief Content encodings
+    enum Encoding
+    {
+      NONE,     ///< Not compressed
+      GZIP,     ///< gzip format
+      DEFLATE,  ///< zlib format
+    };
+
+    /// @brief Responses smaller than this are not compressed
+    static constexpr size_t MinimumSize {1024};
+
+    /// @brief Choose an encoding from an `Accept-Encoding` header
+    /// @param[in] acceptEncoding the header value
+    /// @return the preferred encoding or `NONE` if gzip and deflate are not accepted
+    static Encoding Negotiate(const std::string &acceptEncoding);
+    /// @brief get the `Content-Encoding` name of an encoding
+    /// @param[in] encoding the encoding
+    /// @return the name
+    static const char *Name(Encoding encoding)
+    {
+      switch (encoding)
+      {
+        case GZIP:
+          return "gzip";
+        case DEFLATE:
+          return "deflate";
+        default:
+          return "identity";
+      }
+    }
+
+    /// @brief Create a compression context
+    /// @param[in] encoding either `GZIP` or `DEFLATE`
+    Compressor(Encoding encoding);
+    Compressor(const Compressor &) = delete;
+    ~Compressor();
+
+    /// @brief Compress the next part of the body
+    /// @param[in] data the uncompressed data
+    /// @param[in] finish `true` if this is the end of the body
+    /// @return the compressed data
+    std::string compress(std::string_view data, bool finish = false);
+
+    /// @brief get the encoding
+    /// @return the encoding
+    Encoding getEncoding() const { return m_encoding; }
+
+  protected:
+    Encoding m_encoding;
+    std::unique_ptr<z_stream_s> m_stream;
+    bool m_finished {false};
+  };
+}  // namespace mtconnect::sink::rest_sink
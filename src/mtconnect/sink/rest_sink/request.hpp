@@ -61,6 +61,7 @@ namespace mtconnect::sink::rest_sink {
     std::string m_body;               ///< The body of the request
     std::string m_accepts;            ///< The accepts header
     std::string m_acceptsEncoding;    ///< Encodings that can be returned
+    std::string m_ifNoneMatch;        ///< Entity tags of the documents the requestor has
     std::string m_contentType;        ///< The content type for the body
     std::string m_path;               ///< The URI for the request
     std::string m_foreignIp;          ///< The requestors IP Address
@@ -20,10 +20,14 @@
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/beast/http/status.hpp>
 
+#include <array>
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 
 #include "cached_file.hpp"
+#include "compressor.hpp"
 #include "mtconnect/config.hpp"
 #include "mtconnect/utilities.hpp"
 #include "request.hpp"
@@ -35,6 +39,38 @@ namespace mtconnect {
   namespace sink::rest_sink {
     using status = boost::beast::http::status;
 
+    /// @brief A generated document shared by the responses of a cache
+    ///
+    /// The compressed forms of the document are created the first time they are requested and
+    /// kept with the document.
+    struct SharedBody
+    {
+      /// @brief Create a shared body from a document
+      /// @param[in] body the document
+      SharedBody(std::string &&body) : m_body(std::move(body)) {}
+      SharedBody(const SharedBody &) = delete;
+
+      /// @brief get the document compressed with an encoding
+      /// @param[in] encoding either `GZIP` or `DEFLATE`
+      /// @return the compressed document
+      const std::string &compressed(Compressor::Encoding encoding)
+      {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto &compressed = m_compressed[encoding];
+        if (!compressed)
+          compressed = std::make_unique<std::string>(Compressor(encoding).compress(m_body, true));
+        return *compressed;
+      }
+
+      const std::string m_body;  ///< The uncompressed document
+
+    protected:
+      std::mutex m_lock;
+      std::array<std::unique_ptr<std::string>, 3> m_compressed;
+    };
+
+    using SharedBodyPtr = std::shared_ptr<SharedBody>;
+
     /// @brief A response for a simple request request returning some content
     struct Response
     {
@@ -61,11 +97,13 @@ namespace mtconnect {
       std::string m_body;                     ///< The body of the response
       std::string m_mimeType;                 ///< The mime type of the response
       std::optional<std::string> m_location;  ///< optional location
+      std::optional<std::string> m_etag;      ///< optional entity tag of the body
       std::chrono::seconds
           m_expires;         ///< how long should this session should stay open before it is closed
       bool m_close {false};  ///< `true` if this session should closed after it responds
 
-      CachedFilePtr m_file;  ///< Cached file if a file is being returned
+      CachedFilePtr m_file;    ///< Cached file if a file is being returned
+      SharedBodyPtr m_shared;  ///< Shared document returned instead of the body
     };
 
     using ResponsePtr = std::unique_ptr<Response>;
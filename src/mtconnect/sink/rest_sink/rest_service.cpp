@@ -17,6 +17,9 @@
 
 #include "rest_service.hpp"
 
+#include <unordered_set>
+
+#include "mtconnect/buffer/buffer_snapshot.hpp"
 #include "mtconnect/configuration/config_options.hpp"
 #include "mtconnect/entity/xml_parser.hpp"
 #include "mtconnect/pipeline/shdr_token_mapper.hpp"
@@ -46,8 +49,28 @@ namespace mtconnect {
         m_strand(context),
         m_schemaVersion(GetOption<string>(options, config::SchemaVersion).value_or("x.y")),
         m_options(options),
-        m_logStreamData(GetOption<bool>(options, config::LogStreams).value_or(false))
+        m_logStreamData(GetOption<bool>(options, config::LogStreams).value_or(false)),
+        m_streamCounters(make_shared<StreamCounters>()),
+        m_streamMetricsTimer(context)
     {
+      // One shard per worker thread so the streams are printed in parallel
+      auto shards = std::max(GetOption<int>(options, config::WorkerThreads).value_or(1), 1);
+      for (int i = 0; i < shards; i++)
+        m_shards.emplace_back(make_unique<StreamShard>(context));
+
+      m_backlogLimit = uint64_t(
+          std::max(GetOption<int>(options, config::StreamBacklogLimit).value_or(0), 0));
+      auto policy = GetOption<string>(options, config::StreamBacklogPolicy);
+      if (policy)
+      {
+        if (iequals(*policy, "Coalesce"))
+          m_backlogPolicy = BacklogPolicy::COALESCE;
+        else if (iequals(*policy, "Skip"))
+          m_backlogPolicy = BacklogPolicy::SKIP;
+        else if (!iequals(*policy, "Disconnect"))
+          LOG(warning) << "Unknown StreamBacklogPolicy " << *policy << ", using Disconnect";
+      }
+
       auto maxSize =
           ConvertFileSize(options, mtconnect::configuration::MaxCachedFileSize, 20 * 1024);
       auto compressSize =
@@ -113,6 +136,7 @@ namespace mtconnect {
       createCurrentRoutings();
       createSampleRoutings();
       createAssetRoutings();
+      createSnapshotRoutings();
       createPutObservationRoutings();
       createFileRoutings();
 
@@ -131,9 +155,24 @@ namespace mtconnect {
           });
     }
 
-    void RestService::start() { m_server->start(); }
+    void RestService::start()
+    {
+      // Continue the instance of a recovered durable buffer or buffer snapshot
+      if (auto id = m_sinkContract->getInstanceId())
+        m_instanceId = *id;
+      m_server->start();
+
+      if (m_sinkContract->getDataItemById("stream_count"))
+        publishStreamMetrics();
+    }
 
-    void RestService::stop() { m_server->stop(); }
+    void RestService::stop()
+    {
+      m_streamMetricsTimer.cancel();
+      m_server->stop();
+      for (auto &shard : m_shards)
+        shard->m_wheel->stop();
+    }
 
     // Configuration
     void RestService::loadNamespace(const ptree &tree, const char *namespaceType,
@@ -388,6 +427,33 @@ namespace mtconnect {
       session->writeResponse(std::move(response));
     }
 
+    // Check if an If-None-Match header has an entity tag, the weak comparison ignores the W/
+    static bool ETagMatches(string_view ifNoneMatch, string_view etag)
+    {
+      auto opaque = [](string_view tag) {
+        auto first = tag.find_first_not_of(" \t");
+        if (first == string_view::npos)
+          return string_view();
+        tag = tag.substr(first, tag.find_last_not_of(" \t") - first + 1);
+        if (tag.substr(0, 2) == "W/")
+          tag.remove_prefix(2);
+        return tag;
+      };
+
+      auto tag = opaque(etag);
+      while (!ifNoneMatch.empty())
+      {
+        auto comma = ifNoneMatch.find(',');
+        auto t = opaque(ifNoneMatch.substr(0, comma));
+        if (t == "*" || t == tag)
+          return true;
+        if (comma == string_view::npos)
+          break;
+        ifNoneMatch.remove_prefix(comma + 1);
+      }
+      return false;
+    }
+
     void RestService::createFileRoutings()
     {
       using namespace rest_sink;
@@ -427,7 +493,16 @@ namespace mtconnect {
             m_sinkContract->findDeviceByUUIDorName(*device) == nullptr)
           return false;
 
-        respond(session, probeRequest(printer, device, pretty));
+        auto response = probeRequest(printer, device, pretty);
+        if (!request->m_ifNoneMatch.empty() &&
+            ETagMatches(request->m_ifNoneMatch, *response->m_etag))
+        {
+          auto notModified =
+              make_unique<Response>(rest_sink::status::not_modified, "", response->m_mimeType);
+          notModified->m_etag = response->m_etag;
+          response = std::move(notModified);
+        }
+        respond(session, std::move(response));
         return true;
       };
 
@@ -595,7 +670,9 @@ namespace mtconnect {
           streamCurrentRequest(session, printerForAccepts(request->m_accepts), *interval,
                                request->parameter<string>("device"),
                                request->parameter<string>("path"),
-                               *request->parameter<bool>("pretty"));
+                               *request->parameter<bool>("pretty"),
+                               *request->parameter<bool>("delta"),
+                               *request->parameter<int32_t>("refresh"));
         }
         else
         {
@@ -610,7 +687,8 @@ namespace mtconnect {
 
       string qp(
           "path={string}&at={unsigned_integer}&"
-          "interval={integer}&pretty={bool:false}");
+          "interval={integer}&pretty={bool:false}&"
+          "delta={bool:false}&refresh={integer:10000}");
       m_server->addRouting({boost::beast::http::verb::get, "/current?" + qp, handler})
           .document("MTConnect current request",
                     "Gets a stapshot of the state of all the observations for all devices "
@@ -625,23 +703,28 @@ namespace mtconnect {
     {
       using namespace rest_sink;
       auto handler = [&](SessionPtr session, RequestPtr request) -> bool {
+        auto printer = printerForAccepts(request->m_accepts);
+        auto fromTime = checkTimestamp(printer, request->parameter<string>("fromTime"), "fromTime");
+        auto toTime = checkTimestamp(printer, request->parameter<string>("toTime"), "toTime");
+
         auto interval = request->parameter<int32_t>("interval");
         if (interval)
         {
           streamSampleRequest(
-              session, printerForAccepts(request->m_accepts), *interval,
-              *request->parameter<int32_t>("heartbeat"), *request->parameter<int32_t>("count"),
-              request->parameter<string>("device"), request->parameter<uint64_t>("from"),
-              request->parameter<string>("path"), *request->parameter<bool>("pretty"));
+              session, printer, *interval, *request->parameter<int32_t>("heartbeat"),
+              *request->parameter<int32_t>("count"), request->parameter<string>("device"),
+              request->parameter<uint64_t>("from"), request->parameter<string>("path"),
+              *request->parameter<bool>("pretty"), fromTime);
         }
         else
         {
           respond(session,
-                  sampleRequest(
-                      printerForAccepts(request->m_accepts), *request->parameter<int32_t>("count"),
-                      request->parameter<string>("device"), request->parameter<uint64_t>("from"),
-                      request->parameter<uint64_t>("to"), request->parameter<string>("path"),
-                      *request->parameter<bool>("pretty")));
+                  sampleRequest(printer, *request->parameter<int32_t>("count"),
+                                request->parameter<string>("device"),
+                                request->parameter<uint64_t>("from"),
+                                request->parameter<uint64_t>("to"),
+                                request->parameter<string>("path"),
+                                *request->parameter<bool>("pretty"), fromTime, toTime));
         }
         return true;
       };
@@ -650,17 +733,20 @@ namespace mtconnect {
           "path={string}&from={unsigned_integer}&"
           "interval={integer}&count={integer:100}&"
           "heartbeat={integer:10000}&to={unsigned_integer}&"
+          "fromTime={string}&toTime={string}&"
           "pretty={bool:false}");
       m_server->addRouting({boost::beast::http::verb::get, "/sample?" + qp, handler})
           .document("MTConnect sample request",
                     "Gets a time series of at maximum `count` observations for all devices "
                     "optionally filtered by the `path` and starting at `from`. By default, from is "
-                    "the first available observation known to the agent");
+                    "the first available observation known to the agent. The range can also be "
+                    "given as ISO 8601 times with `fromTime` and `toTime`");
       m_server->addRouting({boost::beast::http::verb::get, "/{device}/sample?" + qp, handler})
           .document("MTConnect sample request",
                     "Gets a time series of at maximum `count` observations for device `device` "
                     "optionally filtered by the `path` and starting at `from`. By default, from is "
-                    "the first available observation known to the agent");
+                    "the first available observation known to the agent. The range can also be "
+                    "given as ISO 8601 times with `fromTime` and `toTime`");
     }
 
     void RestService::createPutObservationRoutings()
@@ -697,6 +783,51 @@ namespace mtconnect {
       }
     }
 
+    void RestService::createSnapshotRoutings()
+    {
+      using namespace rest_sink;
+
+      auto path = GetOption<string>(m_options, config::BufferSnapshotPath);
+      if (m_server->arePutsAllowed() && path && !path->empty())
+      {
+        // Must be added before the observation routings so /snapshot is not taken as a device
+        auto handler = [this](SessionPtr session, RequestPtr request) -> bool {
+          respond(session, snapshotRequest(printerForAccepts(request->m_accepts)));
+          return true;
+        };
+
+        m_server->addRouting({boost::beast::http::verb::post, "/snapshot", handler})
+            .document("Non-normative POST to write a snapshot of the observation buffer",
+                      "The snapshot is written to a file in the BufferSnapshotPath directory");
+      }
+    }
+
+    ResponsePtr RestService::snapshotRequest(const Printer *printer)
+    {
+      NAMED_SCOPE("RestService::snapshotRequest");
+
+      auto &buffer = m_sinkContract->getCircularBuffer();
+      std::filesystem::path file(*GetOption<string>(m_options, config::BufferSnapshotPath));
+      file /= "snapshot-" + to_string(buffer.getSequence()) + ".bin";
+
+      try
+      {
+        auto count = buffer::BufferSnapshot::write(file, buffer, m_instanceId);
+
+        stringstream str;
+        str << "Wrote " << count << " observations to " << file.string();
+        return make_unique<Response>(status::ok, str.str(), "text/plain");
+      }
+      catch (std::exception &e)
+      {
+        LOG(error) << "Cannot write buffer snapshot: " << e.what();
+        return make_unique<Response>(
+            status::internal_server_error,
+            printError(printer, "INTERNAL_ERROR", "Cannot write buffer snapshot"),
+            printer->mimeType());
+      }
+    }
+
     // ----------------------------------------------------
     // Observation Add Method
     // ----------------------------------------------------
@@ -712,6 +843,23 @@ namespace mtconnect {
       return true;
     }
 
+    bool RestService::publish(ObservationList &observations)
+    {
+      // Observers keep the lowest sequence number signaled, so each data item only needs
+      // to signal its first observation in the batch.
+      std::unordered_set<DataItemPtr> signaled;
+      for (auto &observation : observations)
+      {
+        if (observation->isOrphan())
+          continue;
+
+        auto dataItem = observation->getDataItem();
+        if (signaled.insert(dataItem).second)
+          dataItem->signalObservers(observation->getSequence());
+      }
+      return true;
+    }
+
     // -------------------------------------------
     // ReST API Requests
     // -------------------------------------------
@@ -721,28 +869,61 @@ namespace mtconnect {
     {
       NAMED_SCOPE("RestService::probeRequest");
 
-      list<DevicePtr> deviceList;
-
+      DevicePtr dev;
       if (device)
+        dev = checkDevice(printer, *device);
+
+      auto storage = m_sinkContract->getAssetStorage();
+      auto counts = storage->getCountsByType();
+      auto assetCount = storage->getCount();
+      auto maxAssets = storage->getMaxAssets();
+      auto bufferSize = m_sinkContract->getCircularBuffer().getBufferSize();
+
+      // Get the version before printing so a change while the document is printed is not missed
+      auto version = printer->getModelVersion();
+
+      std::lock_guard<std::mutex> lock(m_probeCacheLock);
+      auto &cached = m_probeCache[{printer, device.value_or(""), pretty}];
+      if (!cached.m_body || cached.m_modelVersion != version ||
+          cached.m_instanceId != m_instanceId || cached.m_bufferSize != bufferSize ||
+          cached.m_maxAssets != maxAssets || cached.m_assetCount != assetCount ||
+          cached.m_counts != counts)
       {
-        auto dev = checkDevice(printer, *device);
-        deviceList.emplace_back(dev);
-      }
-      else
-      {
-        deviceList = m_sinkContract->getDevices();
+        list<DevicePtr> deviceList;
+        if (dev)
+          deviceList.emplace_back(dev);
+        else
+          deviceList = m_sinkContract->getDevices();
+
+        auto body = printer->printProbe(m_instanceId, bufferSize,
+                                        m_sinkContract->getCircularBuffer().getSequence(),
+                                        uint32_t(maxAssets), uint32_t(assetCount), deviceList,
+                                        &counts, false, pretty);
+
+        // The tag is weak since the creation time is not current and the document can be
+        // compressed
+        string changeTime;
+        for (auto c : printer->getModelChangeTime())
+          if (isdigit(c))
+            changeTime.push_back(c);
+        stringstream etag;
+        etag << "W/\"" << m_instanceId << '-' << bufferSize << '-' << maxAssets << '-'
+             << changeTime << '-' << hex << std::hash<string> {}(body) << '"';
+
+        cached.m_modelVersion = version;
+        cached.m_instanceId = m_instanceId;
+        cached.m_bufferSize = bufferSize;
+        cached.m_maxAssets = maxAssets;
+        cached.m_assetCount = assetCount;
+        cached.m_counts = std::move(counts);
+        cached.m_etag = etag.str();
+        cached.m_body = make_shared<SharedBody>(std::move(body));
       }
 
-      auto counts = m_sinkContract->getAssetStorage()->getCountsByType();
-
-      return make_unique<Response>(
-          rest_sink::status::ok,
-          printer->printProbe(m_instanceId, m_sinkContract->getCircularBuffer().getBufferSize(),
-                              m_sinkContract->getCircularBuffer().getSequence(),
-                              uint32_t(m_sinkContract->getAssetStorage()->getMaxAssets()),
-                              uint32_t(m_sinkContract->getAssetStorage()->getCount()), deviceList,
-                              &counts, false, pretty),
-          printer->mimeType());
+      auto response = make_unique<Response>(rest_sink::status::ok, "", printer->mimeType());
+      response->m_shared = cached.m_body;
+      response->m_etag = cached.m_etag;
+      return response;
     }
 
     ResponsePtr RestService::currentRequest(const Printer *printer,
@@ -773,7 +954,9 @@ namespace mtconnect {
                                            const std::optional<std::string> &device,
                                            const std::optional<SequenceNumber_t> &from,
                                            const std::optional<SequenceNumber_t> &to,
-                                           const std::optional<std::string> &path, bool pretty)
+                                           const std::optional<std::string> &path, bool pretty,
+                                           const std::optional<Timestamp> &fromTime,
+                                           const std::optional<Timestamp> &toTime)
     {
       using namespace rest_sink;
       DevicePtr dev {nullptr};
@@ -788,23 +971,75 @@ namespace mtconnect {
         checkPath(printer, path, dev, *filter);
       }
 
+      // Resolve the time range to sequence numbers using the time index of the buffer
+      auto start = from, stop = to;
+      if (fromTime || toTime)
+      {
+        auto &buffer = m_sinkContract->getCircularBuffer();
+        if ((from && fromTime) || (to && toTime))
+        {
+          string msg("A range cannot be given by both sequence numbers and times");
+          throw RequestError(msg.c_str(), printError(printer, "INVALID_REQUEST", msg),
+                             printer->mimeType(), status::bad_request);
+        }
+
+        auto next = buffer.getSequence();
+        if (fromTime)
+          start = buffer.getSequenceAt(*fromTime).value_or(next);
+        if (toTime)
+        {
+          // The first sequence number after the bucket containing the end time
+          auto after =
+              buffer.getSequenceAt(*toTime + CircularBuffer::TimeIndexResolution).value_or(next);
+          auto lower = start ? *start : buffer.getEarliestSequence();
+          if (after <= lower)
+          {
+            // There are no observations in the range
+            ObservationList empty;
+            return make_unique<Response>(
+                rest_sink::status::ok,
+                printer->printSample(m_instanceId, buffer.getBufferSize(), lower,
+                                     buffer.getEarliestSequence(), next - 1, empty, pretty),
+                printer->mimeType());
+          }
+          stop = after - 1;
+        }
+      }
+
       // Check if there is a frequency to stream data or not
       SequenceNumber_t end;
       bool endOfBuffer;
 
       return make_unique<Response>(
           rest_sink::status::ok,
-          fetchSampleData(printer, filter, count, from, to, end, endOfBuffer, nullptr, pretty),
+          fetchSampleData(printer, filter, count, start, stop, end, endOfBuffer, nullptr, pretty),
           printer->mimeType());
     }
 
+    /// @brief The last chunk computed for a group of sample streams with the same printer,
+    ///        filter, count and interval
+    ///
+    /// The chunk holds the observations from `m_start` up to `m_end`, which do not change once
+    /// they are in the buffer, so a stream at the same position reuses it and continues from
+    /// `m_end`.
+    struct SampleStreamGroup
+    {
+      // The streams of a group can be on different shards
+      std::mutex m_lock;
+      SequenceNumber_t m_start {0};
+      SequenceNumber_t m_end {0};
+      bool m_endOfBuffer {false};
+      std::shared_ptr<const string> m_content;
+    };
+
     struct AsyncSampleResponse
     {
-      AsyncSampleResponse(rest_sink::SessionPtr &session, boost::asio::io_context::strand &strand)
+      AsyncSampleResponse(rest_sink::SessionPtr &session, StreamShard &shard)
         : m_session(session),
-          m_observer(strand),
+          m_observer(shard.m_strand, shard.m_wheel),
           m_last(chrono::system_clock::now()),
-          m_timer(strand.context())
+          m_strand(shard.m_strand),
+          m_wheel(shard.m_wheel)
       {}
 
       std::weak_ptr<Sink> m_service;
@@ -818,17 +1053,42 @@ namespace mtconnect {
       bool m_endOfBuffer {false};
       const Printer *m_printer {nullptr};
       FilterSet m_filter;
-      ChangeObserver m_observer;
+      WheelChangeObserver m_observer;
       chrono::system_clock::time_point m_last;
-      boost::asio::steady_timer m_timer;
+      boost::asio::io_context::strand &m_strand;
+      std::shared_ptr<TimerWheel> m_wheel;
       bool m_pretty {false};
+      std::shared_ptr<SampleStreamGroup> m_group;
+      std::shared_ptr<StreamCounters> m_counters;
+      uint64_t m_backlog {0};
+
+      ~AsyncSampleResponse()
+      {
+        if (m_counters)
+        {
+          m_counters->m_streams--;
+          m_counters->m_backlog -= m_backlog;
+        }
+      }
+
+      void setBacklog(uint64_t backlog)
+      {
+        m_counters->m_backlog += backlog;
+        m_counters->m_backlog -= m_backlog;
+        m_backlog = backlog;
+
+        auto max = m_counters->m_maxBacklog.load();
+        while (backlog > max && !m_counters->m_maxBacklog.compare_exchange_weak(max, backlog))
+          ;
+      }
     };
 
     void RestService::streamSampleRequest(rest_sink::SessionPtr session, const Printer *printer,
                                           const int interval, const int heartbeatIn,
                                           const int count, const std::optional<std::string> &device,
                                           const std::optional<SequenceNumber_t> &from,
-                                          const std::optional<std::string> &path, bool pretty)
+                                          const std::optional<std::string> &path, bool pretty,
+                                          const std::optional<Timestamp> &fromTime)
     {
       NAMED_SCOPE("RestService::streamSampleRequest");
 
@@ -844,12 +1104,14 @@ namespace mtconnect {
         dev = checkDevice(printer, *device);
       }
 
-      auto asyncResponse = make_shared<AsyncSampleResponse>(session, m_strand);
+      auto asyncResponse = make_shared<AsyncSampleResponse>(session, nextShard());
       asyncResponse->m_count = count;
       asyncResponse->m_printer = printer;
       asyncResponse->m_heartbeat = std::chrono::milliseconds(heartbeatIn);
       asyncResponse->m_service = getptr();
       asyncResponse->m_pretty = pretty;
+      asyncResponse->m_counters = m_streamCounters;
+      m_streamCounters->m_streams++;
 
       checkPath(asyncResponse->m_printer, path, dev, asyncResponse->m_filter);
 
@@ -871,22 +1133,59 @@ namespace mtconnect {
       }
 
       chrono::milliseconds interMilli {interval};
-      SequenceNumber_t firstSeq = m_sinkContract->getCircularBuffer().getFirstSequence();
+      auto &buffer = m_sinkContract->getCircularBuffer();
+      SequenceNumber_t firstSeq = buffer.getEarliestSequence();
+
+      auto start = from;
+      if (fromTime)
+      {
+        if (from)
+        {
+          string msg("A range cannot be given by both sequence numbers and times");
+          throw RequestError(msg.c_str(), printError(printer, "INVALID_REQUEST", msg),
+                             printer->mimeType(), status::bad_request);
+        }
+        start = buffer.getSequenceAt(*fromTime).value_or(buffer.getSequence());
+      }
 
-      if (!from || *from < firstSeq)
+      if (!start || *start < firstSeq)
         asyncResponse->m_sequence = firstSeq;
       else
-        asyncResponse->m_sequence = *from;
+        asyncResponse->m_sequence = *start;
 
-      asyncResponse->m_endOfBuffer = from >= m_sinkContract->getCircularBuffer().getSequence();
+      asyncResponse->m_endOfBuffer = start >= buffer.getSequence();
 
       asyncResponse->m_interval = chrono::milliseconds(interval);
       asyncResponse->m_logStreamData = m_logStreamData;
 
+      // Join the group of streams with the same content
+      stringstream key;
+      key << printer->mimeType() << ':' << pretty << ':' << count << ':' << interval;
+      for (const auto &id : asyncResponse->m_filter)
+        key << ':' << id;
+      {
+        std::lock_guard<std::mutex> lock(m_sampleGroupsLock);
+        for (auto it = m_sampleGroups.begin(); it != m_sampleGroups.end();)
+        {
+          if (it->second.expired())
+            it = m_sampleGroups.erase(it);
+          else
+            it++;
+        }
+        auto &group = m_sampleGroups[key.str()];
+        asyncResponse->m_group = group.lock();
+        if (!asyncResponse->m_group)
+        {
+          asyncResponse->m_group = make_shared<SampleStreamGroup>();
+          group = asyncResponse->m_group;
+        }
+      }
+
       session->beginStreaming(
           printer->mimeType(),
-          asio::bind_executor(
-              m_strand, boost::bind(&RestService::streamSampleWriteComplete, this, asyncResponse)));
+          asio::bind_executor(asyncResponse->m_strand,
+                              boost::bind(&RestService::streamSampleWriteComplete, this,
+                                          asyncResponse)));
     }
 
     void RestService::streamSampleWriteComplete(shared_ptr<AsyncSampleResponse> asyncResponse)
@@ -901,8 +1200,9 @@ namespace mtconnect {
 
         asyncResponse->m_observer.wait(
             asyncResponse->m_heartbeat,
-            asio::bind_executor(m_strand, boost::bind(&RestService::streamNextSampleChunk, this,
-                                                      asyncResponse, _1)));
+            asio::bind_executor(asyncResponse->m_strand,
+                                boost::bind(&RestService::streamNextSampleChunk, this,
+                                            asyncResponse, _1)));
       }
       else
       {
@@ -939,99 +1239,168 @@ namespace mtconnect {
         return;
       }
 
-      {
-        std::lock_guard<CircularBuffer> lock(m_sinkContract->getCircularBuffer());
+      auto &buffer = m_sinkContract->getCircularBuffer();
 
-        if (!asyncResponse->m_endOfBuffer)
-        {
-          // Check if we are streaming chunks rapidly to catch up to the end of
-          // buffer. We will not delay between chunks in this case and write as
-          // rapidly as possible
-        }
-        else if (!asyncResponse->m_observer.wasSignaled())
+      if (!asyncResponse->m_endOfBuffer)
+      {
+        // Check if we are streaming chunks rapidly to catch up to the end of
+        // buffer. We will not delay between chunks in this case and write as
+        // rapidly as possible
+      }
+      else if (!asyncResponse->m_observer.wasSignaled())
+      {
+        // If nothing came out during the last wait, continue from the end of the last
+        // chunk. The buffer is not locked, so jumping to the current sequence could skip an
+        // observation that has been added but not yet signaled.
+      }
+      else
+      {
+        // The observer can be signaled before the interval has expired. If this occurs, then
+        // Wait the remaining duration of the interval.
+        auto delta = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now() -
+                                                                 asyncResponse->m_last);
+        if (delta < asyncResponse->m_interval)
         {
-          // If nothing came out during the last wait, we may have still have advanced
-          // the sequence number. We should reset the start to something closer to the
-          // current sequence. If we lock the sequence lock, we can check if the observer
-          // was signaled between the time the wait timed out and the mutex was locked.
-          // Otherwise, nothing has arrived and we set to the next sequence number to
-          // the next sequence number to be allocated and continue.
-          asyncResponse->m_sequence = m_sinkContract->getCircularBuffer().getSequence();
+          asyncResponse->m_wheel->schedule(
+              asyncResponse->m_interval - delta,
+              asio::bind_executor(asyncResponse->m_strand,
+                                  boost::bind(&RestService::streamNextSampleChunk, this,
+                                              asyncResponse, _1)));
+          return;
         }
-        else
-        {
-          // The observer can be signaled before the interval has expired. If this occurs, then
-          // Wait the remaining duration of the interval.
-          auto delta = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now() -
-                                                                   asyncResponse->m_last);
-          if (delta < asyncResponse->m_interval)
-          {
-            asyncResponse->m_timer.expires_from_now(asyncResponse->m_interval - delta);
-            asyncResponse->m_timer.async_wait(asio::bind_executor(
-                m_strand,
-                boost::bind(&RestService::streamNextSampleChunk, this, asyncResponse, _1)));
-            return;
-          }
 
-          // Get the sequence # signaled in the observer when the earliest event arrived.
-          // This will allow the next set of data to be pulled. Any later events will have
-          // greater sequence numbers, so this should not cause a problem. Also, signaled
-          // sequence numbers can only decrease, never increase.
-          asyncResponse->m_sequence = asyncResponse->m_observer.getSequence();
-          asyncResponse->m_observer.reset();
-        }
+        // The observer was reset before the last chunk was read, so the sequence signaled may
+        // already have been sent. Continue from the end of the last chunk.
+        asyncResponse->m_observer.reset();
+      }
 
-        // Fetch sample data now resets the observer while holding the sequence
-        // mutex to make sure that a new event will be recorded in the observer
-        // when it returns.
-        uint64_t end(0ull);
-        string content;
-        asyncResponse->m_endOfBuffer = true;
+      // Fetch sample data now resets the observer before reading the buffer to make sure
+      // that a new event will be recorded in the observer when it returns.
+      uint64_t end(0ull);
+      bool behind = !asyncResponse->m_endOfBuffer;
+      asyncResponse->m_endOfBuffer = true;
+
+      // Check if we're falling too far behind. If the buffer has passed the stream or the
+      // backlog is over the limit, apply the backlog policy. The backlog is only measured when
+      // the last chunk stopped short of the end of the buffer, otherwise the observations after
+      // the stream's sequence have not been filtered and may not belong to the stream.
+      SequenceNumber_t backlog = 0;
+      if (behind)
+      {
+        auto sequence = buffer.getSequence();
+        if (sequence > asyncResponse->m_sequence)
+          backlog = sequence - asyncResponse->m_sequence;
+      }
+      asyncResponse->setBacklog(backlog);
+      if (asyncResponse->m_sequence < buffer.getEarliestSequence() ||
+          (m_backlogLimit > 0 && backlog > m_backlogLimit))
+      {
+        if (!streamBacklogOverflow(asyncResponse, backlog))
+          return;
+      }
 
-        // Check if we're falling too far behind. If we are, generate an
-        // MTConnectError and return.
-        if (asyncResponse->m_sequence < m_sinkContract->getCircularBuffer().getFirstSequence())
-        {
+      // end and endOfBuffer are set during the fetch sample data from a consistent
+      // view of the buffer. The next chunk will start at the end of this one.
+      auto content = fetchSharedSampleData(asyncResponse, end);
+      asyncResponse->m_sequence = end;
+
+      if (m_logStreamData)
+        asyncResponse->m_log << *content << endl;
+
+      asyncResponse->m_session->writeChunk(
+          *content,
+          asio::bind_executor(asyncResponse->m_strand,
+                              boost::bind(&RestService::streamSampleWriteComplete, this,
+                                          asyncResponse)));
+    }
+
+    bool RestService::streamBacklogOverflow(shared_ptr<AsyncSampleResponse> asyncResponse,
+                                            SequenceNumber_t backlog)
+    {
+      auto &buffer = m_sinkContract->getCircularBuffer();
+
+      switch (m_backlogPolicy)
+      {
+        case BacklogPolicy::DISCONNECT:
+          m_streamCounters->m_disconnected++;
           LOG(warning) << "Client fell too far behind, disconnecting";
           asyncResponse->m_session->fail(boost::beast::http::status::not_found,
                                          "Client fell too far behind, disconnecting");
-          return;
-        }
+          return false;
 
-        // end and endOfBuffer are set during the fetch sample data while the
-        // mutex is held. This removed the race to check if we are at the end of
-        // the bufffer and setting the next start to the last sequence number
-        // sent.
-        content = fetchSampleData(asyncResponse->m_printer, asyncResponse->m_filter,
-                                  asyncResponse->m_count, asyncResponse->m_sequence, nullopt, end,
-                                  asyncResponse->m_endOfBuffer, &asyncResponse->m_observer,
-                                  asyncResponse->m_pretty);
-
-        // Even if we are at the end of the buffer, or within range. If we are filtering,
-        // we will need to make sure we are not spinning when there are no valid events
-        // to be reported. we will waste cycles spinning on the end of the buffer when
-        // we should be in a heartbeat wait as well.
-        if (!asyncResponse->m_endOfBuffer)
-        {
-          // If we're not at the end of the buffer, move to the end of the previous set and
-          // begin filtering from where we left off.
-          asyncResponse->m_sequence = end;
-        }
+        case BacklogPolicy::SKIP:
+          m_streamCounters->m_skipped++;
+          LOG(debug) << "Client fell too far behind, skipping " << backlog << " observations";
+          asyncResponse->m_sequence = buffer.getSequence();
+          asyncResponse->setBacklog(0);
+          return true;
 
-        if (m_logStreamData)
-          asyncResponse->m_log << content << endl;
+        case BacklogPolicy::COALESCE:
+          break;
+      }
 
-        asyncResponse->m_session->writeChunk(
-            content,
-            asio::bind_executor(m_strand, boost::bind(&RestService::streamSampleWriteComplete, this,
-                                                      asyncResponse)));
+      m_streamCounters->m_coalesced++;
+      LOG(debug) << "Client fell too far behind, coalescing " << backlog << " observations";
+
+      // Reset the observer before reading the buffer so observations added while the current
+      // values are collected signal the stream again.
+      asyncResponse->m_observer.reset();
+      asyncResponse->m_sequence = buffer.getSequence();
+      asyncResponse->m_endOfBuffer = true;
+      asyncResponse->setBacklog(0);
+
+      auto content = fetchCurrentData(asyncResponse->m_printer, asyncResponse->m_filter, nullopt,
+                                      asyncResponse->m_pretty);
+      if (m_logStreamData)
+        asyncResponse->m_log << content << endl;
+
+      asyncResponse->m_session->writeChunk(
+          content, asio::bind_executor(asyncResponse->m_strand,
+                                       boost::bind(&RestService::streamSampleWriteComplete, this,
+                                                   asyncResponse)));
+      return false;
+    }
+
+    shared_ptr<const string> RestService::fetchSharedSampleData(
+        shared_ptr<AsyncSampleResponse> asyncResponse, SequenceNumber_t &end)
+    {
+      auto &buffer = m_sinkContract->getCircularBuffer();
+      auto &group = *asyncResponse->m_group;
+
+      // Only one stream of the group reads the buffer and prints the chunk, the others wait for it
+      std::lock_guard<std::mutex> lock(group.m_lock);
+
+      // Reset the observer before checking the buffer, any observation added after this point
+      // will signal the observer again.
+      asyncResponse->m_observer.reset();
+      if (group.m_content && group.m_start == asyncResponse->m_sequence)
+      {
+        // If observations were added after a chunk that reached the end of the buffer, the
+        // observer may not have seen them, so continue without waiting.
+        end = group.m_end;
+        asyncResponse->m_endOfBuffer = group.m_endOfBuffer && end >= buffer.getSequence();
+        m_streamCounters->m_sharedChunks++;
+        return group.m_content;
       }
+
+      auto content = make_shared<const string>(fetchSampleData(
+          asyncResponse->m_printer, asyncResponse->m_filter, asyncResponse->m_count,
+          asyncResponse->m_sequence, nullopt, end, asyncResponse->m_endOfBuffer, nullptr,
+          asyncResponse->m_pretty));
+      m_streamCounters->m_chunks++;
+
+      group.m_start = asyncResponse->m_sequence;
+      group.m_end = end;
+      group.m_endOfBuffer = asyncResponse->m_endOfBuffer;
+      group.m_content = content;
+
+      return content;
     }
 
     struct AsyncCurrentResponse
     {
-      AsyncCurrentResponse(rest_sink::SessionPtr session, asio::io_context &context)
-        : m_session(session), m_timer(context)
+      AsyncCurrentResponse(rest_sink::SessionPtr session, StreamShard &shard)
+        : m_session(session), m_strand(shard.m_strand), m_wheel(shard.m_wheel)
       {}
 
       std::weak_ptr<Sink> m_service;
@@ -1039,23 +1408,32 @@ namespace mtconnect {
       chrono::milliseconds m_interval;
       const Printer *m_printer {nullptr};
       FilterSetOpt m_filter;
-      boost::asio::steady_timer m_timer;
+      boost::asio::io_context::strand &m_strand;
+      std::shared_ptr<TimerWheel> m_wheel;
       bool m_pretty {false};
+
+      // Delta streams only send the data items that changed since the last chunk
+      bool m_delta {false};
+      chrono::milliseconds m_refresh;
+      chrono::steady_clock::time_point m_lastRefresh;
+      SequenceNumber_t m_sequence {0};
     };
 
     void RestService::streamCurrentRequest(SessionPtr session, const Printer *printer,
                                            const int interval,
                                            const std::optional<std::string> &device,
-                                           const std::optional<std::string> &path, bool pretty)
+                                           const std::optional<std::string> &path, bool pretty,
+                                           bool delta, const int refresh)
     {
       checkRange(printer, interval, 0, numeric_limits<int>().max(), "interval");
+      checkRange(printer, refresh, 0, numeric_limits<int>().max(), "refresh");
       DevicePtr dev {nullptr};
       if (device)
       {
         dev = checkDevice(printer, *device);
       }
 
-      auto asyncResponse = make_shared<AsyncCurrentResponse>(session, m_context);
+      auto asyncResponse = make_shared<AsyncCurrentResponse>(session, nextShard());
       if (path || device)
       {
         asyncResponse->m_filter = make_optional<FilterSet>();
@@ -1065,9 +1443,12 @@ namespace mtconnect {
       asyncResponse->m_printer = printer;
       asyncResponse->m_service = getptr();
       asyncResponse->m_pretty = pretty;
+      asyncResponse->m_delta = delta;
+      asyncResponse->m_refresh = chrono::milliseconds {refresh};
 
       asyncResponse->m_session->beginStreaming(
-          printer->mimeType(), boost::asio::bind_executor(m_strand, [this, asyncResponse]() {
+          printer->mimeType(),
+          boost::asio::bind_executor(asyncResponse->m_strand, [this, asyncResponse]() {
             streamNextCurrent(asyncResponse, boost::system::error_code {});
           }));
     }
@@ -1099,14 +1480,38 @@ namespace mtconnect {
         return;
       }
 
-      asyncResponse->m_session->writeChunk(
-          fetchCurrentData(asyncResponse->m_printer, asyncResponse->m_filter, nullopt,
-                           asyncResponse->m_pretty),
-          boost::asio::bind_executor(m_strand, [this, asyncResponse]() {
-            asyncResponse->m_timer.expires_from_now(asyncResponse->m_interval);
-            asyncResponse->m_timer.async_wait(boost::asio::bind_executor(
-                m_strand, boost::bind(&RestService::streamNextCurrent, this, asyncResponse, _1)));
-          }));
+      auto wait = [this, asyncResponse]() {
+        asyncResponse->m_wheel->schedule(
+            asyncResponse->m_interval,
+            boost::asio::bind_executor(asyncResponse->m_strand,
+                                       boost::bind(&RestService::streamNextCurrent, this,
+                                                   asyncResponse, _1)));
+      };
+
+      if (!asyncResponse->m_delta)
+      {
+        asyncResponse->m_session->writeChunk(
+            fetchCurrentData(asyncResponse->m_printer, asyncResponse->m_filter, nullopt,
+                             asyncResponse->m_pretty),
+            boost::asio::bind_executor(asyncResponse->m_strand, wait));
+        return;
+      }
+
+      // Send all the data items in the first chunk and every refresh interval
+      auto now = chrono::steady_clock::now();
+      bool full = asyncResponse->m_sequence == 0 ||
+                  (asyncResponse->m_refresh.count() > 0 &&
+                   now - asyncResponse->m_lastRefresh >= asyncResponse->m_refresh);
+      if (full)
+        asyncResponse->m_lastRefresh = now;
+
+      auto content = fetchCurrentDelta(asyncResponse->m_printer, asyncResponse->m_filter,
+                                       asyncResponse->m_sequence, full, asyncResponse->m_pretty);
+      if (content)
+        asyncResponse->m_session->writeChunk(
+            *content, boost::asio::bind_executor(asyncResponse->m_strand, wait));
+      else
+        wait();
     }
 
     ResponsePtr RestService::assetRequest(const Printer *printer, const int32_t count,
@@ -1322,6 +1727,43 @@ namespace mtconnect {
     // For debugging
     void RestService::setLogStreamData(bool log) { m_logStreamData = log; }
 
+    StreamMetrics RestService::getStreamMetrics() const
+    {
+      StreamMetrics metrics;
+      metrics.m_streams = m_streamCounters->m_streams;
+      metrics.m_backlog = m_streamCounters->m_backlog;
+      metrics.m_maxBacklog = m_streamCounters->m_maxBacklog;
+      metrics.m_disconnected = m_streamCounters->m_disconnected;
+      metrics.m_coalesced = m_streamCounters->m_coalesced;
+      metrics.m_skipped = m_streamCounters->m_skipped;
+      metrics.m_chunks = m_streamCounters->m_chunks;
+      metrics.m_sharedChunks = m_streamCounters->m_sharedChunks;
+      return metrics;
+    }
+
+    void RestService::publishStreamMetrics()
+    {
+      NAMED_SCOPE("RestService::publishStreamMetrics");
+
+      auto metrics = getStreamMetrics();
+      auto publish = [this](const char *id, uint64_t value) {
+        if (auto di = m_sinkContract->getDataItemById(id))
+          m_loopback->receive(di, to_string(value));
+      };
+      publish("stream_count", metrics.m_streams);
+      publish("stream_backlog", metrics.m_backlog);
+      publish("stream_max_backlog", metrics.m_maxBacklog);
+      publish("stream_overflow_count",
+              metrics.m_disconnected + metrics.m_coalesced + metrics.m_skipped);
+
+      m_streamMetricsTimer.expires_after(10s);
+      m_streamMetricsTimer.async_wait(
+          asio::bind_executor(m_strand, [this](boost::system::error_code ec) {
+            if (!ec)
+              publishStreamMetrics();
+          }));
+    }
+
     // Get the printer for a type
     const std::string RestService::acceptFormat(const std::string &accepts) const
     {
@@ -1386,6 +1828,39 @@ namespace mtconnect {
       }
     }
 
+    std::optional<Timestamp> RestService::checkTimestamp(const Printer *printer,
+                                                         const std::optional<std::string> &time,
+                                                         const std::string &param) const
+    {
+      if (!time)
+        return std::nullopt;
+
+      // A time ending in `Z` or without a zone is UTC, a `+hh:mm` or `-hh:mm` offset is
+      // applied. Anything else after the time is an error.
+      auto parse = [&time](const char *format) -> std::optional<Timestamp> {
+        Timestamp ts;
+        istringstream in(*time);
+        in >> date::parse(format, ts);
+        if (in.fail() || in.peek() != istringstream::traits_type::eof())
+          return std::nullopt;
+        return ts;
+      };
+
+      auto ts = parse("%FT%TZ");
+      if (!ts)
+        ts = parse("%FT%T%Ez");
+      if (!ts)
+        ts = parse("%FT%T");
+      if (!ts)
+      {
+        stringstream str;
+        str << '\'' << param << '\'' << " must be an ISO 8601 timestamp: " << *time;
+        throw RequestError(str.str().c_str(), printError(printer, "INVALID_REQUEST", str.str()),
+                           printer->mimeType(), status::bad_request);
+      }
+      return ts;
+    }
+
     void RestService::checkPath(const Printer *printer, const std::optional<std::string> &path,
                                 const DevicePtr device, FilterSet &filter) const
     {
@@ -1429,27 +1904,50 @@ namespace mtconnect {
     {
       ObservationList observations;
       SequenceNumber_t firstSeq, seq;
+      auto &buffer = m_sinkContract->getCircularBuffer();
 
+      if (at)
       {
-        std::lock_guard<CircularBuffer> lock(m_sinkContract->getCircularBuffer());
-
-        firstSeq = m_sinkContract->getCircularBuffer().getFirstSequence();
-        seq = m_sinkContract->getCircularBuffer().getSequence();
-        if (at)
-        {
-          checkRange(printer, *at, firstSeq - 1, seq, "at");
+        firstSeq = buffer.getFirstSequence();
+        seq = buffer.getSequence();
+        checkRange(printer, *at, firstSeq - 1, seq, "at");
 
-          auto check = m_sinkContract->getCircularBuffer().getCheckpointAt(*at, filterSet);
+        auto check = buffer.getCheckpointAt(*at, filterSet);
+        if (check)
           check->getObservations(observations);
-        }
         else
-        {
-          m_sinkContract->getCircularBuffer().getLatest().getObservations(observations, filterSet);
-        }
+          // The buffer advanced past `at` after it was checked
+          checkRange(printer, *at, buffer.getFirstSequence() - 1, buffer.getSequence(), "at");
+      }
+      else
+      {
+        seq = buffer.getLatestObservations(observations, filterSet, firstSeq);
       }
 
-      return printer->printSample(m_instanceId, m_sinkContract->getCircularBuffer().getBufferSize(),
-                                  seq, firstSeq, seq - 1, observations, pretty);
+      return printer->printSample(m_instanceId, buffer.getBufferSize(), seq, firstSeq, seq - 1,
+                                  observations, pretty);
+    }
+
+    optional<string> RestService::fetchCurrentDelta(const Printer *printer,
+                                                    const FilterSetOpt &filterSet,
+                                                    SequenceNumber_t &since, bool full,
+                                                    bool pretty)
+    {
+      ObservationList observations;
+      SequenceNumber_t firstSeq, seq;
+      auto &buffer = m_sinkContract->getCircularBuffer();
+
+      if (full)
+        seq = buffer.getLatestObservations(observations, filterSet, firstSeq);
+      else
+        seq = buffer.getChangedObservations(observations, filterSet, since, firstSeq);
+
+      since = seq;
+      if (!full && observations.empty())
+        return nullopt;
+
+      return printer->printSample(m_instanceId, buffer.getBufferSize(), seq, firstSeq, seq - 1,
+                                  observations, pretty);
     }
 
     string RestService::fetchSampleData(const Printer *printer, const FilterSetOpt &filterSet,
@@ -1460,36 +1958,36 @@ namespace mtconnect {
     {
       std::unique_ptr<ObservationList> observations;
       SequenceNumber_t firstSeq, lastSeq;
+      auto &buffer = m_sinkContract->getCircularBuffer();
 
-      {
-        std::lock_guard<CircularBuffer> lock(m_sinkContract->getCircularBuffer());
-        firstSeq = m_sinkContract->getCircularBuffer().getFirstSequence();
-        auto seq = m_sinkContract->getCircularBuffer().getSequence();
-        lastSeq = seq - 1;
-        int upperCountLimit = m_sinkContract->getCircularBuffer().getBufferSize() + 1;
-        int lowerCountLimit = -upperCountLimit;
+      firstSeq = buffer.getEarliestSequence();
+      auto seq = buffer.getSequence();
+      lastSeq = seq - 1;
+      int upperCountLimit = buffer.getBufferSize() + 1;
+      int lowerCountLimit = -upperCountLimit;
 
-        if (from)
-        {
-          checkRange(printer, *from, firstSeq - 1, seq + 1, "from");
-        }
-        if (to)
-        {
-          auto lower = from ? *from : firstSeq;
-          checkRange(printer, *to, lower, seq + 1, "to");
-          lowerCountLimit = 0;
-        }
-        checkRange(printer, count, lowerCountLimit, upperCountLimit, "count", true);
+      if (from)
+      {
+        checkRange(printer, *from, firstSeq - 1, seq + 1, "from");
+      }
+      if (to)
+      {
+        // A range of a single observation has the same from and to
+        auto lower = from ? *from : firstSeq;
+        checkRange(printer, *to, lower - 1, seq + 1, "to");
+        lowerCountLimit = 0;
+      }
+      checkRange(printer, count, lowerCountLimit, upperCountLimit, "count", true);
 
-        observations = m_sinkContract->getCircularBuffer().getObservations(
-            count, filterSet, from, to, end, firstSeq, endOfBuffer);
+      // The buffer is read without a lock, so reset the observer before reading. Any
+      // observation added after this point will signal the observer again.
+      if (observer)
+        observer->reset();
 
-        if (observer)
-          observer->reset();
-      }
+      observations = buffer.getObservations(count, filterSet, from, to, end, firstSeq, endOfBuffer);
 
-      return printer->printSample(m_instanceId, m_sinkContract->getCircularBuffer().getBufferSize(),
-                                  end, firstSeq, lastSeq, *observations, pretty);
+      return printer->printSample(m_instanceId, buffer.getBufferSize(), end, firstSeq, lastSeq,
+                                  *observations, pretty);
     }
 
   }  // namespace sink::rest_sink
@@ -18,6 +18,15 @@
 #pragma once
 
 #include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 
 #include "mtconnect/buffer/circular_buffer.hpp"
 #include "mtconnect/config.hpp"
@@ -27,6 +36,7 @@
 #include "request.hpp"
 #include "response.hpp"
 #include "server.hpp"
+#include "timer_wheel.hpp"
 
 namespace mtconnect {
   namespace printer {
@@ -37,6 +47,71 @@ namespace mtconnect {
   namespace sink::rest_sink {
     struct AsyncSampleResponse;
     struct AsyncCurrentResponse;
+    struct SampleStreamGroup;
+
+    /// @brief What to do with a sample stream that falls behind the buffer
+    enum class BacklogPolicy
+    {
+      DISCONNECT,  ///< Close the stream with an error
+      COALESCE,    ///< Send the current values of the stream's data items and continue from there
+      SKIP         ///< Drop the unsent observations and continue from the end of the buffer
+    };
+
+    /// @brief Metrics of the sample streams
+    struct StreamMetrics
+    {
+      uint64_t m_streams {0};       ///< Number of active sample streams
+      uint64_t m_backlog {0};       ///< Total unsent observations of the active streams
+      uint64_t m_maxBacklog {0};    ///< Largest backlog seen by a stream
+      uint64_t m_disconnected {0};  ///< Streams closed because they fell behind
+      uint64_t m_coalesced {0};     ///< Backlogs replaced by the current values
+      uint64_t m_skipped {0};       ///< Backlogs dropped
+      uint64_t m_chunks {0};        ///< Sample chunks printed
+      uint64_t m_sharedChunks {0};  ///< Sample chunks reused from another stream of the group
+    };
+
+    /// @brief Counters shared by the sample streams to compute the metrics
+    struct StreamCounters
+    {
+      std::atomic<uint64_t> m_streams {0};
+      std::atomic<uint64_t> m_backlog {0};
+      std::atomic<uint64_t> m_maxBacklog {0};
+      std::atomic<uint64_t> m_disconnected {0};
+      std::atomic<uint64_t> m_coalesced {0};
+      std::atomic<uint64_t> m_skipped {0};
+      std::atomic<uint64_t> m_chunks {0};
+      std::atomic<uint64_t> m_sharedChunks {0};
+    };
+
+    /// @brief A strand and timer wheel shared by a subset of the streams
+    ///
+    /// The callbacks of a stream are serialized on its shard's strand, streams on different shards
+    /// are printed in parallel by the worker threads.
+    struct StreamShard
+    {
+      /// @brief Create a shard
+      /// @param context the boost asio io_context
+      StreamShard(boost::asio::io_context &context)
+        : m_strand(context), m_wheel(std::make_shared<TimerWheel>(m_strand))
+      {}
+
+      boost::asio::io_context::strand m_strand;
+      std::shared_ptr<TimerWheel> m_wheel;
+    };
+
+    /// @brief A probe document kept until the device model, the buffer or asset sizes, or the
+    ///        asset counts change
+    struct CachedProbe
+    {
+      uint64_t m_modelVersion {0};              ///< Model version of the printer when printed
+      uint64_t m_instanceId {0};                ///< The instance id in the header
+      size_t m_bufferSize {0};                  ///< The buffer size in the header
+      size_t m_maxAssets {0};                   ///< The maximum assets in the header
+      size_t m_assetCount {0};                  ///< The asset count in the header
+      asset::AssetStorage::TypeCount m_counts;  ///< The asset counts by type in the header
+      SharedBodyPtr m_body;                     ///< The document
+      std::string m_etag;                       ///< The entity tag of the document
+    };
 
     /// @brief Callback fundtion for setting namespaces
     using NamespaceFunction = void (printer::XmlPrinter::*)(const std::string &,
@@ -77,6 +152,8 @@ namespace mtconnect {
 
       bool publish(observation::ObservationPtr &observation) override;
 
+      bool publish(observation::ObservationList &observations) override;
+
       bool publish(asset::AssetPtr asset) override { return false; }
       ///@}
 
@@ -91,6 +168,10 @@ namespace mtconnect {
       ///@{
 
       /// @brief Handler for a probe request
+      ///
+      /// The documents are cached by printer, device and pretty until the device model or the
+      /// asset counts change. The response has an entity tag for conditional requests.
+      ///
       /// @param[in]  p printer for doc generation
       /// @param[in] device optional device name or uuid
       /// @param[in] pretty `true` to ensure response is formatted
@@ -120,13 +201,17 @@ namespace mtconnect {
       /// @param[in] to optional ending sequence number
       /// @param[in] path an xpath for filtering
       /// @param[in] pretty `true` to ensure response is formatted
+      /// @param[in] fromTime optional starting time, resolved to `from` using the time index
+      /// @param[in] toTime optional ending time, resolved to `to` using the time index
       /// @return MTConnect Streams response
       ResponsePtr sampleRequest(const printer::Printer *p, const int count = 100,
                                 const std::optional<std::string> &device = std::nullopt,
                                 const std::optional<SequenceNumber_t> &from = std::nullopt,
                                 const std::optional<SequenceNumber_t> &to = std::nullopt,
                                 const std::optional<std::string> &path = std::nullopt,
-                                bool pretty = false);
+                                bool pretty = false,
+                                const std::optional<Timestamp> &fromTime = std::nullopt,
+                                const std::optional<Timestamp> &toTime = std::nullopt);
       /// @brief Handler for a streaming sample
       /// @param[in] session session to stream data to
       /// @param[in] p printer for doc generation
@@ -137,12 +222,14 @@ namespace mtconnect {
       /// @param[in] from optional starting sequence number
       /// @param[in] path optional path for filtering
       /// @param[in] pretty `true` to ensure response is formatted
+      /// @param[in] fromTime optional starting time, resolved to `from` using the time index
       void streamSampleRequest(SessionPtr session, const printer::Printer *p, const int interval,
                                const int heartbeat, const int count = 100,
                                const std::optional<std::string> &device = std::nullopt,
                                const std::optional<SequenceNumber_t> &from = std::nullopt,
                                const std::optional<std::string> &path = std::nullopt,
-                               bool pretty = false);
+                               bool pretty = false,
+                               const std::optional<Timestamp> &fromTime = std::nullopt);
 
       /// @brief Handler for a streaming current
       /// @param[in] session session to stream data to
@@ -151,10 +238,14 @@ namespace mtconnect {
       /// @param[in] device optional device name or uuid
       /// @param[in] path optional path for filtering
       /// @param[in] pretty `true` to ensure response is formatted
+      /// @param[in] delta `true` to only send the data items that changed since the last document
+      /// @param[in] refresh the interval in ms between documents with all the data items when
+      ///                    streaming deltas, `0` to only send all the data items first
       void streamCurrentRequest(SessionPtr session, const printer::Printer *p, const int interval,
                                 const std::optional<std::string> &device = std::nullopt,
                                 const std::optional<std::string> &path = std::nullopt,
-                                bool pretty = false);
+                                bool pretty = false, bool delta = false,
+                                const int refresh = 10000);
       /// @brief Handler for put/post observation
       /// @param[in] p printer for response generation
       /// @param[in] device device
@@ -165,6 +256,11 @@ namespace mtconnect {
                                         const QueryMap observations,
                                         const std::optional<std::string> &time = std::nullopt);
 
+      /// @brief Handler for writing a buffer snapshot to the snapshot directory
+      /// @param[in] p printer for error responses
+      /// @return the file name and number of observations written
+      ResponsePtr snapshotRequest(const printer::Printer *p);
+
       ///@}
 
       /// @name Async stream method
@@ -237,6 +333,31 @@ namespace mtconnect {
                                          const std::optional<std::string> &type = std::nullopt);
       ///@}
 
+      /// @brief Get the metrics of the sample streams
+      ///
+      /// The backlog of a stream is the number of observations in the buffer after the end of
+      /// the last chunk sent to the client. It is only measured when the last chunk stopped short
+      /// of the end of the buffer, a stream that is caught up has no backlog. A stream produces
+      /// its next chunk only after the last chunk is written, so the backlog is the depth of the
+      /// session's outgoing queue.
+      ///
+      /// @return the stream metrics
+      StreamMetrics getStreamMetrics() const;
+
+      /// @brief Publish the stream metrics to the agent device data items
+      ///
+      /// Repeats every 10 seconds while the agent device has the `stream_count` data item.
+      void publishStreamMetrics();
+
+      /// @brief Get the number of stream shards
+      /// @return the number of strands the streams are distributed across
+      size_t getStreamShardCount() const { return m_shards.size(); }
+
+      /// @brief Get a stream shard
+      /// @param index the index of the shard, less than `getStreamShardCount()`
+      /// @return the shard
+      const StreamShard &getStreamShard(size_t index) const { return *m_shards[index]; }
+
       /// @brief For debugging: turn on stream data logging
       /// @note This is only for debuging
       void setLogStreamData(bool log);
@@ -283,6 +404,8 @@ namespace mtconnect {
       // HTTP Routings
       void createPutObservationRoutings();
 
+      void createSnapshotRoutings();
+
       void createFileRoutings();
 
       void createProbeRoutings();
@@ -296,6 +419,12 @@ namespace mtconnect {
       // Current Data Collection
       std::string fetchCurrentData(const printer::Printer *printer, const FilterSetOpt &filterSet,
                                    const std::optional<SequenceNumber_t> &at, bool pretty = false);
+      // Current data of the data items that changed since a sequence number, or all the data items
+      // if full. Returns nullopt if nothing changed. Updates since to the next sequence number.
+      std::optional<std::string> fetchCurrentDelta(const printer::Printer *printer,
+                                                   const FilterSetOpt &filterSet,
+                                                   SequenceNumber_t &since, bool full,
+                                                   bool pretty = false);
 
       // Sample data collection
       std::string fetchSampleData(const printer::Printer *printer, const FilterSetOpt &filterSet,
@@ -304,12 +433,27 @@ namespace mtconnect {
                                   bool &endOfBuffer,
                                   observation::ChangeObserver *observer = nullptr,
                                   bool pretty = false);
+      // Apply the backlog policy to a stream that fell behind, returns `false` if the stream has
+      // been handled
+      bool streamBacklogOverflow(std::shared_ptr<AsyncSampleResponse> asyncResponse,
+                                 SequenceNumber_t backlog);
+
+      // Shard for a new stream
+      StreamShard &nextShard() { return *m_shards[m_nextShard++ % m_shards.size()]; }
+
+      // Sample data shared by the streams in the same group
+      std::shared_ptr<const std::string> fetchSharedSampleData(
+          std::shared_ptr<AsyncSampleResponse> asyncResponse, SequenceNumber_t &end);
 
       // Verification methods
       template <typename T>
       void checkRange(const printer::Printer *printer, const T value, const T min, const T max,
                       const std::string &param, bool notZero = false) const;
 
+      std::optional<Timestamp> checkTimestamp(const printer::Printer *printer,
+                                              const std::optional<std::string> &time,
+                                              const std::string &param) const;
+
       void checkPath(const printer::Printer *printer, const std::optional<std::string> &path,
                      const DevicePtr device, FilterSet &filter) const;
 
@@ -321,6 +465,11 @@ namespace mtconnect {
 
       boost::asio::io_context::strand m_strand;
 
+      // Streams are assigned round robin to a shard that serializes their callbacks and schedules
+      // their interval and heartbeat waits
+      std::vector<std::unique_ptr<StreamShard>> m_shards;
+      std::atomic<size_t> m_nextShard {0};
+
       std::string m_schemaVersion;
 
       ConfigOptions m_options;
@@ -335,6 +484,20 @@ namespace mtconnect {
       FileCache m_fileCache;
 
       bool m_logStreamData {false};
+
+      // Limits on the unsent observations of a sample stream
+      uint64_t m_backlogLimit {0};
+      BacklogPolicy m_backlogPolicy {BacklogPolicy::DISCONNECT};
+      std::shared_ptr<StreamCounters> m_streamCounters;
+      boost::asio::steady_timer m_streamMetricsTimer;
+
+      // Sample streams with the same printer, filter, count and interval share their chunks
+      std::mutex m_sampleGroupsLock;
+      std::unordered_map<std::string, std::weak_ptr<SampleStreamGroup>> m_sampleGroups;
+
+      // Probe documents by printer, device and pretty
+      std::mutex m_probeCacheLock;
+      std::map<std::tuple<const printer::Printer *, std::string, bool>, CachedProbe> m_probeCache;
     };
   }  // namespace sink::rest_sink
 }  // namespace mtconnect
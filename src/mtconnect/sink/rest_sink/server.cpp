@@ -198,7 +198,8 @@ namespace mtconnect::sink::rest_sink {
       {
         auto dectector =
             make_shared<TlsDector>(std::move(socket), m_sslContext, m_tlsOnly, m_allowPuts,
-                                   m_allowPutsFrom, m_fields, dispatcher, m_errorFunction);
+                                   m_allowPutsFrom, m_compress, m_fields, dispatcher,
+                                   m_errorFunction);
 
         dectector->run();
       }
@@ -213,6 +214,7 @@ namespace mtconnect::sink::rest_sink {
           session->allowPutsFrom(m_allowPutsFrom);
         else if (m_allowPuts)
           session->allowPuts();
+        session->compressResponses(m_compress);
 
         session->run();
       }
@@ -54,11 +54,13 @@ namespace mtconnect::sink::rest_sink {
     /// - AllowPut, defaults to false
     /// - ServerIp, defaults to 0.0.0.0
     /// - HttpHeaders
+    /// - CompressResponses, defaults to true
     Server(boost::asio::io_context &context, const ConfigOptions &options = {})
       : m_context(context),
         m_port(GetOption<int>(options, configuration::Port).value_or(5000)),
         m_options(options),
         m_allowPuts(IsOptionSet(options, configuration::AllowPut)),
+        m_compress(GetOption<bool>(options, configuration::CompressResponses).value_or(true)),
         m_acceptor(context),
         m_sslContext(boost::asio::ssl::context::tls)
     {
@@ -148,6 +150,13 @@ namespace mtconnect::sink::rest_sink {
     }
     ///@}
 
+    /// @brief compress responses and streams if the client accepts gzip or deflate
+    /// @param[in] compress `true` to compress
+    void compressResponses(bool compress = true) { m_compress = compress; }
+    /// @brief are responses compressed
+    /// @return `true` if responses are compressed when the client accepts it
+    bool areResponsesCompressed() const { return m_compress; }
+
     /// @brief Entry point for all requests
     ///
     /// Search routings for a match, if a match is found, then dispatch the request, otherwise
@@ -270,6 +279,7 @@ namespace mtconnect::sink::rest_sink {
     // Put handling controls
     bool m_allowPuts {false};
     std::set<boost::asio::ip::address> m_allowPutsFrom;
+    bool m_compress {true};
 
     std::list<Routing> m_routings;
     std::unique_ptr<FileCache> m_fileCache;
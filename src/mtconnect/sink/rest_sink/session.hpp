@@ -105,6 +105,9 @@ namespace mtconnect::sink::rest_sink {
       m_allowPuts = true;
       m_allowPutsFrom = hosts;
     }
+    /// @brief compress responses if the client accepts gzip or deflate
+    /// @param compress `true` if responses can be compressed
+    void compressResponses(bool compress = true) { m_compress = compress; }
     /// @brief get the remote endpoint
     /// @return the asio tcp endpoint
     auto &getRemote() const { return m_remote; }
@@ -124,6 +127,7 @@ namespace mtconnect::sink::rest_sink {
     bool m_unauthorized {false};
     bool m_allowPuts {false};
     std::set<boost::asio::ip::address> m_allowPutsFrom;
+    bool m_compress {false};
     boost::asio::ip::tcp::endpoint m_remote;
   };
 
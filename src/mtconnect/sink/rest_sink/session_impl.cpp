@@ -34,6 +34,7 @@
 #include "request.hpp"
 #include "response.hpp"
 #include "tls_dector.hpp"
+#include "websocket_session.hpp"
 
 namespace mtconnect::sink::rest_sink {
   namespace beast = boost::beast;  // from <boost/beast.hpp>
@@ -154,6 +155,8 @@ namespace mtconnect::sink::rest_sink {
     m_serializer.reset();
     m_boundary.clear();
     m_mimeType.clear();
+    m_compressor.reset();
+    m_compressed.clear();
 
     m_parser.emplace();
   }
@@ -197,6 +200,13 @@ namespace mtconnect::sink::rest_sink {
     auto &msg = m_parser->get();
     const auto &remote = beast::get_lowest_layer(derived().stream()).socket().remote_endpoint();
 
+    // Hand the connection over to a WebSocket session
+    if (beast::websocket::is_upgrade(msg))
+    {
+      derived().upgrade(m_parser->release());
+      return;
+    }
+
     // Check for put, post, or delete
     if (msg.method() != http::verb::get)
     {
@@ -226,6 +236,8 @@ namespace mtconnect::sink::rest_sink {
       m_request->m_contentType = string(a->value());
     if (auto a = msg.find(http::field::accept_encoding); a != msg.end())
       m_request->m_acceptsEncoding = string(a->value());
+    if (auto a = msg.find(http::field::if_none_match); a != msg.end())
+      m_request->m_ifNoneMatch = string(a->value());
     m_request->m_body = msg.body();
 
     if (auto f = msg.find(http::field::content_type);
@@ -306,6 +318,18 @@ namespace mtconnect::sink::rest_sink {
       res->set(f.first, f.second);
     }
 
+    // The chunks are compressed as one stream with a context kept for the whole stream
+    if (m_compress && m_request)
+    {
+      if (auto encoding = Compressor::Negotiate(m_request->m_acceptsEncoding);
+          encoding != Compressor::NONE)
+      {
+        m_compressor = make_unique<Compressor>(encoding);
+        res->set(field::content_encoding, Compressor::Name(encoding));
+        res->set(field::vary, "Accept-Encoding");
+      }
+    }
+
     auto sr = make_shared<response_serializer<empty_body>>(*res);
     m_serializer = sr;
     async_write_header(derived().stream(), *sr,
@@ -330,8 +354,17 @@ namespace mtconnect::sink::rest_sink {
         << to_string(field::content_length) << ": " << to_string(body.length()) << "\r\n\r\n"
         << body << "\r\n";
 
-    async_write(derived().stream(), http::make_chunk(m_streamBuffer->data()),
-                beast::bind_front_handler(&SessionImpl::sent, shared_ptr()));
+    if (m_compressor)
+    {
+      m_compressed = m_compressor->compress(beast::buffers_to_string(m_streamBuffer->data()));
+      async_write(derived().stream(), http::make_chunk(asio::buffer(m_compressed)),
+                  beast::bind_front_handler(&SessionImpl::sent, shared_ptr()));
+    }
+    else
+    {
+      async_write(derived().stream(), http::make_chunk(m_streamBuffer->data()),
+                  beast::bind_front_handler(&SessionImpl::sent, shared_ptr()));
+    }
   }
 
   template <class Derived>
@@ -339,6 +372,17 @@ namespace mtconnect::sink::rest_sink {
   {
     NAMED_SCOPE("SessionImpl::closeStream");
 
+    // Finish the compressed stream before the last chunk
+    if (m_compressor)
+    {
+      m_compressed = m_compressor->compress({}, true);
+      m_compressor.reset();
+      m_complete = [this]() { closeStream(); };
+      async_write(derived().stream(), http::make_chunk(asio::buffer(m_compressed)),
+                  beast::bind_front_handler(&SessionImpl::sent, shared_ptr()));
+      return;
+    }
+
     m_complete = [this]() { close(); };
     http::fields trailer;
     async_write(derived().stream(), http::make_chunk_last(trailer),
@@ -355,8 +399,11 @@ namespace mtconnect::sink::rest_sink {
     if (response.m_expires == 0s)
     {
       res->set(http::field::expires, "-1");
-      res->set(http::field::cache_control, "no-store, max-age=0");
+      // Documents with an entity tag can be kept by the client if it revalidates them
+      res->set(http::field::cache_control, response.m_etag ? "no-cache" : "no-store, max-age=0");
     }
+    if (response.m_etag)
+      res->set(http::field::etag, *response.m_etag);
     res->set(http::field::content_type, response.m_mimeType);
     for (const auto &f : m_fields)
     {
@@ -427,19 +474,48 @@ namespace mtconnect::sink::rest_sink {
         bp = m_outgoing->m_file->m_buffer;
         size = m_outgoing->m_file->m_size;
       }
+      else if (m_outgoing->m_shared)
+      {
+        bp = m_outgoing->m_shared->m_body.c_str();
+        size = m_outgoing->m_shared->m_body.size();
+      }
       else
       {
         bp = m_outgoing->m_body.c_str();
         size = m_outgoing->m_body.size();
       }
 
+      // Compress generated documents, cached files are small or already compressed
+      auto encoding = Compressor::NONE;
+      if (m_compress && m_request && !m_outgoing->m_file && size >= Compressor::MinimumSize)
+        encoding = Compressor::Negotiate(m_request->m_acceptsEncoding);
+      if (encoding != Compressor::NONE && m_outgoing->m_shared)
+      {
+        // Shared documents are only compressed once
+        const auto &compressed = m_outgoing->m_shared->compressed(encoding);
+        bp = compressed.data();
+        size = compressed.size();
+      }
+      else if (encoding != Compressor::NONE)
+      {
+        m_compressed = Compressor(encoding).compress(string_view(bp, size), true);
+        bp = m_compressed.data();
+        size = m_compressed.size();
+      }
+
       auto res = make_shared<http::response<http::span_body<const char>>>(
           std::piecewise_construct, std::make_tuple(bp, size),
           std::make_tuple(m_outgoing->m_status, 11));
 
       addHeaders(*m_outgoing, res);
+      if (encoding != Compressor::NONE)
+      {
+        res->set(http::field::content_encoding, Compressor::Name(encoding));
+        res->set(http::field::vary, "Accept-Encoding");
+      }
       res->chunked(false);
-      res->content_length(size);
+      if (m_outgoing->m_status != status::not_modified)
+        res->content_length(size);
 
       m_response = res;
 
@@ -462,6 +538,14 @@ namespace mtconnect::sink::rest_sink {
     }
   }
 
+  void HttpSession::upgrade(UpgradeRequest &&request)
+  {
+    m_upgraded = true;
+    auto session = make_shared<WebsocketSession<beast::tcp_stream>>(std::move(m_stream), m_remote,
+                                                                    m_dispatch, m_errorFunction);
+    session->run(std::move(request));
+  }
+
   /// @brief A secure https session
   class HttpsSession : public SessionImpl<HttpsSession>
   {
@@ -505,6 +589,16 @@ namespace mtconnect::sink::rest_sink {
     /// @return the stream
     beast::ssl_stream<beast::tcp_stream> releaseStream() { return std::move(m_stream); }
 
+    /// @brief hand the stream over to a WebSocket session
+    /// @param request the upgrade request
+    void upgrade(UpgradeRequest &&request)
+    {
+      m_closing = true;
+      auto session = make_shared<WebsocketSession<beast::ssl_stream<beast::tcp_stream>>>(
+          std::move(m_stream), m_remote, m_dispatch, m_errorFunction);
+      session->run(std::move(request));
+    }
+
     /// @brief shutdown the stream asyncronously closing the secure stream
     void close() override
     {
@@ -597,6 +691,7 @@ namespace mtconnect::sink::rest_sink {
         session->allowPutsFrom(m_allowPutsFrom);
       else if (m_allowPuts)
         session->allowPuts();
+      session->compressResponses(m_compress);
 
       session->run();
     }
@@ -24,6 +24,7 @@
 #include <memory>
 #include <optional>
 
+#include "compressor.hpp"
 #include "mtconnect/config.hpp"
 #include "mtconnect/configuration/config_options.hpp"
 #include "mtconnect/utilities.hpp"
@@ -104,6 +105,10 @@ namespace mtconnect {
       std::shared_ptr<void> m_response;
       std::shared_ptr<void> m_serializer;
       ResponsePtr m_outgoing;
+
+      // Compression of the response or stream
+      std::unique_ptr<Compressor> m_compressor;
+      std::string m_compressed;
     };
 
     /// @brief An HTTP Session for communication without TLS
@@ -135,18 +140,25 @@ namespace mtconnect {
       /// @return the stream
       auto &stream() { return m_stream; }
 
+      /// @brief hand the stream over to a WebSocket session
+      /// @param request the upgrade request
+      void upgrade(boost::beast::http::request<boost::beast::http::string_body> &&request);
+
       /// @brief close the session and shutdown the socket
       void close() override
       {
         NAMED_SCOPE("HttpSession::close");
 
         m_request.reset();
+        if (m_upgraded)
+          return;
         boost::beast::error_code ec;
         m_stream.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
       }
 
     protected:
       boost::beast::tcp_stream m_stream;
+      bool m_upgraded {false};
     };
   }  // namespace sink::rest_sink
 }  // namespace mtconnect
@@ -0,0 +1,149 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#include "timer_wheel.hpp"
+
+#include "mtconnect/logging.hpp"
+
+using namespace std;
+
+namespace mtconnect::sink::rest_sink {
+  TimerWheel::TimerId TimerWheel::schedule(chrono::milliseconds delay, Handler handler)
+  {
+    // Nothing to wait for
+    if (delay.count() <= 0)
+    {
+      boost::asio::post(m_strand,
+                        [handler = std::move(handler)]() { handler(boost::system::error_code {}); });
+      return 0;
+    }
+
+    TimerId id;
+    bool start = false;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      // The wheel does not advance while it is idle
+      auto current = std::max(now(), m_current);
+      if (!m_running)
+        m_current = current;
+
+      uint64_t ticks = 1;
+      if (delay > m_tick)
+        ticks = uint64_t((delay + m_tick - 1ms) / m_tick);
+      auto expires = current + ticks;
+      auto slot = expires % m_slots.size();
+      id = m_nextId++;
+      auto &list = m_slots[slot];
+      list.push_back({id, expires, std::move(handler)});
+      m_index.emplace(id, make_pair(slot, std::prev(list.end())));
+
+      start = !m_running;
+      m_running = true;
+    }
+
+    if (start)
+      boost::asio::dispatch(m_strand, [self = shared_from_this()]() { self->arm(); });
+
+    return id;
+  }
+
+  bool TimerWheel::cancel(TimerId id)
+  {
+    Handler handler;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto it = m_index.find(id);
+      if (it == m_index.end())
+        return false;
+
+      auto &[slot, wait] = it->second;
+      handler = std::move(wait->m_handler);
+      m_slots[slot].erase(wait);
+      m_index.erase(it);
+    }
+
+    boost::asio::post(m_strand, [handler = std::move(handler)]() {
+      handler(boost::asio::error::operation_aborted);
+    });
+    return true;
+  }
+
+  void TimerWheel::stop()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &slot : m_slots)
+      slot.clear();
+    m_index.clear();
+    m_running = false;
+    boost::asio::post(m_strand, [self = shared_from_this()]() { self->m_timer.cancel(); });
+  }
+
+  void TimerWheel::arm()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_running)
+      return;
+
+    // Wake up at the start of the next tick so waits expiring together are run together
+    m_timer.expires_at(m_start + (m_current + 1) * m_tick);
+    m_timer.async_wait(boost::asio::bind_executor(
+        m_strand, [self = shared_from_this()](boost::system::error_code ec) { self->expired(ec); }));
+  }
+
+  void TimerWheel::expired(boost::system::error_code ec)
+  {
+    if (ec)
+      return;
+
+    list<Handler> handlers;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_running)
+        return;
+
+      // Visit the slots of every tick since the last wake up, at most one turn of the wheel
+      auto target = std::max(now(), m_current + 1);
+      auto steps = std::min<uint64_t>(target - m_current, m_slots.size());
+      for (uint64_t step = 1; step <= steps; step++)
+      {
+        auto slot = (m_current + step) % m_slots.size();
+        auto &list = m_slots[slot];
+        for (auto wait = list.begin(); wait != list.end();)
+        {
+          if (wait->m_expires <= target)
+          {
+            handlers.emplace_back(std::move(wait->m_handler));
+            m_index.erase(wait->m_id);
+            wait = list.erase(wait);
+          }
+          else
+          {
+            wait++;
+          }
+        }
+      }
+      m_current = target;
+      m_running = !m_index.empty();
+    }
+
+    for (auto &handler : handlers)
+      handler(boost::system::error_code {});
+
+    arm();
+  }
+}  // namespace mtconnect::sink::rest_sink
@@ -0,0 +1,160 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <boost/asio.hpp>
+
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "mtconnect/config.hpp"
+#include "mtconnect/observation/change_observer.hpp"
+
+namespace mtconnect::sink::rest_sink {
+  /// @brief Schedules the interval and heartbeat waits of all the streams with one timer
+  ///
+  /// A hashed timer wheel: each wait is placed in the slot of the tick it expires on, and a single
+  /// timer wakes up once per tick to run the waits in the slot. Waits that expire in the same tick
+  /// are run together, and scheduling or canceling a wait is constant time regardless of the number
+  /// of streams. Waits longer than one turn of the wheel stay in their slot until their tick. The
+  /// timer only runs while there are waits scheduled.
+  ///
+  /// Waits can be scheduled and canceled from any thread. Handlers are called in the strand.
+  class AGENT_LIB_API TimerWheel : public std::enable_shared_from_this<TimerWheel>
+  {
+  public:
+    using Handler = std::function<void(boost::system::error_code)>;
+    using TimerId = uint64_t;
+
+    /// @brief Create a timer wheel
+    /// @param[in] strand the strand the handlers are called in
+    /// @param[in] tick the resolution of the wheel
+    /// @param[in] slots the number of ticks in one turn of the wheel
+    TimerWheel(boost::asio::io_context::strand &strand,
+               std::chrono::milliseconds tick = std::chrono::milliseconds(10), size_t slots = 1024)
+      : m_strand(strand),
+        m_timer(strand.context()),
+        m_tick(tick),
+        m_slots(slots),
+        m_start(std::chrono::steady_clock::now())
+    {}
+    TimerWheel(const TimerWheel &) = delete;
+    ~TimerWheel() = default;
+
+    /// @brief Schedule a handler to be called after a delay
+    ///
+    /// The delay is rounded up to the next tick. If there is no delay, the handler is posted to the
+    /// strand.
+    ///
+    /// @param[in] delay the delay
+    /// @param[in] handler the handler, called with no error when the delay expires
+    /// @return the id to cancel the wait, `0` if there is no delay
+    TimerId schedule(std::chrono::milliseconds delay, Handler handler);
+    /// @brief Cancel a wait
+    ///
+    /// The handler is called with `operation_aborted` in the strand.
+    ///
+    /// @param[in] id the id of the wait
+    /// @return `true` if the wait was pending
+    bool cancel(TimerId id);
+    /// @brief Drop all the waits without calling their handlers and stop the timer
+    void stop();
+
+    /// @brief get the number of pending waits
+    /// @return the number of waits
+    size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_index.size();
+    }
+    /// @brief get the resolution of the wheel
+    /// @return the duration of a tick
+    auto getTick() const { return m_tick; }
+
+  protected:
+    struct Wait
+    {
+      TimerId m_id;
+      uint64_t m_expires;
+      Handler m_handler;
+    };
+    using Slot = std::list<Wait>;
+
+    uint64_t now() const
+    {
+      return uint64_t((std::chrono::steady_clock::now() - m_start) / m_tick);
+    }
+    void arm();
+    void expired(boost::system::error_code ec);
+
+  protected:
+    boost::asio::io_context::strand &m_strand;
+    boost::asio::steady_timer m_timer;
+    std::chrono::milliseconds m_tick;
+    std::vector<Slot> m_slots;
+    std::chrono::steady_clock::time_point m_start;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<TimerId, std::pair<size_t, Slot::iterator>> m_index;
+    uint64_t m_current {0};
+    TimerId m_nextId {1};
+    bool m_running {false};
+  };
+
+  /// @brief A change observer that waits on a shared timer wheel instead of its own timer
+  class AGENT_LIB_API WheelChangeObserver : public observation::ChangeObserver
+  {
+  public:
+    /// @brief Create a change observer using a timer wheel
+    /// @param[in] strand the strand
+    /// @param[in] wheel the timer wheel
+    WheelChangeObserver(boost::asio::io_context::strand &strand,
+                        std::shared_ptr<TimerWheel> wheel)
+      : ChangeObserver(strand), m_wheel(wheel)
+    {}
+    ~WheelChangeObserver() override
+    {
+      if (m_timerId)
+        m_wheel->cancel(m_timerId);
+    }
+
+  protected:
+    void startTimer(std::chrono::milliseconds duration,
+                    std::function<void(boost::system::error_code)> handler) override
+    {
+      m_timerId = m_wheel->schedule(duration, handler);
+    }
+    void cancelTimer() override
+    {
+      if (m_timerId)
+      {
+        m_wheel->cancel(m_timerId);
+        m_timerId = 0;
+      }
+    }
+
+  protected:
+    std::shared_ptr<TimerWheel> m_wheel;
+    TimerWheel::TimerId m_timerId {0};
+  };
+}  // namespace mtconnect::sink::rest_sink
@@ -0,0 +1,287 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "mtconnect/config.hpp"
+#include "mtconnect/logging.hpp"
+#include "request.hpp"
+#include "response.hpp"
+#include "session.hpp"
+
+namespace mtconnect::sink::rest_sink {
+  /// @brief Split a request target into the path and the query parameters
+  /// @param[in] url the request target
+  /// @param[out] queries the decoded query parameters
+  /// @return the decoded path
+  std::string parseUrl(std::string url, QueryMap &queries);
+
+  /// @brief The HTTP upgrade request that starts a WebSocket session
+  using UpgradeRequest = boost::beast::http::request<boost::beast::http::string_body>;
+
+  /// @brief A WebSocket connection carrying requests and streams to a client
+  ///
+  /// Every text message from the client is a request target, such as
+  /// `/LinuxCNC/sample?interval=100&path=//DataItem[@type='EXECUTION']`, that is dispatched like
+  /// an HTTP GET. Responses and stream chunks are sent back as one text message each. A new request
+  /// replaces the stream of the previous request, so the client changes the filter or interval of
+  /// its stream by sending another request on the same connection. If the upgrade request has a
+  /// target other than `/`, it is dispatched as the first request.
+  ///
+  /// @tparam Stream the next layer stream, either a plain tcp stream or a TLS stream
+  template <class Stream>
+  class WebsocketSession : public std::enable_shared_from_this<WebsocketSession<Stream>>
+  {
+  public:
+    /// @brief A request received on the connection
+    ///
+    /// Implements the session interface for the request handlers. Once a newer request has been
+    /// received, the writes are dropped and their completions are not called, which ends the
+    /// request's stream.
+    class RequestSession : public Session
+    {
+    public:
+      /// @brief Create a request session
+      /// @param connection the WebSocket connection
+      /// @param id the request id on the connection
+      /// @param dispatch dispatch function
+      /// @param error error function
+      RequestSession(std::shared_ptr<WebsocketSession> connection, uint64_t id, Dispatch dispatch,
+                     ErrorFunction error)
+        : Session(dispatch, error), m_connection(connection), m_id(id)
+      {
+        m_remote = connection->m_remote;
+      }
+
+      /// @name Session Interface
+      ///@{
+      void run() override {}
+      void writeResponse(ResponsePtr &&response, Complete complete = nullptr) override
+      {
+        if (response->m_file && response->m_file->m_cached)
+          m_connection->send(m_id, std::string(response->m_file->m_buffer, response->m_file->m_size),
+                             complete);
+        else
+          m_connection->send(m_id, std::move(response->m_body), complete);
+      }
+      void writeFailureResponse(ResponsePtr &&response, Complete complete = nullptr) override
+      {
+        writeResponse(std::move(response), complete);
+      }
+      void beginStreaming(const std::string &mimeType, Complete complete) override { complete(); }
+      void writeChunk(const std::string &chunk, Complete complete) override
+      {
+        m_connection->send(m_id, chunk, complete);
+      }
+      /// @brief ends the request, the connection remains open
+      void close() override {}
+      /// @brief ends the stream, the connection remains open
+      void closeStream() override {}
+      ///@}
+
+    protected:
+      std::shared_ptr<WebsocketSession> m_connection;
+      uint64_t m_id;
+    };
+
+    /// @brief Create a WebSocket session taking over the stream of an HTTP session
+    /// @param stream the stream (takes ownership)
+    /// @param remote the remote endpoint
+    /// @param dispatch dispatch function
+    /// @param error error function
+    WebsocketSession(Stream &&stream, const boost::asio::ip::tcp::endpoint &remote,
+                     Dispatch dispatch, ErrorFunction error)
+      : m_stream(std::move(stream)), m_remote(remote), m_dispatch(dispatch), m_errorFunction(error)
+    {}
+    /// @brief Sessions cannot be copied
+    WebsocketSession(const WebsocketSession &) = delete;
+    ~WebsocketSession() = default;
+
+    /// @brief Complete the WebSocket handshake
+    /// @param request the HTTP upgrade request (takes ownership)
+    void run(UpgradeRequest &&request)
+    {
+      namespace beast = boost::beast;
+      namespace websocket = beast::websocket;
+
+      NAMED_SCOPE("WebsocketSession::run");
+
+      // The websocket stream manages its own timeouts
+      beast::get_lowest_layer(m_stream).expires_never();
+      m_stream.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+      m_stream.set_option(websocket::stream_base::decorator([](websocket::response_type &res) {
+        res.set(beast::http::field::server, "MTConnectAgent");
+      }));
+
+      m_upgrade = std::move(request);
+      if (auto a = m_upgrade.find(beast::http::field::accept); a != m_upgrade.end())
+        m_accepts = std::string(a->value());
+
+      m_stream.async_accept(m_upgrade,
+                            beast::bind_front_handler(&WebsocketSession::accepted, getptr()));
+    }
+
+    /// @brief Queue a message for the client
+    ///
+    /// The message is dropped if the connection is closed or a newer request has been received.
+    ///
+    /// @param id the id of the request sending the message
+    /// @param message the message
+    /// @param complete completion called after the message is written
+    void send(uint64_t id, std::string message, Complete complete)
+    {
+      boost::asio::dispatch(m_stream.get_executor(), [self = getptr(), id,
+                                                      message = std::move(message),
+                                                      complete]() mutable {
+        if (self->m_closed || id != self->m_requestId)
+          return;
+
+        self->m_queue.emplace_back(std::move(message), std::move(complete));
+        if (self->m_queue.size() == 1)
+          self->write();
+      });
+    }
+
+  protected:
+    std::shared_ptr<WebsocketSession> getptr() { return this->shared_from_this(); }
+
+    void accepted(boost::system::error_code ec)
+    {
+      NAMED_SCOPE("WebsocketSession::accepted");
+
+      if (ec)
+      {
+        fail(ec, "WebSocket handshake failed");
+        return;
+      }
+
+      LOG(info) << "WebSocket: From [" << m_remote.address() << ':' << m_remote.port()
+                << "]: " << m_upgrade.target();
+
+      auto target = std::string(m_upgrade.target());
+      if (!target.empty() && target != "/")
+        request(target);
+
+      read();
+    }
+
+    void read()
+    {
+      m_stream.async_read(m_buffer,
+                          boost::beast::bind_front_handler(&WebsocketSession::received, getptr()));
+    }
+
+    void received(boost::system::error_code ec, size_t len)
+    {
+      NAMED_SCOPE("WebsocketSession::received");
+
+      if (ec)
+      {
+        if (ec != boost::beast::websocket::error::closed)
+          fail(ec, "Could not read request");
+        m_closed = true;
+        m_queue.clear();
+        return;
+      }
+
+      auto target = boost::beast::buffers_to_string(m_buffer.data());
+      m_buffer.consume(m_buffer.size());
+      request(target);
+
+      read();
+    }
+
+    void request(const std::string &target)
+    {
+      LOG(debug) << "WebSocket Request: From [" << m_remote.address() << ':' << m_remote.port()
+                 << "]: " << target;
+
+      auto request = std::make_shared<Request>();
+      request->m_verb = boost::beast::http::verb::get;
+      request->m_path = parseUrl(target, request->m_query);
+      request->m_accepts = m_accepts;
+      request->m_foreignIp = m_remote.address().to_string();
+      request->m_foreignPort = m_remote.port();
+
+      // The new request replaces the stream of the last request
+      auto session =
+          std::make_shared<RequestSession>(getptr(), ++m_requestId, m_dispatch, m_errorFunction);
+      if (!m_dispatch(session, request))
+      {
+        LOG(error) << "Failed to find handler for WebSocket request " << target;
+      }
+    }
+
+    void write()
+    {
+      m_stream.text(true);
+      m_stream.async_write(boost::asio::buffer(m_queue.front().first),
+                           boost::beast::bind_front_handler(&WebsocketSession::written, getptr()));
+    }
+
+    void written(boost::system::error_code ec, size_t len)
+    {
+      NAMED_SCOPE("WebsocketSession::written");
+
+      if (ec)
+      {
+        fail(ec, "Error sending message");
+        m_closed = true;
+        m_queue.clear();
+        return;
+      }
+
+      auto complete = std::move(m_queue.front().second);
+      m_queue.pop_front();
+      if (!m_queue.empty())
+        write();
+
+      if (complete)
+        complete();
+    }
+
+    void fail(boost::system::error_code ec, const std::string &message)
+    {
+      LOG(warning) << "WebSocket operation failed: " << message;
+      LOG(warning) << "Closing: " << ec.category().message(ec.value()) << " - " << ec.message();
+    }
+
+  protected:
+    boost::beast::websocket::stream<Stream> m_stream;
+    boost::asio::ip::tcp::endpoint m_remote;
+    Dispatch m_dispatch;
+    ErrorFunction m_errorFunction;
+
+    UpgradeRequest m_upgrade;
+    std::string m_accepts;
+    boost::beast::flat_buffer m_buffer;
+
+    // Only accessed from the stream's executor
+    uint64_t m_requestId {0};
+    bool m_closed {false};
+    std::deque<std::pair<std::string, Complete>> m_queue;
+  };
+}  // namespace mtconnect::sink::rest_sink
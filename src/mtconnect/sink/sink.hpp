@@ -98,6 +98,9 @@ namespace mtconnect {
       /// @brief Get the common circular buffer
       /// @return a reference to the circular buffer
       virtual buffer::CircularBuffer &getCircularBuffer() = 0;
+      /// @brief Get the instance id the agent recovered from a durable buffer
+      /// @return the instance id or `nullopt` if the sink should create one
+      virtual std::optional<uint64_t> getInstanceId() const { return std::nullopt; }
 
       /// @brief Get a pointer to the asset storage
       /// @return a pointer to the asset storage.
@@ -145,6 +148,19 @@ namespace mtconnect {
       /// @param observation shared pointer to the observation
       /// @return `true` if the publishing was successful
       virtual bool publish(observation::ObservationPtr &observation) = 0;
+      /// @brief Receive a batch of observations with a contiguous range of sequence numbers
+      ///
+      /// The default publishes each observation in order.
+      ///
+      /// @param observations the observations
+      /// @return `true` if the publishing was successful
+      virtual bool publish(observation::ObservationList &observations)
+      {
+        bool result = true;
+        for (auto &observation : observations)
+          result = publish(observation) && result;
+        return result;
+      }
       /// @brief Receive an asset
       /// @param asset shared point to the asset
       /// @return `true` if successful
@@ -32,6 +32,7 @@
 #include <set>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "logging.hpp"
@@ -158,4 +159,10 @@ namespace mtconnect {
 
     return address;
   }
+
+  DataItemIndexes &DataItemIndexes::Default()
+  {
+    static DataItemIndexes indexes;
+    return indexes;
+  }
 }  // namespace mtconnect
@@ -31,6 +31,7 @@
 #include <chrono>
 #include <date/date.h>
 #include <filesystem>
+#include <mutex>
 #include <mtconnect/version.h>
 
 #include "mtconnect/config.hpp"
@@ -409,8 +410,126 @@ namespace mtconnect {
 
   /// @brief observation sequence type
   using SequenceNumber_t = uint64_t;
+
+  /// @brief Assigns dense indexes to data item ids
+  ///
+  /// Indexes are assigned in the order the ids are first seen and are never reused. The agent
+  /// owns a registry for its device model, so the indexes stay dense for the data items it has
+  /// loaded and a data item keeps its index when the device model is reloaded. Data items that
+  /// are not loaded by an agent take their index from the `Default()` registry.
+  class AGENT_LIB_API DataItemIndexes
+  {
+  public:
+    /// @brief Get the index of a data item id, assigning the next one if it is new
+    /// @param[in] id the data item id
+    /// @return the index of the id
+    size_t assign(const std::string &id)
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      return m_indexes.try_emplace(id, m_indexes.size()).first->second;
+    }
+    /// @brief Find the index of a data item id without assigning one
+    /// @param[in] id the data item id
+    /// @return the index of the id if it has been assigned
+    std::optional<size_t> find(const std::string &id) const
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      auto it = m_indexes.find(id);
+      if (it != m_indexes.end())
+        return it->second;
+      else
+        return std::nullopt;
+    }
+    /// @brief get the number of assigned indexes
+    /// @return one past the largest index
+    size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(m_lock);
+      return m_indexes.size();
+    }
+
+    /// @brief the registry for data items that are not loaded by an agent
+    /// @return the default registry
+    static DataItemIndexes &Default();
+
+  protected:
+    mutable std::mutex m_lock;
+    std::unordered_map<std::string, size_t> m_indexes;
+  };
+
   /// @brief set of data item ids for filtering
-  using FilterSet = std::set<std::string>;
+  ///
+  /// Also keeps a bitmap of the dense data item indexes so observations can be filtered
+  /// without hashing the data item id.
+  class FilterSet
+  {
+  public:
+    using const_iterator = std::set<std::string>::const_iterator;
+
+    FilterSet() = default;
+    FilterSet(std::initializer_list<std::string> ids)
+    {
+      for (const auto &id : ids)
+        insert(id);
+    }
+
+    /// @brief add a data item id to the filter with its index from the default registry
+    /// @param[in] id the data item id
+    /// @return iterator and `true` if the id was added
+    std::pair<const_iterator, bool> insert(const std::string &id)
+    {
+      if (m_ids.count(id) > 0)
+        return {m_ids.find(id), false};
+      return insert(id, DataItemIndexes::Default().assign(id));
+    }
+
+    /// @brief add a data item id to the filter
+    /// @param[in] id the data item id
+    /// @param[in] index the dense data item index
+    /// @return iterator and `true` if the id was added
+    std::pair<const_iterator, bool> insert(const std::string &id, size_t index)
+    {
+      auto res = m_ids.insert(id);
+      if (res.second)
+      {
+        if (index >= m_indexes.size())
+          m_indexes.resize(index + 1);
+        m_indexes[index] = true;
+      }
+      return res;
+    }
+
+    /// @brief check if the filter has a data item id
+    /// @param[in] id the data item id
+    /// @return `1` if the filter has the id
+    size_t count(const std::string &id) const { return m_ids.count(id); }
+    /// @brief check if the filter has a data item index
+    /// @param[in] index the dense data item index
+    /// @return `true` if the filter has the index
+    bool contains(size_t index) const { return index < m_indexes.size() && m_indexes[index]; }
+    /// @brief get the upper bound of the data item indexes in the filter
+    /// @return one past the largest index
+    size_t indexLimit() const { return m_indexes.size(); }
+
+    /// @brief remove all data item ids
+    void clear()
+    {
+      m_ids.clear();
+      m_indexes.clear();
+    }
+
+    auto begin() const { return m_ids.begin(); }
+    auto end() const { return m_ids.end(); }
+    auto size() const { return m_ids.size(); }
+    auto empty() const { return m_ids.empty(); }
+
+    bool operator==(const FilterSet &other) const { return m_ids == other.m_ids; }
+
+  protected:
+    std::set<std::string> m_ids;
+    std::vector<bool> m_indexes;
+  };
+
   using FilterSetOpt = std::optional<FilterSet>;
   using Milliseconds = std::chrono::milliseconds;
   using Microseconds = std::chrono::microseconds;
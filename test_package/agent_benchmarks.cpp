@@ -0,0 +1,240 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+
+// Benchmarks that print timings and memory use. They are built by the agent_benchmarks target
+// and are not run by ctest.
+
+// Ensure that gtest is the first header otherwise Windows raises an error
+#include <gtest/gtest.h>
+// Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+#include "agent_test_helper.hpp"
+#include "mtconnect/buffer/circular_buffer.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace mtconnect;
+using namespace mtconnect::buffer;
+using namespace mtconnect::observation;
+using namespace mtconnect::sink::rest_sink;
+using namespace device_model;
+using namespace entity;
+using namespace data_item;
+using namespace std::literals;
+using namespace date::literals;
+
+namespace {
+  size_t residentBytes()
+  {
+#ifdef __linux__
+    ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * size_t(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+  }
+}  // namespace
+
+// main
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+class BufferBenchmark : public testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    ErrorList errors;
+    Properties device {{"id", "1"s}, {"name", "DeviceTest1"s}, {"uuid", "UnivUniqId1"s}};
+    m_device = dynamic_pointer_cast<Device>(Device::getFactory()->make("Device", device, errors));
+
+    auto comp = Component::make("Comp1", {{"id", "2"s}, {"name", "Comp1"s}}, errors);
+    m_device->addChild(comp, errors);
+
+    m_condition = DataItem::make(
+        {{"id", "1"s}, {"type", "LOAD"s}, {"category", "CONDITION"s}, {"name", "DataItemTest1"s}},
+        errors);
+    comp->addDataItem(m_condition, errors);
+
+    m_sample = DataItem::make({{"id", "3"s},
+                               {"type", "POSITION"s},
+                               {"category", "SAMPLE"s},
+                               {"name", "DataItemTest2"s},
+                               {"subType", "ACTUAL"s},
+                               {"units", "MILLIMETER"s},
+                               {"nativeUnits", "MILLIMETER"s}},
+                              errors);
+    comp->addDataItem(m_sample, errors);
+  }
+
+  DevicePtr m_device;
+  DataItemPtr m_condition;
+  DataItemPtr m_sample;
+  Timestamp m_time {Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min};
+};
+
+TEST_F(BufferBenchmark, should_filter_sparse_observations_independent_of_buffer_size)
+{
+  ErrorList errors;
+
+  // A filtered sample for a data item that has one observation every 1024
+  for (auto exp : {10u, 14u, 17u, 20u})
+  {
+    for (auto indexed : {false, true})
+    {
+      CircularBuffer buffer(exp, 1000, indexed);
+      for (int i = 0; i < (1 << exp); i++)
+      {
+        auto sparse = i % 1024 == 1023;
+        auto di = sparse ? m_condition : m_sample;
+        auto props = sparse ? Properties {{"level", "NORMAL"s}} : Properties {{"VALUE", double(i)}};
+        auto obs = Observation::make(di, props, m_time, errors);
+        buffer.addToBuffer(obs);
+      }
+
+      FilterSetOpt filter {FilterSet {"1"}};
+      std::optional<SequenceNumber_t> start, to;
+      SequenceNumber_t first, end;
+      bool eob = false;
+      size_t found = 0;
+
+      auto begin = steady_clock::now();
+      for (int i = 0; i < 100; i++)
+        found = buffer.getObservations(100, filter, start, to, end, first, eob)->size();
+      auto elapsed = duration_cast<microseconds>(steady_clock::now() - begin) / 100;
+
+      ASSERT_EQ(min((1 << exp) / 1024, 100), int(found));
+      cout << "Buffer 2^" << exp << (indexed ? " indexed: " : " scanned: ") << elapsed.count()
+           << "us per filtered sample" << endl;
+    }
+  }
+}
+
+TEST_F(BufferBenchmark, should_use_less_resident_memory_with_compact_observations)
+{
+#ifndef __linux__
+  GTEST_SKIP() << "Resident memory is only measured on Linux";
+#endif
+
+  ErrorList errors;
+
+  // 2^20 samples in the buffer. The compact buffer runs first so the entity buffer cannot reuse
+  // memory released by it.
+  map<bool, size_t> used;
+  for (auto compact : {true, false})
+  {
+    auto before = residentBytes();
+    {
+      CircularBuffer buffer(20, 1000, false, compact);
+      for (int i = 0; i < (1 << 20); i++)
+      {
+        auto obs = Observation::make(m_sample, {{"VALUE", double(i)}},
+                                     m_time + chrono::microseconds(i), errors);
+        buffer.addToBuffer(obs);
+      }
+      used[compact] = residentBytes() - before;
+    }
+
+    cout << (compact ? "Compact" : "Entity") << " buffer: " << used[compact] / (1 << 20)
+         << " resident bytes per observation" << endl;
+  }
+
+  ASSERT_LT(used[true], used[false]);
+}
+
+TEST(StreamBenchmark, should_scale_stream_chunk_throughput_with_worker_threads)
+{
+  // Counts the chunks written by all the sessions
+  class CountingSession : public TestSession
+  {
+  public:
+    CountingSession(std::atomic<uint64_t> &chunks, Dispatch dispatch, ErrorFunction error)
+      : TestSession(dispatch, error), m_chunks(chunks)
+    {}
+    void writeChunk(const std::string &chunk, Complete complete) override
+    {
+      m_chunks++;
+      if (m_streaming)
+        complete();
+    }
+
+    std::atomic<uint64_t> &m_chunks;
+  };
+
+  // Current streams with no interval, each chunk is printed as soon as the last one is written
+  const int streams = 16;
+  for (auto threads : {1, 2, 4, 8})
+  {
+    AgentTestHelper helper;
+    helper.createAgent("/samples/test_config.xml", 8, 4, "1.3", 25, false, true,
+                       {{configuration::WorkerThreads, threads}});
+    auto rest = helper.getRestService();
+    ASSERT_EQ(size_t(threads), rest->getStreamShardCount());
+    rest->start();
+
+    std::atomic<uint64_t> chunks {0};
+    vector<shared_ptr<CountingSession>> sessions;
+    for (int i = 0; i < streams; i++)
+    {
+      auto session = make_shared<CountingSession>(
+          chunks, [](SessionPtr, RequestPtr) { return true; }, helper.m_server->getErrorFunction());
+      auto request = make_shared<Request>();
+      request->m_verb = boost::beast::http::verb::get;
+      request->m_path = "/LinuxCNC/current";
+      request->m_query["interval"] = "0";
+      request->m_accepts = "text/xml";
+      ASSERT_TRUE(rest->getServer()->dispatch(session, request));
+      sessions.push_back(session);
+    }
+
+    auto begin = steady_clock::now();
+    vector<thread> workers;
+    for (int i = 0; i < threads; i++)
+      workers.emplace_back([&helper]() { helper.m_ioContext.run_for(500ms); });
+    for (auto &worker : workers)
+      worker.join();
+    auto elapsed = duration_cast<milliseconds>(steady_clock::now() - begin);
+
+    ASSERT_LT(uint64_t(streams), chunks.load());
+    cout << threads << " worker thread(s), " << streams << " streams: "
+         << chunks * 1000 / elapsed.count() << " chunks per second" << endl;
+
+    for (auto &session : sessions)
+      session->closeStream();
+    rest->stop();
+    helper.m_ioContext.restart();
+    helper.m_ioContext.run_for(50ms);
+  }
+}
@@ -19,9 +19,13 @@
 #include <gtest/gtest.h>
 // Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
 
+#include <atomic>
 #include <chrono>
+#include <filesystem>
 #include <iostream>
 #include <map>
+#include <regex>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <thread>
@@ -29,6 +33,7 @@
 #include "agent_test_helper.hpp"
 #include "mtconnect/agent.hpp"
 #include "mtconnect/asset/file_asset.hpp"
+#include "mtconnect/buffer/durable_buffer.hpp"
 #include "mtconnect/device_model/reference.hpp"
 #include "mtconnect/printer//xml_printer.hpp"
 #include "mtconnect/source/adapter/adapter.hpp"
@@ -128,6 +133,77 @@ TEST_F(AgentTest, Probe)
   }
 }
 
+TEST_F(AgentTest, should_cache_probe_until_the_device_model_changes)
+{
+  addAdapter();
+  auto session = m_agentTestHelper->session();
+
+  string body;
+  string etag;
+  {
+    PARSE_XML_RESPONSE("/probe");
+    ASSERT_TRUE(session->m_etag);
+    etag = *session->m_etag;
+    body = session->m_body;
+  }
+
+  {
+    PARSE_XML_RESPONSE("/probe");
+    ASSERT_EQ(etag, *session->m_etag);
+    ASSERT_EQ(body, session->m_body);
+  }
+
+  {
+    PARSE_XML_RESPONSE("/LinuxCNC/probe");
+    ASSERT_NE(etag, *session->m_etag);
+  }
+
+  // A conditional request with the same tag is not modified
+  auto request = make_shared<Request>();
+  request->m_verb = boost::beast::http::verb::get;
+  request->m_path = "/probe";
+  request->m_accepts = "text/xml";
+  request->m_ifNoneMatch = "\"other\", " + etag;
+  ASSERT_TRUE(m_agentTestHelper->m_restService->getServer()->dispatch(session, request));
+  ASSERT_EQ(status::not_modified, session->m_code);
+  ASSERT_TRUE(session->m_body.empty());
+  ASSERT_EQ(etag, *session->m_etag);
+
+  // Changing a device property changes the document
+  m_agentTestHelper->m_adapter->parseBuffer("* manufacturer: Big Tool\n");
+  {
+    PARSE_XML_RESPONSE("/probe");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Description@manufacturer", "Big Tool");
+    ASSERT_NE(etag, *session->m_etag);
+  }
+
+  request->m_parameters.clear();
+  ASSERT_TRUE(m_agentTestHelper->m_restService->getServer()->dispatch(session, request));
+  ASSERT_EQ(status::ok, session->m_code);
+  ASSERT_FALSE(session->m_body.empty());
+}
+
+TEST_F(AgentTest, should_print_the_probe_again_when_the_buffer_is_resized)
+{
+  auto agent = m_agentTestHelper->createAgent("/samples/test_config.xml", 8, 4, "1.3", 25);
+  auto session = m_agentTestHelper->session();
+
+  string etag;
+  {
+    PARSE_XML_RESPONSE("/probe");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Header@bufferSize", "256");
+    ASSERT_TRUE(session->m_etag);
+    etag = *session->m_etag;
+  }
+
+  agent->resizeBuffer(10, 25);
+  {
+    PARSE_XML_RESPONSE("/probe");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Header@bufferSize", "1024");
+    ASSERT_NE(etag, *session->m_etag);
+  }
+}
+
 TEST_F(AgentTest, FailWithDuplicateDeviceUUID)
 {
   using namespace configuration;
@@ -313,7 +389,7 @@ TEST_F(AgentTest, CurrentAt64)
   auto &circ = m_agentTestHelper->getAgent()->getCircularBuffer();
 
   uint64_t start = (((uint64_t)1) << 48) + 1317;
-  circ.setSequence(start);
+  circ.skipTo(start);
 
   // Add many events
   for (int i = 1; i <= 500; i++)
@@ -521,6 +597,108 @@ TEST_F(AgentTest, Adapter)
   }
 }
 
+TEST_F(AgentTest, should_order_streams_with_the_positions_of_the_data_items)
+{
+  addAdapter();
+  auto agent = m_agentTestHelper->getAgent();
+
+  // The positions follow the order of the device, component, category, and id
+  auto orders = agent->getPrinter("xml")->getStreamOrders();
+  ASSERT_TRUE(orders);
+  ASSERT_EQ(orders, agent->getPrinter("json")->getStreamOrders());
+
+  vector<DataItemPtr> dataItems;
+  for (auto &device : agent->getDevices())
+  {
+    for (auto &wdi : device->getDeviceDataItems())
+    {
+      auto di = wdi.lock();
+      ASSERT_LT(di->getIndex(), orders->size());
+      ASSERT_NE(0u, (*orders)[di->getIndex()].m_stream);
+      ASSERT_NE(0u, (*orders)[di->getIndex()].m_category);
+      dataItems.push_back(di);
+    }
+  }
+  sort(dataItems.begin(), dataItems.end(), [](auto &a, auto &b) { return *a < *b; });
+  for (size_t i = 1; i < dataItems.size(); i++)
+    ASSERT_LT((*orders)[dataItems[i - 1]->getIndex()].m_stream,
+              (*orders)[dataItems[i]->getIndex()].m_stream);
+
+  m_agentTestHelper->m_adapter->processData(
+      "2021-02-01T12:00:00Z|line|204|clc|fault|1|2|HIGH|Over load|ctmp|warning|3||LOW|Hot");
+  m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:01Z|clc|normal||||");
+
+  auto documents = [this]() {
+    static const regex creationTime(R"(creationTime"?(=|:)"[^"]*")");
+    vector<string> docs;
+    for (auto accepts : {"text/xml", "application/json"})
+    {
+      for (auto path : {"/current", "/sample"})
+      {
+        m_agentTestHelper->makeRequest(__FILE__, __LINE__, boost::beast::http::verb::get, "", {},
+                                       path, accepts);
+        docs.push_back(regex_replace(m_agentTestHelper->session()->m_body, creationTime, ""));
+      }
+    }
+    return docs;
+  };
+
+  // Without a position the observations are ordered by comparing the ids and names
+  auto positioned = documents();
+  auto partial = make_shared<printer::StreamOrders>(*orders);
+  (*partial)[dataItems.front()->getIndex()] = {};
+  for (auto &[type, pr] : agent->getPrinters())
+    pr->setStreamOrders(partial);
+  ASSERT_EQ(positioned, documents());
+}
+
+TEST_F(AgentTest, should_order_a_sample_consistently_while_devices_are_added)
+{
+  addAdapter();
+  auto agent = m_agentTestHelper->getAgent();
+  m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|line|204|Xact|10|Yact|20");
+
+  auto &circ = agent->getCircularBuffer();
+  auto sequence = circ.getSequence();
+  ObservationList observations;
+  circ.getLatest().getObservations(observations);
+
+  // The header changes with the model, only the streams are compared
+  auto streams = [](const string &doc) {
+    auto begin = doc.find("<Streams>");
+    return doc.substr(begin, doc.find("</Streams>") - begin);
+  };
+
+  auto xml = agent->getPrinter("xml");
+  auto expected = streams(xml->printSample(1, 8, sequence, 1, sequence - 1, observations));
+
+  // The new devices sort before the existing device and move all its positions
+  atomic_bool done {false};
+  vector<string> documents;
+  thread printing([&]() {
+    while (!done || documents.empty())
+      documents.push_back(xml->printSample(1, 8, sequence, 1, sequence - 1, observations));
+  });
+
+  auto xmlPrinter = dynamic_cast<printer::XmlPrinter *>(xml);
+  for (int i = 0; i < 20; i++)
+  {
+    auto id = "added"s + to_string(i);
+    auto device = agent->getXmlParser()->parseDevice(
+        "<Device uuid=\"" + id + "\" name=\"" + id + "\" id=\"" + id +
+            "\"><DataItems><DataItem type=\"AVAILABILITY\" category=\"EVENT\" id=\"" + id +
+            "_avail\"/></DataItems></Device>",
+        xmlPrinter);
+    EXPECT_TRUE(device && agent->receiveDevice(device, false));
+  }
+
+  done = true;
+  printing.join();
+
+  for (const auto &doc : documents)
+    ASSERT_EQ(expected, streams(doc));
+}
+
 TEST_F(AgentTest, SampleAtNextSeq)
 {
   QueryMap query;
@@ -680,6 +858,82 @@ TEST_F(AgentTest, SampleToParameter)
   // to > from
 }
 
+TEST_F(AgentTest, SampleTimeParameters)
+{
+  QueryMap query;
+  addAdapter();
+
+  char line[80] = {0};
+
+  // One position every second
+  for (int i = 0; i < 30; i++)
+  {
+    sprintf(line, "2021-02-01T12:00:%02dZ|Xact|%d", i, i);
+    m_agentTestHelper->m_adapter->processData(line);
+  }
+
+  {
+    query["path"] = "//DataItem[@name='Xact']";
+    query["fromTime"] = "2021-02-01T12:00:10Z";
+    query["toTime"] = "2021-02-01T12:00:14Z";
+
+    PARSE_XML_RESPONSE_QUERY("/sample", query);
+    ASSERT_XML_PATH_COUNT(doc, "//m:DeviceStream//m:Position", 5);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceStream//m:Position[1]", "10");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceStream//m:Position[5]", "14");
+  }
+
+  {
+    query.erase("toTime");
+    query["fromTime"] = "2021-02-01T12:00:25Z";
+
+    PARSE_XML_RESPONSE_QUERY("/sample", query);
+    ASSERT_XML_PATH_COUNT(doc, "//m:DeviceStream//m:Position", 5);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceStream//m:Position[1]", "25");
+  }
+
+  {
+    query["fromTime"] = "2021-02-01T13:00:00Z";
+    query["toTime"] = "2021-02-01T13:05:00Z";
+
+    PARSE_XML_RESPONSE_QUERY("/sample", query);
+    ASSERT_XML_PATH_COUNT(doc, "//m:DeviceStream//m:Position", 0);
+  }
+
+  {
+    query["fromTime"] = "2021-02-01T14:00:10+02:00";
+    query["toTime"] = "2021-02-01T07:00:14-05:00";
+
+    PARSE_XML_RESPONSE_QUERY("/sample", query);
+    ASSERT_XML_PATH_COUNT(doc, "//m:DeviceStream//m:Position", 5);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceStream//m:Position[1]", "10");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceStream//m:Position[5]", "14");
+  }
+
+  {
+    query["fromTime"] = "2021-02-01T12:00:10 EST";
+
+    PARSE_XML_RESPONSE_QUERY("/sample", query);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Error@errorCode", "INVALID_REQUEST");
+  }
+
+  {
+    query["fromTime"] = "yesterday";
+
+    PARSE_XML_RESPONSE_QUERY("/sample", query);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Error@errorCode", "INVALID_REQUEST");
+  }
+
+  {
+    query.erase("toTime");
+    query["fromTime"] = "2021-02-01T12:00:10Z";
+    query["from"] = "1";
+
+    PARSE_XML_RESPONSE_QUERY("/sample", query);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Error@errorCode", "INVALID_REQUEST");
+  }
+}
+
 TEST_F(AgentTest, EmptyStream)
 {
   {
@@ -746,7 +1000,7 @@ TEST_F(AgentTest, SequenceNumberRollover)
 
   // Set the sequence number near MAX_UINT32
   auto &circ = m_agentTestHelper->getAgent()->getCircularBuffer();
-  circ.setSequence(0xFFFFFFA0);
+  circ.skipTo(0xFFFFFFA0);
   SequenceNumber_t seq = circ.getSequence();
   ASSERT_EQ((int64_t)0xFFFFFFA0, seq);
 
@@ -2718,6 +2972,178 @@ TEST_F(AgentTest, StreamDataObserver)
   }
 }
 
+TEST_F(AgentTest, should_coalesce_a_stream_that_falls_behind)
+{
+  m_agentTestHelper->createAgent("/samples/test_config.xml", 8, 4, "1.3", 25, false, true,
+                                 {{configuration::StreamBacklogLimit, 10},
+                                  {configuration::StreamBacklogPolicy, "Coalesce"s}});
+  addAdapter();
+  auto rest = m_agentTestHelper->getRestService();
+  rest->start();
+
+  auto &circ = m_agentTestHelper->getAgent()->getCircularBuffer();
+  auto from = circ.getSequence();
+  for (int i = 0; i < 20; i++)
+  {
+    m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|block|" + to_string(i));
+  }
+
+  QueryMap query;
+  query["interval"] = "10";
+  query["heartbeat"] = "1000";
+  query["count"] = "5";
+  query["from"] = to_string(from);
+  query["path"] = "//DataItem[@name='block']";
+
+  {
+    PARSE_XML_STREAM_QUERY("/LinuxCNC/sample", query);
+    m_agentTestHelper->m_ioContext.run_for(50ms);
+
+    PARSE_XML_CHUNK();
+    ASSERT_XML_PATH_COUNT(doc, "//m:Block", 1);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Block", "19");
+
+    auto metrics = rest->getStreamMetrics();
+    ASSERT_EQ(1u, metrics.m_streams);
+    ASSERT_EQ(1u, metrics.m_coalesced);
+    ASSERT_EQ(0u, metrics.m_disconnected);
+    ASSERT_LE(20u, metrics.m_maxBacklog);
+  }
+}
+
+TEST_F(AgentTest, should_print_a_chunk_once_for_identical_streams)
+{
+  m_agentTestHelper->createAgent("/samples/test_config.xml", 8, 4, "1.3", 25);
+  addAdapter();
+  auto rest = m_agentTestHelper->getRestService();
+  rest->start();
+
+  auto &circ = m_agentTestHelper->getAgent()->getCircularBuffer();
+  auto from = circ.getSequence();
+  for (int i = 0; i < 3; i++)
+  {
+    m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|block|" + to_string(i));
+  }
+
+  auto stream = [&]() {
+    auto session = make_shared<TestSession>([](SessionPtr, RequestPtr) { return true; },
+                                            m_agentTestHelper->m_server->getErrorFunction());
+    auto request = make_shared<Request>();
+    request->m_verb = boost::beast::http::verb::get;
+    request->m_path = "/LinuxCNC/sample";
+    request->m_query["interval"] = "10";
+    request->m_query["heartbeat"] = "1000";
+    request->m_query["from"] = to_string(from);
+    request->m_query["path"] = "//DataItem[@name='block']";
+    request->m_accepts = "text/xml";
+    EXPECT_TRUE(rest->getServer()->dispatch(session, request));
+    return session;
+  };
+
+  auto first = stream();
+  auto second = stream();
+  m_agentTestHelper->m_ioContext.run_for(50ms);
+
+  // The second stream reuses the chunk printed for the first
+  auto metrics = rest->getStreamMetrics();
+  ASSERT_EQ(1u, metrics.m_chunks);
+  ASSERT_EQ(1u, metrics.m_sharedChunks);
+  ASSERT_FALSE(first->m_chunkBody.empty());
+  ASSERT_EQ(first->m_chunkBody, second->m_chunkBody);
+
+  first->closeStream();
+  second->closeStream();
+}
+
+TEST_F(AgentTest, should_only_stream_changed_data_items_in_a_delta_current_stream)
+{
+  m_agentTestHelper->createAgent("/samples/test_config.xml", 8, 4, "1.3", 25);
+  addAdapter();
+  auto rest = m_agentTestHelper->getRestService();
+  rest->start();
+
+  QueryMap query;
+  query["interval"] = "10";
+  query["delta"] = "true";
+  query["refresh"] = "0";
+
+  PARSE_XML_STREAM_QUERY("/LinuxCNC/current", query);
+  m_agentTestHelper->m_ioContext.run_for(50ms);
+
+  {
+    PARSE_XML_CHUNK();
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Block", "UNAVAILABLE");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Line", "UNAVAILABLE");
+  }
+
+  m_agentTestHelper->m_session->m_chunkBody.clear();
+  m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|block|G01X1");
+  m_agentTestHelper->m_ioContext.run_for(50ms);
+
+  {
+    PARSE_XML_CHUNK();
+    ASSERT_XML_PATH_COUNT(doc, "//m:ComponentStream", 1);
+    ASSERT_XML_PATH_COUNT(doc, "//m:Events/*", 1);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Block", "G01X1");
+  }
+
+  // Nothing changed, so no chunk is sent
+  m_agentTestHelper->m_session->m_chunkBody.clear();
+  m_agentTestHelper->m_ioContext.run_for(50ms);
+  ASSERT_TRUE(m_agentTestHelper->m_session->m_chunkBody.empty());
+}
+
+TEST_F(AgentTest, should_assign_streams_to_shards_round_robin)
+{
+  // Records the shards whose strand wrote a chunk
+  class ShardSession : public TestSession
+  {
+  public:
+    ShardSession(const RestService &rest, Dispatch dispatch, ErrorFunction error)
+      : TestSession(dispatch, error), m_rest(rest)
+    {}
+    void writeChunk(const std::string &chunk, Complete complete) override
+    {
+      for (size_t i = 0; i < m_rest.getStreamShardCount(); i++)
+        if (m_rest.getStreamShard(i).m_strand.running_in_this_thread())
+          m_shards.insert(i);
+      TestSession::writeChunk(chunk, complete);
+    }
+
+    const RestService &m_rest;
+    set<size_t> m_shards;
+  };
+
+  m_agentTestHelper->createAgent("/samples/test_config.xml", 8, 4, "1.3", 25, false, true,
+                                 {{configuration::WorkerThreads, 3}});
+  auto rest = m_agentTestHelper->getRestService();
+  ASSERT_EQ(3u, rest->getStreamShardCount());
+  rest->start();
+
+  vector<shared_ptr<ShardSession>> sessions;
+  for (int i = 0; i < 6; i++)
+  {
+    auto session = make_shared<ShardSession>(*rest, [](SessionPtr, RequestPtr) { return true; },
+                                             m_agentTestHelper->m_server->getErrorFunction());
+    auto request = make_shared<Request>();
+    request->m_verb = boost::beast::http::verb::get;
+    request->m_path = "/LinuxCNC/current";
+    request->m_query["interval"] = "10";
+    request->m_accepts = "text/xml";
+    ASSERT_TRUE(rest->getServer()->dispatch(session, request));
+    sessions.push_back(session);
+  }
+
+  m_agentTestHelper->m_ioContext.run_for(50ms);
+
+  // Each stream's chunks are written on one strand, the streams take the shards in turn
+  for (size_t i = 0; i < sessions.size(); i++)
+  {
+    ASSERT_EQ(set<size_t> {i % 3}, sessions[i]->m_shards) << "stream " << i;
+    sessions[i]->closeStream();
+  }
+}
+
 // ------------- Put tests
 
 TEST_F(AgentTest, Put)
@@ -2966,3 +3392,234 @@ TEST_F(AgentTest, device_should_have_hash_for_2_2)
     ASSERT_XML_PATH_EQUAL(doc, "//m:DeviceAdded[3]@hash", (*di)->get<string>("hash").c_str());
   }
 }
+
+TEST_F(AgentTest, should_warm_start_from_a_buffer_snapshot_written_by_the_route)
+{
+  namespace fs = std::filesystem;
+
+  auto now = chrono::steady_clock::now().time_since_epoch().count();
+  auto directory = fs::temp_directory_path() / ("agent_snapshot_test_" + to_string(now));
+  fs::create_directories(directory);
+
+  // The buffer data items only exist when there is a memory limit, so they are missing when the
+  // snapshot is loaded by an agent without one
+  m_agentTestHelper->createAgent("/samples/test_config.xml", 8, 4, "1.3", 25, true, true,
+                                 {{configuration::BufferSnapshotPath, directory.string()},
+                                  {configuration::BufferMemoryLimit, "1M"s}});
+  addAdapter();
+  for (int i = 0; i < 5; i++)
+    m_agentTestHelper->m_adapter->processData("2021-02-01T12:00:00Z|block|" + to_string(i));
+
+  map<SequenceNumber_t, string> written;
+  auto &buffer = m_agentTestHelper->getAgent()->getCircularBuffer();
+  for (auto seq = buffer.getFirstSequence(); seq < buffer.getSequence(); seq++)
+    written[seq] = buffer.getFromBuffer(seq)->getDataItem()->getId();
+  auto sequence = buffer.getSequence();
+  ASSERT_EQ(1u, written.count(sequence - 1));
+  ASSERT_NE(written.end(), find_if(written.begin(), written.end(), [](const auto &w) {
+              return w.second == "observation_buffer_memory";
+            }));
+
+  m_agentTestHelper->getRestService()->setInstanceId(1234);
+
+  auto session = m_agentTestHelper->session();
+  auto request = make_shared<Request>();
+  request->m_verb = boost::beast::http::verb::post;
+  request->m_path = "/snapshot";
+  ASSERT_TRUE(m_agentTestHelper->m_restService->getServer()->dispatch(session, request));
+  ASSERT_EQ(status::ok, session->m_code);
+  auto file = directory / ("snapshot-" + to_string(sequence) + ".bin");
+  ASSERT_TRUE(fs::exists(file));
+
+  m_agentTestHelper->createAgent("/samples/test_config.xml", 8, 4, "1.3", 25, false, false,
+                                 {{configuration::BufferSnapshotFile, file.string()}});
+  m_agentTestHelper->getRestService()->start();
+
+  // The observations keep their sequence numbers, the missing data items leave gaps
+  auto &loaded = m_agentTestHelper->getAgent()->getCircularBuffer();
+  ASSERT_EQ(sequence, loaded.getSequence());
+  for (auto &[seq, id] : written)
+  {
+    auto obs = loaded.getFromBuffer(seq);
+    if (id.rfind("observation_buffer_", 0) == 0)
+    {
+      ASSERT_FALSE(obs) << seq;
+    }
+    else
+    {
+      ASSERT_TRUE(obs) << seq;
+      ASSERT_EQ(id, obs->getDataItem()->getId());
+    }
+  }
+
+  {
+    QueryMap query;
+    query["path"] = "//DataItem[@name='block']";
+    query["from"] = to_string(written.begin()->first);
+    PARSE_XML_RESPONSE_QUERY("/sample", query);
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Header@instanceId", "1234");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Header@nextSequence", to_string(sequence).c_str());
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Block[last()]", "4");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:Block[last()]@sequence", to_string(sequence - 1).c_str());
+  }
+
+  m_agentTestHelper.reset();
+  fs::remove_all(directory);
+}
+
+TEST_F(AgentTest, should_recover_durable_buffer_across_a_missing_data_item)
+{
+  using namespace mtconnect::buffer;
+  using namespace device_model::data_item;
+  namespace fs = std::filesystem;
+
+  auto now = chrono::steady_clock::now().time_since_epoch().count();
+  auto directory = fs::temp_directory_path() / ("agent_durable_test_" + to_string(now));
+
+  {
+    entity::ErrorList errors;
+    auto known = DataItem::make({{"id", "x2"s},
+                                 {"type", "POSITION"s},
+                                 {"category", "SAMPLE"s},
+                                 {"subType", "COMMANDED"s},
+                                 {"units", "MILLIMETER"s}},
+                                errors);
+    auto removed = DataItem::make(
+        {{"id", "gone"s}, {"type", "POSITION"s}, {"category", "SAMPLE"s}, {"units", "MILLIMETER"s}},
+        errors);
+
+    DurableBuffer buffer(directory, 64 * 1024, 256);
+    buffer.recover([](ObservationRecord &) {});
+    for (SequenceNumber_t seq = 1; seq <= 4; seq++)
+    {
+      auto obs = Observation::make(seq == 2 ? removed : known, {{"VALUE", double(seq)}},
+                                   system_clock::now(), errors);
+      obs->setSequence(seq);
+      buffer.append(obs);
+    }
+  }
+
+  ConfigOptions options {{configuration::DurableBufferPath, directory.string()}};
+  m_agentTestHelper->createAgent("/samples/test_config.xml", 8, 4, "1.3", 25, false, false,
+                                 options);
+
+  // The observations on both sides of the missing data item are kept with their sequence numbers
+  auto &buffer = m_agentTestHelper->getAgent()->getCircularBuffer();
+  ASSERT_EQ(1, buffer.getFirstSequence());
+  ASSERT_EQ(5, buffer.getSequence());
+
+  auto first = buffer.getFromBuffer(1);
+  ASSERT_TRUE(first);
+  ASSERT_EQ(1.0, first->getValue<double>());
+  ASSERT_FALSE(buffer.getFromBuffer(2));
+  for (SequenceNumber_t seq = 3; seq <= 4; seq++)
+  {
+    auto obs = buffer.getFromBuffer(seq);
+    ASSERT_TRUE(obs);
+    ASSERT_EQ(seq, obs->getSequence());
+    ASSERT_EQ(double(seq), obs->getValue<double>());
+  }
+
+  m_agentTestHelper.reset();
+  fs::remove_all(directory);
+}
+
+TEST_F(AgentTest, should_use_the_extension_namespace_for_buffer_data_items)
+{
+  m_agentTestHelper->createAgent("/samples/test_config.xml", 8, 4, "1.3", 25, false, true,
+                                 {{configuration::BufferMemoryLimit, "1M"s}});
+
+  {
+    PARSE_XML_RESPONSE("/Agent/probe");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DataItem[@id='observation_buffer_memory']@type",
+                          "x:OBSERVATION_BUFFER_MEMORY");
+    ASSERT_XML_PATH_EQUAL(doc, "//m:DataItem[@id='observation_buffer_count']@type",
+                          "x:OBSERVATION_BUFFER_COUNT");
+  }
+
+  {
+    PARSE_XML_RESPONSE("/Agent/current");
+    ASSERT_XML_PATH_COUNT(doc, "//x:ObservationBufferMemory", 1);
+    ASSERT_XML_PATH_COUNT(doc, "//x:ObservationBufferCount", 1);
+  }
+}
+
+TEST_F(AgentTest, should_publish_stream_metrics_to_the_agent_device)
+{
+  m_agentTestHelper->createAgent("/samples/test_config.xml", 8, 4, "1.3", 25, false, true,
+                                 {{configuration::StreamBacklogLimit, 10}});
+  auto rest = m_agentTestHelper->getRestService();
+  rest->start();
+
+  {
+    PARSE_XML_RESPONSE("/Agent/current");
+    ASSERT_XML_PATH_EQUAL(doc, "//x:StreamCount[@dataItemId='stream_count']", "0");
+    ASSERT_XML_PATH_EQUAL(doc, "//x:StreamBacklog[@dataItemId='stream_backlog']", "0");
+    ASSERT_XML_PATH_EQUAL(doc, "//x:StreamMaxBacklog[@dataItemId='stream_max_backlog']", "0");
+    ASSERT_XML_PATH_EQUAL(doc, "//x:StreamOverflowCount[@dataItemId='stream_overflow_count']",
+                          "0");
+  }
+}
+
+TEST_F(AgentTest, should_not_cache_fragments_with_a_compact_buffer)
+{
+  auto agent = m_agentTestHelper->createAgent(
+      "/samples/test_config.xml", 8, 4, "1.3", 25, false, true,
+      {{configuration::CacheObservationFragments, true}, {configuration::CompactBuffer, true}});
+
+  for (auto &[type, printer] : agent->getPrinters())
+    ASSERT_FALSE(printer->getCacheFragments()) << type;
+}
+
+TEST_F(AgentTest, should_not_cache_fragments_with_a_buffer_memory_limit)
+{
+  auto agent = m_agentTestHelper->createAgent(
+      "/samples/test_config.xml", 8, 4, "1.3", 25, false, true,
+      {{configuration::CacheObservationFragments, true},
+       {configuration::BufferMemoryLimit, "1M"s}});
+
+  for (auto &[type, printer] : agent->getPrinters())
+    ASSERT_FALSE(printer->getCacheFragments()) << type;
+}
+
+TEST_F(AgentTest, should_keep_data_item_indexes_dense_and_stable_across_device_updates)
+{
+  using namespace device_model::data_item;
+
+  auto agent = m_agentTestHelper->createAgent("/samples/test_config.xml", 8, 4, "2.0", 25);
+  const auto &indexes = agent->getDataItemIndexes();
+
+  auto count = indexes.size();
+  for (const auto &device : agent->getDevices())
+  {
+    for (const auto &item : device->getDeviceDataItems())
+    {
+      auto di = item.lock();
+      ASSERT_TRUE(di);
+      ASSERT_LT(di->getIndex(), count) << di->getId();
+      ASSERT_EQ(di->getIndex(), *indexes.find(di->getId()));
+    }
+  }
+
+  auto c1 = agent->getDataItemById("c1")->getIndex();
+
+  auto xmlPrinter = dynamic_cast<printer::XmlPrinter *>(agent->getPrinter("xml"));
+  auto device = agent->getXmlParser()
+                    ->parseFile(TEST_RESOURCE_DIR "/samples/test_config.xml", xmlPrinter)
+                    .front();
+
+  entity::ErrorList errors;
+  auto added = DataItem::make(
+      {{"id", "added"s}, {"type", "POSITION"s}, {"category", "SAMPLE"s}, {"units", "MILLIMETER"s}},
+      errors);
+  device->addDataItem(added, errors);
+  ASSERT_TRUE(errors.empty());
+
+  ASSERT_TRUE(agent->receiveDevice(device, false));
+
+  auto updated = agent->getDataItemById("c1");
+  ASSERT_EQ(device->getDeviceDataItem("c1"), updated);
+  ASSERT_EQ(c1, updated->getIndex());
+  ASSERT_EQ(count, agent->getDataItemById("added")->getIndex());
+  ASSERT_EQ(count + 1, indexes.size());
+}
@@ -60,9 +60,12 @@ namespace mtconnect {
           m_code = response->m_status;
           if (response->m_file)
             m_body = response->m_file->m_buffer;
+          else if (response->m_shared)
+            m_body = response->m_shared->m_body;
           else
             m_body = response->m_body;
           m_mimeType = response->m_mimeType;
+          m_etag = response->m_etag;
           if (complete)
             complete();
         }
@@ -98,6 +101,7 @@ namespace mtconnect {
         std::string m_mimeType;
         boost::beast::http::status m_code;
         std::chrono::seconds m_expires;
+        std::optional<std::string> m_etag;
 
         std::string m_chunkBody;
         std::string m_chunkMimeType;
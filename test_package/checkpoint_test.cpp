@@ -108,16 +108,19 @@ TEST_F(CheckpointTest, AddObservations)
   ASSERT_TRUE(p1);
   EXPECT_EQ(1, p1.use_count());
   m_checkpoint->addObservation(p1);
-  EXPECT_EQ(2, p1.use_count());
+  // Held by the slot and the active conditions
+  EXPECT_EQ(3, p1.use_count());
 
   auto p2 = observation::Observation::make(m_dataItem1, warning2, time, errors);
   ASSERT_TRUE(p2);
   m_checkpoint->addObservation(p2);
 
   {
-    auto prev = dynamic_pointer_cast<Condition>(p2)->getPrev();
-    ASSERT_TRUE(prev);
-    EXPECT_EQ(p1, prev);
+    ObservationList list;
+    m_checkpoint->getObservations(list);
+    ASSERT_EQ(2, list.size());
+    EXPECT_EQ(p2, list.front());
+    EXPECT_EQ(p1, list.back());
   }
 
   auto p3 = observation::Observation::make(m_dataItem1, normal, time, errors);
@@ -129,7 +132,7 @@ TEST_F(CheckpointTest, AddObservations)
     ASSERT_FALSE(prev);
   }
 
-  EXPECT_EQ(2, p1.use_count());
+  EXPECT_EQ(1, p1.use_count());
   EXPECT_EQ(1, p2.use_count());
 
   auto p4 = observation::Observation::make(m_dataItem1, warning1, time, errors);
@@ -171,17 +174,40 @@ TEST_F(CheckpointTest, Copy)
 
   auto p1 = observation::Observation::make(m_dataItem1, warning1, time, errors);
   m_checkpoint->addObservation(p1);
-  ASSERT_EQ(2, p1.use_count());
+  ASSERT_EQ(3, p1.use_count());
 
   auto p2 = observation::Observation::make(m_dataItem1, warning2, time, errors);
   m_checkpoint->addObservation(p2);
-  ASSERT_EQ(2, p2.use_count());
+  ASSERT_EQ(3, p2.use_count());
+  ASSERT_EQ(2, p1.use_count());
 
+  // The copy shares the observations and conditions with the original until one is modified
   auto copy = make_unique<Checkpoint>(*m_checkpoint);
   ASSERT_EQ(2, p1.use_count());
   ASSERT_EQ(3, p2.use_count());
+  ASSERT_EQ(p2, copy->getObservation("1"));
+
+  auto p3 = observation::Observation::make(m_dataItem2, value, time, errors);
+  m_checkpoint->addObservation(p3);
+  ASSERT_EQ(4, p2.use_count());
+  ASSERT_EQ(2, p3.use_count());
+  ASSERT_EQ(p2, copy->getObservation("1"));
+  ASSERT_FALSE(copy->getObservation("3"));
+  ASSERT_EQ(p3, m_checkpoint->getObservation("3"));
+
+  // Clearing a condition copies the conditions of the original
+  auto normal2 = entity::Properties {{"nativeCode", "CODE2"s}, {"level", "NORMAL"s}};
+  auto p4 = observation::Observation::make(m_dataItem1, normal2, time, errors);
+  m_checkpoint->addObservation(p4);
+  ASSERT_EQ(p1, m_checkpoint->getObservation("1"));
+  ASSERT_EQ(p2, copy->getObservation("1"));
+
+  ObservationList list;
+  copy->getObservations(list);
+  ASSERT_EQ(2, list.size());
+
   copy.reset();
-  ASSERT_EQ(2, p2.use_count());
+  ASSERT_EQ(1, p2.use_count());
 }
 
 TEST_F(CheckpointTest, GetObservations)
@@ -404,7 +430,7 @@ TEST_F(CheckpointTest, ConditionChaining)
 
   auto p1 = observation::Observation::make(m_dataItem1, warning1, time, errors);
   m_checkpoint->addObservation(p1);
-  ASSERT_EQ(2, p1.use_count());
+  ASSERT_EQ(3, p1.use_count());
 
   m_checkpoint->getObservations(list);
   ASSERT_EQ(1, list.size());
@@ -412,69 +438,59 @@ TEST_F(CheckpointTest, ConditionChaining)
 
   auto p2 = observation::Observation::make(m_dataItem1, warning2, time, errors);
   m_checkpoint->addObservation(p2);
-  ASSERT_EQ(2, p2.use_count());
+  ASSERT_EQ(3, p2.use_count());
   ASSERT_EQ(2, p1.use_count());
 
   list.clear();
   m_checkpoint->getObservations(list);
   ASSERT_EQ(2, list.size());
-  ASSERT_EQ(p1, dynamic_pointer_cast<Condition>(p2)->getPrev());
+  ASSERT_EQ(p2, list.front());
+  ASSERT_EQ(p1, list.back());
   list.clear();
 
   auto p3 = observation::Observation::make(m_dataItem1, warning3, time, errors);
   m_checkpoint->addObservation(p3);
-  ASSERT_EQ(2, p3.use_count());
+  ASSERT_EQ(3, p3.use_count());
   ASSERT_EQ(2, p2.use_count());
   ASSERT_EQ(2, p1.use_count());
 
-  ASSERT_EQ(p2, dynamic_pointer_cast<Condition>(p3)->getPrev());
-  ASSERT_EQ(p1, dynamic_pointer_cast<Condition>(p2)->getPrev());
-  ASSERT_FALSE(dynamic_pointer_cast<Condition>(p1)->getPrev());
+  // The observations are not chained
+  ASSERT_FALSE(Cond(p3)->getPrev());
+  ASSERT_FALSE(Cond(p2)->getPrev());
 
   list.clear();
   m_checkpoint->getObservations(list);
-  ASSERT_EQ(3, list.size());
+  ASSERT_EQ((ObservationList {p3, p2, p1}), list);
   list.clear();
 
-  // Replace Warning on CODE 2 with a fault
+  // Replace Warning on CODE 2 with a fault, it becomes the most recent
   auto p4 = observation::Observation::make(m_dataItem1, fault2, time, errors);
   m_checkpoint->addObservation(p4);
-  ASSERT_EQ(2, p4.use_count());
-  ASSERT_EQ(1, p3.use_count());
-  ASSERT_EQ(2, p2.use_count());
+  ASSERT_EQ(3, p4.use_count());
+  ASSERT_EQ(2, p3.use_count());
+  ASSERT_EQ(1, p2.use_count());
   ASSERT_EQ(2, p1.use_count());
 
-  // Should have been deep copyied
-  ASSERT_NE(p3, Cond(p4)->getPrev());
-
-  // Codes should still match
-  ASSERT_EQ(Cond(p3)->getCode(), Cond(p4)->getPrev()->getCode());
-  ASSERT_EQ(2, Cond(p4)->getPrev().use_count());
-  ASSERT_EQ(Cond(p1)->getCode(), Cond(p4)->getPrev()->getPrev()->getCode());
-  ASSERT_EQ(2, Cond(p4)->getPrev()->getPrev().use_count());
-  ASSERT_FALSE(Cond(p4)->getPrev()->getPrev()->getPrev());
-
+  // The other conditions are shared, not copied
   list.clear();
   m_checkpoint->getObservations(list);
-  ASSERT_EQ(3, list.size());
+  ASSERT_EQ((ObservationList {p4, p3, p1}), list);
   list.clear();
 
   auto p5 = observation::Observation::make(m_dataItem1, normal2, time, errors);
   m_checkpoint->addObservation(p5);
   ASSERT_FALSE(Cond(p5)->getPrev());
 
-  // Check cleanup
-  ObservationPtr p7 = m_checkpoint->getObservations().at(std::string("1"));
+  // Check cleanup, the most recent active condition is the latest
+  ObservationPtr p7 = m_checkpoint->getObservation("1");
   ASSERT_TRUE(p7);
-  ASSERT_EQ(2, p7.use_count());
+  ASSERT_EQ(p3, p7);
   ASSERT_NE(p5, p7);
   ASSERT_EQ(std::string("CODE3"), Cond(p7)->getCode());
-  ASSERT_EQ(std::string("CODE1"), Cond(p7)->getPrev()->getCode());
-  ASSERT_FALSE(Cond(p7)->getPrev()->getPrev());
 
   list.clear();
   m_checkpoint->getObservations(list);
-  ASSERT_EQ(2, list.size());
+  ASSERT_EQ((ObservationList {p3, p1}), list);
   list.clear();
 
   // Clear all
@@ -580,3 +596,108 @@ TEST_F(CheckpointTest, orphaned_observations_should_be_skipped)
 
   ASSERT_EQ(0, list2.size());
 }
+
+TEST_F(CheckpointTest, should_activate_and_clear_many_conditions_by_code)
+{
+  entity::ErrorList errors;
+  Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min;
+
+  for (int i = 0; i < 200; i++)
+  {
+    auto p = observation::Observation::make(
+        m_dataItem1, {{"level", "FAULT"s}, {"nativeCode", "CODE" + to_string(i)}}, time, errors);
+    m_checkpoint->addObservation(p);
+  }
+
+  Checkpoint copy(*m_checkpoint);
+
+  // Clear the even codes
+  for (int i = 0; i < 200; i += 2)
+  {
+    auto p = observation::Observation::make(
+        m_dataItem1, {{"level", "NORMAL"s}, {"nativeCode", "CODE" + to_string(i)}}, time, errors);
+    m_checkpoint->addObservation(p);
+  }
+
+  ObservationList list;
+  m_checkpoint->getObservations(list);
+  ASSERT_EQ(100, list.size());
+
+  // Most recently activated first
+  int i = 199;
+  for (auto &o : list)
+  {
+    ASSERT_EQ("CODE" + to_string(i), Cond(o)->getCode());
+    i -= 2;
+  }
+  auto latest = m_checkpoint->getObservation("1");
+  ASSERT_EQ("CODE199", Cond(latest)->getCode());
+
+  // The copy is not affected
+  list.clear();
+  copy.getObservations(list);
+  ASSERT_EQ(200, list.size());
+}
+
+TEST_F(CheckpointTest, should_merge_data_set_changes_without_changing_shared_events)
+{
+  entity::ErrorList errors;
+  Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min;
+
+  auto di = DataItem::make({{"id", "v1"s},
+                            {"type", "VARIABLE"s},
+                            {"category", "EVENT"s},
+                            {"representation", "DATA_SET"s}},
+                           errors);
+  m_device->addDataItem(di, errors);
+
+  DataSet initial;
+  for (int i = 0; i < 100; i++)
+    initial.emplace("k" + to_string(i), int64_t(i));
+  m_checkpoint->addObservation(Observation::make(di, {{"VALUE", initial}}, time, errors));
+
+  // Hold the merged event like a printer would while the checkpoint is updated
+  m_checkpoint->addObservation(
+      Observation::make(di, {{"VALUE", DataSet {{"k1", int64_t(101)}}}}, time, errors));
+  auto held = dynamic_pointer_cast<DataSetEvent>(m_checkpoint->getObservation("v1"));
+  ASSERT_EQ(100, held->getDataSet().size());
+
+  DataSet changes {{"k2", int64_t(102)}, {"k3", ""s, true}, {"new", "value"s}};
+  auto diff = m_checkpoint->dataSetDifference(Observation::make(di, {{"VALUE", changes}}, time, errors),
+                                              m_checkpoint->getObservation("v1"));
+  ASSERT_TRUE(diff);
+  m_checkpoint->addObservation(diff);
+
+  for (int i = 0; i < 10; i++)
+    m_checkpoint->addObservation(Observation::make(
+        di, {{"VALUE", DataSet {{"k4", int64_t(i)}}}}, time, errors));
+
+  auto latest = dynamic_pointer_cast<DataSetEvent>(m_checkpoint->getObservation("v1"));
+  auto &set = latest->getDataSet();
+  ASSERT_EQ(100, set.size());
+  ASSERT_EQ(100, latest->get<int64_t>("count"));
+  ASSERT_EQ(int64_t(101), get<int64_t>(set.find(DataSetEntry("k1"))->m_value));
+  ASSERT_EQ(int64_t(102), get<int64_t>(set.find(DataSetEntry("k2"))->m_value));
+  ASSERT_EQ(set.end(), set.find(DataSetEntry("k3")));
+  ASSERT_EQ(int64_t(9), get<int64_t>(set.find(DataSetEntry("k4"))->m_value));
+  ASSERT_EQ("value", get<string>(set.find(DataSetEntry("new"))->m_value));
+
+  // The held event is not affected by the later merges
+  auto &heldSet = held->getDataSet();
+  ASSERT_EQ(100, heldSet.size());
+  ASSERT_EQ(int64_t(2), get<int64_t>(heldSet.find(DataSetEntry("k2"))->m_value));
+  ASSERT_NE(heldSet.end(), heldSet.find(DataSetEntry("k3")));
+
+  // Entries that have not changed are removed from the difference
+  auto same = m_checkpoint->dataSetDifference(
+      Observation::make(di, {{"VALUE", DataSet {{"k1", int64_t(101)}, {"k5", int64_t(50)}}}},
+                        time, errors),
+      latest);
+  ASSERT_TRUE(same);
+  auto sameSet = dynamic_pointer_cast<DataSetEvent>(same)->getDataSet();
+  ASSERT_EQ(1, sameSet.size());
+  ASSERT_EQ("k5", sameSet.begin()->m_key);
+
+  ASSERT_FALSE(m_checkpoint->dataSetDifference(
+      Observation::make(di, {{"VALUE", DataSet {{"k1", int64_t(101)}}}}, time, errors), latest));
+}
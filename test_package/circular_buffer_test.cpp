@@ -19,6 +19,10 @@
 #include <gtest/gtest.h>
 // Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
 
+#include <atomic>
+#include <set>
+#include <thread>
+
 #include "agent_test_helper.hpp"
 #include "mtconnect/buffer/checkpoint.hpp"
 #include "mtconnect/buffer/circular_buffer.hpp"
@@ -191,3 +195,473 @@ TEST_F(CircularBufferTest, should_skip_orphaned_observations)
   ASSERT_EQ(7, end);
   ASSERT_TRUE(eob);
 }
+
+TEST_F(CircularBufferTest, should_replace_observations_when_data_items_change)
+{
+  addSomeObservations();
+
+  auto before = m_circularBuffer->getFromBuffer(6);
+  ASSERT_TRUE(before);
+  ASSERT_EQ(m_dataItem2, before->getDataItem());
+
+  ErrorList errors;
+  auto dataItem = DataItem::make({{"id", "3"s},
+                                  {"type", "POSITION"s},
+                                  {"category", "SAMPLE"s},
+                                  {"name", "DataItemTest2"s},
+                                  {"subType", "COMMANDED"s},
+                                  {"units", "MILLIMETER"s}},
+                                 errors);
+  unordered_map<string, WeakDataItemPtr> diMap {{"1", m_dataItem1}, {"3", dataItem}};
+  m_circularBuffer->updateDataItems(diMap);
+
+  // An observation held by a reader is not changed
+  ASSERT_EQ(m_dataItem2, before->getDataItem());
+
+  auto after = m_circularBuffer->getFromBuffer(6);
+  ASSERT_TRUE(after);
+  ASSERT_NE(before, after);
+  ASSERT_EQ(6, after->getSequence());
+  ASSERT_EQ(dataItem, after->getDataItem());
+
+  // The checkpoint shares the copy in the buffer
+  ASSERT_EQ(after, m_circularBuffer->getLatest().getObservation("3"));
+
+  auto cond = dynamic_pointer_cast<Condition>(m_circularBuffer->getLatest().getObservation("1"));
+  ASSERT_TRUE(cond);
+  ASSERT_EQ(cond, m_circularBuffer->getFromBuffer(4));
+}
+
+TEST_F(CircularBufferTest, should_skip_sequence_numbers_and_keep_observations)
+{
+  addSomeObservations();
+
+  m_circularBuffer->skipTo(10);
+  ASSERT_EQ(10, m_circularBuffer->getSequence());
+  ASSERT_EQ(1, m_circularBuffer->getFirstSequence());
+
+  ErrorList errors;
+  Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 2min;
+  auto obs = Observation::make(m_dataItem2, {{"VALUE", 1.0}}, time, errors);
+  ASSERT_EQ(10, m_circularBuffer->addToBuffer(obs));
+
+  std::optional<SequenceNumber_t> start {1}, stop;
+  SequenceNumber_t first, end;
+  bool eob = false;
+  auto list {m_circularBuffer->getObservations(100, nullopt, start, stop, end, first, eob)};
+  ASSERT_EQ(7, list->size());
+  ASSERT_EQ(10, list->back()->getSequence());
+  ASSERT_FALSE(m_circularBuffer->getFromBuffer(8));
+
+  // The checkpoint in the gap has the observations before it
+  auto check = m_circularBuffer->getCheckpointAt(9, nullopt);
+  ASSERT_TRUE(check);
+  ASSERT_EQ(6, check->getObservation("3")->getSequence());
+
+  // A gap larger than the buffer evicts all the observations
+  m_circularBuffer->skipTo(40);
+  ASSERT_EQ(40, m_circularBuffer->getSequence());
+  ASSERT_EQ(40, m_circularBuffer->getFirstSequence());
+  ASSERT_EQ(10, m_circularBuffer->getFirst().getObservation("3")->getSequence());
+}
+
+TEST_F(CircularBufferTest, should_read_observations_while_writer_adds_to_buffer)
+{
+  entity::ErrorList errors;
+  Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min;
+  atomic_bool done {false};
+  atomic_int failures {0};
+
+  auto reader = [&]() {
+    while (!done)
+    {
+      std::optional<SequenceNumber_t> start, stop;
+      SequenceNumber_t first, end;
+      bool eob = false;
+      FilterSetOpt opt;
+      auto list {m_circularBuffer->getObservations(8, opt, start, stop, end, first, eob)};
+
+      // Observations must always be in sequence order and within the range returned
+      SequenceNumber_t last = 0;
+      for (auto &o : *list)
+      {
+        if (o->getSequence() <= last || o->getSequence() < first || o->getSequence() >= end)
+          failures++;
+        last = o->getSequence();
+      }
+    }
+  };
+
+  thread r1(reader), r2(reader);
+  for (int i = 0; i < 10000; i++)
+  {
+    auto value = entity::Properties {{"VALUE", double(i)}};
+    auto obs = observation::Observation::make(m_dataItem2, value, time, errors);
+    m_circularBuffer->addToBuffer(obs);
+  }
+  done = true;
+  r1.join();
+  r2.join();
+
+  ASSERT_EQ(0, failures);
+  ASSERT_EQ(10001, m_circularBuffer->getSequence());
+  ASSERT_EQ(10001 - 16, m_circularBuffer->getFirstSequence());
+
+  auto check = m_circularBuffer->getCheckpointAt(9990, nullopt);
+  ASSERT_TRUE(check);
+  auto obs = check->getObservation("3");
+  ASSERT_TRUE(obs);
+  ASSERT_EQ(9990, obs->getSequence());
+
+  ASSERT_FALSE(m_circularBuffer->getCheckpointAt(100, nullopt));
+}
+
+TEST_F(CircularBufferTest, should_use_index_for_filtered_observations)
+{
+  entity::ErrorList errors;
+  Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min;
+  auto indexed = make_unique<CircularBuffer>(4, 4, true);
+  auto scanned = make_unique<CircularBuffer>(4, 4, false);
+  ASSERT_TRUE(indexed->isIndexed());
+  ASSERT_FALSE(scanned->isIndexed());
+
+  // Every third observation is for data item 1, wrapping the buffer more than twice
+  for (int i = 0; i < 40; i++)
+  {
+    auto di = i % 3 == 0 ? m_dataItem1 : m_dataItem2;
+    auto props = i % 3 == 0 ? entity::Properties {{"level", "NORMAL"s}}
+                            : entity::Properties {{"VALUE", double(i)}};
+    for (auto buffer : {indexed.get(), scanned.get()})
+    {
+      auto obs = observation::Observation::make(di, props, time, errors);
+      buffer->addToBuffer(obs);
+    }
+  }
+
+  ASSERT_EQ(41, indexed->getSequence());
+  ASSERT_EQ(25, indexed->getFirstSequence());
+  ASSERT_GE(32u, indexed->getIndexedCount("1") + indexed->getIndexedCount("3"));
+
+  FilterSet filter {"1"};
+  FilterSetOpt opt {filter};
+  using Query = tuple<int, std::optional<SequenceNumber_t>, std::optional<SequenceNumber_t>>;
+  auto queries = {Query {100, nullopt, nullopt}, Query {2, 26, nullopt},
+                  Query {3, 5, nullopt}, Query {2, 40, nullopt},
+                  Query {100, 41, nullopt}, Query {-2, nullopt, nullopt},
+                  Query {-3, 30, nullopt}, Query {-100, nullopt, nullopt},
+                  Query {2, nullopt, 38}, Query {2, 30, 38},
+                  Query {100, 30, 38}};
+  for (auto &query : queries)
+  {
+    auto [count, start, to] = query;
+    SequenceNumber_t ifirst, iend, sfirst, send;
+    bool ieob = false, seob = false;
+    auto ilist = indexed->getObservations(count, opt, start, to, iend, ifirst, ieob);
+    auto slist = scanned->getObservations(count, opt, start, to, send, sfirst, seob);
+
+    ASSERT_EQ(slist->size(), ilist->size());
+    auto it = ilist->begin();
+    for (auto &o : *slist)
+    {
+      ASSERT_EQ(o->getSequence(), (*it)->getSequence());
+      ASSERT_EQ("1", (*it)->getDataItem()->getId());
+      it++;
+    }
+    ASSERT_EQ(sfirst, ifirst);
+    ASSERT_EQ(send, iend);
+    ASSERT_EQ(seob, ieob);
+  }
+}
+
+TEST_F(CircularBufferTest, should_filter_sparse_observations)
+{
+  entity::ErrorList errors;
+  Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min;
+
+  // Data item 1 has one observation every 64 observations
+  CircularBuffer buffer(8, 64, true);
+  for (int i = 1; i <= 256; i++)
+  {
+    auto di = i % 64 == 0 ? m_dataItem1 : m_dataItem2;
+    auto props = i % 64 == 0 ? entity::Properties {{"level", "NORMAL"s}}
+                             : entity::Properties {{"VALUE", double(i)}};
+    auto obs = observation::Observation::make(di, props, time, errors);
+    buffer.addToBuffer(obs);
+  }
+
+  FilterSet filter {"1"};
+  FilterSetOpt opt {filter};
+  std::optional<SequenceNumber_t> start, to;
+  SequenceNumber_t first, end;
+  bool eob = false;
+
+  auto list = buffer.getObservations(100, opt, start, to, end, first, eob);
+  ASSERT_EQ(4, list->size());
+  SequenceNumber_t seq = 64;
+  for (auto &o : *list)
+  {
+    ASSERT_EQ(seq, o->getSequence());
+    ASSERT_EQ("1", o->getDataItem()->getId());
+    seq += 64;
+  }
+  ASSERT_EQ(257, end);
+  ASSERT_TRUE(eob);
+
+  list = buffer.getObservations(2, opt, start, to, end, first, eob);
+  ASSERT_EQ(2, list->size());
+  ASSERT_EQ(64, list->front()->getSequence());
+  ASSERT_EQ(128, list->back()->getSequence());
+  ASSERT_EQ(129, end);
+  ASSERT_FALSE(eob);
+
+  list = buffer.getObservations(-2, opt, start, to, end, first, eob);
+  ASSERT_EQ(2, list->size());
+  set<SequenceNumber_t> sequences;
+  for (auto &o : *list)
+    sequences.insert(o->getSequence());
+  ASSERT_EQ((set<SequenceNumber_t> {192, 256}), sequences);
+}
+
+TEST_F(CircularBufferTest, should_materialize_compact_observations)
+{
+  m_circularBuffer = make_unique<CircularBuffer>(4, 4, true, true);
+  ASSERT_TRUE(m_circularBuffer->isCompact());
+
+  addSomeObservations();
+
+  SequenceNumber_t end, first;
+  bool eob;
+  auto list = m_circularBuffer->getObservations(10, nullopt, nullopt, nullopt, end, first, eob);
+  ASSERT_EQ(6, list->size());
+  ASSERT_EQ(7, end);
+
+  auto it = list->begin();
+  auto c1 = dynamic_pointer_cast<Condition>(*it);
+  ASSERT_TRUE(c1);
+  ASSERT_EQ(1, c1->getSequence());
+  ASSERT_EQ(Condition::WARNING, c1->getLevel());
+  ASSERT_EQ("CODE1", c1->get<string>("nativeCode"));
+  ASSERT_EQ("HIGH", c1->get<string>("qualifier"));
+  ASSERT_EQ("Over...", c1->getValue<string>());
+  ASSERT_EQ("Warning", c1->getName());
+
+  it++;
+  it++;
+  auto c3 = dynamic_pointer_cast<Condition>(*it);
+  ASSERT_TRUE(c3);
+  ASSERT_EQ(Condition::NORMAL, c3->getLevel());
+  ASSERT_FALSE(c3->hasProperty("nativeCode"));
+
+  auto s5 = m_circularBuffer->getFromBuffer(5);
+  ASSERT_TRUE(s5);
+  ASSERT_EQ(m_dataItem2, s5->getDataItem());
+  ASSERT_EQ(123.0, s5->getValue<double>());
+  ASSERT_EQ("ACTUAL", s5->get<string>("subType"));
+
+  // The filter is applied before the observations are materialized
+  FilterSet filter {"3"};
+  list = m_circularBuffer->getObservations(10, filter, nullopt, nullopt, end, first, eob);
+  ASSERT_EQ(2, list->size());
+  ASSERT_EQ(5, list->front()->getSequence());
+  ASSERT_EQ(6, list->back()->getSequence());
+}
+
+TEST_F(CircularBufferTest, should_use_less_memory_with_compact_observations)
+{
+  entity::ErrorList errors;
+  Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min;
+
+  // Fill a compact and an entity buffer with the same samples and compare the estimates of the
+  // memory held by their slots
+  CircularBuffer compact(4, 4, false, true);
+  CircularBuffer entities(4, 4, false, false);
+  for (int i = 0; i < 16; i++)
+  {
+    auto make = [&]() {
+      return observation::Observation::make(m_dataItem2, {{"VALUE", double(i)}},
+                                            time + chrono::microseconds(i), errors);
+    };
+    auto obs = make();
+    ASSERT_LT(CompactObservation(obs).getMemorySize(), memory::ObservationSize(*obs));
+
+    compact.addToBuffer(obs);
+    entities.addToBuffer(make());
+  }
+
+  ASSERT_EQ(16, compact.getCount());
+  ASSERT_EQ(16, entities.getCount());
+  ASSERT_LT(0u, compact.getMemoryUsed());
+  ASSERT_LT(compact.getMemoryUsed(), entities.getMemoryUsed());
+}
+
+TEST_F(CircularBufferTest, should_add_a_batch_with_contiguous_sequence_numbers)
+{
+  entity::ErrorList errors;
+  Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min;
+
+  ObservationList batch;
+  for (int i = 0; i < 3; i++)
+    batch.push_back(observation::Observation::make(m_dataItem2, {{"VALUE", double(i)}}, time,
+                                                   errors));
+
+  // An orphaned observation is removed from the batch
+  auto orphan = DataItem::make(
+      {{"id", "orphan"s}, {"type", "POSITION"s}, {"category", "SAMPLE"s}}, errors);
+  batch.insert(next(batch.begin()),
+               observation::Observation::make(orphan, {{"VALUE", 1.0}}, time, errors));
+  orphan.reset();
+
+  ASSERT_EQ(1, m_circularBuffer->addToBuffer(batch));
+  ASSERT_EQ(3, batch.size());
+  ASSERT_EQ(4, m_circularBuffer->getSequence());
+
+  SequenceNumber_t seq = 1;
+  for (auto &obs : batch)
+  {
+    ASSERT_EQ(seq, obs->getSequence());
+    ASSERT_EQ(obs, m_circularBuffer->getFromBuffer(seq));
+    seq++;
+  }
+
+  auto latest = m_circularBuffer->getLatest().getObservation("3");
+  ASSERT_TRUE(latest);
+  ASSERT_EQ(3, latest->getSequence());
+
+  ObservationList empty;
+  ASSERT_EQ(0, m_circularBuffer->addToBuffer(empty));
+  ASSERT_EQ(4, m_circularBuffer->getSequence());
+}
+
+TEST_F(CircularBufferTest, should_evict_oldest_observations_when_over_memory_limit)
+{
+  entity::ErrorList errors;
+  Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min;
+
+  auto sample = observation::Observation::make(m_dataItem2, {{"VALUE", 1.0}}, time, errors);
+  auto size = memory::ObservationSize(*sample);
+  m_circularBuffer->setMemoryLimit(size * 5);
+
+  for (int i = 0; i < 10; i++)
+  {
+    auto obs = observation::Observation::make(m_dataItem2, {{"VALUE", double(i)}}, time, errors);
+    m_circularBuffer->addToBuffer(obs);
+  }
+
+  ASSERT_EQ(11, m_circularBuffer->getSequence());
+  ASSERT_EQ(6, m_circularBuffer->getFirstSequence());
+  ASSERT_EQ(5, m_circularBuffer->getCount());
+  ASSERT_EQ(size * 5, m_circularBuffer->getMemoryUsed());
+  ASSERT_FALSE(m_circularBuffer->getFromBuffer(5));
+
+  auto first = m_circularBuffer->getFirst().getObservation("3");
+  ASSERT_TRUE(first);
+  ASSERT_EQ(6, first->getSequence());
+
+  // A large observation evicts everything before it, but is always kept
+  auto large = observation::Observation::make(
+      m_dataItem1, {{"level", "FAULT"s}, {"VALUE", string(size * 10, 'x')}}, time, errors);
+  m_circularBuffer->addToBuffer(large);
+
+  ASSERT_EQ(11, m_circularBuffer->getFirstSequence());
+  ASSERT_EQ(1, m_circularBuffer->getCount());
+  ASSERT_LT(size * 10, m_circularBuffer->getMemoryUsed());
+
+  auto obs = observation::Observation::make(m_dataItem2, {{"VALUE", 1.0}}, time, errors);
+  m_circularBuffer->addToBuffer(obs);
+  ASSERT_EQ(12, m_circularBuffer->getFirstSequence());
+  ASSERT_EQ(size, m_circularBuffer->getMemoryUsed());
+}
+
+TEST_F(CircularBufferTest, should_resize_and_rebuild_checkpoints)
+{
+  entity::ErrorList errors;
+  Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min;
+
+  auto add = [&](int count) {
+    for (int i = 0; i < count; i++)
+    {
+      auto seq = m_circularBuffer->getSequence();
+      auto value = entity::Properties {{"VALUE", double(seq)}};
+      auto obs = observation::Observation::make(m_dataItem2, value, time, errors);
+      m_circularBuffer->addToBuffer(obs);
+    }
+  };
+
+  add(20);
+  ASSERT_EQ(16, m_circularBuffer->getBufferSize());
+  ASSERT_EQ(5, m_circularBuffer->getFirstSequence());
+
+  // Grow the buffer and keep all the observations
+  m_circularBuffer->resize(6, 8);
+  ASSERT_EQ(64, m_circularBuffer->getBufferSize());
+  ASSERT_EQ(8, m_circularBuffer->getCheckpointCount());
+  ASSERT_EQ(5, m_circularBuffer->getFirstSequence());
+  ASSERT_EQ(21, m_circularBuffer->getSequence());
+  while (!m_circularBuffer->rebuildCheckpoints(3))
+    ;
+
+  add(40);
+  ASSERT_EQ(5, m_circularBuffer->getFirstSequence());
+
+  SequenceNumber_t first, end;
+  bool eob = false;
+  auto list =
+      m_circularBuffer->getObservations(100, nullopt, nullopt, nullopt, end, first, eob);
+  ASSERT_EQ(56, list->size());
+  SequenceNumber_t seq = 5;
+  for (auto &o : *list)
+    ASSERT_EQ(seq++, o->getSequence());
+
+  for (SequenceNumber_t at : {5, 8, 13, 16, 31, 59})
+  {
+    auto check = m_circularBuffer->getCheckpointAt(at, nullopt);
+    ASSERT_TRUE(check);
+    ASSERT_EQ(at, check->getObservation("3")->getSequence());
+  }
+
+  // Shrink the buffer and evict the oldest observations
+  m_circularBuffer->resize(3, 2);
+  ASSERT_EQ(8, m_circularBuffer->getBufferSize());
+  ASSERT_EQ(53, m_circularBuffer->getFirstSequence());
+  while (!m_circularBuffer->rebuildCheckpoints(1))
+    ;
+
+  list = m_circularBuffer->getObservations(100, nullopt, nullopt, nullopt, end, first, eob);
+  ASSERT_EQ(8, list->size());
+  ASSERT_EQ(53, list->front()->getSequence());
+  ASSERT_EQ(60, list->back()->getSequence());
+
+  add(3);
+  ASSERT_EQ(56, m_circularBuffer->getFirstSequence());
+  for (SequenceNumber_t at : {56, 57, 58, 62, 63})
+  {
+    auto check = m_circularBuffer->getCheckpointAt(at, nullopt);
+    ASSERT_TRUE(check);
+    ASSERT_EQ(at, check->getObservation("3")->getSequence());
+  }
+}
+
+TEST_F(CircularBufferTest, should_index_time_by_the_latest_timestamp_when_time_goes_backward)
+{
+  m_circularBuffer = make_unique<CircularBuffer>(8, 4);
+
+  ErrorList errors;
+  Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h;
+  auto add = [&](Timestamp ts) {
+    auto obs = Observation::make(m_dataItem2, {{"VALUE", 1.0}}, ts, errors);
+    return m_circularBuffer->addToBuffer(obs);
+  };
+
+  auto first = add(time);
+  auto second = add(time + 1s);
+  auto backward = add(time + 500ms);
+  auto third = add(time + 2s);
+
+  // The observation with the earlier timestamp does not remove the later bucket
+  ASSERT_EQ(first, *m_circularBuffer->getSequenceAt(time));
+  ASSERT_EQ(second, *m_circularBuffer->getSequenceAt(time + 1s));
+  ASSERT_EQ(second, *m_circularBuffer->getSequenceAt(time + 500ms));
+  ASSERT_EQ(third, *m_circularBuffer->getSequenceAt(time + 2s));
+  ASSERT_LT(second, backward);
+  ASSERT_FALSE(m_circularBuffer->getSequenceAt(time + 3s));
+}
@@ -234,3 +234,26 @@ TEST_F(DataItemTest, SampleRate)
 
   ASSERT_EQ(42000, d->get<double>("sampleRate"));
 }
+
+TEST_F(DataItemTest, should_assign_the_same_dense_index_to_the_same_id)
+{
+  Properties props {{"id", "1"s},
+                    {"name", "DataItemTest1"s},
+                    {"type", "POSITION"s},
+                    {"category", "SAMPLE"s},
+                    {"units", "MILLIMETER"s},
+                    {"nativeUnits", "MILLIMETER"s}};
+  ErrorList errors;
+  auto d = DataItem::make(props, errors);
+  EXPECT_EQ(0, errors.size());
+
+  ASSERT_EQ(m_dataItemA->getIndex(), d->getIndex());
+  ASSERT_NE(m_dataItemA->getIndex(), m_dataItemB->getIndex());
+  ASSERT_NE(m_dataItemB->getIndex(), m_dataItemC->getIndex());
+  ASSERT_EQ(m_dataItemC->getIndex(), *DataItemIndexes::Default().find("4"));
+
+  FilterSet filter {"1", "4"};
+  ASSERT_TRUE(filter.contains(d->getIndex()));
+  ASSERT_FALSE(filter.contains(m_dataItemB->getIndex()));
+  ASSERT_TRUE(filter.contains(m_dataItemC->getIndex()));
+}
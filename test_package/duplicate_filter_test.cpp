@@ -245,9 +245,12 @@ TEST_F(DuplicateFilterTest, test_condition_duplicates)
     ASSERT_TRUE(cond);
     ASSERT_EQ("YYY", cond->get<string>("nativeCode"));
     ASSERT_EQ(Condition::WARNING, cond->getLevel());
-    auto prev = cond->getPrev();
-    ASSERT_TRUE(prev);
-    ASSERT_FALSE(prev->getPrev());
+
+    ObservationList active;
+    contract->m_checkpoint.getObservations(active, FilterSet {"c1"});
+    ASSERT_EQ(2, active.size());
+    ASSERT_EQ(cond, active.front());
+    auto prev = dynamic_pointer_cast<Condition>(active.back());
     ASSERT_EQ("XXX", prev->get<string>("nativeCode"));
     ASSERT_EQ("100", prev->get<string>("nativeSeverity"));
   }
@@ -264,10 +267,11 @@ TEST_F(DuplicateFilterTest, test_condition_duplicates)
     ASSERT_EQ("101", cond->get<string>("nativeSeverity"));
     ASSERT_EQ("XXX", cond->get<string>("nativeCode"));
 
-    auto prev = cond->getPrev();
-    ASSERT_TRUE(prev);
-    ASSERT_EQ("YYY", prev->get<string>("nativeCode"));
-    ASSERT_FALSE(prev->getPrev());
+    ObservationList active;
+    contract->m_checkpoint.getObservations(active, FilterSet {"c1"});
+    ASSERT_EQ(2, active.size());
+    ASSERT_EQ(cond, active.front());
+    ASSERT_EQ("YYY", active.back()->get<string>("nativeCode"));
   }
 
   {
@@ -280,7 +284,10 @@ TEST_F(DuplicateFilterTest, test_condition_duplicates)
     auto cond = dynamic_pointer_cast<Condition>(obs);
     ASSERT_EQ("YYY", cond->get<string>("nativeCode"));
     ASSERT_TRUE(cond);
-    ASSERT_FALSE(cond->getPrev());
+
+    ObservationList active;
+    contract->m_checkpoint.getObservations(active, FilterSet {"c1"});
+    ASSERT_EQ(1, active.size());
   }
 
   {
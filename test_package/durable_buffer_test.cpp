@@ -0,0 +1,324 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+// Ensure that gtest is the first header otherwise Windows raises an error
+#include <gtest/gtest.h>
+// Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
+
+#include <filesystem>
+#include <fstream>
+
+#include "mtconnect/buffer/buffer_snapshot.hpp"
+#include "mtconnect/buffer/durable_buffer.hpp"
+#include "mtconnect/device_model/device.hpp"
+#include "mtconnect/observation/observation.hpp"
+
+using namespace std;
+using namespace mtconnect;
+using namespace mtconnect::buffer;
+using namespace mtconnect::observation;
+using namespace device_model;
+using namespace entity;
+using namespace data_item;
+using namespace std::literals;
+using namespace date::literals;
+
+namespace fs = std::filesystem;
+
+// main
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+class DurableBufferTest : public testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    ErrorList errors;
+    m_condition = DataItem::make(
+        {{"id", "c1"s}, {"type", "LOAD"s}, {"category", "CONDITION"s}, {"name", "load"s}},
+        errors);
+    m_sample = DataItem::make({{"id", "s1"s},
+                               {"type", "POSITION"s},
+                               {"category", "SAMPLE"s},
+                               {"subType", "ACTUAL"s},
+                               {"units", "MILLIMETER"s}},
+                              errors);
+    m_dataSet = DataItem::make({{"id", "v1"s},
+                                {"type", "VARIABLE"s},
+                                {"category", "EVENT"s},
+                                {"representation", "DATA_SET"s}},
+                               errors);
+
+    auto now = chrono::steady_clock::now().time_since_epoch().count();
+    m_directory = fs::temp_directory_path() / ("durable_buffer_test_" + to_string(now));
+    fs::remove_all(m_directory);
+  }
+
+  void TearDown() override { fs::remove_all(m_directory); }
+
+  ObservationPtr makeSample(SequenceNumber_t sequence, double value)
+  {
+    ErrorList errors;
+    auto obs = Observation::make(m_sample, {{"VALUE", value}}, m_time, errors);
+    obs->setSequence(sequence);
+    return obs;
+  }
+
+  ObservationRecord roundTrip(const ObservationPtr &obs)
+  {
+    string buffer;
+    DurableBuffer::encode(buffer, obs);
+
+    ObservationRecord record;
+    EXPECT_TRUE(DurableBuffer::decode(buffer.data(), buffer.size(), record));
+    return record;
+  }
+
+  DataItemPtr m_condition;
+  DataItemPtr m_sample;
+  DataItemPtr m_dataSet;
+  fs::path m_directory;
+  Timestamp m_time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min;
+};
+
+TEST_F(DurableBufferTest, should_encode_and_decode_a_sample)
+{
+  auto record = roundTrip(makeSample(10, 1.5));
+
+  ASSERT_EQ(10, record.m_sequence);
+  ASSERT_EQ(m_time, record.m_timestamp);
+  ASSERT_EQ("s1", record.m_dataItemId);
+  ASSERT_EQ(1, record.m_properties.size());
+  ASSERT_EQ(1.5, get<double>(record.m_properties["VALUE"]));
+}
+
+TEST_F(DurableBufferTest, should_encode_and_decode_a_condition)
+{
+  ErrorList errors;
+  auto obs = Observation::make(m_condition,
+                               {{"level", "WARNING"s},
+                                {"nativeCode", "CODE1"s},
+                                {"qualifier", "HIGH"s},
+                                {"VALUE", "Over..."s}},
+                               m_time, errors);
+  obs->setSequence(2);
+  auto record = roundTrip(obs);
+
+  ASSERT_EQ("c1", record.m_dataItemId);
+  ASSERT_EQ("WARNING", get<string>(record.m_properties["level"]));
+  ASSERT_EQ("CODE1", get<string>(record.m_properties["nativeCode"]));
+  ASSERT_EQ("HIGH", get<string>(record.m_properties["qualifier"]));
+  ASSERT_EQ("Over...", get<string>(record.m_properties["VALUE"]));
+
+  auto copy = Observation::make(m_condition, record.m_properties, record.m_timestamp, errors);
+  ASSERT_TRUE(errors.empty());
+  auto cond = dynamic_pointer_cast<Condition>(copy);
+  ASSERT_TRUE(cond);
+  ASSERT_EQ(Condition::WARNING, cond->getLevel());
+}
+
+TEST_F(DurableBufferTest, should_encode_and_decode_a_data_set)
+{
+  ErrorList errors;
+  DataSet set;
+  set.emplace("a", int64_t(1));
+  set.emplace("b", 2.5);
+  set.emplace("c", "text"s);
+  set.emplace("d", DataSetValue(), true);
+
+  auto obs = Observation::make(m_dataSet, {{"VALUE", set}}, m_time, errors);
+  obs->setSequence(3);
+  auto record = roundTrip(obs);
+
+  auto &value = get<DataSet>(record.m_properties["VALUE"]);
+  ASSERT_EQ(set, value);
+  ASSERT_TRUE(value.find(DataSetEntry("d"))->m_removed);
+}
+
+TEST_F(DurableBufferTest, should_recover_observations_and_instance_id)
+{
+  uint64_t instanceId;
+  {
+    DurableBuffer buffer(m_directory, 64 * 1024, 16);
+    instanceId = buffer.recover([](ObservationRecord &) { FAIL() << "Buffer should be empty"; });
+    for (SequenceNumber_t seq = 1; seq <= 10; seq++)
+      buffer.append(makeSample(seq, double(seq)));
+  }
+
+  DurableBuffer buffer(m_directory, 64 * 1024, 16);
+  vector<SequenceNumber_t> sequences;
+  auto recovered = buffer.recover([&](ObservationRecord &record) {
+    ASSERT_EQ(double(record.m_sequence), get<double>(record.m_properties["VALUE"]));
+    sequences.push_back(record.m_sequence);
+  });
+
+  ASSERT_EQ(instanceId, recovered);
+  ASSERT_EQ(10, sequences.size());
+  ASSERT_EQ(1, sequences.front());
+  ASSERT_EQ(10, sequences.back());
+
+  // New observations are appended after the recovered observations
+  buffer.append(makeSample(11, 11.0));
+  buffer.flush();
+
+  DurableBuffer again(m_directory, 64 * 1024, 16);
+  sequences.clear();
+  again.recover([&](ObservationRecord &record) { sequences.push_back(record.m_sequence); });
+  ASSERT_EQ(11, sequences.size());
+  ASSERT_EQ(11, sequences.back());
+}
+
+TEST_F(DurableBufferTest, should_keep_the_instance_id_when_the_last_segment_is_zeroed)
+{
+  // Segments are at least 1K beyond the header, this will hold about 20 records
+  uint64_t instanceId;
+  {
+    DurableBuffer buffer(m_directory, 0, 1024);
+    instanceId = buffer.recover([](ObservationRecord &) {});
+    for (SequenceNumber_t seq = 1; seq <= 30; seq++)
+      buffer.append(makeSample(seq, double(seq)));
+    ASSERT_EQ(2, buffer.getSegmentCount());
+  }
+
+  // A crash while the next segment was created leaves a segment with a zeroed header
+  auto torn = m_directory / "observations-00000000000000000031.seg";
+  {
+    ofstream out(torn, ios::binary | ios::trunc);
+    string zeros(2048, '\0');
+    out.write(zeros.data(), zeros.size());
+  }
+
+  vector<SequenceNumber_t> sequences;
+  {
+    DurableBuffer buffer(m_directory, 0, 1024);
+    auto recovered =
+        buffer.recover([&](ObservationRecord &record) { sequences.push_back(record.m_sequence); });
+
+    ASSERT_EQ(instanceId, recovered);
+    ASSERT_EQ(30, sequences.size());
+    ASSERT_EQ(30, sequences.back());
+    ASSERT_FALSE(fs::exists(torn));
+    ASSERT_EQ(2, buffer.getSegmentCount());
+
+    buffer.append(makeSample(31, 31.0));
+  }
+
+  DurableBuffer again(m_directory, 0, 1024);
+  sequences.clear();
+  ASSERT_EQ(instanceId, again.recover([&](ObservationRecord &record) {
+    sequences.push_back(record.m_sequence);
+  }));
+  ASSERT_EQ(31, sequences.size());
+  ASSERT_EQ(31, sequences.back());
+}
+
+TEST_F(DurableBufferTest, should_rotate_and_remove_old_segments)
+{
+  // Segments are at least 1K beyond the header, this will hold about 20 records
+  {
+    DurableBuffer buffer(m_directory, 0, 32);
+    buffer.recover([](ObservationRecord &) {});
+    for (SequenceNumber_t seq = 1; seq <= 500; seq++)
+      buffer.append(makeSample(seq, double(seq)));
+    ASSERT_LT(1, buffer.getSegmentCount());
+    ASSERT_GT(10, buffer.getSegmentCount());
+  }
+
+  DurableBuffer buffer(m_directory, 0, 32);
+  vector<SequenceNumber_t> sequences;
+  buffer.recover([&](ObservationRecord &record) { sequences.push_back(record.m_sequence); });
+
+  ASSERT_LE(32, sequences.size());
+  ASSERT_GT(500, sequences.size());
+  ASSERT_EQ(500, sequences.back());
+  for (size_t i = 1; i < sequences.size(); i++)
+    ASSERT_EQ(sequences[i - 1] + 1, sequences[i]);
+}
+
+TEST_F(DurableBufferTest, should_write_and_load_a_buffer_snapshot)
+{
+  ErrorList errors;
+  CircularBuffer buffer(4, 4);
+  auto fault = Observation::make(m_condition, {{"level", "FAULT"s}, {"nativeCode", "A"s}},
+                                 m_time, errors);
+  buffer.addToBuffer(fault);
+  for (int i = 0; i < 20; i++)
+  {
+    auto obs = Observation::make(m_sample, {{"VALUE", double(i)}}, m_time, errors);
+    buffer.addToBuffer(obs);
+  }
+  ASSERT_EQ(6, buffer.getFirstSequence());
+
+  fs::create_directories(m_directory);
+  auto file = m_directory / "snapshot.bin";
+  ASSERT_EQ(16, BufferSnapshot::write(file, buffer, 1234));
+
+  auto contents = BufferSnapshot::read(file);
+  ASSERT_TRUE(contents);
+  ASSERT_EQ(1234, contents->m_instanceId);
+  ASSERT_EQ(6, contents->m_firstSequence);
+  ASSERT_EQ(22, contents->m_sequence);
+  ASSERT_EQ(2, contents->m_first.size());
+  ASSERT_EQ(16, contents->m_observations.size());
+
+  // Load the snapshot into a new buffer
+  map<string, DataItemPtr> items {{"c1", m_condition}, {"s1", m_sample}};
+  auto make = [&](const ObservationRecord &record) {
+    auto obs = Observation::make(items[record.m_dataItemId], record.m_properties,
+                                 record.m_timestamp, errors);
+    obs->setSequence(record.m_sequence);
+    return obs;
+  };
+
+  ObservationList first;
+  for (auto &record : contents->m_first)
+    first.push_back(make(record));
+
+  CircularBuffer loaded(4, 4);
+  loaded.restore(contents->m_firstSequence, first);
+  for (auto &record : contents->m_observations)
+  {
+    auto obs = make(record);
+    loaded.addToBuffer(obs);
+  }
+
+  ASSERT_EQ(6, loaded.getFirstSequence());
+  ASSERT_EQ(22, loaded.getSequence());
+
+  auto check = loaded.getCheckpointAt(6, nullopt);
+  ASSERT_TRUE(check);
+  ASSERT_EQ(1, check->getObservation("c1")->getSequence());
+  ASSERT_EQ(6, check->getObservation("s1")->getSequence());
+  ASSERT_EQ(4.0, check->getObservation("s1")->getValue<double>());
+
+  ObservationList latest;
+  SequenceNumber_t firstSeq;
+  ASSERT_EQ(22, loaded.getLatestObservations(latest, nullopt, firstSeq));
+  ASSERT_EQ(2, latest.size());
+
+  // A corrupt snapshot is rejected
+  {
+    fstream out(file, ios::binary | ios::in | ios::out);
+    out.seekp(fs::file_size(file) - 4);
+    out.write("XXXX", 4);
+  }
+  ASSERT_FALSE(BufferSnapshot::read(file));
+}
@@ -24,6 +24,10 @@
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
 
 #include <cstdio>
 #include <fstream>
@@ -99,6 +103,8 @@ public:
     req.set(http::field::host, "localhost");
     req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
     req.set(http::field::content_type, contentType);
+    if (!m_acceptEncoding.empty())
+      req.set(http::field::accept_encoding, m_acceptEncoding);
     if (close)
       req.set(http::field::connection, "close");
     req.body() = body;
@@ -259,6 +265,7 @@ public:
   bool m_connected {false};
   int m_status;
   std::string m_result;
+  std::string m_acceptEncoding;
   asio::io_context& m_context;
   bool m_done {false};
   beast::tcp_stream m_stream;
@@ -648,6 +655,98 @@ TEST_F(RestServiceTest, streaming_response)
     ;
 }
 
+TEST_F(RestServiceTest, should_stream_over_a_websocket)
+{
+  namespace websocket = boost::beast::websocket;
+
+  auto probe = [&](SessionPtr session, RequestPtr request) -> bool {
+    ResponsePtr resp = make_unique<Response>(status::ok, "All Devices");
+    session->writeResponse(std::move(resp));
+    return true;
+  };
+
+  SessionPtr streamSession;
+  auto sample = [&](SessionPtr session, RequestPtr request) -> bool {
+    EXPECT_TRUE(request->m_parameters.count("interval") > 0);
+    streamSession = session;
+    session->beginStreaming("text/plain", []() {});
+    return true;
+  };
+
+  m_server->addRouting({boost::beast::http::verb::get, "/probe", probe});
+  m_server->addRouting({boost::beast::http::verb::get, "/sample?interval={integer}", sample});
+
+  start();
+
+  websocket::stream<beast::tcp_stream> ws(m_context);
+  vector<string> messages;
+  asio::spawn(m_context, [&](asio::yield_context yield) {
+    beast::error_code ec;
+    tcp::endpoint server(asio::ip::address_v4::from_string("127.0.0.1"),
+                         static_cast<unsigned short>(m_server->getPort()));
+    beast::get_lowest_layer(ws).async_connect(server, yield[ec]);
+    ASSERT_FALSE(ec) << ec.message();
+    ws.async_handshake("localhost", "/probe", yield[ec]);
+    ASSERT_FALSE(ec) << ec.message();
+
+    beast::flat_buffer buffer;
+    while (true)
+    {
+      ws.async_read(buffer, yield[ec]);
+      if (ec)
+        break;
+      messages.emplace_back(beast::buffers_to_string(buffer.data()));
+      buffer.consume(buffer.size());
+    }
+  });
+
+  auto send = [&](const string &message) {
+    asio::spawn(m_context, [&ws, message](asio::yield_context yield) {
+      beast::error_code ec;
+      ws.async_write(asio::buffer(message), yield[ec]);
+    });
+  };
+
+  // The target of the upgrade request is the first request
+  while (messages.size() < 1 && m_context.run_for(20ms) > 0)
+    ;
+  ASSERT_EQ(1, messages.size());
+  EXPECT_EQ("All Devices", messages[0]);
+
+  send("/sample?interval=100");
+  while (!streamSession && m_context.run_for(20ms) > 0)
+    ;
+  ASSERT_TRUE(streamSession);
+
+  bool written {false};
+  streamSession->writeChunk("Chunk Content #1", [&written]() { written = true; });
+  while ((!written || messages.size() < 2) && m_context.run_for(20ms) > 0)
+    ;
+  ASSERT_EQ(2, messages.size());
+  EXPECT_EQ("Chunk Content #1", messages[1]);
+
+  // A new request replaces the stream of the last request
+  auto oldSession = streamSession;
+  send("/sample?interval=200");
+  while (streamSession == oldSession && m_context.run_for(20ms) > 0)
+    ;
+  ASSERT_NE(oldSession, streamSession);
+
+  bool oldWritten {false};
+  written = false;
+  oldSession->writeChunk("Old Content", [&oldWritten]() { oldWritten = true; });
+  streamSession->writeChunk("Chunk Content #2", [&written]() { written = true; });
+  while ((!written || messages.size() < 3) && m_context.run_for(20ms) > 0)
+    ;
+  ASSERT_EQ(3, messages.size());
+  EXPECT_EQ("Chunk Content #2", messages[2]);
+  EXPECT_FALSE(oldWritten);
+
+  beast::get_lowest_layer(ws).close();
+  while (m_context.run_for(20ms) > 0)
+    ;
+}
+
 TEST_F(RestServiceTest, additional_header_fields)
 {
   m_server->setHttpHeaders({"Access-Control-Allow-Origin:*", "Origin:https://foo.example"});
@@ -677,6 +776,45 @@ TEST_F(RestServiceTest, additional_header_fields)
   ASSERT_EQ("https://foo.example", f2->second);
 }
 
+TEST_F(RestServiceTest, should_compress_responses_when_accepted)
+{
+  string body;
+  for (int i = 0; i < 200; i++)
+    body += "<Sample dataItemId=\"a\">" + to_string(i) + "</Sample>";
+
+  auto probe = [&](SessionPtr session, RequestPtr request) -> bool {
+    ResponsePtr resp = make_unique<Response>(status::ok, body);
+    session->writeResponse(std::move(resp));
+    return true;
+  };
+
+  m_server->addRouting({boost::beast::http::verb::get, "/probe", probe});
+
+  start();
+  startClient();
+
+  m_client->spawnRequest(http::verb::get, "/probe");
+  EXPECT_EQ(200, m_client->m_status);
+  EXPECT_EQ(m_client->m_fields.end(), m_client->m_fields.find("Content-Encoding"));
+  EXPECT_EQ(body, m_client->m_result);
+
+  m_client->m_acceptEncoding = "deflate, gzip";
+  m_client->spawnRequest(http::verb::get, "/probe");
+  EXPECT_EQ(200, m_client->m_status);
+  auto f = m_client->m_fields.find("Content-Encoding");
+  ASSERT_NE(m_client->m_fields.end(), f);
+  ASSERT_EQ("gzip", f->second);
+  ASSERT_GT(body.size(), m_client->m_result.size());
+
+  namespace io = boost::iostreams;
+  stringstream compressed(m_client->m_result), decompressed;
+  io::filtering_istream in;
+  in.push(io::gzip_decompressor());
+  in.push(compressed);
+  io::copy(in, decompressed);
+  EXPECT_EQ(body, decompressed.str());
+}
+
 const string CertFile(TEST_RESOURCE_DIR "/user.crt");
 const string KeyFile {TEST_RESOURCE_DIR "/user.key"};
 const string DhFile {TEST_RESOURCE_DIR "/dh2048.pem"};
@@ -121,3 +121,40 @@ TEST_F(PipelineDeliverTest, filter_upcase)
   auto obs2 = circ.getFromBuffer(seq + 1);
   ASSERT_EQ(101.0, obs2->getValue<double>());
 }
+
+TEST_F(PipelineDeliverTest, should_deliver_observations_from_a_line_as_a_batch)
+{
+  m_agentTestHelper->addAdapter();
+  auto &circ = m_agentTestHelper->getAgent()->getCircularBuffer();
+  auto seq = circ.getSequence();
+  m_agentTestHelper->m_adapter->processData(
+      "2021-01-22T12:33:45.123Z|Xpos|100.0|Xload|50|Sload|20");
+  ASSERT_EQ(seq + 3, circ.getSequence());
+
+  auto obs = circ.getFromBuffer(seq);
+  ASSERT_TRUE(obs);
+  ASSERT_EQ("Xpos", obs->getDataItem()->getName());
+  obs = circ.getFromBuffer(seq + 1);
+  ASSERT_TRUE(obs);
+  ASSERT_EQ("Xload", obs->getDataItem()->getName());
+  obs = circ.getFromBuffer(seq + 2);
+  ASSERT_TRUE(obs);
+  ASSERT_EQ("Sload", obs->getDataItem()->getName());
+  ASSERT_EQ(20.0, obs->getValue<double>());
+}
+
+TEST_F(PipelineDeliverTest, should_filter_duplicates_within_a_batch)
+{
+  ConfigOptions options {{configuration::FilterDuplicates, true}};
+  m_agentTestHelper->addAdapter(options);
+  auto &circ = m_agentTestHelper->getAgent()->getCircularBuffer();
+  auto seq = circ.getSequence();
+  m_agentTestHelper->m_adapter->processData(
+      "2021-01-22T12:33:45.123Z|Xpos|100.0|Xpos|100.0|Xpos|101.0");
+  ASSERT_EQ(seq + 2, circ.getSequence());
+
+  auto obs = circ.getFromBuffer(seq);
+  ASSERT_EQ(100.0, obs->getValue<double>());
+  obs = circ.getFromBuffer(seq + 1);
+  ASSERT_EQ(101.0, obs->getValue<double>());
+}
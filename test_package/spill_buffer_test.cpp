@@ -0,0 +1,229 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+
+// Ensure that gtest is the first header otherwise Windows raises an error
+#include <gtest/gtest.h>
+// Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
+
+#include <filesystem>
+
+#include "mtconnect/buffer/circular_buffer.hpp"
+#include "mtconnect/buffer/spill_buffer.hpp"
+#include "mtconnect/device_model/device.hpp"
+#include "mtconnect/observation/observation.hpp"
+
+using namespace std;
+using namespace mtconnect;
+using namespace mtconnect::buffer;
+using namespace mtconnect::observation;
+using namespace device_model;
+using namespace entity;
+using namespace data_item;
+using namespace std::literals;
+using namespace date::literals;
+
+namespace fs = std::filesystem;
+
+// main
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+class SpillBufferTest : public testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    ErrorList errors;
+    m_dataItem1 = DataItem::make({{"id", "x"s},
+                                  {"type", "POSITION"s},
+                                  {"category", "SAMPLE"s},
+                                  {"subType", "ACTUAL"s},
+                                  {"units", "MILLIMETER"s}},
+                                 errors);
+    m_dataItem2 = DataItem::make(
+        {{"id", "mode"s}, {"type", "CONTROLLER_MODE"s}, {"category", "EVENT"s}}, errors);
+
+    auto now = chrono::steady_clock::now().time_since_epoch().count();
+    m_directory = fs::temp_directory_path() / ("spill_buffer_test_" + to_string(now));
+
+    // 16 slots in the ring and 8 observations per segment
+    m_circularBuffer = make_unique<CircularBuffer>(4, 4);
+    m_circularBuffer->setSpillBuffer(make_unique<SpillBuffer>(m_directory, 0, 0s, 8));
+  }
+
+  void TearDown() override
+  {
+    m_circularBuffer.reset();
+    fs::remove_all(m_directory);
+  }
+
+  void addObservations(int count)
+  {
+    ErrorList errors;
+    Timestamp time = Timestamp(date::sys_days(2021_y / jan / 19_d)) + 10h + 1min;
+    for (int i = 0; i < count; i++)
+    {
+      // Every fifth observation is a mode change
+      ObservationPtr obs;
+      if (i % 5 == 4)
+        obs = Observation::make(m_dataItem2, {{"VALUE", "AUTOMATIC"s}}, time, errors);
+      else
+        obs = Observation::make(m_dataItem1, {{"VALUE", double(i)}}, time, errors);
+      m_circularBuffer->addToBuffer(obs);
+    }
+  }
+
+  std::unique_ptr<CircularBuffer> m_circularBuffer;
+  DataItemPtr m_dataItem1;
+  DataItemPtr m_dataItem2;
+  fs::path m_directory;
+};
+
+TEST_F(SpillBufferTest, should_spill_evicted_observations_to_segments)
+{
+  addObservations(100);
+
+  auto spill = m_circularBuffer->getSpillBuffer();
+  spill->flush();
+  ASSERT_EQ(85, m_circularBuffer->getFirstSequence());
+  ASSERT_EQ(1, spill->getFirstSequence());
+  ASSERT_EQ(1, m_circularBuffer->getEarliestSequence());
+
+  // 84 evicted observations, 80 in segments and 4 pending
+  ASSERT_EQ(10, spill->getSegmentCount());
+  ASSERT_LT(0, spill->getSize());
+}
+
+TEST_F(SpillBufferTest, should_read_from_spill_and_continue_into_the_ring)
+{
+  addObservations(100);
+
+  SequenceNumber_t end, first;
+  bool endOfBuffer;
+  auto list = m_circularBuffer->getObservations(30, nullopt, 70, nullopt, end, first, endOfBuffer);
+
+  ASSERT_EQ(30, list->size());
+  ASSERT_EQ(1, first);
+  ASSERT_EQ(100, end);
+  ASSERT_FALSE(endOfBuffer);
+
+  SequenceNumber_t seq = 70;
+  for (auto &obs : *list)
+    ASSERT_EQ(seq++, obs->getSequence());
+
+  // Read entirely from the spill buffer
+  list = m_circularBuffer->getObservations(10, nullopt, 3, nullopt, end, first, endOfBuffer);
+  ASSERT_EQ(10, list->size());
+  ASSERT_EQ(3, list->front()->getSequence());
+  ASSERT_EQ(12, list->back()->getSequence());
+  ASSERT_EQ(13, end);
+  ASSERT_FALSE(endOfBuffer);
+
+  auto x = dynamic_pointer_cast<Sample>(list->front());
+  ASSERT_TRUE(x);
+  ASSERT_EQ(m_dataItem1, x->getDataItem());
+  ASSERT_EQ(2.0, x->getValue<double>());
+}
+
+TEST_F(SpillBufferTest, should_filter_spilled_observations)
+{
+  addObservations(100);
+
+  FilterSet filter;
+  filter.insert(m_dataItem2->getId());
+
+  SequenceNumber_t end, first;
+  bool endOfBuffer;
+  auto list = m_circularBuffer->getObservations(100, filter, 1, nullopt, end, first, endOfBuffer);
+
+  ASSERT_EQ(20, list->size());
+  SequenceNumber_t seq = 5;
+  for (auto &obs : *list)
+  {
+    ASSERT_EQ(seq, obs->getSequence());
+    ASSERT_EQ("mode", obs->getDataItem()->getId());
+    seq += 5;
+  }
+}
+
+TEST_F(SpillBufferTest, should_read_backward_into_the_spill_buffer)
+{
+  addObservations(100);
+
+  SequenceNumber_t end, first;
+  bool endOfBuffer;
+  auto list = m_circularBuffer->getObservations(20, nullopt, 60, 90, end, first, endOfBuffer);
+
+  ASSERT_EQ(20, list->size());
+  set<SequenceNumber_t> sequences;
+  for (auto &obs : *list)
+    sequences.insert(obs->getSequence());
+  ASSERT_EQ(71, *sequences.begin());
+  ASSERT_EQ(90, *sequences.rbegin());
+
+  list = m_circularBuffer->getObservations(-30, nullopt, nullopt, nullopt, end, first, endOfBuffer);
+  ASSERT_EQ(30, list->size());
+  sequences.clear();
+  for (auto &obs : *list)
+    sequences.insert(obs->getSequence());
+  ASSERT_EQ(71, *sequences.begin());
+  ASSERT_EQ(100, *sequences.rbegin());
+}
+
+TEST_F(SpillBufferTest, should_remove_oldest_segments_when_over_size)
+{
+  m_circularBuffer->setSpillBuffer(make_unique<SpillBuffer>(m_directory, 1, 0s, 8));
+  addObservations(100);
+
+  // Every segment exceeds the size limit, only the pending observations remain
+  auto spill = m_circularBuffer->getSpillBuffer();
+  spill->flush();
+  ASSERT_EQ(0, spill->getSegmentCount());
+  ASSERT_EQ(81, spill->getFirstSequence());
+
+  SequenceNumber_t end, first;
+  bool endOfBuffer;
+  auto list = m_circularBuffer->getObservations(10, nullopt, 81, nullopt, end, first, endOfBuffer);
+  ASSERT_EQ(81, first);
+  ASSERT_EQ(81, list->front()->getSequence());
+}
+
+TEST_F(SpillBufferTest, should_read_segments_while_they_are_written_in_the_background)
+{
+  addObservations(100);
+
+  // The segments may still be queued for the background thread
+  SequenceNumber_t end, first;
+  bool endOfBuffer;
+  auto list = m_circularBuffer->getObservations(100, nullopt, 1, nullopt, end, first, endOfBuffer);
+  ASSERT_EQ(100, list->size());
+  SequenceNumber_t seq = 1;
+  for (auto &obs : *list)
+    ASSERT_EQ(seq++, obs->getSequence());
+
+  auto spill = m_circularBuffer->getSpillBuffer();
+  spill->flush();
+  ASSERT_EQ(10, spill->getSegmentCount());
+
+  list = m_circularBuffer->getObservations(100, nullopt, 1, nullopt, end, first, endOfBuffer);
+  ASSERT_EQ(100, list->size());
+  ASSERT_EQ(1, list->front()->getSequence());
+  ASSERT_EQ(100, list->back()->getSequence());
+}
@@ -0,0 +1,141 @@
+//
+// Copyright Copyright 2009-2022, AMT – The Association For Manufacturing Technology (“AMT”)
+// All rights reserved.
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//       http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+// Ensure that gtest is the first header otherwise Windows raises an error
+#include <gtest/gtest.h>
+// Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
+
+#include <chrono>
+#include <thread>
+
+#include "mtconnect/sink/rest_sink/timer_wheel.hpp"
+
+using namespace std;
+using namespace std::chrono_literals;
+using namespace mtconnect;
+using namespace mtconnect::sink::rest_sink;
+
+// main
+int main(int argc, char *argv[])
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+class TimerWheelTest : public testing::Test
+{
+public:
+  TimerWheelTest() : m_strand(m_context) {}
+
+protected:
+  void SetUp() override { m_wheel = make_shared<TimerWheel>(m_strand, 10ms, 8); }
+
+  void TearDown() override { m_wheel.reset(); }
+
+  boost::asio::io_context m_context;
+  boost::asio::io_context::strand m_strand;
+  shared_ptr<TimerWheel> m_wheel;
+};
+
+TEST_F(TimerWheelTest, should_call_handlers_in_order_of_expiration)
+{
+  vector<int> called;
+  m_wheel->schedule(50ms, [&](boost::system::error_code ec) {
+    EXPECT_FALSE(ec);
+    called.push_back(2);
+  });
+  m_wheel->schedule(20ms, [&](boost::system::error_code ec) {
+    EXPECT_FALSE(ec);
+    called.push_back(1);
+  });
+  // Longer than one turn of the wheel
+  m_wheel->schedule(150ms, [&](boost::system::error_code ec) {
+    EXPECT_FALSE(ec);
+    called.push_back(3);
+  });
+  ASSERT_EQ(3, m_wheel->size());
+
+  m_context.run_for(35ms);
+  ASSERT_EQ(vector<int>({1}), called);
+
+  m_context.run_for(50ms);
+  ASSERT_EQ(vector<int>({1, 2}), called);
+
+  m_context.run_for(100ms);
+  ASSERT_EQ(vector<int>({1, 2, 3}), called);
+  ASSERT_EQ(0, m_wheel->size());
+}
+
+TEST_F(TimerWheelTest, should_call_canceled_handlers_with_operation_aborted)
+{
+  boost::system::error_code result;
+  bool called {false};
+  auto id = m_wheel->schedule(1000ms, [&](boost::system::error_code ec) {
+    called = true;
+    result = ec;
+  });
+
+  m_context.run_for(20ms);
+  ASSERT_FALSE(called);
+
+  // Cancel from another thread like a change signaler
+  thread signaler([this, id]() { EXPECT_TRUE(m_wheel->cancel(id)); });
+  signaler.join();
+  ASSERT_FALSE(m_wheel->cancel(id));
+
+  m_context.run_for(20ms);
+  ASSERT_TRUE(called);
+  ASSERT_EQ(boost::asio::error::operation_aborted, result);
+  ASSERT_EQ(0, m_wheel->size());
+}
+
+TEST_F(TimerWheelTest, should_wake_a_change_observer_when_signaled)
+{
+  observation::ChangeSignaler signaler;
+  WheelChangeObserver observer(m_strand, m_wheel);
+  signaler.addObserver(&observer);
+
+  boost::system::error_code result;
+  bool called {false};
+  observer.wait(1000ms, [&](boost::system::error_code ec) {
+    called = true;
+    result = ec;
+  });
+  m_context.run_for(20ms);
+  ASSERT_FALSE(called);
+  ASSERT_EQ(1, m_wheel->size());
+
+  signaler.signalObservers(100);
+  m_context.run_for(20ms);
+  ASSERT_TRUE(called);
+  ASSERT_EQ(boost::asio::error::operation_aborted, result);
+  ASSERT_TRUE(observer.wasSignaled());
+  ASSERT_EQ(100, observer.getSequence());
+
+  // Times out after the heartbeat when nothing is signaled. The context ran out of work when the
+  // wheel became idle.
+  observer.reset();
+  called = false;
+  observer.wait(30ms, [&](boost::system::error_code ec) {
+    called = true;
+    result = ec;
+  });
+  m_context.restart();
+  m_context.run_for(60ms);
+  ASSERT_TRUE(called);
+  ASSERT_FALSE(result);
+  ASSERT_FALSE(observer.wasSignaled());
+}
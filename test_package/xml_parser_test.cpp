@@ -142,7 +142,7 @@ TEST_F(XmlParserTest, Condition)
 
 TEST_F(XmlParserTest, GetDataItems)
 {
-  std::set<string> filter;
+  FilterSet filter;
 
   m_xmlParser->getDataItems(filter, "//Linear");
   ASSERT_EQ(13, (int)filter.size());
@@ -175,7 +175,7 @@ TEST_F(XmlParserTest, GetDataItems)
 
 TEST_F(XmlParserTest, GetDataItemsExt)
 {
-  std::set<string> filter;
+  FilterSet filter;
 
   if (m_xmlParser)
   {
@@ -403,7 +403,7 @@ TEST_F(XmlParserTest, References)
   ASSERT_TRUE(r);
   ASSERT_TRUE(r->getComponent().lock()) << "Component was not resolved.";
 
-  std::set<string> filter;
+  FilterSet filter;
   m_xmlParser->getDataItems(filter, "//BarFeederInterface");
 
   ASSERT_EQ((size_t)5, filter.size());
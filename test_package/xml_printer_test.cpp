@@ -19,6 +19,8 @@
 #include <gtest/gtest.h>
 // Keep this comment to keep gtest.h above. (clang-format off/on is not working here!)
 
+#include <regex>
+
 #include "mtconnect/asset/asset.hpp"
 #include "mtconnect/buffer/checkpoint.hpp"
 #include "mtconnect/device_model/data_item/data_item.hpp"
@@ -242,6 +244,97 @@ TEST_F(XmlPrinterTest, PrintCurrent)
   ASSERT_XML_PATH_EQUAL(doc, "//m:ComponentStream[@name='power']/m:Events/m:PowerState", "ON");
 }
 
+TEST_F(XmlPrinterTest, should_print_the_same_document_from_cached_fragments)
+{
+  Checkpoint checkpoint;
+  auto xact = addEventToCheckpoint(checkpoint, "Xact", 10254804, "0"_value);
+  addEventToCheckpoint(checkpoint, "Yact", 10254797, "0.00199"_value);
+  addEventToCheckpoint(checkpoint, "block", 10254789, "x-0.132010 y-0.158143"_value);
+  addEventToCheckpoint(checkpoint, "execution", 10254795, "READY"_value);
+  addEventToCheckpoint(checkpoint, "power", 1, "ON"_value);
+
+  XmlPrinter printer;
+  printer.setSchemaVersion("1.2");
+
+  regex creationTime("creationTime=\"[^\"]*\"");
+  auto print = [&]() {
+    ObservationList list;
+    checkpoint.getObservations(list);
+    return regex_replace(printer.printSample(123, 131072, 10254805, 10123733, 10123800, list),
+                         creationTime, "");
+  };
+
+  auto expected = print();
+  ASSERT_FALSE(xact->getFragments().get(FragmentCache::XML, printer.getFragmentKey()));
+
+  printer.setCacheFragments(true);
+  ASSERT_EQ(expected, print());
+  auto fragment = xact->getFragments().get(FragmentCache::XML, printer.getFragmentKey());
+  ASSERT_TRUE(fragment);
+  ASSERT_EQ("<Position dataItemId=\"Xact\"", fragment->m_text.substr(0, 27));
+
+  ASSERT_EQ(expected, print());
+  ASSERT_EQ(fragment, xact->getFragments().get(FragmentCache::XML, printer.getFragmentKey()));
+}
+
+TEST_F(XmlPrinterTest, should_print_the_same_document_with_the_direct_writer)
+{
+  Checkpoint checkpoint;
+  addEventToCheckpoint(checkpoint, "Xact", 10254804, "0"_value);
+  addEventToCheckpoint(checkpoint, "Yact", 10254797, "0.00199"_value);
+  addEventToCheckpoint(checkpoint, "block", 10254789, "A duck > a foul & < \"cat\"\r\n\t'"_value);
+  addEventToCheckpoint(checkpoint, "execution", 10254795, "READY"_value);
+  addEventToCheckpoint(checkpoint, "power", 1, "ON"_value);
+  addEventToCheckpoint(
+      checkpoint, "Xts", 10254806,
+      Properties {{"sampleCount", int64_t(6)}, {"VALUE", "1.1 2.2 3.3 4.4 5.5 6.6"s}});
+  addEventToCheckpoint(checkpoint, "ctmp", 18,
+                       Properties {{{"level", "WARNING"s},
+                                    {"nativeCode", "\"O\tTEMP\"\n<\xC3\x9C" "ber>"s},
+                                    {"qualifier", "HIGH"s},
+                                    {"VALUE", "Spindle \xC3\x9C" "bertemperatur"s}}});
+  addEventToCheckpoint(checkpoint, "cmp", 18, Properties {{{"level", "NORMAL"s}}});
+
+  XmlPrinter printer;
+  printer.setSchemaVersion("1.2");
+  printer.setStreamStyle("/styles/streams.xsl");
+
+  // Data sets are written by libxml2
+  XmlParser parser;
+  auto devices = parser.parseFile(TEST_RESOURCE_DIR "/samples/data_set.xml", &printer);
+  entity::ErrorList errors;
+  auto dataSet = Observation::make(devices.front()->getDeviceDataItem("v1"),
+                                   Properties {{"VALUE", "a=1 b=2 c=3"s}},
+                                   chrono::system_clock::now(), errors);
+  ASSERT_TRUE(errors.empty());
+  dataSet->setSequence(10254807);
+
+  regex creationTime("creationTime=\"[^\"]*\"");
+  auto print = [&](bool pretty) {
+    ObservationList list;
+    checkpoint.getObservations(list);
+    list.push_back(dataSet);
+    return regex_replace(
+        printer.printSample(123, 131072, 10254808, 10123733, 10123800, list, pretty),
+        creationTime, "");
+  };
+
+  auto expected = print(false);
+  auto expectedPretty = print(true);
+
+  printer.setDirectWriter(true);
+  ASSERT_EQ(expected, print(false));
+  ASSERT_EQ(expectedPretty, print(true));
+
+  // Fragments are cached as they are written in the document
+  printer.setCacheFragments(true);
+  ASSERT_EQ(expected, print(false));
+  ASSERT_EQ(expected, print(false));
+
+  printer.setDirectWriter(false);
+  ASSERT_EQ(expected, print(false));
+}
+
 TEST_F(XmlPrinterTest, ChangeDevicesNamespace)
 {
   // Devices